@@ -35,6 +35,7 @@
 #define SHOW_APPVER                 1
 #define SHOW_BUILDID                0
 
+/* fallback if the disconnection is not indicated */
 #define DFU_ENTER_DELAY             0.1
 
 
@@ -54,6 +55,9 @@ typedef enum
     DFU_DISCONNECT
 } dfu_msg_id_t;
 
+/* connection index of the link that requested DFU mode, or -1 */
+static int dfu_enter_conidx = -1;
+
 typedef enum
 {
     /* Service DFU */
@@ -249,6 +253,32 @@ static void DFUS_Start(void)
     GATTM_AddAttributeDatabase(dfu_att_db, DFU_ATT_NB);
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : void DFUS_SetHandover(uint8_t conidx)
+ * ----------------------------------------------------------------------------
+ * Description   : Hands the peer address and the connection parameters over
+ *                 to the FOTA stack, which then reconnects with directed
+ *                 advertising instead of waiting for a new scan.
+ * Inputs        : - conidx     - connection index
+ * Outputs       : None
+ * Assumptions   : connection is still active
+ * ------------------------------------------------------------------------- */
+static void DFUS_SetHandover(uint8_t conidx)
+{
+    const struct gapc_connection_req_ind *info_p = GAPC_GetConnectionInfo(conidx);
+    Sys_Fota_handover_t *handover_p = SYS_FOTA_HANDOVER;
+
+    memset(handover_p, 0, sizeof(*handover_p));
+    memcpy(handover_p->peer_addr_a, info_p->peer_addr.addr,
+           sizeof(handover_p->peer_addr_a));
+    handover_p->peer_addr_type = info_p->peer_addr_type;
+    handover_p->con_interval   = info_p->con_interval;
+    handover_p->con_latency    = info_p->con_latency;
+    handover_p->sup_to         = info_p->sup_to;
+    handover_p->magic          = SYS_FOTA_HANDOVER_MAGIC;
+    handover_p->check          = Sys_Fota_HandoverCheck(handover_p);
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void Dfus_MsgHandler(ke_msg_id_t const msg_id,
  *                                      void const *param,
@@ -281,11 +311,22 @@ static void Dfus_MsgHandler(ke_msg_id_t const msg_id, void const *param,
         break;
         case DFU_DISCONNECT:
         {
+            dfu_enter_conidx = KE_IDX_GET(dest_id);
+            DFUS_SetHandover(dfu_enter_conidx);
             GAPC_DisconnectAll(CO_ERROR_REMOTE_USER_TERM_CON);
             ke_timer_set(DFU_ENTER_TIMEOUT, dest_id,
                          KE_TIME_IN_SEC(DFU_ENTER_DELAY));
         }
         break;
+        case GAPC_DISCONNECT_IND:
+        {
+            /* start DFU as soon as the peer has seen the disconnection */
+            if (KE_IDX_GET(src_id) == dfu_enter_conidx)
+            {
+                Sys_Fota_StartDfu(1);
+            }
+        }
+        break;
         case DFU_ENTER_TIMEOUT:
         {
             Sys_Fota_StartDfu(1);
@@ -307,4 +348,5 @@ void DFUS_Initialize(void)
     MsgHandler_Add(GAPM_CMP_EVT, Dfus_MsgHandler);
     MsgHandler_Add(DFU_ENTER_TIMEOUT, Dfus_MsgHandler);
     MsgHandler_Add(DFU_DISCONNECT, Dfus_MsgHandler);
+    MsgHandler_Add(GAPC_DISCONNECT_IND, Dfus_MsgHandler);
 }
@@ -41,11 +41,39 @@
 #define CFG_FOTA_SVC_UUID               SYS_FOTA_DFU_SVC_UUID
 #define CFG_FALLBACK_ADDR               { 225, 173, 212, 24, 126, 51 }
 #define CFG_MAX_ADVERTISING_TIME        60
+#define CFG_ADV_SCHEDULE                { {  10,   32 }, \
+                                          {  20,  160 }, \
+                                          {   0,  800 } } /* { duration [s], interval [0.625 ms] } */
+//#define CFG_ADV_RESTART_DIO             6 /* restarts the schedule on a falling edge */
+#define CFG_DFU_RESET_DELAY             0.5 /* reset delay after a transaction */
+#define CFG_DFU_DELTA                   /* delta image download support */
+#define CFG_DFU_MANIFEST_MAX_CHUNKS     184 /* chunks of a manifest image */
+#define CFG_DFU_SPARSE                  /* sparse image download support */
+#define CFG_DFU_STAT                    /* telemetry characteristic */
+#define CFG_DFU_STAT_PERIOD             1.0 /* telemetry period [s] */
+#define CFG_DFU_FLASH_SCHED             /* flash operations between connection events */
+#define CFG_DFU_FLASH_GUARD_US          500 /* guard time before a connection event */
+//#define CFG_DFU_READ_REGION             /* crash log upload for field diagnostics */
+//#define CFG_DFU_LOG_BASE                0x0017E000 /* crash log area of the application */
+//#define CFG_DFU_LOG_SIZE                0x2000
+#define CFG_DFU_RESP_SDU_SIZE           512 /* SDU size of streamed responses */
+#define CFG_DFU_SIG_ECDSA               /* ECDSA secp256r1 image signatures */
+//#define CFG_DFU_SIG_ED25519             /* Ed25519 image signatures */
+#define CFG_DFU_KEY_TABLE               /* precomputed public key table for ECDSA */
 
 #define CFG_HDLC_NB_LINKS               1
-#define CFG_HDLC_T200                   0.5
+#define CFG_HDLC_T200                   0.5 /* s, until the first round-trip time is measured */
+#define CFG_HDLC_T200_MIN               0.03 /* s, bounds of the adaptive T200 */
+#define CFG_HDLC_T200_MAX               4
 #define CFG_HDLC_SDU_MAX_SIZE           2048
+#define CFG_HDLC_TX_CREDITS             8 /* fragments queued in the BLE stack per link */
+#define CFG_HDLC_EXT_WINDOW_SIZE        32 /* window in modulo 128 mode (SABME), up to 64 */
+#define CFG_HDLC_SREJ_BUFFER_SIZE       2048 /* out-of-sequence I frames held for SREJ (window up to half the modulus, else REJ) */
 #define CFG_BLE_MAX_DATA_SIZE           240
+//#define CFG_BLE_LECB                    /* DFU data over an L2CAP LE credit based channel */
+#define CFG_BLE_LECB_PSM                0x0080
+#define CFG_BLE_LECB_MAX_DATA_SIZE      490 /* two K-frames at max. data length */
+#define CFG_BLE_LECB_CREDITS            16
 
 /*** BLE Stack ***/
 #define CFG_BLE
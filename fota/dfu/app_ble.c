@@ -17,10 +17,13 @@
 
 #include "config.h"
 
+#include <stddef.h>
 #include <rsl10.h>
 #include <rsl10_protocol.h>
 
 #include "app_ble.h"
+#include "app_stat.h"
+#include "app_sched.h"
 #include "app_conf.h"
 #include "app_trace.h"
 #include "ble_gap.h"
@@ -39,7 +42,10 @@
 
 #define DEFAULT_MAX_DATA_SIZE       20
 #define MAX_DATA_SIZE               240
-#define DATA_SIZE_OVERHEAD          7
+#define DATA_SIZE_OVERHEAD          7    /* L2CAP and ATT notification header */
+#define MTU_OVERHEAD                3    /* ATT notification header */
+#define DEFAULT_TX_OCTETS           (DATA_SIZE_OVERHEAD + DEFAULT_MAX_DATA_SIZE)
+#define DEFAULT_MTU                 (MTU_OVERHEAD + DEFAULT_MAX_DATA_SIZE)
 #if (CFG_BLE_MAX_DATA_SIZE < DEFAULT_MAX_DATA_SIZE || CFG_BLE_MAX_DATA_SIZE > MAX_DATA_SIZE)
     #error CFG_BLE_MAX_DATA_SIZE must be in the range 20...240
 #endif /* if (CFG_BLE_MAX_DATA_SIZE < DEFAULT_MAX_DATA_SIZE || CFG_BLE_MAX_DATA_SIZE > MAX_DATA_SIZE) */
@@ -48,8 +54,23 @@
 #define PREF_SLV_MAX_CON_INTERVAL   12
 #define PREF_SLV_LATENCY            0
 #define PREF_SLV_SUP_TIMEOUT        200
-#define PREF_GAPM_TX_OCT_MAX        (DATA_SIZE_OVERHEAD + DEFAULT_MAX_DATA_SIZE)
+#define PREF_GAPM_TX_OCT_MAX        251    /* max. LE data length */
 #define PREF_GAPM_TX_TIME_MAX       (14 * 8 + PREF_GAPM_TX_OCT_MAX * 8)
+#define PREF_GAPM_MTU_MAX           (PREF_GAPM_TX_OCT_MAX - DATA_SIZE_OVERHEAD + \
+                                     MTU_OVERHEAD)
+
+/* sequence number of telemetry notifications, their confirmation is not
+ * forwarded to HDLC */
+#define STAT_SEQ_NB                 0xFFFF
+
+#ifdef CFG_BLE_LECB
+#if (CFG_BLE_LECB_MAX_DATA_SIZE < MAX_DATA_SIZE)
+    #error CFG_BLE_LECB_MAX_DATA_SIZE must be at least 240
+#endif /* if (CFG_BLE_LECB_MAX_DATA_SIZE < MAX_DATA_SIZE) */
+#define LECB_SDU_OVERHEAD           2    /* SDU length field of the first K-frame */
+#define LECB_MPS                    GAPM_DEFAULT_MPS_MAX /* local MPS, the peer's K-frames are at most this long */
+#define LECB_NB_LINKS               1
+#endif    /* ifdef CFG_BLE_LECB */
 
 
 #define  CS_CHAR_TEXT_DESC(idx, text)   \
@@ -95,6 +116,14 @@ typedef enum
     DFU_BUILDID_VAL,
     DFU_BUILDID_NAME,
 
+#ifdef CFG_DFU_STAT
+    /* Telemetry Characteristic in Service DFU */
+    DFU_STAT_CHAR,
+    DFU_STAT_VAL,
+    DFU_STAT_CCC,
+    DFU_STAT_NAME,
+#endif    /* ifdef CFG_DFU_STAT */
+
     /* Max number of services and characteristics */
     DFU_ATT_NB
 } dfu_att_t;
@@ -136,8 +165,72 @@ struct gapm_start_advertise_cmd advertiseCmd =
     }
 };
 
+/* transport the DFU link was activated on, the first one wins */
+typedef enum
+{
+    DFU_TRANSPORT_NONE,
+    DFU_TRANSPORT_GATT,
+    DFU_TRANSPORT_LECB
+} dfu_transport_t;
+
+static dfu_transport_t dfu_transport;
 static uint16_t dfu_ccc_value;
 static uint16_t dfu_link_max_size;
+static uint16_t dfu_link_tx_octets;
+static uint16_t dfu_link_mtu;
+#ifdef CFG_DFU_STAT
+static uint16_t stat_ccc_value;
+#endif    /* ifdef CFG_DFU_STAT */
+#ifdef CFG_BLE_LECB
+static uint16_t lecb_cid;
+static uint16_t lecb_pending;      /* SDUs waiting for L2CC_CMP_EVT */
+static uint16_t lecb_last_seq_nb;  /* sequence number of the last SDU sent */
+#endif    /* ifdef CFG_BLE_LECB */
+
+/* advertising schedule, the interval is lowered stage by stage */
+typedef struct
+{
+    uint16_t duration;    /* [s], 0 = until the advertising timeout */
+    uint16_t interval;    /* [0.625 ms] */
+} adv_stage_t;
+
+static const adv_stage_t adv_schedule_a[] = CFG_ADV_SCHEDULE;
+
+#define ADV_NB_STAGES               (sizeof(adv_schedule_a) / sizeof(adv_schedule_a[0]))
+
+static uint_fast8_t adv_stage;
+static bool adv_restart;    /* advertising is cancelled to apply a new stage */
+#ifdef CFG_ADV_RESTART_DIO
+static volatile bool adv_restart_req;
+#endif    /* ifdef CFG_ADV_RESTART_DIO */
+
+/* peer handed over by the application, valid until the first directed
+ * advertising attempt ends */
+static Sys_Fota_handover_t handover;
+static bool handover_valid;
+
+/* ----------------------------------------------------------------------------
+ * Function      : LoadHandover(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Takes over the peer of the application which requested
+ *                 the DFU mode. The retained record is invalidated, so a
+ *                 later reset falls back to undirected advertising.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void LoadHandover(void)
+{
+    Sys_Fota_handover_t *handover_p = SYS_FOTA_HANDOVER;
+
+    handover_valid = (handover_p->magic == SYS_FOTA_HANDOVER_MAGIC &&
+                      handover_p->check == Sys_Fota_HandoverCheck(handover_p));
+    if (handover_valid)
+    {
+        handover = *handover_p;
+    }
+    handover_p->magic = 0;
+}
 
 /* ----------------------------------------------------------------------------
  * Function      : AdvScanSetup(void)
@@ -181,6 +274,43 @@ static void AdvScanSetup(void)
                     &advertiseCmd.info.host.scan_rsp_data_len);
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : AdvertiseCmd(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends the advertising command of the current stage
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void AdvertiseCmd(void)
+{
+    if (handover_valid)
+    {
+        /* reconnect the handed over peer with high duty cycle directed
+         * advertising, GAPM_CMP_EVT falls back to undirected advertising */
+        struct gapm_start_advertise_cmd directCmd =
+        {
+            .op =
+            {
+                .code = GAPM_ADV_DIRECT,
+                .addr_src = GAPM_STATIC_ADDR,
+            },
+            .channel_map = GAPM_DEFAULT_ADV_CHMAP
+        };
+
+        memcpy(directCmd.info.direct.addr.addr, handover.peer_addr_a,
+               sizeof(directCmd.info.direct.addr.addr));
+        directCmd.info.direct.addr_type = handover.peer_addr_type;
+        GAPM_StartAdvertiseCmd(&directCmd);
+    }
+    else
+    {
+        advertiseCmd.intv_min = adv_schedule_a[adv_stage].interval;
+        advertiseCmd.intv_max = adv_schedule_a[adv_stage].interval;
+        GAPM_StartAdvertiseCmd(&advertiseCmd);
+    }
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : StartAdvertising(ke_task_id_t id)
  * ----------------------------------------------------------------------------
@@ -191,10 +321,97 @@ static void AdvScanSetup(void)
  * ------------------------------------------------------------------------- */
 static void StartAdvertising(ke_task_id_t id)
 {
-    GAPM_StartAdvertiseCmd(&advertiseCmd);
+    AdvertiseCmd();
     Sys_Man_SetAppState(id, APP_BLE_ADVERTISING);
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : SetAdvStage(ke_task_id_t id, uint_fast8_t stage)
+ * ----------------------------------------------------------------------------
+ * Description   : Switches to an advertising stage. Ongoing undirected
+ *                 advertising is cancelled and restarted by GAPM_CMP_EVT
+ *                 with the new interval, directed advertising picks it up
+ *                 when it falls back to undirected advertising.
+ * Inputs        : id               - application task ID
+ *                 stage            - index in the schedule
+ * Outputs       : None
+ * Assumptions   : state APP_BLE_ADVERTISING
+ * ------------------------------------------------------------------------- */
+static void SetAdvStage(ke_task_id_t id, uint_fast8_t stage)
+{
+    if (stage != adv_stage)
+    {
+        adv_stage = stage;
+        if (!handover_valid && !adv_restart)
+        {
+            adv_restart = true;
+            GAPM_CancelCmd();
+        }
+    }
+
+    if (adv_schedule_a[adv_stage].duration != 0)
+    {
+        ke_timer_set(APP_BLE_ADV_TIMER, id,
+                     KE_TIME_IN_SEC(adv_schedule_a[adv_stage].duration));
+    }
+    else
+    {
+        ke_timer_clear(APP_BLE_ADV_TIMER, id);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : AdvTimerHandler(ke_msg_id_t msg_id, const void *param,
+ *                                 ke_task_id_t dest_id, ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Advances the advertising schedule to the next stage
+ * Inputs        : - msg_id     - always APP_BLE_ADV_TIMER
+ *                 - param      - always NULL
+ *                 - dest_id    - Destination task ID number
+ *                 - src_id     - Source task ID number
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void AdvTimerHandler(ke_msg_id_t msg_id, const void *param,
+                            ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    if (Sys_Man_GetAppState(dest_id) == APP_BLE_ADVERTISING &&
+        adv_stage + 1 < ADV_NB_STAGES)
+    {
+        SetAdvStage(dest_id, adv_stage + 1);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : AdvStateHandler(ke_msg_id_t msg_id, const void *param,
+ *                                 ke_task_id_t dest_id, ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Runs the advertising schedule while advertising
+ * Inputs        : - msg_id     - always SYS_MAN_STATE_CHANGE_IND
+ *                 - param      - always NULL
+ *                 - dest_id    - Destination task ID number
+ *                 - src_id     - Source task ID number
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void AdvStateHandler(ke_msg_id_t msg_id, const void *param,
+                            ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    if (Sys_Man_GetAppState(dest_id) == APP_BLE_ADVERTISING)
+    {
+        /* a fall back from directed advertising continues the schedule */
+        if (!ke_timer_active(APP_BLE_ADV_TIMER, dest_id))
+        {
+            SetAdvStage(dest_id, adv_stage);
+        }
+    }
+    else
+    {
+        ke_timer_clear(APP_BLE_ADV_TIMER, dest_id);
+        adv_stage = 0;
+    }
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : GapcParamUpdateCmd(uint_fast8_t conidx)
  * ----------------------------------------------------------------------------
@@ -205,8 +422,18 @@ static void StartAdvertising(ke_task_id_t id)
  * ------------------------------------------------------------------------- */
 static void GapcParamUpdateCmd(uint_fast8_t conidx)
 {
+    const struct gapc_connection_req_ind *info_p = GAPC_GetConnectionInfo(conidx);
     struct gapc_param_update_cmd *cmd;
 
+    /* skip the procedure if the central already uses suitable parameters,
+     * typically on reconnection of a handed over peer */
+    if (info_p->con_interval >= dev_slv_params.slv_params.con_intv_min &&
+        info_p->con_interval <= dev_slv_params.slv_params.con_intv_max &&
+        info_p->con_latency  == dev_slv_params.slv_params.slave_latency)
+    {
+        return;
+    }
+
     cmd = KE_MSG_ALLOC(GAPC_PARAM_UPDATE_CMD, KE_BUILD_ID(TASK_GAPC, conidx),
                        TASK_APP, gapc_param_update_cmd);
 
@@ -237,6 +464,85 @@ static void GapcParamUpdateCmd(uint_fast8_t conidx)
     ke_msg_send(cmd);
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : NegotiateLink(uint_fast8_t conidx)
+ * ----------------------------------------------------------------------------
+ * Description   : Requests max. LE data length, max. MTU and 2M PHY for a
+ *                 new link. The results are indicated by GAPC_LE_PKT_SIZE_IND
+ *                 and GATTC_MTU_CHANGED_IND.
+ * Inputs        : conidx       - Connection index
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void NegotiateLink(uint_fast8_t conidx)
+{
+    struct gapc_set_le_pkt_size_cmd *pkt_size_p;
+    struct gattc_exc_mtu_cmd *mtu_p;
+#ifdef CFG_BLE_2MBPS
+    struct gapc_set_phy_cmd *phy_p;
+#endif    /* ifdef CFG_BLE_2MBPS */
+
+    pkt_size_p = KE_MSG_ALLOC(GAPC_SET_LE_PKT_SIZE_CMD,
+                              KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
+                              gapc_set_le_pkt_size_cmd);
+    pkt_size_p->operation = GAPC_SET_LE_PKT_SIZE;
+    pkt_size_p->tx_octets = PREF_GAPM_TX_OCT_MAX;
+    pkt_size_p->tx_time   = PREF_GAPM_TX_TIME_MAX;
+    ke_msg_send(pkt_size_p);
+
+    mtu_p = KE_MSG_ALLOC(GATTC_EXC_MTU_CMD,
+                         KE_BUILD_ID(TASK_GATTC, conidx), TASK_APP,
+                         gattc_exc_mtu_cmd);
+    mtu_p->operation = GATTC_MTU_EXCH;
+    mtu_p->seq_num   = 0;
+    ke_msg_send(mtu_p);
+
+#ifdef CFG_BLE_2MBPS
+    phy_p = KE_MSG_ALLOC(GAPC_SET_PHY_CMD,
+                         KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
+                         gapc_set_phy_cmd);
+    phy_p->operation = GAPC_SET_PHY;
+    phy_p->tx_rates  = GAP_RATE_LE_2MBPS;
+    phy_p->rx_rates  = GAP_RATE_LE_2MBPS;
+    ke_msg_send(phy_p);
+#endif    /* ifdef CFG_BLE_2MBPS */
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : UpdateMaxDataSize(uint_fast8_t conidx)
+ * ----------------------------------------------------------------------------
+ * Description   : Derives the max. data size from the negotiated LE data
+ *                 length and MTU and signals it to an active link.
+ * Inputs        : conidx       - Connection index
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void UpdateMaxDataSize(uint_fast8_t conidx)
+{
+    uint_fast16_t max_size = CFG_BLE_MAX_DATA_SIZE;
+
+    /* a notification must fit into a single LL PDU and the MTU */
+    if (max_size > dfu_link_tx_octets - DATA_SIZE_OVERHEAD)
+    {
+        max_size = dfu_link_tx_octets - DATA_SIZE_OVERHEAD;
+    }
+    if (max_size > dfu_link_mtu - MTU_OVERHEAD)
+    {
+        max_size = dfu_link_mtu - MTU_OVERHEAD;
+    }
+
+    if (max_size > dfu_link_max_size && dfu_transport == DFU_TRANSPORT_GATT)
+    {
+        App_Ble_MaxSizeInd(conidx, max_size);
+    }
+    /* the size of an active link never shrinks, queued frames were
+     * built for it */
+    if (max_size > dfu_link_max_size || dfu_transport != DFU_TRANSPORT_GATT)
+    {
+        dfu_link_max_size = max_size;
+    }
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : GapcConnectionCfm(uint_fast8_t conidx)
  * ----------------------------------------------------------------------------
@@ -255,11 +561,16 @@ static void GapcConnectionCfm(uint_fast8_t conidx)
     };
 
     /* Init link state */
-    dfu_ccc_value     = ATT_CCC_STOP_NTFIND;
-    dfu_link_max_size = DEFAULT_MAX_DATA_SIZE;
+    dfu_transport      = DFU_TRANSPORT_NONE;
+    dfu_ccc_value      = ATT_CCC_STOP_NTFIND;
+    dfu_link_max_size  = DEFAULT_MAX_DATA_SIZE;
+    dfu_link_tx_octets = DEFAULT_TX_OCTETS;
+    dfu_link_mtu       = DEFAULT_MTU;
 
     GAPC_ConnectionCfm(conidx, &cfm);
+    App_Sched_IntervalInd(GAPC_GetConnectionInfo(conidx)->con_interval);
     Sys_Man_SetAppState(KE_BUILD_ID(TASK_APP, conidx), APP_BLE_CONNECTED);
+    NegotiateLink(conidx);
 }
 
 /* ----------------------------------------------------------------------------
@@ -284,9 +595,13 @@ static void GapmSetDevConfigCmd(void)
         .att_and_ext_cfg = GAPM_MASK_ATT_SLV_PREF_CON_PAR_EN,
         .sugg_max_tx_octets = PREF_GAPM_TX_OCT_MAX,
         .sugg_max_tx_time = PREF_GAPM_TX_TIME_MAX,
-        .max_mtu = GAPM_DEFAULT_MTU_MAX,
+        .max_mtu = PREF_GAPM_MTU_MAX,
         .max_mps = GAPM_DEFAULT_MPS_MAX,
+#ifdef CFG_BLE_LECB
+        .max_nb_lecb = LECB_NB_LINKS,
+#else
         .max_nb_lecb = GAPM_DEFAULT_MAX_NB_LECB,
+#endif    /* ifdef CFG_BLE_LECB */
         .audio_cfg = GAPM_DEFAULT_AUDIO_CFG,
         .tx_pref_rates = GAP_RATE_ANY,
         .rx_pref_rates = GAP_RATE_LE_2MBPS
@@ -310,6 +625,153 @@ static void GapmSetDevConfigCmd(void)
     GAPM_SetDevConfigCmd(&devConfig);
 }
 
+#ifdef CFG_BLE_LECB
+
+/* ----------------------------------------------------------------------------
+ * Function      : LepsmRegisterCmd(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Registers the DFU LE_PSM, so a peer can open an L2CAP LE
+ *                 credit based channel for the DFU data instead of using
+ *                 the GATT data characteristic.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void LepsmRegisterCmd(void)
+{
+    struct gapm_lepsm_register_cmd *cmd;
+
+    cmd = KE_MSG_ALLOC(GAPM_LEPSM_REGISTER_CMD, TASK_GAPM, TASK_APP,
+                       gapm_lepsm_register_cmd);
+    cmd->operation = GAPM_LEPSM_REG;
+    cmd->le_psm    = CFG_BLE_LECB_PSM;
+    cmd->app_task  = TASK_APP;
+    cmd->sec_lvl   = 0;
+    ke_msg_send(cmd);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : LecbConnectCfm(uint_fast8_t conidx,
+ *                                const struct gapc_lecb_connect_req_ind *p)
+ * ----------------------------------------------------------------------------
+ * Description   : Accepts a channel on the DFU LE_PSM if the DFU link is not
+ *                 active on GATT yet.
+ * Inputs        : conidx       - Connection index
+ *                 p            - connection request
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void LecbConnectCfm(uint_fast8_t conidx,
+                           const struct gapc_lecb_connect_req_ind *p)
+{
+    struct gapc_lecb_connect_cfm *cfm;
+
+    cfm = KE_MSG_ALLOC(GAPC_LECB_CONNECT_CFM,
+                       KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
+                       gapc_lecb_connect_cfm);
+    cfm->le_psm = p->le_psm;
+    if (p->le_psm == CFG_BLE_LECB_PSM && dfu_transport == DFU_TRANSPORT_NONE)
+    {
+        cfm->status = L2C_CB_CON_SUCCESS;
+    }
+    else
+    {
+        cfm->status = L2C_CB_CON_NO_RES_AVAIL;
+    }
+    ke_msg_send(cfm);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : LecbAddCmd(uint_fast8_t conidx, uint_fast16_t credit)
+ * ----------------------------------------------------------------------------
+ * Description   : Grants credits to the peer.
+ * Inputs        : conidx       - Connection index
+ *                 credit       - number of K-frames the peer may send
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void LecbAddCmd(uint_fast8_t conidx, uint_fast16_t credit)
+{
+    struct gapc_lecb_add_cmd *cmd;
+
+    cmd = KE_MSG_ALLOC(GAPC_LECB_ADD_CMD,
+                       KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
+                       gapc_lecb_add_cmd);
+    cmd->operation = GAPC_LE_CB_ADDITION;
+    cmd->le_psm    = CFG_BLE_LECB_PSM;
+    cmd->credit    = credit;
+    ke_msg_send(cmd);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : L2ccHandler(ke_msg_id_t msg_id, const void *param,
+ *                             ke_task_id_t dest_id, ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Handle L2CC messages of the DFU channel
+ * Inputs        : - msg_id     - Kernel message ID number
+ *                 - param      - Message parameter
+ *                 - dest_id    - Destination task ID number
+ *                 - src_id     - Source task ID number
+ * Outputs       : None
+ * Assumptions   : None
+ * ------------------------------------------------------------------------- */
+static void L2ccHandler(ke_msg_id_t msg_id, const void *param,
+                        ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+
+    if (dfu_transport != DFU_TRANSPORT_LECB)
+    {
+        return;
+    }
+
+    switch (msg_id)
+    {
+        case L2CC_LECNX_SDU_RECV_IND:
+        {
+            const struct l2cc_lecnx_sdu_recv_ind *p = param;
+
+            App_Sched_EventInd();
+            if (p->status == GAP_ERR_NO_ERROR && p->sdu.cid == lecb_cid)
+            {
+                App_Ble_DataInd(conidx, p->sdu.data, p->sdu.length);
+
+                /* return the credits of the consumed SDU, so the peer is
+                 * paced by the rate the HDLC layer processes the data. The
+                 * peer cuts the SDU to the local MPS, so this is the least
+                 * number of K-frames it took and never more than used */
+                LecbAddCmd(conidx, (p->sdu.length + LECB_SDU_OVERHEAD +
+                                    LECB_MPS - 1) / LECB_MPS);
+            }
+        }
+        break;
+
+        case L2CC_CMP_EVT:
+        {
+            const struct l2cc_cmp_evt *p = param;
+            App_Ble_status_t status;
+
+            /* SDUs complete in the order they were sent */
+            if (p->operation == L2CC_LECNX_SDU_SEND && lecb_pending != 0)
+            {
+                if (p->status == GAP_ERR_NO_ERROR)
+                {
+                    status = APP_BLE_SUCCESS;
+                }
+                else
+                {
+                    status = APP_BLE_FAILURE;
+                }
+                lecb_pending--;
+                App_Ble_DataCfm(conidx, lecb_last_seq_nb - lecb_pending, status);
+            }
+        }
+        break;
+    }
+}
+
+#endif    /* ifdef CFG_BLE_LECB */
+
 /* ----------------------------------------------------------------------------
  * Function      : uint8_t DfusCallback(uint8_t conidx, uint16_t attidx,
  *                                     uint16_t handle, uint8_t *toData,
@@ -331,8 +793,9 @@ static uint8_t DfusCallback(uint8_t conidx, uint16_t attidx, uint16_t handle,
         {
             case DFU_DATA_VAL:
             {
-            	// ͹̼д
-                if (dfu_ccc_value)
+            	// 发送固件传到这里进行处理
+                App_Sched_EventInd();
+                if (dfu_transport == DFU_TRANSPORT_GATT)
                 {
                     App_Ble_DataInd(conidx, fromData, lenData);
                 }
@@ -346,25 +809,45 @@ static uint8_t DfusCallback(uint8_t conidx, uint16_t attidx, uint16_t handle,
                 memcpy(&dfu_ccc_value, fromData, lenData);
                 dfu_ccc_value &= ATT_CCC_START_NTF;
 
-                /* on notification status change invoke link activation/deactivation */
+                /* on notification status change invoke link activation/deactivation,
+                 * unless the link is already active on the L2CAP channel */
                 if (prev_ccc_value ^ dfu_ccc_value)
                 {
-                    if (dfu_ccc_value)
+                    if (dfu_ccc_value && dfu_transport == DFU_TRANSPORT_NONE)
                     {
-                    	// Ӳ
+                    	// 更新连接参数
                         /* Update connection parameters on change of the DFU data CCC */
                         GapcParamUpdateCmd(conidx);
+                        dfu_transport = DFU_TRANSPORT_GATT;
                         App_Ble_ActivationInd(conidx, dfu_link_max_size);
                         Sys_Man_SetAppState(KE_BUILD_ID(TASK_APP, conidx), APP_BLE_LINKUP);
                     }
-                    else
+                    else if (!dfu_ccc_value && dfu_transport == DFU_TRANSPORT_GATT)
                     {
+                        dfu_transport = DFU_TRANSPORT_NONE;
                         App_Ble_DeactivationInd(conidx);
                         Sys_Man_SetAppState(KE_BUILD_ID(TASK_APP, conidx), APP_BLE_CONNECTED);
                     }
                 }
             }
             break;
+
+#ifdef CFG_DFU_STAT
+            case DFU_STAT_CCC:
+            {
+                memcpy(&stat_ccc_value, fromData, lenData);
+                stat_ccc_value &= ATT_CCC_START_NTF;
+                if (stat_ccc_value)
+                {
+                    App_Stat_ActivationInd(conidx);
+                }
+                else
+                {
+                    App_Stat_DeactivationInd(conidx);
+                }
+            }
+            break;
+#endif    /* ifdef CFG_DFU_STAT */
         }
     }
     else if (operation == GATTC_READ_REQ_IND)
@@ -377,6 +860,14 @@ static uint8_t DfusCallback(uint8_t conidx, uint16_t attidx, uint16_t handle,
             }
             break;
 
+#ifdef CFG_DFU_STAT
+            case DFU_STAT_CCC:
+            {
+                memcpy(toData, &stat_ccc_value, lenData);
+            }
+            break;
+#endif    /* ifdef CFG_DFU_STAT */
+
             case DFU_DEVID_VAL:
             {
                 memcpy(toData, App_Conf_GetDeviceID(), lenData);
@@ -474,7 +965,16 @@ static void DfusSetup(void)
         CS_CHAR_UUID_128(DFU_BUILDID_CHAR, DFU_BUILDID_VAL, SYS_FOTA_DFU_BUILDID_UUID,
                          PERM(RD, ENABLE),
                          sizeof(App_Conf_build_id_t), NULL, DfusCallback),
-        CS_CHAR_TEXT_DESC(DFU_BUILDID_NAME, "BLE Stack Build ID")
+        CS_CHAR_TEXT_DESC(DFU_BUILDID_NAME, "BLE Stack Build ID"),
+
+#ifdef CFG_DFU_STAT
+        /* Telemetry Characteristic in Service DFU */
+        CS_CHAR_UUID_128(DFU_STAT_CHAR, DFU_STAT_VAL, SYS_FOTA_DFU_STAT_UUID,
+                         PERM(NTF, ENABLE),
+                         APP_STAT_RECORD_SIZE, NULL, DfusCallback),
+        CS_CHAR_CCC(DFU_STAT_CCC, &stat_ccc_value, DfusCallback),
+        CS_CHAR_TEXT_DESC(DFU_STAT_NAME, "DFU Telemetry"),
+#endif    /* ifdef CFG_DFU_STAT */
     };
 
     GATTM_AddAttributeDatabase(dfu_scv_db, DFU_ATT_NB);
@@ -520,9 +1020,29 @@ static void GapmGattmHandler(ke_msg_id_t msg_id, const void *param,
             else if (p->operation == GAPM_SET_DEV_CONFIG &&
                      p->status    == GAP_ERR_NO_ERROR)
             {
+#ifdef CFG_BLE_LECB
+                LepsmRegisterCmd();
+#endif    /* ifdef CFG_BLE_LECB */
                 /* Add DFU Server */
                 DfusSetup();
             }
+            else if (p->operation == GAPM_ADV_DIRECT &&
+                     p->status    != GAP_ERR_NO_ERROR)
+            {
+                /* handed over peer did not reconnect -> advertise undirected */
+                handover_valid = false;
+                StartAdvertising(KE_BUILD_ID(TASK_APP, conidx));
+            }
+            else if (p->operation == GAPM_ADV_UNDIRECT && adv_restart)
+            {
+                /* cancelled for a new stage -> restart with its interval */
+                adv_restart = false;
+                if (p->status == GAP_ERR_CANCELED &&
+                    Sys_Man_GetAppState(KE_BUILD_ID(TASK_APP, conidx)) == APP_BLE_ADVERTISING)
+                {
+                    AdvertiseCmd();
+                }
+            }
             else if (p->operation == GAPM_RESOLV_ADDR &&    /* IRK not found for address */
                      p->status    == GAP_ERR_NOT_FOUND)
             {
@@ -575,6 +1095,10 @@ static void GapcGattcHandler(ke_msg_id_t msg_id, const void *param,
 
             /* Sending notification processing is completed. */
             if (p->operation == GATTC_NOTIFY)
+            {
+                App_Sched_EventInd();
+            }
+            if (p->operation == GATTC_NOTIFY && p->seq_num != STAT_SEQ_NB)
             {
                 if (p->status == ATT_ERR_NO_ERROR)
                 {
@@ -598,14 +1122,81 @@ static void GapcGattcHandler(ke_msg_id_t msg_id, const void *param,
         case GAPC_DISCONNECT_IND:
         {
             Sys_Man_SetAppState(KE_BUILD_ID(TASK_APP, conidx), APP_BLE_DISCONNECTED);
+            App_Sched_IntervalInd(0);
+#ifdef CFG_DFU_STAT
+            stat_ccc_value = 0;
+            App_Stat_DeactivationInd(conidx);
+#endif    /* ifdef CFG_DFU_STAT */
             //StartAdvertising(KE_BUILD_ID(TASK_APP, conidx));
         }
         break;
 
+#ifdef CFG_BLE_LECB
+        case GAPC_LECB_CONNECT_REQ_IND:
+        {
+            LecbConnectCfm(conidx, param);
+        }
+        break;
+
+        case GAPC_LECB_CONNECTED_IND:
+        {
+            const struct gapc_lecb_connected_ind *p = param;
+            uint_fast16_t max_size = CFG_BLE_LECB_MAX_DATA_SIZE;
+
+            if (p->le_psm == CFG_BLE_LECB_PSM && dfu_transport == DFU_TRANSPORT_NONE)
+            {
+                if (max_size > p->max_sdu)
+                {
+                    max_size = p->max_sdu;
+                }
+                dfu_transport = DFU_TRANSPORT_LECB;
+                lecb_cid      = p->dest_cid;
+                lecb_pending  = 0;
+                LecbAddCmd(conidx, CFG_BLE_LECB_CREDITS);
+                GapcParamUpdateCmd(conidx);
+                App_Ble_ActivationInd(conidx, max_size);
+                Sys_Man_SetAppState(KE_BUILD_ID(TASK_APP, conidx), APP_BLE_LINKUP);
+            }
+        }
+        break;
+
+        case GAPC_LECB_DISCONNECT_IND:
+        {
+            const struct gapc_lecb_disconnect_ind *p = param;
+
+            if (p->le_psm == CFG_BLE_LECB_PSM && dfu_transport == DFU_TRANSPORT_LECB)
+            {
+                dfu_transport = DFU_TRANSPORT_NONE;
+                App_Ble_DeactivationInd(conidx);
+                Sys_Man_SetAppState(KE_BUILD_ID(TASK_APP, conidx), APP_BLE_CONNECTED);
+            }
+        }
+        break;
+#endif    /* ifdef CFG_BLE_LECB */
+
+        case GAPC_PARAM_UPDATED_IND:
+        {
+            const struct gapc_param_updated_ind *p = param;
+
+            App_Sched_IntervalInd(p->con_interval);
+        }
+        break;
+
         case GAPC_LE_PKT_SIZE_IND:
         {
             const struct gapc_le_pkt_size_ind *p = param;
-            dfu_link_max_size = p->max_tx_octets - DATA_SIZE_OVERHEAD;
+
+            dfu_link_tx_octets = p->max_tx_octets;
+            UpdateMaxDataSize(conidx);
+        }
+        break;
+
+        case GATTC_MTU_CHANGED_IND:
+        {
+            const struct gattc_mtu_changed_ind *p = param;
+
+            dfu_link_mtu = p->mtu;
+            UpdateMaxDataSize(conidx);
         }
         break;
 
@@ -682,12 +1273,57 @@ void App_Ble_Init(void)
     /* Configure application-specific advertising data and scan response data.
      * The advertisement period will change after 30 s as per 5.1.1 */
     AdvScanSetup();
+    LoadHandover();
+
+#ifdef CFG_ADV_RESTART_DIO
+    /* restart the advertising schedule on a falling edge */
+    Sys_DIO_Config(CFG_ADV_RESTART_DIO,
+                   DIO_MODE_INPUT | DIO_WEAK_PULL_UP | DIO_LPF_ENABLE);
+    Sys_DIO_IntConfig(0, DIO_EVENT_FALLING_EDGE | DIO_SRC(CFG_ADV_RESTART_DIO) |
+                      DIO_DEBOUNCE_ENABLE, DIO_DEBOUNCE_SLOWCLK_DIV1024, 49);
+    NVIC_ClearPendingIRQ(DIO0_IRQn);
+    NVIC_EnableIRQ(DIO0_IRQn);
+#endif    /* ifdef CFG_ADV_RESTART_DIO */
 
     /* Add application message handlers */
     MsgHandler_Add(GATTC_CMP_EVT, GapcGattcHandler);
+    MsgHandler_Add(GATTC_MTU_CHANGED_IND, GapcGattcHandler);
     MsgHandler_Add(TASK_ID_GAPC, GapcGattcHandler);
     MsgHandler_Add(GATTM_ADD_SVC_RSP, GapmGattmHandler);
     MsgHandler_Add(TASK_ID_GAPM, GapmGattmHandler);
+    MsgHandler_Add(SYS_MAN_STATE_CHANGE_IND, AdvStateHandler);
+    MsgHandler_Add(APP_BLE_ADV_TIMER, AdvTimerHandler);
+#ifdef CFG_BLE_LECB
+    MsgHandler_Add(L2CC_LECNX_SDU_RECV_IND, L2ccHandler);
+    MsgHandler_Add(L2CC_CMP_EVT, L2ccHandler);
+#endif    /* ifdef CFG_BLE_LECB */
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_Poll(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Polls the module. A restart request from the DIO
+ *                 interrupt resets the advertising schedule to the first
+ *                 stage. The state change re-arms the advertising timeout.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Ble_Poll(void)
+{
+#ifdef CFG_ADV_RESTART_DIO
+    ke_task_id_t id = KE_BUILD_ID(TASK_APP, 0);
+
+    if (adv_restart_req)
+    {
+        adv_restart_req = false;
+        if (Sys_Man_GetAppState(id) == APP_BLE_ADVERTISING)
+        {
+            SetAdvStage(id, 0);
+            Sys_Man_SetAppState(id, APP_BLE_ADVERTISING);
+        }
+    }
+#endif    /* ifdef CFG_ADV_RESTART_DIO */
 }
 
 /* ----------------------------------------------------------------------------
@@ -707,30 +1343,159 @@ void App_Ble_StartAdvertising(ke_task_id_t id)
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : void App_Ble_DataReq(uint_fast8_t   link,
- *                                      uint_fast16_t  seq_nb,
- *                                      const uint8_t *data_p,
- *                                      uint_fast16_t  size)
+ * Function      : uint8_t *App_Ble_DataAlloc(uint_fast8_t  link,
+ *                                            uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Allocates the message of the next data request, so that
+ *                 the data is built in place
+ * Inputs        : link             - link ID
+ * Inputs        : size             - max. size of data
+ * Outputs       : return value     - pointer to data or NULL if the link is
+ *                                    down
+ * Assumptions   : link is active
+ * ------------------------------------------------------------------------- */
+uint8_t * App_Ble_DataAlloc(uint_fast8_t link, uint_fast16_t size)
+{
+    struct gattc_send_evt_cmd *evt;
+#ifdef CFG_BLE_LECB
+    struct l2cc_lecnx_sdu_send_cmd *cmd;
+#endif    /* ifdef CFG_BLE_LECB */
+    uint8_t *data_p = NULL;
+
+    switch (dfu_transport)
+    {
+        case DFU_TRANSPORT_GATT:
+        {
+            evt = KE_MSG_ALLOC_DYN(GATTC_SEND_EVT_CMD,
+                                   KE_BUILD_ID(TASK_GATTC, link), TASK_APP,
+                                   gattc_send_evt_cmd, size);
+            evt->operation = GATTC_NOTIFY;
+            evt->handle    = GATTM_GetHandle(DFU_DATA_VAL);
+            data_p = evt->value;
+        }
+        break;
+
+#ifdef CFG_BLE_LECB
+        case DFU_TRANSPORT_LECB:
+        {
+            cmd = KE_MSG_ALLOC_DYN(L2CC_LECNX_SDU_SEND_CMD,
+                                   KE_BUILD_ID(TASK_L2CC, link), TASK_APP,
+                                   l2cc_lecnx_sdu_send_cmd, size);
+            cmd->operation  = L2CC_LECNX_SDU_SEND;
+            cmd->offset     = 0;
+            cmd->sdu.cid    = lecb_cid;
+            cmd->sdu.credit = 0;
+            cmd->sdu.offset = 0;
+            data_p = cmd->sdu.data;
+        }
+        break;
+#endif    /* ifdef CFG_BLE_LECB */
+
+        default:
+        {
+            /* link down */
+        }
+        break;
+    }
+    return data_p;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_DataReq(uint_fast8_t  link,
+ *                                      uint_fast16_t seq_nb,
+ *                                      uint8_t      *data_p,
+ *                                      uint_fast16_t size)
  * ----------------------------------------------------------------------------
  * Description   : Requests sending data
  * Inputs        : link             - link ID
  * Inputs        : seq_nb           - sequence number
- * Inputs        : data_p           - pointer to data
- * Inputs        : size             - size of data
+ * Inputs        : data_p           - pointer to data of App_Ble_DataAlloc
+ * Inputs        : size             - size of data, at most the allocated
  * Outputs       : None
  * Assumptions   : link is active
  * ------------------------------------------------------------------------- */
 void App_Ble_DataReq(uint_fast8_t link, uint_fast16_t seq_nb,
-                     const uint8_t *data_p, uint_fast16_t size)
+                     uint8_t *data_p, uint_fast16_t size)
 {
-    if (dfu_ccc_value)
+    struct gattc_send_evt_cmd *evt;
+#ifdef CFG_BLE_LECB
+    struct l2cc_lecnx_sdu_send_cmd *cmd;
+#endif    /* ifdef CFG_BLE_LECB */
+
+    switch (dfu_transport)
     {
-        GATTC_SendEvtCmd(link, GATTC_NOTIFY, seq_nb,
-                         GATTM_GetHandle(DFU_DATA_VAL),
-                         size, data_p);
+        case DFU_TRANSPORT_GATT:
+        {
+            evt = (struct gattc_send_evt_cmd *)
+                  (data_p - offsetof(struct gattc_send_evt_cmd, value));
+            evt->seq_num = seq_nb;
+            evt->length  = size;
+            ke_msg_send(evt);
+        }
+        break;
+
+#ifdef CFG_BLE_LECB
+        case DFU_TRANSPORT_LECB:
+        {
+            /* the stack holds the SDU back until the peer grants credits */
+            cmd = (struct l2cc_lecnx_sdu_send_cmd *)
+                  (data_p - offsetof(struct l2cc_lecnx_sdu_send_cmd, sdu.data));
+            cmd->sdu.length = size;
+            ke_msg_send(cmd);
+            lecb_pending++;
+            lecb_last_seq_nb = seq_nb;
+        }
+        break;
+#endif    /* ifdef CFG_BLE_LECB */
+
+        default:
+        {
+            /* not reached, App_Ble_DataAlloc failed on a link down */
+        }
+        break;
     }
-    else
+}
+
+#ifdef CFG_DFU_STAT
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_StatReq(uint_fast8_t   link,
+ *                                      const uint8_t *data_p,
+ *                                      uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Notifies a telemetry record
+ * Inputs        : link             - link ID
+ * Inputs        : data_p           - pointer to record
+ * Inputs        : size             - size of record
+ * Outputs       : None
+ * Assumptions   : the record is dropped if notifications are disabled
+ * ------------------------------------------------------------------------- */
+void App_Ble_StatReq(uint_fast8_t link,
+                     const uint8_t *data_p, uint_fast16_t size)
+{
+    if (stat_ccc_value)
     {
-        App_Ble_DataCfm(link, seq_nb, APP_BLE_LINK_DOWN);
+        GATTC_SendEvtCmd(link, GATTC_NOTIFY, STAT_SEQ_NB,
+                         GATTM_GetHandle(DFU_STAT_VAL),
+                         size, data_p);
     }
 }
+
+#endif    /* ifdef CFG_DFU_STAT */
+
+#ifdef CFG_ADV_RESTART_DIO
+
+/* ----------------------------------------------------------------------------
+ * Function      : void DIO0_IRQHandler(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Requests a restart of the advertising schedule
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void DIO0_IRQHandler(void)
+{
+    adv_restart_req = true;
+}
+
+#endif    /* ifdef CFG_ADV_RESTART_DIO */
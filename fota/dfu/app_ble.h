@@ -33,6 +33,7 @@
     APP_BLE_DISCONNECTED,   \
 
 #define APP_BLE_MSGS        \
+    APP_BLE_ADV_TIMER,      \
 
 /* ----------------------------------------------------------------------------
  * Global variables and types
@@ -59,6 +60,16 @@ typedef enum
  * ------------------------------------------------------------------------- */
 void App_Ble_Init(void);
 
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_Poll(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Polls the module
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Ble_Poll(void);
+
 /* ----------------------------------------------------------------------------
  * Function      : void App_Ble_StartAdvertising(ke_task_id_t id)
  * ----------------------------------------------------------------------------
@@ -81,6 +92,19 @@ void App_Ble_StartAdvertising(ke_task_id_t id);
  * ------------------------------------------------------------------------- */
 void App_Ble_ActivationInd(uint_fast8_t link, uint_fast16_t max_size);
 
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_MaxSizeInd(uint_fast8_t  link,
+ *                                         uint_fast16_t max_size)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates a larger max. data size after the link
+ *                 parameters have been negotiated
+ * Inputs        : link             - link ID
+ * Inputs        : max_size         - max. data size for App_Ble_DataReq
+ * Outputs       : None
+ * Assumptions   : link is active
+ * ------------------------------------------------------------------------- */
+void App_Ble_MaxSizeInd(uint_fast8_t link, uint_fast16_t max_size);
+
 /* ----------------------------------------------------------------------------
  * Function      : void App_Ble_DeactivationInd(uint_fast8_t  link)
  * ----------------------------------------------------------------------------
@@ -92,28 +116,42 @@ void App_Ble_ActivationInd(uint_fast8_t link, uint_fast16_t max_size);
 void App_Ble_DeactivationInd(uint_fast8_t link);
 
 /* ----------------------------------------------------------------------------
- * Function      : void App_Ble_DataReq(uint_fast8_t   link,
- *                                      uint_fast16_t  seq_nb,
- *                                      const uint8_t *data_p,
- *                                      uint_fast16_t  size)
+ * Function      : uint8_t *App_Ble_DataAlloc(uint_fast8_t  link,
+ *                                            uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Allocates the message of the next data request, so that
+ *                 the data is built in place
+ * Inputs        : link             - link ID
+ * Inputs        : size             - max. size of data
+ * Outputs       : return value     - pointer to data or NULL if the link is
+ *                                    down
+ * Assumptions   : link is active
+ * ------------------------------------------------------------------------- */
+uint8_t * App_Ble_DataAlloc(uint_fast8_t link, uint_fast16_t size);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_DataReq(uint_fast8_t  link,
+ *                                      uint_fast16_t seq_nb,
+ *                                      uint8_t      *data_p,
+ *                                      uint_fast16_t size)
  * ----------------------------------------------------------------------------
  * Description   : Requests sending data
  * Inputs        : link             - link ID
  * Inputs        : seq_nb           - sequence number
- * Inputs        : data_p           - pointer to data
- * Inputs        : size             - size of data
+ * Inputs        : data_p           - pointer to data of App_Ble_DataAlloc
+ * Inputs        : size             - size of data, at most the allocated
  * Outputs       : None
  * Assumptions   : link is active
  * ------------------------------------------------------------------------- */
 void App_Ble_DataReq(uint_fast8_t link, uint_fast16_t seq_nb,
-                     const uint8_t *data_p, uint_fast16_t size);
+                     uint8_t *data_p, uint_fast16_t size);
 
 /* ----------------------------------------------------------------------------
  * Function      : void App_Ble_DataCfm(uint_fast8_t      link,
  *                                      uint_fast16_t     seq_nb,
  *                                      App_Hdlc_status_t status)
  * ----------------------------------------------------------------------------
- * Description   : Confirms processing App_Hdlc_DataReq
+ * Description   : Confirms processing App_Ble_DataReq
  * Inputs        : link             - link ID
  * Inputs        : seq_nb           - sequence number
  * Inputs        : status           - request status
@@ -138,4 +176,23 @@ void App_Ble_DataCfm(uint_fast8_t link, uint_fast16_t seq_nb,
 void App_Ble_DataInd(uint_fast8_t link,
                      const uint8_t *data_p, uint_fast16_t size);
 
+#ifdef CFG_DFU_STAT
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_StatReq(uint_fast8_t   link,
+ *                                      const uint8_t *data_p,
+ *                                      uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Notifies a telemetry record
+ * Inputs        : link             - link ID
+ * Inputs        : data_p           - pointer to record
+ * Inputs        : size             - size of record
+ * Outputs       : None
+ * Assumptions   : the record is dropped if notifications are disabled
+ * ------------------------------------------------------------------------- */
+void App_Ble_StatReq(uint_fast8_t link,
+                     const uint8_t *data_p, uint_fast16_t size);
+
+#endif    /* ifdef CFG_DFU_STAT */
+
 #endif    /* _APP_BLE_H */
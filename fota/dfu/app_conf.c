@@ -33,6 +33,10 @@ typedef struct
     App_Conf_key_t public_key;
     App_Conf_uuid_t uuid;
     App_Conf_dev_name_t dev_name;
+    uint32_t sig_scheme;
+#ifdef CFG_DFU_KEY_TABLE
+    App_Conf_key_table_t public_key_table;
+#endif    /* ifdef CFG_DFU_KEY_TABLE */
 } config_t;
 
 typedef struct
@@ -128,6 +132,36 @@ App_Conf_key_t * App_Conf_GetPublicKey(void)
     return &Sys_Boot_app_version.config.public_key;
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast8_t App_Conf_GetSignatureScheme(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the signature scheme of the public key
+ * Inputs        : None
+ * Outputs       : return value     - signature scheme (App_Sig_scheme_t)
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+uint_fast8_t App_Conf_GetSignatureScheme(void)
+{
+    return Sys_Boot_app_version.config.sig_scheme;
+}
+
+#ifdef CFG_DFU_KEY_TABLE
+
+/* ----------------------------------------------------------------------------
+ * Function      : App_Conf_key_table_t * App_Conf_GetPublicKeyTable(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the precomputed table of the public key
+ * Inputs        : None
+ * Outputs       : return value     - pointer to public key table
+ * Assumptions   : embedded by mkfotaimg.py together with the public key
+ * ------------------------------------------------------------------------- */
+App_Conf_key_table_t * App_Conf_GetPublicKeyTable(void)
+{
+    return &Sys_Boot_app_version.config.public_key_table;
+}
+
+#endif    /* ifdef CFG_DFU_KEY_TABLE */
+
 /* ----------------------------------------------------------------------------
  * Function      : App_Conf_uuid_t * App_Conf_GetServiceId(void)
  * ----------------------------------------------------------------------------
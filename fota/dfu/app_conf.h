@@ -37,6 +37,7 @@ typedef const Sys_Fota_uuid_t App_Conf_uuid_t;
 typedef const Sys_Boot_app_version_t App_Conf_version_t;
 typedef const uint8_t App_Conf_build_id_t[32];
 typedef const uint8_t App_Conf_key_t[64];
+typedef const uint8_t App_Conf_key_table_t[15 * 64];
 typedef const struct
 {
     uint16_t length;
@@ -88,6 +89,30 @@ App_Conf_build_id_t * App_Conf_GetBuildID(void);
  * ------------------------------------------------------------------------- */
 App_Conf_key_t * App_Conf_GetPublicKey(void);
 
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast8_t App_Conf_GetSignatureScheme(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the signature scheme of the public key
+ * Inputs        : None
+ * Outputs       : return value     - signature scheme (App_Sig_scheme_t)
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+uint_fast8_t App_Conf_GetSignatureScheme(void);
+
+#ifdef CFG_DFU_KEY_TABLE
+
+/* ----------------------------------------------------------------------------
+ * Function      : App_Conf_key_table_t * App_Conf_GetPublicKeyTable(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the precomputed table of the public key
+ * Inputs        : None
+ * Outputs       : return value     - pointer to public key table
+ * Assumptions   : embedded by mkfotaimg.py together with the public key
+ * ------------------------------------------------------------------------- */
+App_Conf_key_table_t * App_Conf_GetPublicKeyTable(void);
+
+#endif    /* ifdef CFG_DFU_KEY_TABLE */
+
 /* ----------------------------------------------------------------------------
  * Function      : App_Conf_uuid_t * App_Conf_GetServiceId(void)
  * ----------------------------------------------------------------------------
@@ -0,0 +1,211 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_delta.c
+ * - Streaming binary delta decoder. Rebuilds a new image from insert and
+ *   copy operations against a base image into the caller's output ring.
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "app_delta.h"
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define VARINT_MORE             0x80
+#define VARINT_MASK             0x7F
+#define VARINT_MAX_SHIFT        28
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool ReadVarint(App_Delta_state_t *delta_p, uint8_t c)
+ * ----------------------------------------------------------------------------
+ * Description   : Collects a varint byte.
+ * Inputs        : delta_p          - pointer to decoder state
+ *                 c                - received byte
+ * Outputs       : return value     - true  varint is complete
+ *                                  - false more bytes needed (or error)
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool ReadVarint(App_Delta_state_t *delta_p, uint8_t c)
+{
+    delta_p->value |= (uint32_t)(c & VARINT_MASK) << delta_p->shift;
+    if ((c & VARINT_MORE) == 0)
+    {
+        delta_p->shift = 0;
+        return true;
+    }
+    delta_p->shift += 7;
+    if (delta_p->shift > VARINT_MAX_SHIFT)
+    {
+        delta_p->step = APP_DELTA_ERROR;
+    }
+    return false;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Delta_Init(App_Delta_state_t   *delta_p,
+ *                                     void                *window_p,
+ *                                     uint_fast32_t        size,
+ *                                     App_Delta_base_fn_t *base_fn)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes a delta decoder instance.
+ * Inputs        : delta_p          - pointer to decoder state
+ *                 window_p         - output ring
+ *                 size             - size of the output ring
+ *                 base_fn          - base image accessor
+ * Outputs       : None
+ * Assumptions   : size is a power of 2
+ * ------------------------------------------------------------------------- */
+void App_Delta_Init(App_Delta_state_t *delta_p, void *window_p,
+                    uint_fast32_t size, App_Delta_base_fn_t *base_fn)
+{
+    delta_p->step        = APP_DELTA_HEADER;
+    delta_p->shift       = 0;
+    delta_p->value       = 0;
+    delta_p->length      = 0;
+    delta_p->window_p    = window_p;
+    delta_p->window_mask = size - 1;
+    delta_p->out_len     = 0;
+    delta_p->base_fn     = base_fn;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t App_Delta_Decode(App_Delta_state_t *delta_p,
+ *                                               const uint8_t     *data_p,
+ *                                               uint_fast16_t      size,
+ *                                               uint_fast32_t      out_limit)
+ * ----------------------------------------------------------------------------
+ * Description   : Applies a part of the delta stream to the output ring.
+ *                 Decoding stops when either the input is exhausted or
+ *                 delta_p->out_len has reached out_limit.
+ * Inputs        : delta_p          - pointer to decoder state
+ *                 data_p           - pointer to delta data
+ *                 size             - size of delta data
+ *                 out_limit        - output position to stop at
+ * Outputs       : return value     - number of consumed input bytes
+ * Assumptions   : out_limit does not overwrite unconsumed output
+ * ------------------------------------------------------------------------- */
+uint_fast16_t App_Delta_Decode(App_Delta_state_t *delta_p,
+                               const uint8_t *data_p, uint_fast16_t size,
+                               uint_fast32_t out_limit)
+{
+    uint8_t      *window_p = delta_p->window_p;
+    uint_fast32_t mask     = delta_p->window_mask;
+    uint_fast32_t out_len  = delta_p->out_len;
+    uint_fast16_t used     = 0;
+
+    while (out_len < out_limit)
+    {
+        if (delta_p->step == APP_DELTA_COPY)
+        {
+            /* copy from base image */
+            const uint8_t *src_p = delta_p->base_fn(delta_p->src);
+
+            if (src_p == NULL)
+            {
+                delta_p->step = APP_DELTA_ERROR;
+                break;
+            }
+            window_p[out_len & mask] = *src_p;
+            out_len++;
+            delta_p->src++;
+            if (--delta_p->length == 0)
+            {
+                delta_p->step = APP_DELTA_HEADER;
+            }
+            continue;
+        }
+
+        if (used >= size || delta_p->step == APP_DELTA_ERROR)
+        {
+            break;
+        }
+
+        switch (delta_p->step)
+        {
+            case APP_DELTA_HEADER:
+            {
+                if (ReadVarint(delta_p, data_p[used++]))
+                {
+                    delta_p->length = delta_p->value >> 1;
+                    if (delta_p->length == 0)
+                    {
+                        delta_p->step = APP_DELTA_ERROR;
+                    }
+                    else if ((delta_p->value & 1) == APP_DELTA_OP_COPY)
+                    {
+                        delta_p->step = APP_DELTA_OFFSET;
+                    }
+                    else
+                    {
+                        delta_p->step = APP_DELTA_INSERT;
+                    }
+                    delta_p->value = 0;
+                }
+            }
+            break;
+
+            case APP_DELTA_OFFSET:
+            {
+                if (ReadVarint(delta_p, data_p[used++]))
+                {
+                    /* zigzag decoding */
+                    delta_p->src   = out_len + ((delta_p->value >> 1) ^
+                                                -(delta_p->value & 1));
+                    delta_p->value = 0;
+                    delta_p->step  = APP_DELTA_COPY;
+                }
+            }
+            break;
+
+            case APP_DELTA_INSERT:
+            {
+                window_p[out_len & mask] = data_p[used++];
+                out_len++;
+                if (--delta_p->length == 0)
+                {
+                    delta_p->step = APP_DELTA_HEADER;
+                }
+            }
+            break;
+
+            default:
+            {
+            }
+            break;
+        }
+    }
+
+    delta_p->out_len = out_len;
+    return used;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Delta_IsValid(const App_Delta_state_t *delta_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks that all copy operations referenced available
+ *                 base image data.
+ * Inputs        : delta_p          - pointer to decoder state
+ * Outputs       : return value     - true  stream is consistent so far
+ *                                  - false stream is corrupt
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Delta_IsValid(const App_Delta_state_t *delta_p)
+{
+    return (delta_p->step != APP_DELTA_ERROR);
+}
@@ -0,0 +1,126 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_delta.h
+ * - Interface to the streaming binary delta decoder.
+ * ------------------------------------------------------------------------- */
+
+#ifndef _APP_DELTA_H    /* avoids multiple inclusion */
+#define _APP_DELTA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+/* Stream format (must match mkfotaimg.py), all numbers are LEB128 varints:
+ *  - op header: (length << 1) | type
+ *  - type 0 (insert): length literal bytes follow
+ *  - type 1 (copy):   zigzag encoded offset delta follows, copies length
+ *                     bytes from base image offset (output offset + delta)
+ */
+#define APP_DELTA_OP_INSERT     0
+#define APP_DELTA_OP_COPY       1
+
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef enum
+{
+    APP_DELTA_HEADER,
+    APP_DELTA_OFFSET,
+    APP_DELTA_INSERT,
+    APP_DELTA_COPY,
+    APP_DELTA_ERROR
+} App_Delta_step_t;
+
+/* ----------------------------------------------------------------------------
+ * Function      : const uint8_t *App_Delta_base_fn_t(uint_fast32_t offset)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns a base image byte.
+ * Inputs        : offset           - offset in the base image
+ * Outputs       : return value     - pointer to the byte
+ *                                  - NULL if the byte is not available
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+typedef const uint8_t *App_Delta_base_fn_t(uint_fast32_t offset);
+
+typedef struct
+{
+    App_Delta_step_t     step;
+    uint8_t              shift;
+    uint32_t             value;
+    uint32_t             length;
+    uint32_t             src;
+    uint8_t             *window_p;
+    uint32_t             window_mask;
+    uint32_t             out_len;
+    App_Delta_base_fn_t *base_fn;
+} App_Delta_state_t;
+
+/* ----------------------------------------------------------------------------
+ * Function prototypes
+ * ------------------------------------------------------------------------- */
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Delta_Init(App_Delta_state_t   *delta_p,
+ *                                     void                *window_p,
+ *                                     uint_fast32_t        size,
+ *                                     App_Delta_base_fn_t *base_fn)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes a delta decoder instance.
+ * Inputs        : delta_p          - pointer to decoder state
+ *                 window_p         - output ring
+ *                 size             - size of the output ring
+ *                 base_fn          - base image accessor
+ * Outputs       : None
+ * Assumptions   : size is a power of 2
+ * ------------------------------------------------------------------------- */
+void App_Delta_Init(App_Delta_state_t *delta_p, void *window_p,
+                    uint_fast32_t size, App_Delta_base_fn_t *base_fn);
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t App_Delta_Decode(App_Delta_state_t *delta_p,
+ *                                               const uint8_t     *data_p,
+ *                                               uint_fast16_t      size,
+ *                                               uint_fast32_t      out_limit)
+ * ----------------------------------------------------------------------------
+ * Description   : Applies a part of the delta stream to the output ring.
+ *                 Decoding stops when either the input is exhausted or
+ *                 delta_p->out_len has reached out_limit.
+ * Inputs        : delta_p          - pointer to decoder state
+ *                 data_p           - pointer to delta data
+ *                 size             - size of delta data
+ *                 out_limit        - output position to stop at
+ * Outputs       : return value     - number of consumed input bytes
+ * Assumptions   : out_limit does not overwrite unconsumed output
+ * ------------------------------------------------------------------------- */
+uint_fast16_t App_Delta_Decode(App_Delta_state_t *delta_p,
+                               const uint8_t *data_p, uint_fast16_t size,
+                               uint_fast32_t out_limit);
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Delta_IsValid(const App_Delta_state_t *delta_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks that all copy operations referenced available
+ *                 base image data.
+ * Inputs        : delta_p          - pointer to decoder state
+ * Outputs       : return value     - true  stream is consistent so far
+ *                                  - false stream is corrupt
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Delta_IsValid(const App_Delta_state_t *delta_p);
+
+#endif    /* _APP_DELTA_H */
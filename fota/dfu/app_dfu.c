@@ -30,9 +30,13 @@
 #include "msg_handler.h"
 #include "drv_targ.h"
 #include "drv_flash.h"
+#include "app_lz.h"
+#include "app_delta.h"
+#include "app_stat.h"
+#include "app_sched.h"
+#include "app_sig.h"
 
 #include "sha256.h"
-#include "uECC.h"
 
 /* ----------------------------------------------------------------------------
  * Defines
@@ -45,15 +49,49 @@
     #error IMAGE_SECTOR_SIZE must be a multiple of 8
 #endif /* if (IMAGE_SECTOR_SIZE % 8 != 0) */
 
+#define CHUNK_HASH_SIZE             16
+#define MANIFEST_HEADER_SIZE        sizeof(uint32_t)
+#define MANIFEST_MAX_SIZE           (MANIFEST_HEADER_SIZE +                   \
+                                     CFG_DFU_MANIFEST_MAX_CHUNKS *            \
+                                     CHUNK_HASH_SIZE +                        \
+                                     sizeof(App_Conf_key_t))
+
+#define TRANSACTION_MAX_IMAGES      2
+
+#define SECTOR_HASH_SIZE            8
+#define SPARSE_HDR_SIZE             4
+#define SECTOR_HASH_MAX_SECTORS     (APP_MAX_SIZE / IMAGE_SECTOR_SIZE)
+
+#define READ_REGION_BODY_SIZE       (2 * sizeof(uint32_t))
+
+#if defined(CFG_DFU_READ_REGION) && \
+    !(defined(CFG_DFU_LOG_BASE) && defined(CFG_DFU_LOG_SIZE))
+    #error CFG_DFU_READ_REGION needs the crash log area CFG_DFU_LOG_BASE/SIZE
+#endif /* if defined(CFG_DFU_READ_REGION) && ... */
+
 /* ----------------------------------------------------------------------------
  * Local variables and types
  * --------------------------------------------------------------------------*/
 
 typedef enum
 {
-    IMAGE_DDOWNLOAD = 1,
+    IMAGE_DDOWNLOAD   = 1,
+    IMAGE_DDOWNLOAD_Z = 2,
+    IMAGE_DDOWNLOAD_D = 3,
+    IMAGE_MANIFEST    = 4,
+    IMAGE_SECTOR_HASH = 5,
+    IMAGE_DDOWNLOAD_S = 6,
+    IMAGE_TRANSACTION = 7,
+    IMAGE_READ_REGION = 8,
 } msg_code_t;
 
+typedef enum
+{
+    REGION_STACK      = 0,
+    REGION_APP        = 1,
+    REGION_LOG        = 4
+} region_t;
+
 typedef enum
 {
     MSG_WAIT,
@@ -75,7 +113,11 @@ typedef struct
     msg_state_t state;
     uint32_t rx_len;
     msg_header_t header;
+    uint16_t busy_size;     /* SDU which did not fit, 0 if receiver ready */
+    bool held;              /* message part or end waits for flash memory */
+    uint16_t held_len;      /* rest of the message part in held_a */
     uint32_t body_a[IMAGE_SECTOR_SIZE / sizeof(uint32_t)];
+    uint8_t held_a[CFG_HDLC_SDU_MAX_SIZE];
 } message_t;
 
 typedef struct
@@ -93,6 +135,11 @@ typedef enum
     IMAGE_DNL_BAD_FLASH         = 4,
     IMAGE_DNL_BAD_SIG           = 5,
     IMAGE_DNL_BAD_START         = 6,
+    IMAGE_DNL_BAD_FORMAT        = 7,
+    IMAGE_DNL_BAD_BASE          = 8,
+    IMAGE_DNL_BAD_HASH          = 9,
+    IMAGE_DNL_LINK_RESET        = 10,
+    IMAGE_DNL_DEFERRED          = 254,  /* internal, never sent */
     IMAGE_DNL_INTERNAL_FAILURE  = 255
 } image_dnl_resp_status_t;
 
@@ -103,14 +150,36 @@ typedef enum
     PROG_FAILURE
 } prog_state_t;
 
+typedef struct
+{
+    uint16_t hdr_len;
+    uint16_t sector;
+    uint32_t data_len;
+} sparse_state_t;
+
 typedef struct
 {
     prog_state_t state;
+    image_dnl_resp_status_t failure;
+    const uint8_t *chunk_hash_p;
+    uint32_t image_len;
+    uint32_t rx_len;
     uint32_t flash_start_adr;
     uint32_t erase_len;
     uint32_t prog_len;
     flash_quantum_t vector;
     SHA256_CTX hash;
+    uint32_t dscr_adr;
+    uint32_t base_adr;
+    uint32_t base_len;
+    uint32_t copy_adr;
+    uint32_t copy_end;
+    union
+    {
+        App_Lz_state_t lz;
+        App_Delta_state_t delta;
+        sparse_state_t sparse;
+    } codec;
 } image_dnl_t;
 
 typedef struct
@@ -122,8 +191,66 @@ typedef struct
     uint32_t image_dscr;
 } vector_table_t;
 
+typedef struct
+{
+    bool valid;
+    uint8_t data_a[MANIFEST_MAX_SIZE];
+} manifest_t;
+
+typedef struct
+{
+    uint32_t adr;
+    flash_quantum_t vector;
+} commit_t;
+
+typedef struct
+{
+    uint8_t nb_images;
+    uint8_t nb_started;
+    uint8_t nb_verified;
+    bool app_invalid;
+    uint32_t app_start;
+    const uint32_t *build_id_p;
+    commit_t commit_a[TRANSACTION_MAX_IMAGES];
+} transaction_t;
+
+typedef struct
+{
+    msg_header_t resp;
+    uint32_t adr;
+    uint16_t nb_sectors;
+    uint16_t hash_cnt;
+    uint16_t resp_len;
+    uint16_t tx_len;
+    uint8_t hash_a[SECTOR_HASH_MAX_SECTORS * SECTOR_HASH_SIZE];
+} sector_hash_t;
+
+typedef struct
+{
+    msg_header_t resp;
+    uint32_t adr;
+    uint32_t resp_len;
+    uint32_t tx_len;
+    uint8_t body_a[READ_REGION_BODY_SIZE];
+} region_read_t;
+
 static message_t current_msg;
 static image_dnl_t image_download;
+static manifest_t manifest;
+static transaction_t transaction;
+
+#ifdef CFG_DFU_SPARSE
+static sector_hash_t sector_hash;
+#endif    /* ifdef CFG_DFU_SPARSE */
+
+#ifdef CFG_DFU_READ_REGION
+static region_read_t region_read;
+#endif    /* ifdef CFG_DFU_READ_REGION */
+
+#ifdef CFG_DFU_DELTA
+/* content of the last erased sector while patching in place */
+static uint32_t base_sector_a[FLASH_SECTOR_SIZE / sizeof(uint32_t)];
+#endif    /* ifdef CFG_DFU_DELTA */
 
 /* ----------------------------------------------------------------------------
  * Function      : int memtst(const void *mem_p, int c, size_t size)
@@ -218,7 +345,7 @@ static bool CheckDevID(const uint8_t *id_p)
  * Function      : bool CheckBuildID(const uint32_t id_a[])
  * ----------------------------------------------------------------------------
  * Description   : Checks the image build ID against the installed
- *                 BLE stack build ID.
+ *                 BLE stack build ID or the one of a staged FOTA stack.
  * Inputs        : id_a             - image build ID
  * Outputs       : return value     - true  build ID match
  *                                  - false build ID differ
@@ -226,26 +353,230 @@ static bool CheckDevID(const uint8_t *id_p)
  * ------------------------------------------------------------------------- */
 static bool CheckBuildID(const uint32_t id_a[])
 {
-    return (memcmp(App_Conf_GetBuildID(), id_a,
-                   sizeof(App_Conf_build_id_t)) == 0);
+    const void *ref_p = App_Conf_GetBuildID();
+
+    /* an application behind a staged FOTA stack must match that stack */
+    if (transaction.build_id_p != NULL)
+    {
+        ref_p = transaction.build_id_p;
+    }
+    return (memcmp(ref_p, id_a, sizeof(App_Conf_build_id_t)) == 0);
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : bool ProgramImage(message_t *msg_p, image_dnl_t *dnl_p)
+ * Function      : bool VerifySignature(const uint8_t  hash_a[],
+ *                                      const uint8_t *sig_p)
  * ----------------------------------------------------------------------------
- * Description   : Programs image data to flash memory.
- * Inputs        : msg_p            - pointer to message structure
- *                 data_p           - pointer to message part
+ * Description   : Verifies a signature over a hash with the installed public
+ *                 key and its signature scheme. Without public key a plain
+ *                 hash in the signature field is checked.
+ * Inputs        : hash_a           - SHA-256 hash (little-endian)
+ *                 sig_p            - pointer to signature
+ * Outputs       : return value     - true  signature is ok
+ *                                  - false signature is wrong
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool VerifySignature(const uint8_t hash_a[], const uint8_t *sig_p)
+{
+    App_Conf_key_t *pub_key_p = App_Conf_GetPublicKey();
+
+    /* check if a public key is available */
+    if (memtst(pub_key_p, 0, sizeof(App_Conf_key_t)) != 0)
+    {
+        uint32_t start = App_Stat_Start();
+        bool     valid;
+
+        /* verify signature */
+        valid = App_Sig_Verify(App_Conf_GetSignatureScheme(), *pub_key_p,
+                               hash_a, sig_p);
+        App_Stat_Stop(APP_STAT_ECDSA, start);
+        return valid;
+    }
+    else if (memtst(sig_p + SHA256_BLOCK_SIZE, -1, SHA256_BLOCK_SIZE) == 0)
+    {
+        /* check hash */
+        return (memcmp(hash_a, sig_p, SHA256_BLOCK_SIZE) == 0);
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool CheckChunk(image_dnl_t *dnl_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Compares the hash of a completely programmed chunk with
+ *                 the manifest and restarts hashing for the next chunk.
+ * Inputs        : dnl_p            - pointer to download structure
+ * Outputs       : return value     - true  chunk is ok
+ *                                  - false chunk differs from manifest
+ * Assumptions   : dnl_p->chunk_hash_p points to the expected hash
+ * ------------------------------------------------------------------------- */
+static bool CheckChunk(image_dnl_t *dnl_p)
+{
+    uint8_t  hash_a[SHA256_BLOCK_SIZE];
+    uint32_t start = App_Stat_Start();
+
+    sha256_final(&dnl_p->hash, hash_a);
+    App_Stat_Stop(APP_STAT_SHA, start);
+    if (memcmp(hash_a, dnl_p->chunk_hash_p, CHUNK_HASH_SIZE) != 0)
+    {
+        return false;
+    }
+    dnl_p->chunk_hash_p += CHUNK_HASH_SIZE;
+    sha256_init(&dnl_p->hash);
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool HashImage(image_dnl_t *dnl_p,
+ *                                uint_fast32_t adr, uint_fast32_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds programmed image data to the image hash and checks
+ *                 the chunk hash at the chunk end.
+ * Inputs        : dnl_p            - pointer to download structure
+ *                 adr              - flash address of the data
+ *                 size             - data size
  * Outputs       : return value     - true  no error so far
+ *                                  - false chunk differs from manifest
+ * Assumptions   : data does not cross a chunk end
+ * ------------------------------------------------------------------------- */
+static bool HashImage(image_dnl_t *dnl_p,
+                      uint_fast32_t adr, uint_fast32_t size)
+{
+    /* update hash with read-back data excluding signature
+     * (chunk hashes cover the signature as well) */
+    uint_fast32_t len = dnl_p->image_len;
+
+    if (dnl_p->chunk_hash_p == NULL)
+    {
+        len -= sizeof(App_Conf_key_t);
+    }
+    if (len > dnl_p->prog_len)
+    {
+        uint32_t start = App_Stat_Start();
+
+        len -= dnl_p->prog_len;
+        if (len > size)
+        {
+            len = size;
+        }
+        sha256_update(&dnl_p->hash, (const uint8_t *)adr, len);
+        App_Stat_Stop(APP_STAT_SHA, start);
+    }
+    dnl_p->prog_len += size;
+
+    /* check chunk hash at the chunk end */
+    return (dnl_p->chunk_hash_p == NULL ||
+            (dnl_p->prog_len % IMAGE_SECTOR_SIZE != 0 &&
+             dnl_p->prog_len < dnl_p->image_len) ||
+            CheckChunk(dnl_p));
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool ProgramFlash(uint_fast32_t adr, const uint32_t data_a[])
+ * ----------------------------------------------------------------------------
+ * Description   : Programs a flash quantum of image data and accounts it in
+ *                 the scheduler and the telemetry.
+ * Inputs        : adr              - flash address
+ *                 data_a           - data to program
+ * Outputs       : return value     - true  success
+ *                                  - false flash memory error
+ * Assumptions   : flash is unlocked
+ * ------------------------------------------------------------------------- */
+static bool ProgramFlash(uint_fast32_t adr, const uint32_t data_a[])
+{
+    uint32_t start = App_Stat_Start();
+    uint32_t begin = App_Sched_Begin();
+    bool     ok    = Drv_Flash_Program(adr, data_a);
+
+    App_Sched_End(APP_SCHED_PROGRAM, begin);
+    App_Stat_Stop(APP_STAT_FLASH, start);
+    App_Stat_Count(APP_STAT_PROG_BYTES, ok ? sizeof(flash_quantum_t) : 0);
+    return ok;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool EraseFlash(uint_fast32_t adr)
+ * ----------------------------------------------------------------------------
+ * Description   : Erases a flash sector for image data and accounts it in
+ *                 the scheduler and the telemetry.
+ * Inputs        : adr              - flash sector address
+ * Outputs       : return value     - true  success
+ *                                  - false flash memory error
+ * Assumptions   : flash is unlocked
+ * ------------------------------------------------------------------------- */
+static bool EraseFlash(uint_fast32_t adr)
+{
+    uint32_t start = App_Stat_Start();
+    uint32_t begin = App_Sched_Begin();
+    bool     ok    = Drv_Flash_Erase(adr);
+
+    App_Sched_End(APP_SCHED_ERASE, begin);
+    App_Stat_Stop(APP_STAT_FLASH, start);
+    App_Stat_Count(APP_STAT_ERASED_SECTORS, ok);
+    return ok;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool InvalidateApp(const image_dnl_t *dnl_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Invalidates the installed application before a sector is
+ *                 erased. Within a transaction the installed application
+ *                 stays valid until the commit, unless the sector to erase
+ *                 holds part of it.
+ * Inputs        : dnl_p            - pointer to download structure,
+ *                                    NULL at the transaction commit
+ * Outputs       : return value     - true  ok
  *                                  - false flash memory error
+ * Assumptions   : Flash memory is unlocked
+ * ------------------------------------------------------------------------- */
+static bool InvalidateApp(const image_dnl_t *dnl_p)
+{
+    static const uint32_t invalid_mark_a[2] = { 0, 0 };
+    uint_fast32_t app_adr = GetAppStart();
+    uint_fast32_t size;
+
+    if (transaction.nb_images == 0)
+    {
+        /* invalidate app image with the first erase */
+        return (dnl_p->erase_len > 0 ||
+                Drv_Flash_Program(app_adr, invalid_mark_a));
+    }
+    if (transaction.app_invalid)
+    {
+        return true;
+    }
+    if (dnl_p != NULL)
+    {
+        size = Sys_Boot_GetImageSize(Sys_Boot_GetDscr(app_adr)) +
+               sizeof(App_Conf_key_t);
+        if (size <= APP_MAX_SIZE &&
+            dnl_p->flash_start_adr + dnl_p->erase_len >= app_adr + size)
+        {
+            /* sector is behind the installed application */
+            return true;
+        }
+    }
+    transaction.app_invalid = true;
+    return Drv_Flash_Program(app_adr, invalid_mark_a);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool ProgramImage(message_t *msg_p, image_dnl_t *dnl_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Programs image data to flash memory. A flash operation
+ *                 is deferred if it would collide with a connection event.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 dnl_p            - pointer to download structure
+ * Outputs       : return value     - true  no error so far, more to do
+ *                                  - false flash memory error or nothing
+ *                                          to do
  * Assumptions   :
  * ------------------------------------------------------------------------- */
 static bool ProgramImage(message_t *msg_p, image_dnl_t *dnl_p)
 {
-    static const uint32_t invalid_mark_a[2] = { 0, 0 };
-    // ж״̬ǷڽУ״̬ǽʱı
+    // 判断状态是否正在进行，这个状态是接受完数据时改变的
     if (dnl_p->state   == PROG_ONGOING &&
-        dnl_p->prog_len < msg_p->rx_len)
+        dnl_p->prog_len < dnl_p->rx_len)
     {
         if (dnl_p->prog_len < dnl_p->erase_len)
         {
@@ -254,48 +585,79 @@ static bool ProgramImage(message_t *msg_p, image_dnl_t *dnl_p)
             uint8_t      *data_p = (uint8_t *)msg_p->body_a +
                                    dnl_p->prog_len % sizeof(msg_p->body_a);
 
+            if (dnl_p->prog_len < dnl_p->copy_end)
+            {
+                /* sector is missing in the sparse image
+                 * -> copy it from the installed image */
+                data_p = (uint8_t *)(uintptr_t)(dnl_p->copy_adr +
+                                                dnl_p->prog_len);
+            }
             /* check if at least two words are available to program */
-            if (msg_p->rx_len - dnl_p->prog_len < sizeof(flash_quantum_t))
+            else if (dnl_p->rx_len - dnl_p->prog_len < sizeof(flash_quantum_t))
             {
-                /* wait for more data except we reached the end of the message */
-                if (msg_p->rx_len < msg_p->header.body_len)
+                /* wait for more data except we reached the end of the image */
+                if (dnl_p->rx_len < dnl_p->image_len)
                 {
                     return true;
                 }
-                len = msg_p->header.body_len - dnl_p->prog_len;
+                len = dnl_p->image_len - dnl_p->prog_len;
 
                 /* fill up to a flash prog quantum */
                 memset(data_p + len, -1, sizeof(flash_quantum_t) - len);
             }
-            // д뵽flash
+            if (!App_Sched_Allow(APP_SCHED_PROGRAM))
+            {
+                /* retry once the gap after the connection event opens,
+                 * which raises no interrupt */
+                return true;
+            }
+            // 将数据写入到flash中
             /* program flash */
-            if (Drv_Flash_Program(adr, (uint32_t *)data_p))
+            if (ProgramFlash(adr, (uint32_t *)data_p))
             {
-                /* update hash with read-back data excluding signature */
-                len = msg_p->header.body_len - sizeof(App_Conf_key_t);
-                if (len > dnl_p->prog_len)
+                if (HashImage(dnl_p, adr, sizeof(flash_quantum_t)))
                 {
-                    len -= dnl_p->prog_len;
-                    if (len > sizeof(flash_quantum_t))
-                    {
-                        len = sizeof(flash_quantum_t);
-                    }
-                    sha256_update(&dnl_p->hash,
-                                  (const uint8_t *)adr,
-                                  len);
+                    return true;
                 }
-                dnl_p->prog_len += sizeof(flash_quantum_t);
+                dnl_p->failure = IMAGE_DNL_BAD_HASH;
+            }
+        }
+        else if (dnl_p->prog_len < dnl_p->copy_end &&
+                 dnl_p->copy_adr == dnl_p->flash_start_adr)
+        {
+            /* sector is missing in the sparse image and the image is
+             * installed in place -> keep the sector, just hash it */
+            if (HashImage(dnl_p, dnl_p->flash_start_adr + dnl_p->prog_len,
+                          IMAGE_SECTOR_SIZE))
+            {
+                dnl_p->erase_len += FLASH_SECTOR_SIZE;
                 return true;
             }
+            dnl_p->failure = IMAGE_DNL_BAD_HASH;
+        }
+        else if (!App_Sched_Allow(APP_SCHED_ERASE))
+        {
+            /* retry once the gap opens, see above */
+            return true;
         }
         else
         {
+#ifdef CFG_DFU_DELTA
+            /* keep the base image sector for delta copy operations */
+            if (dnl_p->base_len > 0)
+            {
+                memcpy(base_sector_a,
+                       (const void *)(uintptr_t)(dnl_p->flash_start_adr +
+                                                 dnl_p->erase_len),
+                       sizeof(base_sector_a));
+            }
+#endif    /* ifdef CFG_DFU_DELTA */
+
             /* invalidate app image */
-            if (dnl_p->erase_len > 0 ||
-                Drv_Flash_Program(GetAppStart(), invalid_mark_a))
+            if (InvalidateApp(dnl_p))
             {
                 /* erase flash */
-                if (Drv_Flash_Erase(dnl_p->flash_start_adr + dnl_p->erase_len))
+                if (EraseFlash(dnl_p->flash_start_adr + dnl_p->erase_len))
                 {
                     dnl_p->erase_len += FLASH_SECTOR_SIZE;
                     return true;
@@ -308,17 +670,185 @@ static bool ProgramImage(message_t *msg_p, image_dnl_t *dnl_p)
     return false;
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t ProgramStep(message_t   *msg_p,
+ *                                                     image_dnl_t *dnl_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Programs flash synchronously to make room in the ring or
+ *                 to finish the image. A flash operation deferred to the
+ *                 next gap is not waited for, as the gap only opens once
+ *                 the BLE stack gets the CPU again.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 dnl_p            - pointer to download structure
+ * Outputs       : return value     - IMAGE_DNL_OK
+ *                                      a flash operation was done
+ *                                  - IMAGE_DNL_DEFERRED
+ *                                      flash operation deferred, see
+ *                                      App_Dfu_Poll()
+ *                                  - IMAGE_DNL_BAD_FLASH
+ *                                      flash memory error
+ *                                  - IMAGE_DNL_BAD_HASH
+ *                                      chunk differs from manifest
+ * Assumptions   : the ring holds image data to program
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t ProgramStep(message_t *msg_p,
+                                           image_dnl_t *dnl_p)
+{
+    uint_fast32_t prog_len  = dnl_p->prog_len;
+    uint_fast32_t erase_len = dnl_p->erase_len;
+
+    if (!ProgramImage(msg_p, dnl_p))
+    {
+        return (dnl_p->state == PROG_FAILURE) ? dnl_p->failure :
+                                                IMAGE_DNL_OK;
+    }
+    if (dnl_p->prog_len == prog_len && dnl_p->erase_len == erase_len)
+    {
+        return IMAGE_DNL_DEFERRED;
+    }
+    return IMAGE_DNL_OK;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t DeferData(message_t     *msg_p,
+ *                                        const uint8_t *data_p,
+ *                                        uint_fast16_t  size,
+ *                                        image_dnl_resp_status_t resp)
+ * ----------------------------------------------------------------------------
+ * Description   : Keeps the rest of a message part whose processing waits
+ *                 for a deferred flash operation. App_Dfu_Poll() hands it
+ *                 to the message handler again, while the peer is held
+ *                 back with a busy receiver.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 data_p           - pointer to rest of message part
+ *                 size             - rest of message part size
+ *                 resp             - status of the processing
+ * Outputs       : return value     - resp
+ * Assumptions   : msg_p->rx_len already counts the message part
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t DeferData(message_t *msg_p,
+                                         const uint8_t *data_p,
+                                         uint_fast16_t size,
+                                         image_dnl_resp_status_t resp)
+{
+    if (resp == IMAGE_DNL_DEFERRED)
+    {
+        if (size > 0)
+        {
+            /* data_p may point into held_a already */
+            memmove(msg_p->held_a, data_p, size);
+        }
+        msg_p->held     = true;
+        msg_p->held_len = size;
+    }
+    return resp;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t CommitTransaction(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Marks all sub-images of a transaction as valid and
+ *                 schedules the reset which installs them. The installed
+ *                 application is invalidated right before the FOTA stack,
+ *                 which is the first sub-image and is committed last. An
+ *                 interrupted transaction leaves the installed images in
+ *                 charge, unless a download area overlapped the installed
+ *                 application, see InvalidateApp(). Then, and after an
+ *                 interrupted commit, only the FOTA stack is left to
+ *                 repeat the download.
+ * Inputs        : None
+ * Outputs       : return value     - IMAGE_DNL_OK
+ *                                      images committed
+ *                                  - IMAGE_DNL_BAD_FLASH
+ *                                      flash memory error
+ * Assumptions   : all sub-images are verified
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t CommitTransaction(void)
+{
+    image_dnl_resp_status_t resp = IMAGE_DNL_OK;
+
+    Drv_Flash_Unlock();
+    while (transaction.nb_verified > 0)
+    {
+        const commit_t *commit_p =
+            &transaction.commit_a[--transaction.nb_verified];
+
+        if ((transaction.nb_verified == 0 && !InvalidateApp(NULL)) ||
+            !Drv_Flash_Program(commit_p->adr, &commit_p->vector.word0))
+        {
+            resp = IMAGE_DNL_BAD_FLASH;
+            break;
+        }
+    }
+    Drv_Flash_Lock();
+
+    memset(&transaction, 0, sizeof(transaction));
+    if (resp == IMAGE_DNL_OK)
+    {
+        ke_timer_set(APP_DFU_RESET_TIMER, TASK_APP,
+                     KE_TIME_IN_SEC(CFG_DFU_RESET_DELAY));
+    }
+    return resp;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t DeferImage(const image_dnl_t *dnl_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Keeps a verified sub-image of a transaction for the commit
+ *                 and commits the transaction with the last sub-image. An
+ *                 application following a FOTA stack is staged behind it.
+ * Inputs        : dnl_p            - pointer to download structure
+ * Outputs       : return value     - IMAGE_DNL_OK
+ *                                      everything so far ok
+ *                                  - IMAGE_DNL_BAD_FLASH
+ *                                      flash memory error
+ * Assumptions   : sub-image is verified
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t DeferImage(const image_dnl_t *dnl_p)
+{
+    commit_t *commit_p = &transaction.commit_a[transaction.nb_verified++];
+
+    commit_p->adr    = dnl_p->flash_start_adr;
+    commit_p->vector = dnl_p->vector;
+
+    if (dnl_p->flash_start_adr == GetStackStart() + APP_MAX_SIZE / 2)
+    {
+        const Sys_Boot_descriptor_t *dscr_p =
+            (const void *)(uintptr_t)dnl_p->dscr_adr;
+        uint_fast32_t size = dnl_p->image_len;
+
+        /* image is Flash sector aligned */
+        size += -size % FLASH_SECTOR_SIZE;
+
+        transaction.app_start  = GetStackStart() + size;
+        transaction.build_id_p = dscr_p->build_id_a;
+    }
+
+    if (transaction.nb_verified == transaction.nb_images)
+    {
+        return CommitTransaction();
+    }
+    return IMAGE_DNL_OK;
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : image_dnl_resp_status_t CheckSignature(message_t   *msg_p,
  *                                                        image_dnl_t *dnl_p)
  * ----------------------------------------------------------------------------
- * Description   : Checks the image signature.
+ * Description   : Checks the image signature. If the image was checked
+ *                 chunk by chunk against a signed manifest, the signature
+ *                 was already verified with the manifest.
  * Inputs        : msg_p            - pointer to message structure
  *                 dnl_p            - pointer to download structure
  * Outputs       : return value     - IMAGE_DNL_OK
  *                                      signature is ok
+ *                                  - IMAGE_DNL_DEFERRED
+ *                                      image not yet programmed, see
+ *                                      ProgramStep()
  *                                  - IMAGE_DNL_BAD_SIG
  *                                      signature is wrong
+ *                                  - IMAGE_DNL_BAD_HASH
+ *                                      chunk differs from manifest
  *                                  - IMAGE_DNL_BAD_FLASH
  *                                      flash memory error
  * Assumptions   :
@@ -326,45 +856,45 @@ static bool ProgramImage(message_t *msg_p, image_dnl_t *dnl_p)
 static image_dnl_resp_status_t CheckSignature(message_t *msg_p,
                                               image_dnl_t *dnl_p)
 {
-    App_Conf_key_t *pub_key_p = App_Conf_GetPublicKey();
     const uint8_t  *sig_p = (const uint8_t *)(dnl_p->flash_start_adr +
-                                              msg_p->header.body_len -
+                                              dnl_p->image_len -
                                               sizeof(App_Conf_key_t));
 
     /* finish programming image */
-    while (ProgramImage(msg_p, dnl_p));
+    while (dnl_p->state == PROG_ONGOING && dnl_p->prog_len < dnl_p->rx_len)
+    {
+        if (ProgramStep(msg_p, dnl_p) == IMAGE_DNL_DEFERRED)
+        {
+            return IMAGE_DNL_DEFERRED;
+        }
+    }
 
-    if (dnl_p->state == PROG_ONGOING)
+    if (dnl_p->state == PROG_ONGOING && dnl_p->chunk_hash_p == NULL)
     {
+        uint32_t start = App_Stat_Start();
+
         /* finalize hash calculation */
         sha256_final(&dnl_p->hash, dnl_p->hash.data);
+        App_Stat_Stop(APP_STAT_SHA, start);
 
-        /* check if a public key is available */
-        if (memtst(pub_key_p, 0, sizeof(App_Conf_key_t)) != 0)
-        {
-            /* verify signature */
-            if (uECC_verify(*pub_key_p, dnl_p->hash.data, SHA256_BLOCK_SIZE,
-                            sig_p,
-                            uECC_secp256r1()) == 0)
-            {
-                Drv_Flash_Lock();
-                dnl_p->state = PROG_FAILURE;
-                return IMAGE_DNL_BAD_SIG;
-            }
-        }
-        else if (memtst(sig_p + SHA256_BLOCK_SIZE, -1, SHA256_BLOCK_SIZE) == 0)
+        if (!VerifySignature(dnl_p->hash.data, sig_p))
         {
-            /* check hash */
-            if (memcmp(dnl_p->hash.data,
-                       sig_p,
-                       SHA256_BLOCK_SIZE) != 0)
-            {
-                Drv_Flash_Lock();
-                dnl_p->state = PROG_FAILURE;
-                return IMAGE_DNL_BAD_SIG;
-            }
+            Drv_Flash_Lock();
+            dnl_p->state = PROG_FAILURE;
+            return IMAGE_DNL_BAD_SIG;
         }
+    }
+
+    if (dnl_p->state == PROG_ONGOING && transaction.nb_images > 0)
+    {
+        /* marking image as valid is deferred to the transaction commit */
+        Drv_Flash_Lock();
+        dnl_p->state = PROG_SUCCESS;
+        return DeferImage(dnl_p);
+    }
 
+    if (dnl_p->state == PROG_ONGOING)
+    {
         /* mark image as valid */
         if (Drv_Flash_Program(dnl_p->flash_start_adr,
                               &dnl_p->vector.word0))
@@ -376,17 +906,17 @@ static image_dnl_resp_status_t CheckSignature(message_t *msg_p,
     }
     Drv_Flash_Lock();
     dnl_p->state = PROG_FAILURE;
-    return IMAGE_DNL_BAD_FLASH;
+    return dnl_p->failure;
 }
 
 /* ----------------------------------------------------------------------------
  * Function      : image_dnl_resp_status_t CheckImage(message_t *msg_p,
- *                                   image_dnl_t *dnl_p, uint_fast16_t size)
+ *                                   image_dnl_t *dnl_p, uint_fast32_t size)
  * ----------------------------------------------------------------------------
  * Description   : Checks the image data.
  * Inputs        : msg_p            - pointer to message structure
  *                 dnl_p            - pointer to download structure
- *                 size             - message part size
+ *                 size             - number of new image bytes in the ring
  * Outputs       : return value     - IMAGE_DNL_OK
  *                                      everything so far ok
  *                                  - IMAGE_DNL_BAD_SIZE
@@ -399,11 +929,13 @@ static image_dnl_resp_status_t CheckSignature(message_t *msg_p,
  *                                      image has wrong start address
  *                                  - IMAGE_DNL_BAD_FLASH
  *                                      flash memory error
+ *                                  - IMAGE_DNL_BAD_HASH
+ *                                      chunk differs from manifest
  * Assumptions   :
  * ------------------------------------------------------------------------- */
 static image_dnl_resp_status_t CheckImage(message_t *msg_p,
                                           image_dnl_t *dnl_p,
-                                          uint_fast16_t size)
+                                          uint_fast32_t size)
 {
     const vector_table_t        *vector_p = (void *)msg_p->body_a;
     const Sys_Fota_version_t    *version_info_p;
@@ -412,18 +944,18 @@ static image_dnl_resp_status_t CheckImage(message_t *msg_p,
     uint_fast32_t image_size;
     uint_fast32_t offset;
 
-    if (msg_p->rx_len >= IMAGE_HEADER_SIZE)
+    if (dnl_p->rx_len >= IMAGE_HEADER_SIZE)
     {
         /* check for flash error */
         if (dnl_p->state == PROG_FAILURE)
         {
-            return IMAGE_DNL_BAD_FLASH;
+            return dnl_p->failure;
         }
 
         /* header was already checked */
         return IMAGE_DNL_OK;
     }
-    if (msg_p->rx_len + size < IMAGE_HEADER_SIZE)
+    if (dnl_p->rx_len + size < IMAGE_HEADER_SIZE)
     {
         /* header is still incomplete */
         return IMAGE_DNL_OK;
@@ -436,9 +968,9 @@ static image_dnl_resp_status_t CheckImage(message_t *msg_p,
     image_dscr_p   = (const void *)((const uint8_t *)vector_p + offset);
     image_size     = image_dscr_p->image_size + sizeof(App_Conf_key_t);
 
-    if (image_size != msg_p->header.body_len)
+    if (image_size != dnl_p->image_len)
     {
-        /* sub-image size does not match IMAGE_DOWNLOAD body length */
+        /* sub-image size does not match IMAGE_DOWNLOAD image length */
         return IMAGE_DNL_BAD_SIZE;
     }
     else if (!CheckDevID(version_info_p->dev_id))
@@ -449,7 +981,12 @@ static image_dnl_resp_status_t CheckImage(message_t *msg_p,
     else if (image_start == GetStackStart())
     {
         /* it is a FOTA stack sub-image */
-        if (image_size < APP_MIN_SIZE)
+        if (transaction.nb_verified > 0)
+        {
+            /* FOTA stack must be the first sub-image of a transaction */
+            return IMAGE_DNL_BAD_START;
+        }
+        else if (image_size < APP_MIN_SIZE)
         {
             /* FOTA stack sub-image is too small */
             return IMAGE_DNL_BAD_SIZE;
@@ -464,6 +1001,33 @@ static image_dnl_resp_status_t CheckImage(message_t *msg_p,
             dnl_p->flash_start_adr = image_start + APP_MAX_SIZE / 2;
         }
     }
+    else if (transaction.app_start != 0)
+    {
+        /* it is a Application sub-image staged behind a FOTA stack */
+        if (image_start != transaction.app_start)
+        {
+            return IMAGE_DNL_BAD_START;
+        }
+        else if (!CheckBuildID(image_dscr_p->build_id_a))
+        {
+            /* Application sub-image is incompatible with staged FOTA stack */
+            return IMAGE_DNL_BAD_BUILDID;
+        }
+        else if (image_size < APP_MIN_SIZE)
+        {
+            /* Application sub-image is too small */
+            return IMAGE_DNL_BAD_SIZE;
+        }
+        else if (image_start + image_size > APP_BASE_ADR + APP_MAX_SIZE / 2)
+        {
+            /* Application sub-image does not fit into download area */
+            return IMAGE_DNL_BAD_SIZE;
+        }
+        else
+        {
+            dnl_p->flash_start_adr = image_start + APP_MAX_SIZE / 2;
+        }
+    }
     else if (image_start == GetAppStart())
     {
         /* it is a Application sub-image */
@@ -492,6 +1056,17 @@ static image_dnl_resp_status_t CheckImage(message_t *msg_p,
         return IMAGE_DNL_BAD_START;
     }
 
+    if (dnl_p->base_len > 0 && dnl_p->flash_start_adr != dnl_p->base_adr)
+    {
+        /* delta is only supported in place of the installed application */
+        return IMAGE_DNL_BAD_START;
+    }
+
+    /* sectors missing in a sparse image are taken from the installed image */
+    dnl_p->copy_adr = image_start;
+    dnl_p->dscr_adr = dnl_p->flash_start_adr +
+                      vector_p->image_dscr - image_start;
+
     /* init flash programming */
     memcpy(&dnl_p->vector, msg_p->body_a, sizeof(dnl_p->vector));
     sha256_init(&dnl_p->hash);
@@ -499,100 +1074,1048 @@ static image_dnl_resp_status_t CheckImage(message_t *msg_p,
                   sizeof(dnl_p->vector));
     dnl_p->prog_len  = sizeof(dnl_p->vector);
     dnl_p->erase_len = 0;
-    // ı״̬״̬mainлõ
+    dnl_p->failure   = IMAGE_DNL_BAD_FLASH;
+    // 改变状态，这个状态main中会用到
     dnl_p->state     = PROG_ONGOING;
     Drv_Flash_Unlock();
     return IMAGE_DNL_OK;
 }
 
+#ifdef CFG_DFU_DELTA
 /* ----------------------------------------------------------------------------
- * Function      : void ImageDownloadResp(image_dnl_resp_status_t status)
+ * Function      : image_dnl_resp_status_t InitBase(image_dnl_t *dnl_p)
  * ----------------------------------------------------------------------------
- * Description   : Sends an image download response message.
- * Inputs        : status           - response status
- * Outputs       : None
+ * Description   : Selects the installed application as delta base image.
+ * Inputs        : dnl_p            - pointer to download structure
+ * Outputs       : return value     - IMAGE_DNL_OK
+ *                                      base image is available
+ *                                  - IMAGE_DNL_BAD_BASE
+ *                                      no valid application installed
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static void ImageDownloadResp(image_dnl_resp_status_t status)
+static image_dnl_resp_status_t InitBase(image_dnl_t *dnl_p)
 {
-    static msg_header_t resp = { IMAGE_DDOWNLOAD };
+    uint_fast32_t size;
 
-    resp.param_a[0] = status;
+    dnl_p->base_adr = GetAppStart();
+    size = Sys_Boot_GetImageSize(Sys_Boot_GetDscr(dnl_p->base_adr));
+    if (size < APP_MIN_SIZE ||
+        dnl_p->base_adr + size + sizeof(App_Conf_key_t) >
+        APP_BASE_ADR + APP_MAX_SIZE)
+    {
+        return IMAGE_DNL_BAD_BASE;
+    }
+    dnl_p->base_len = size + sizeof(App_Conf_key_t);
+    return IMAGE_DNL_OK;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t CheckBase(message_t      *msg_p,
+ *                                                   image_dnl_t    *dnl_p,
+ *                                                   const uint8_t **data_pp,
+ *                                                   uint_fast16_t  *size_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Compares the base image signature at the message begin
+ *                 with the signature of the installed application and
+ *                 removes it from the message part.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 dnl_p            - pointer to download structure
+ *                 data_pp          - pointer to message part pointer
+ *                 size_p           - pointer to message part size
+ * Outputs       : return value     - IMAGE_DNL_OK
+ *                                      base image matches so far
+ *                                  - IMAGE_DNL_BAD_BASE
+ *                                      delta was built for another image
+ * Assumptions   : base image is still intact (nothing erased yet)
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t CheckBase(message_t *msg_p,
+                                         image_dnl_t *dnl_p,
+                                         const uint8_t **data_pp,
+                                         uint_fast16_t *size_p)
+{
+    const uint8_t *sig_p = (const uint8_t *)(dnl_p->base_adr +
+                                             dnl_p->base_len -
+                                             sizeof(App_Conf_key_t));
+    uint_fast16_t len;
+
+    if (msg_p->rx_len >= sizeof(App_Conf_key_t))
+    {
+        return IMAGE_DNL_OK;
+    }
+
+    len = sizeof(App_Conf_key_t) - msg_p->rx_len;
+    if (len > *size_p)
+    {
+        len = *size_p;
+    }
+    if (memcmp(sig_p + msg_p->rx_len, *data_pp, len) != 0)
+    {
+        return IMAGE_DNL_BAD_BASE;
+    }
+    *data_pp += len;
+    *size_p  -= len;
+    return IMAGE_DNL_OK;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : const uint8_t *GetBaseByte(uint_fast32_t offset)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns a byte of the installed application while it is
+ *                 overwritten in place. Bytes behind the erased area are
+ *                 read from flash, bytes of the last erased sector from its
+ *                 RAM copy.
+ * Inputs        : offset           - offset in the base image
+ * Outputs       : return value     - pointer to the byte
+ *                                  - NULL if the byte is no longer available
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static const uint8_t *GetBaseByte(uint_fast32_t offset)
+{
+    const image_dnl_t *dnl_p = &image_download;
+
+    if (offset >= dnl_p->base_len)
+    {
+        return NULL;
+    }
+    else if (offset >= dnl_p->erase_len)
+    {
+        return (const uint8_t *)(dnl_p->base_adr + offset);
+    }
+    else if (offset + FLASH_SECTOR_SIZE >= dnl_p->erase_len)
+    {
+        return (const uint8_t *)base_sector_a + offset % FLASH_SECTOR_SIZE;
+    }
+    return NULL;
+}
+
+#endif    /* ifdef CFG_DFU_DELTA */
+
+/* ----------------------------------------------------------------------------
+ * Function      : void ImageDownloadResp(const message_t *msg_p,
+ *                                        image_dnl_resp_status_t status)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends an image download response message.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 status           - response status
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void ImageDownloadResp(const message_t *msg_p,
+                              image_dnl_resp_status_t status)
+{
+    static msg_header_t resp;
+
+    resp.code       = msg_p->header.code;
+    resp.param_a[0] = status;
     App_Hdlc_DataReq(0, &resp.code, sizeof(resp));
+    App_Stat_End(status);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast32_t GetRingLevel(const image_dnl_t *dnl_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the number of image bytes in the programming ring
+ *                 still waiting to be programmed.
+ * Inputs        : dnl_p            - pointer to download structure
+ * Outputs       : return value     - number of bytes
+ * Assumptions   : sectors copied from the installed image are not in
+ *                 the ring
+ * ------------------------------------------------------------------------- */
+static uint_fast32_t GetRingLevel(const image_dnl_t *dnl_p)
+{
+    if (dnl_p->prog_len < dnl_p->copy_end)
+    {
+        return dnl_p->rx_len - dnl_p->copy_end;
+    }
+    return dnl_p->rx_len - dnl_p->prog_len;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t StoreImage(message_t     *msg_p,
+ *                                                    image_dnl_t   *dnl_p,
+ *                                                    const uint8_t *data_p,
+ *                                                    uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Copies plain image data to the programming ring. Data
+ *                 received in place is already there.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 dnl_p            - pointer to download structure
+ *                 data_p           - pointer to message part
+ *                 size             - message part size
+ * Outputs       : return value     - see CheckImage()
+ *                                  - IMAGE_DNL_INTERNAL_FAILURE
+ *                                      ring buffer overflow
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t StoreImage(message_t *msg_p,
+                                          image_dnl_t *dnl_p,
+                                          const uint8_t *data_p,
+                                          uint_fast16_t size)
+{
+    image_dnl_resp_status_t resp;
+    uint_fast32_t index = dnl_p->rx_len % sizeof(msg_p->body_a);
+    uint_fast32_t len   = sizeof(msg_p->body_a) - index;
+
+    if (size + GetRingLevel(dnl_p) > sizeof(msg_p->body_a))
+    {
+        return IMAGE_DNL_INTERNAL_FAILURE;
+    }
+
+    /* copy data to ring buffer */
+    if (data_p == (uint8_t *)msg_p->body_a + index)
+    {
+        /* received in place, see App_Hdlc_RxBufferReq() */
+    }
+    else if (size <= len)
+    {
+        memcpy((uint8_t *)msg_p->body_a + index, data_p, size);
+    }
+    else
+    {
+        memcpy((uint8_t *)msg_p->body_a + index, data_p, len);
+        memcpy((uint8_t *)msg_p->body_a, data_p + len, size - len);
+    }
+    // 对收到的数据进行校验
+    /* check image */
+    resp = CheckImage(msg_p, dnl_p, size);
+    dnl_p->rx_len += size;
+    return resp;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t DecodeImage(message_t     *msg_p,
+ *                                                     image_dnl_t   *dnl_p,
+ *                                                     const uint8_t *data_p,
+ *                                                     uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Decompresses or patches image data to the programming
+ *                 ring. If the ring runs full, flash programming is done
+ *                 synchronously to make room for the rest of the message
+ *                 part and for the rest of a match which its last bytes
+ *                 started. Without a message part, only the rest of the
+ *                 match is written, as at the message end.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 dnl_p            - pointer to download structure
+ *                 data_p           - pointer to encoded message part
+ *                 size             - message part size
+ * Outputs       : return value     - see CheckImage()
+ *                                  - IMAGE_DNL_DEFERRED
+ *                                      rest is kept, see DeferData()
+ *                                  - IMAGE_DNL_BAD_FORMAT
+ *                                      corrupt encoded data
+ *                                  - IMAGE_DNL_BAD_FLASH
+ *                                      flash memory error
+ *                                  - IMAGE_DNL_BAD_HASH
+ *                                      chunk differs from manifest
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t DecodeImage(message_t *msg_p,
+                                           image_dnl_t *dnl_p,
+                                           const uint8_t *data_p,
+                                           uint_fast16_t size)
+{
+    image_dnl_resp_status_t resp;
+
+    for (;;)
+    {
+        uint_fast32_t limit = dnl_p->prog_len + sizeof(msg_p->body_a);
+        uint_fast32_t out_len;
+        uint_fast16_t used;
+        bool          valid;
+
+        /* stop at the header to check it before the ring wraps */
+        if (dnl_p->rx_len < IMAGE_HEADER_SIZE)
+        {
+            limit = IMAGE_HEADER_SIZE;
+        }
+        if (limit > dnl_p->image_len)
+        {
+            limit = dnl_p->image_len;
+        }
+
+#ifdef CFG_DFU_DELTA
+        if (msg_p->header.code == IMAGE_DDOWNLOAD_D)
+        {
+            used    = App_Delta_Decode(&dnl_p->codec.delta, data_p, size, limit);
+            out_len = dnl_p->codec.delta.out_len;
+            valid   = App_Delta_IsValid(&dnl_p->codec.delta);
+        }
+        else
+#endif    /* ifdef CFG_DFU_DELTA */
+        {
+            used    = App_Lz_Decode(&dnl_p->codec.lz, data_p, size, limit);
+            out_len = dnl_p->codec.lz.out_len;
+            valid   = App_Lz_IsValid(&dnl_p->codec.lz);
+        }
+        data_p += used;
+        size   -= used;
+        if (!valid)
+        {
+            return IMAGE_DNL_BAD_FORMAT;
+        }
+
+        /* check image */
+        resp = CheckImage(msg_p, dnl_p, out_len - dnl_p->rx_len);
+        dnl_p->rx_len = out_len;
+        if (resp != IMAGE_DNL_OK)
+        {
+            return resp;
+        }
+
+        if (dnl_p->rx_len < limit)
+        {
+            /* input is used up */
+            return IMAGE_DNL_OK;
+        }
+        if (dnl_p->rx_len == dnl_p->image_len)
+        {
+            /* encoded data beyond the image end */
+            return (size > 0) ? IMAGE_DNL_BAD_FORMAT : IMAGE_DNL_OK;
+        }
+
+        /* ring is full, but input is left or a match may still be pending
+         * -> program flash to make room */
+        resp = ProgramStep(msg_p, dnl_p);
+        if (resp != IMAGE_DNL_OK)
+        {
+            return DeferData(msg_p, data_p, size, resp);
+        }
+    }
+}
+
+#ifdef CFG_DFU_SPARSE
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t SkipSectors(message_t    *msg_p,
+ *                                                     image_dnl_t  *dnl_p,
+ *                                                     uint_fast32_t end)
+ * ----------------------------------------------------------------------------
+ * Description   : Takes the sectors up to end from the installed image.
+ *                 The sectors themselves are copied or kept by
+ *                 ProgramImage(), but the ring is emptied first, as the
+ *                 image data behind the gap reuses the whole ring.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 dnl_p            - pointer to download structure
+ *                 end              - image offset of the next record
+ * Outputs       : return value     - IMAGE_DNL_OK
+ *                                      everything so far ok
+ *                                  - IMAGE_DNL_DEFERRED
+ *                                      ring not yet empty, see
+ *                                      ProgramStep()
+ *                                  - IMAGE_DNL_BAD_FLASH
+ *                                      flash memory error
+ *                                  - IMAGE_DNL_BAD_HASH
+ *                                      chunk differs from manifest
+ * Assumptions   : dnl_p->rx_len is sector aligned
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t SkipSectors(message_t *msg_p,
+                                           image_dnl_t *dnl_p,
+                                           uint_fast32_t end)
+{
+    image_dnl_resp_status_t resp;
+
+    while (dnl_p->prog_len < dnl_p->rx_len)
+    {
+        resp = ProgramStep(msg_p, dnl_p);
+        if (resp != IMAGE_DNL_OK)
+        {
+            return resp;
+        }
+    }
+    dnl_p->copy_end = end;
+    dnl_p->rx_len   = end;
+    return IMAGE_DNL_OK;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : image_dnl_resp_status_t SparseImage(message_t     *msg_p,
+ *                                                     image_dnl_t   *dnl_p,
+ *                                                     const uint8_t *data_p,
+ *                                                     uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Splits sparse image data into sector records and copies
+ *                 their data to the programming ring. A record consists of
+ *                 the sector index (uint16_t), a reserved uint16_t and the
+ *                 sector data. Records are in ascending order and start
+ *                 with sector 0, missing sectors are taken from the
+ *                 installed image. If the ring runs full, flash programming
+ *                 is done synchronously to make room for the rest of the
+ *                 message part. A record header is kept until the gap in
+ *                 front of its sector is skipped.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 dnl_p            - pointer to download structure
+ *                 data_p           - pointer to message part
+ *                 size             - message part size
+ * Outputs       : return value     - see CheckImage()
+ *                                  - IMAGE_DNL_DEFERRED
+ *                                      rest is kept, see DeferData()
+ *                                  - IMAGE_DNL_BAD_FORMAT
+ *                                      wrong sector index
+ *                                  - IMAGE_DNL_BAD_FLASH
+ *                                      flash memory error
+ *                                  - IMAGE_DNL_BAD_HASH
+ *                                      chunk differs from manifest
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static image_dnl_resp_status_t SparseImage(message_t *msg_p,
+                                           image_dnl_t *dnl_p,
+                                           const uint8_t *data_p,
+                                           uint_fast16_t size)
+{
+    sparse_state_t         *sparse_p = &dnl_p->codec.sparse;
+    image_dnl_resp_status_t resp;
+
+    while (size > 0)
+    {
+        uint_fast32_t len;
+
+        if (sparse_p->data_len == 0)
+        {
+            /* collect record header */
+            if (sparse_p->hdr_len < SPARSE_HDR_SIZE)
+            {
+                if (sparse_p->hdr_len < sizeof(sparse_p->sector))
+                {
+                    sparse_p->sector |= *data_p << (8 * sparse_p->hdr_len);
+                }
+                data_p++;
+                size--;
+                if (++sparse_p->hdr_len < SPARSE_HDR_SIZE)
+                {
+                    continue;
+                }
+            }
+
+            len = sparse_p->sector * IMAGE_SECTOR_SIZE;
+            if (len < dnl_p->rx_len || len >= dnl_p->image_len ||
+                (dnl_p->rx_len == 0 && len != 0))
+            {
+                return IMAGE_DNL_BAD_FORMAT;
+            }
+            if (len > dnl_p->rx_len)
+            {
+                resp = SkipSectors(msg_p, dnl_p, len);
+                if (resp != IMAGE_DNL_OK)
+                {
+                    return DeferData(msg_p, data_p, size, resp);
+                }
+            }
+            sparse_p->hdr_len = 0;
+            sparse_p->sector  = 0;
+            sparse_p->data_len = dnl_p->image_len - len;
+            if (sparse_p->data_len > IMAGE_SECTOR_SIZE)
+            {
+                sparse_p->data_len = IMAGE_SECTOR_SIZE;
+            }
+            continue;
+        }
+
+        /* ring is full -> program flash to make room */
+        while (GetRingLevel(dnl_p) == sizeof(msg_p->body_a))
+        {
+            resp = ProgramStep(msg_p, dnl_p);
+            if (resp != IMAGE_DNL_OK)
+            {
+                return DeferData(msg_p, data_p, size, resp);
+            }
+        }
+
+        len = sizeof(msg_p->body_a) - GetRingLevel(dnl_p);
+        if (len > size)
+        {
+            len = size;
+        }
+        if (len > sparse_p->data_len)
+        {
+            len = sparse_p->data_len;
+        }
+
+        resp = StoreImage(msg_p, dnl_p, data_p, len);
+        if (resp != IMAGE_DNL_OK)
+        {
+            return resp;
+        }
+        sparse_p->data_len -= len;
+        data_p += len;
+        size   -= len;
+    }
+
+    return IMAGE_DNL_OK;
+}
+
+#endif    /* ifdef CFG_DFU_SPARSE */
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool ImageDownloadCmd(message_t *msg_p,
+ *                                  const uint8_t *data_p, uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Processes image download command message. The
+ *                 IMAGE_DDOWNLOAD_Z variant carries a compressed image (see
+ *                 app_lz.h), the IMAGE_DDOWNLOAD_D variant the signature
+ *                 of the installed application followed by a delta against
+ *                 it (see app_delta.h) and the IMAGE_DDOWNLOAD_S variant
+ *                 only the sectors which differ from the installed image
+ *                 (see SparseImage()). All of them carry the resulting image
+ *                 length in the message parameters.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 data_p           - pointer to message part
+ *                 size             - message part size
+ * Outputs       : return value     - true  no error so far
+ *                                  - false error in message
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool ImageDownloadCmd(message_t *msg_p,
+                             const uint8_t *data_p, uint_fast16_t size)
+{
+    image_dnl_t *dnl_p = &image_download;
+
+    switch (msg_p->state)
+    {
+        case MSG_BEGIN:
+        	// 开始
+        /* handle download command begin */
+        {
+            App_Stat_Begin();
+
+            dnl_p->image_len    = msg_p->header.body_len;
+            dnl_p->rx_len       = 0;
+            dnl_p->prog_len     = 0;
+            dnl_p->erase_len    = 0;
+            dnl_p->base_len     = 0;
+            dnl_p->copy_end     = 0;
+            dnl_p->chunk_hash_p = NULL;
+            dnl_p->failure      = IMAGE_DNL_BAD_FLASH;
+
+            if (msg_p->header.code != IMAGE_DDOWNLOAD)
+            {
+                dnl_p->image_len = msg_p->header.param_a[0]       |
+                                   msg_p->header.param_a[1] << 8  |
+                                   msg_p->header.param_a[2] << 16;
+            }
+
+            if (msg_p->header.code == IMAGE_DDOWNLOAD_Z)
+            {
+                App_Lz_Init(&dnl_p->codec.lz,
+                            msg_p->body_a, sizeof(msg_p->body_a));
+            }
+#ifdef CFG_DFU_DELTA
+            else if (msg_p->header.code == IMAGE_DDOWNLOAD_D)
+            {
+                image_dnl_resp_status_t resp = InitBase(dnl_p);
+
+                if (resp != IMAGE_DNL_OK)
+                {
+                    ImageDownloadResp(msg_p, resp);
+                    return false;
+                }
+                App_Delta_Init(&dnl_p->codec.delta,
+                               msg_p->body_a, sizeof(msg_p->body_a),
+                               GetBaseByte);
+            }
+#endif    /* ifdef CFG_DFU_DELTA */
+#ifdef CFG_DFU_SPARSE
+            else if (msg_p->header.code == IMAGE_DDOWNLOAD_S)
+            {
+                dnl_p->codec.sparse.hdr_len  = 0;
+                dnl_p->codec.sparse.sector   = 0;
+                dnl_p->codec.sparse.data_len = 0;
+            }
+#endif    /* ifdef CFG_DFU_SPARSE */
+
+            /* count sub-images of a transaction */
+            if (transaction.nb_images > 0)
+            {
+                if (transaction.nb_started == transaction.nb_images)
+                {
+                    ImageDownloadResp(msg_p, IMAGE_DNL_BAD_START);
+                    return false;
+                }
+                transaction.nb_started++;
+            }
+
+            /* check for minimal image length */
+            if (dnl_p->image_len < IMAGE_HEADER_SIZE)
+            {
+                /* image too small -> abort */
+                ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIZE);
+                return false;
+            }
+
+            /* a verified manifest applies to the next download only */
+            if (manifest.valid)
+            {
+                uint32_t len;
+
+                manifest.valid = false;
+                memcpy(&len, manifest.data_a, sizeof(len));
+                if (len != dnl_p->image_len)
+                {
+                    ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIZE);
+                    return false;
+                }
+                dnl_p->chunk_hash_p = manifest.data_a + MANIFEST_HEADER_SIZE;
+            }
+        }
+        break;
+        // 结束
+        case MSG_END:
+
+        /* handle download command end */
+        {
+            image_dnl_resp_status_t resp = IMAGE_DNL_OK;
+
+            if (msg_p->header.code == IMAGE_DDOWNLOAD_Z ||
+                msg_p->header.code == IMAGE_DDOWNLOAD_D)
+            {
+                /* finish a match left by a deferred last message part */
+                resp = DecodeImage(msg_p, dnl_p, NULL, 0);
+            }
+#ifdef CFG_DFU_SPARSE
+            /* sectors behind the last record are taken from the installed
+             * image as well */
+            else if (msg_p->header.code == IMAGE_DDOWNLOAD_S &&
+                     dnl_p->codec.sparse.hdr_len  == 0 &&
+                     dnl_p->codec.sparse.data_len == 0 &&
+                     dnl_p->rx_len > 0 && dnl_p->rx_len < dnl_p->image_len)
+            {
+                resp = SkipSectors(msg_p, dnl_p, dnl_p->image_len);
+            }
+#endif    /* ifdef CFG_DFU_SPARSE */
+            if (resp == IMAGE_DNL_OK && dnl_p->rx_len != dnl_p->image_len)
+            {
+                /* compressed data ended before the image end */
+                resp = IMAGE_DNL_BAD_SIZE;
+            }
+            if (resp == IMAGE_DNL_OK)
+            {
+                resp = CheckSignature(msg_p, dnl_p);
+            }
+            else if (resp != IMAGE_DNL_DEFERRED)
+            {
+                Drv_Flash_Lock();
+                dnl_p->state = PROG_FAILURE;
+            }
+
+            if (resp == IMAGE_DNL_DEFERRED)
+            {
+                /* the message end is handled again, see App_Dfu_Poll() */
+                DeferData(msg_p, NULL, 0, resp);
+                break;
+            }
+            ImageDownloadResp(msg_p, resp);
+        }
+        break;
+
+        default:
+
+        /* handle download command data */
+        {
+            image_dnl_resp_status_t resp;
+
+            if (msg_p->header.code == IMAGE_DDOWNLOAD)
+            {
+                resp = StoreImage(msg_p, dnl_p, data_p, size);
+            }
+#ifdef CFG_DFU_SPARSE
+            else if (msg_p->header.code == IMAGE_DDOWNLOAD_S)
+            {
+                resp = SparseImage(msg_p, dnl_p, data_p, size);
+            }
+#endif    /* ifdef CFG_DFU_SPARSE */
+            else
+            {
+#ifdef CFG_DFU_DELTA
+                if (msg_p->header.code == IMAGE_DDOWNLOAD_D)
+                {
+                    resp = CheckBase(msg_p, dnl_p, &data_p, &size);
+                    if (resp != IMAGE_DNL_OK)
+                    {
+                        ImageDownloadResp(msg_p, resp);
+                        return false;
+                    }
+                }
+#endif    /* ifdef CFG_DFU_DELTA */
+                resp = DecodeImage(msg_p, dnl_p, data_p, size);
+            }
+
+            if (resp != IMAGE_DNL_OK && resp != IMAGE_DNL_DEFERRED)
+            {
+                ImageDownloadResp(msg_p, resp);
+                return false;
+            }
+        }
+        break;
+    }
+
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool ManifestCmd(message_t *msg_p,
+ *                                  const uint8_t *data_p, uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Processes image manifest command message. The manifest
+ *                 contains the image length, a truncated SHA-256 hash for
+ *                 every flash sector sized chunk of the image and a
+ *                 signature over both. Once verified it applies to the next
+ *                 image download, whose chunks are then checked as soon as
+ *                 they are programmed.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 data_p           - pointer to message part
+ *                 size             - message part size
+ * Outputs       : return value     - true  no error so far
+ *                                  - false error in message
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool ManifestCmd(message_t *msg_p,
+                        const uint8_t *data_p, uint_fast16_t size)
+{
+    switch (msg_p->state)
+    {
+        case MSG_BEGIN:
+        {
+            uint_fast32_t len = msg_p->header.body_len;
+
+            manifest.valid = false;
+            if (len > sizeof(manifest.data_a) ||
+                len < MANIFEST_HEADER_SIZE + sizeof(App_Conf_key_t) ||
+                (len - MANIFEST_HEADER_SIZE - sizeof(App_Conf_key_t)) %
+                CHUNK_HASH_SIZE != 0)
+            {
+                ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIZE);
+                return false;
+            }
+        }
+        break;
+
+        case MSG_END:
+        {
+            uint8_t       hash_a[SHA256_BLOCK_SIZE];
+            uint32_t      image_len;
+            uint_fast32_t len = msg_p->header.body_len -
+                                sizeof(App_Conf_key_t);
+
+            /* one hash per chunk */
+            memcpy(&image_len, manifest.data_a, sizeof(image_len));
+            if ((len - MANIFEST_HEADER_SIZE) / CHUNK_HASH_SIZE !=
+                (image_len + IMAGE_SECTOR_SIZE - 1) / IMAGE_SECTOR_SIZE)
+            {
+                ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIZE);
+                break;
+            }
+
+            sha256(manifest.data_a, len, hash_a);
+            if (!VerifySignature(hash_a, manifest.data_a + len))
+            {
+                ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIG);
+                break;
+            }
+            manifest.valid = true;
+            ImageDownloadResp(msg_p, IMAGE_DNL_OK);
+        }
+        break;
+
+        default:
+        {
+            memcpy(manifest.data_a + msg_p->rx_len, data_p, size);
+        }
+        break;
+    }
+
+    return true;
+}
+
+#ifdef CFG_DFU_SPARSE
+/* ----------------------------------------------------------------------------
+ * Function      : void SectorHashResp(sector_hash_t *hash_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends as much of the sector hash response as possible.
+ *                 The header is sent as separate SDU and the hashes in SDUs
+ *                 of up to CFG_DFU_RESP_SDU_SIZE, as soon as they are
+ *                 calculated.
+ * Inputs        : hash_p           - pointer to sector hash structure
+ * Outputs       : None
+ * Assumptions   : called again on every confirmation of sent data
+ * ------------------------------------------------------------------------- */
+static void SectorHashResp(sector_hash_t *hash_p)
+{
+    uint_fast16_t max_size = App_Hdlc_GetMaxSduSize(0);
+    uint_fast16_t len      = sizeof(hash_p->resp) +
+                             hash_p->hash_cnt * SECTOR_HASH_SIZE;
+
+    if (max_size > CFG_DFU_RESP_SDU_SIZE)
+    {
+        max_size = CFG_DFU_RESP_SDU_SIZE;
+    }
+
+    if (hash_p->tx_len == 0)
+    {
+        if (!App_Hdlc_DataReq(0, &hash_p->resp.code, sizeof(hash_p->resp)))
+        {
+            return;
+        }
+        hash_p->tx_len = sizeof(hash_p->resp);
+    }
+
+    while (hash_p->tx_len < len)
+    {
+        uint_fast16_t size = len - hash_p->tx_len;
+
+        if (size > max_size)
+        {
+            size = max_size;
+        }
+        else if (len < hash_p->resp_len)
+        {
+            /* wait for a full SDU */
+            break;
+        }
+        if (!App_Hdlc_DataReq(0, hash_p->hash_a + hash_p->tx_len -
+                                 sizeof(hash_p->resp), size))
+        {
+            break;
+        }
+        hash_p->tx_len += size;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool HashSector(sector_hash_t *hash_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Calculates the hash of the next sector of a sector hash
+ *                 query and sends it.
+ * Inputs        : hash_p           - pointer to sector hash structure
+ * Outputs       : return value     - true  more sectors to hash
+ *                                  - false all sectors hashed
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool HashSector(sector_hash_t *hash_p)
+{
+    uint8_t hash_a[SHA256_BLOCK_SIZE];
+
+    if (hash_p->hash_cnt >= hash_p->nb_sectors)
+    {
+        return false;
+    }
+
+    /* truncated little-endian SHA-256 hash of the whole sector */
+    sha256((const uint8_t *)(uintptr_t)(hash_p->adr + hash_p->hash_cnt *
+                                        IMAGE_SECTOR_SIZE),
+           IMAGE_SECTOR_SIZE, hash_a);
+    memcpy(hash_p->hash_a + hash_p->hash_cnt * SECTOR_HASH_SIZE,
+           hash_a, SECTOR_HASH_SIZE);
+    hash_p->hash_cnt++;
+
+    SectorHashResp(hash_p);
+    return (hash_p->hash_cnt < hash_p->nb_sectors);
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : bool ImageDownloadCmd(message_t *msg_p,
+ * Function      : bool SectorHashCmd(message_t *msg_p,
  *                                  const uint8_t *data_p, uint_fast16_t size)
  * ----------------------------------------------------------------------------
- * Description   : Processes image download command message.
+ * Description   : Processes sector hash command message. The parameters
+ *                 select the flash region (region_t) and the max. number of
+ *                 sectors (0 for the whole region). The response carries the
+ *                 number of sectors in the parameters and a truncated
+ *                 SHA-256 hash per sector as body. The hashes are
+ *                 calculated in the background, as hashing a whole region
+ *                 takes too long for the message handler.
  * Inputs        : msg_p            - pointer to message structure
  *                 data_p           - pointer to message part
  *                 size             - message part size
  * Outputs       : return value     - true  no error so far
  *                                  - false error in message
- * Assumptions   :
+ * Assumptions   : no other sector hash response is pending
  * ------------------------------------------------------------------------- */
-static bool ImageDownloadCmd(message_t *msg_p,
-                             const uint8_t *data_p, uint_fast16_t size)
+static bool SectorHashCmd(message_t *msg_p,
+                          const uint8_t *data_p, uint_fast16_t size)
 {
-    switch (msg_p->state)
+    sector_hash_t *hash_p = &sector_hash;
+    uint_fast32_t  end;
+    uint_fast32_t  nb_sectors;
+
+    if (msg_p->state != MSG_END)
     {
-        case MSG_BEGIN:
-        	// ʼ
-        /* handle download command begin */
+        return true;
+    }
+
+    switch (msg_p->header.param_a[0])
+    {
+        case REGION_STACK:
         {
-            /* check for minimal body length */
-            if (msg_p->header.body_len < IMAGE_HEADER_SIZE)
-            {
-                /* body too small -> abort */
-                ImageDownloadResp(IMAGE_DNL_BAD_SIZE);
-                return false;
-            }
+            hash_p->adr = GetStackStart();
+            end         = GetAppStart();
         }
         break;
-        // 
-        case MSG_END:
 
-        /* handle download command end */
+        case REGION_APP:
         {
-            ImageDownloadResp(CheckSignature(msg_p, &image_download));
+            hash_p->adr = GetAppStart();
+            end         = APP_BASE_ADR + APP_MAX_SIZE;
         }
         break;
 
         default:
+        {
+            ImageDownloadResp(msg_p, IMAGE_DNL_BAD_START);
+            return false;
+        }
+    }
 
-        /* handle download command data */
+    nb_sectors = msg_p->header.param_a[1] | msg_p->header.param_a[2] << 8;
+    if (nb_sectors == 0 || nb_sectors > (end - hash_p->adr) / IMAGE_SECTOR_SIZE)
+    {
+        nb_sectors = (end - hash_p->adr) / IMAGE_SECTOR_SIZE;
+    }
+
+    hash_p->nb_sectors      = nb_sectors;
+    hash_p->hash_cnt        = 0;
+    hash_p->tx_len          = 0;
+    hash_p->resp_len        = sizeof(hash_p->resp) +
+                              nb_sectors * SECTOR_HASH_SIZE;
+    hash_p->resp.code       = msg_p->header.code;
+    hash_p->resp.param_a[0] = IMAGE_DNL_OK;
+    hash_p->resp.param_a[1] = nb_sectors;
+    hash_p->resp.param_a[2] = nb_sectors >> 8;
+    hash_p->resp.body_len   = nb_sectors * SECTOR_HASH_SIZE;
+    Drv_Targ_SetBackgroundFlag();
+    return true;
+}
+
+#endif    /* ifdef CFG_DFU_SPARSE */
+
+#ifdef CFG_DFU_READ_REGION
+/* ----------------------------------------------------------------------------
+ * Function      : void ReadRegionResp(region_read_t *read_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends as much of the region read response as possible.
+ *                 The header is sent as separate SDU and the region content
+ *                 in SDUs of up to CFG_DFU_RESP_SDU_SIZE directly from the
+ *                 memory mapped flash, so no buffer is needed.
+ * Inputs        : read_p           - pointer to region read structure
+ * Outputs       : None
+ * Assumptions   : called again on every confirmation of sent data
+ * ------------------------------------------------------------------------- */
+static void ReadRegionResp(region_read_t *read_p)
+{
+    uint_fast16_t max_size = App_Hdlc_GetMaxSduSize(0);
+
+    if (max_size > CFG_DFU_RESP_SDU_SIZE)
+    {
+        max_size = CFG_DFU_RESP_SDU_SIZE;
+    }
+
+    if (read_p->tx_len == 0)
+    {
+        if (!App_Hdlc_DataReq(0, &read_p->resp.code, sizeof(read_p->resp)))
         {
-            image_dnl_resp_status_t resp;
-            uint_fast32_t index = msg_p->rx_len % sizeof(msg_p->body_a);
-            uint_fast32_t len   = sizeof(msg_p->body_a) - index;
+            return;
+        }
+        read_p->tx_len = sizeof(read_p->resp);
+    }
+
+    while (read_p->tx_len < read_p->resp_len)
+    {
+        uint_fast32_t size = read_p->resp_len - read_p->tx_len;
+        uint_fast32_t adr  = read_p->adr + read_p->tx_len -
+                             sizeof(read_p->resp);
+
+        if (size > max_size)
+        {
+            size = max_size;
+        }
+        if (!App_Hdlc_DataReq(0, (const uint8_t *)(uintptr_t)adr, size))
+        {
+            break;
+        }
+        read_p->tx_len += size;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool ReadRegionCmd(message_t *msg_p,
+ *                                  const uint8_t *data_p, uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Processes region read command message. The parameter
+ *                 selects the region (region_t), the body holds the offset
+ *                 into the region and the number of bytes to read (0 for
+ *                 the rest of the region). The response carries the region
+ *                 content as body. Any connected central may send it, so
+ *                 only the crash log area is readable, not the images or
+ *                 the NVR sectors.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 data_p           - pointer to message part
+ *                 size             - message part size
+ * Outputs       : return value     - true  no error so far
+ *                                  - false error in message
+ * Assumptions   : no other region read response is pending
+ * ------------------------------------------------------------------------- */
+static bool ReadRegionCmd(message_t *msg_p,
+                          const uint8_t *data_p, uint_fast16_t size)
+{
+    region_read_t *read_p = &region_read;
+    uint32_t       offset;
+    uint32_t       length;
+    uint_fast32_t  start;
+    uint_fast32_t  end;
 
-            if (size + msg_p->rx_len -
-                image_download.prog_len > sizeof(msg_p->body_a))
+    switch (msg_p->state)
+    {
+        case MSG_BEGIN:
+        {
+            if (msg_p->header.body_len != READ_REGION_BODY_SIZE)
             {
-                ImageDownloadResp(IMAGE_DNL_INTERNAL_FAILURE);
+                ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIZE);
                 return false;
             }
+        }
+        break;
 
-            /* copy data to ring buffer */
-            if (size <= len)
+        case MSG_END:
+        {
+            switch (msg_p->header.param_a[0])
             {
-                memcpy((uint8_t *)msg_p->body_a + index, data_p, size);
+                case REGION_LOG:
+                {
+                    start = CFG_DFU_LOG_BASE;
+                    end   = CFG_DFU_LOG_BASE + CFG_DFU_LOG_SIZE;
+                }
+                break;
+
+                default:
+                {
+                    ImageDownloadResp(msg_p, IMAGE_DNL_BAD_START);
+                    return false;
+                }
             }
-            else
+
+            memcpy(&offset, &read_p->body_a[0], sizeof(offset));
+            memcpy(&length, &read_p->body_a[4], sizeof(length));
+            if (offset > end - start)
             {
-                memcpy((uint8_t *)msg_p->body_a + index, data_p, len);
-                memcpy((uint8_t *)msg_p->body_a, data_p + len, size - len);
+                ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIZE);
+                return false;
             }
-            // յݽУ
-            /* check image */
-            resp = CheckImage(msg_p, &image_download, size);
-            if (resp != IMAGE_DNL_OK)
+            if (length == 0 || length > end - start - offset)
             {
-                ImageDownloadResp(resp);
-                return false;
+                length = end - start - offset;
             }
+
+            read_p->adr             = start + offset;
+            read_p->tx_len          = 0;
+            read_p->resp_len        = sizeof(read_p->resp) + length;
+            read_p->resp.code       = msg_p->header.code;
+            read_p->resp.param_a[0] = IMAGE_DNL_OK;
+            read_p->resp.param_a[1] = 0;
+            read_p->resp.param_a[2] = 0;
+            read_p->resp.body_len   = length;
+            ReadRegionResp(read_p);
+        }
+        break;
+
+        default:
+        {
+            memcpy(read_p->body_a + msg_p->rx_len, data_p, size);
         }
         break;
     }
@@ -600,6 +2123,43 @@ static bool ImageDownloadCmd(message_t *msg_p,
     return true;
 }
 
+#endif    /* ifdef CFG_DFU_READ_REGION */
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool TransactionCmd(message_t *msg_p,
+ *                                  const uint8_t *data_p, uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Processes transaction command message. The parameter
+ *                 is the number of sub-images downloaded next. None of them
+ *                 is marked as valid before all are verified, then all are
+ *                 committed at once and the device is reset. An application
+ *                 following a FOTA stack is staged behind it in the download
+ *                 area and installed by the new FOTA stack. A parameter of 0
+ *                 cancels the transaction.
+ * Inputs        : msg_p            - pointer to message structure
+ *                 data_p           - pointer to message part
+ *                 size             - message part size
+ * Outputs       : return value     - true  no error so far
+ *                                  - false error in message
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool TransactionCmd(message_t *msg_p,
+                           const uint8_t *data_p, uint_fast16_t size)
+{
+    if (msg_p->state == MSG_END)
+    {
+        memset(&transaction, 0, sizeof(transaction));
+        if (msg_p->header.param_a[0] > TRANSACTION_MAX_IMAGES)
+        {
+            ImageDownloadResp(msg_p, IMAGE_DNL_BAD_SIZE);
+            return false;
+        }
+        transaction.nb_images = msg_p->header.param_a[0];
+        ImageDownloadResp(msg_p, IMAGE_DNL_OK);
+    }
+    return true;
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void HandleMsg(message_t *msg_p, const uint8_t *data_p,
  *                                                  uint_fast16_t  size)
@@ -622,12 +2182,50 @@ static void HandleMsg(message_t *msg_p,
     switch (msg_p->header.code)
     {
         case IMAGE_DDOWNLOAD:
+        case IMAGE_DDOWNLOAD_Z:
+#ifdef CFG_DFU_DELTA
+        case IMAGE_DDOWNLOAD_D:
+#endif    /* ifdef CFG_DFU_DELTA */
+        {
+        	// 下载命令
+            result = ImageDownloadCmd(msg_p, data_p, size);
+        }
+        break;
+
+        case IMAGE_MANIFEST:
+        {
+            result = ManifestCmd(msg_p, data_p, size);
+        }
+        break;
+
+        case IMAGE_TRANSACTION:
+        {
+            result = TransactionCmd(msg_p, data_p, size);
+        }
+        break;
+
+#ifdef CFG_DFU_SPARSE
+        case IMAGE_DDOWNLOAD_S:
         {
-        	// 
             result = ImageDownloadCmd(msg_p, data_p, size);
         }
         break;
 
+        case IMAGE_SECTOR_HASH:
+        {
+            result = SectorHashCmd(msg_p, data_p, size);
+        }
+        break;
+#endif    /* ifdef CFG_DFU_SPARSE */
+
+#ifdef CFG_DFU_READ_REGION
+        case IMAGE_READ_REGION:
+        {
+            result = ReadRegionCmd(msg_p, data_p, size);
+        }
+        break;
+#endif    /* ifdef CFG_DFU_READ_REGION */
+
         default:
         {
             result = false;
@@ -638,6 +2236,31 @@ static void HandleMsg(message_t *msg_p,
     msg_p->state = result ? MSG_DATA : MSG_SKIP;
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : void EndMsg(message_t *msg_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles the end of the current message once all of it
+ *                 is received and no part of it waits for flash memory.
+ * Inputs        : msg_p            - pointer to message structure
+ * Outputs       : msg_p->state     - MSG_WAIT ready for the next message
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void EndMsg(message_t *msg_p)
+{
+    if (msg_p->rx_len == msg_p->header.body_len && !msg_p->held)
+    {
+        if (msg_p->state == MSG_DATA)
+        {
+            msg_p->state = MSG_END;
+            HandleMsg(msg_p, NULL, 0);
+        }
+        if (!msg_p->held)
+        {
+            msg_p->state = MSG_WAIT;
+        }
+    }
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : bool DataInd(message_t *msg_p, const uint8_t *data_p,
  *                                                uint_fast16_t  size)
@@ -653,8 +2276,10 @@ static void HandleMsg(message_t *msg_p,
 static bool DataInd(message_t *msg_p,
                     const uint8_t *data_p, uint_fast16_t size)
 {
+    uint_fast16_t sdu_size = size;
+
     /* check for message begin */
-	// ݿͷ
+	// 数据开头
     if (msg_p->state == MSG_WAIT)
     {
         memcpy(&msg_p->header, data_p, sizeof(msg_p->header));
@@ -681,16 +2306,18 @@ static bool DataInd(message_t *msg_p,
     }
 
     /* check for message end */
-    if (msg_p->rx_len == msg_p->header.body_len)
+    EndMsg(msg_p);
+
+    /* hold the peer back while the message waits for flash memory or the
+     * programming ring cannot take another SDU of this size, see
+     * App_Dfu_Poll() */
+    if (msg_p->held ||
+        (msg_p->state == MSG_DATA && msg_p->header.code == IMAGE_DDOWNLOAD &&
+         GetRingLevel(&image_download) + sdu_size > sizeof(msg_p->body_a)))
     {
-        if (msg_p->state == MSG_DATA)
-        {
-            msg_p->state = MSG_END;
-            HandleMsg(msg_p, NULL, 0);
-        }
-        msg_p->state = MSG_WAIT;
+        msg_p->busy_size = sdu_size;
+        return false;
     }
-
     return true;
 }
 
@@ -718,6 +2345,26 @@ static void TimeoutHandler(ke_msg_id_t msg_id, const void *param_p,
     }
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : void ResetHandler(ke_msg_id_t  msg_id,
+ *                                   const void  *param_p,
+ *                                   ke_task_id_t dest_id,
+ *                                   ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles the reset after a committed transaction.
+ * Inputs        : msg_id           - Kernel message ID number
+ *                 param_p          - always NULL
+ *                 dest_id          - Destination task ID number
+ *                 src_id           - Source task ID number
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void ResetHandler(ke_msg_id_t msg_id, const void *param_p,
+                         ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    Drv_Targ_Reset();
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void StateChangeHandler(ke_msg_id_t  msg_id,
  *                                         const void  *param_p,
@@ -739,7 +2386,7 @@ static void StateChangeHandler(ke_msg_id_t msg_id, const void *param_p,
     {
         case APP_BLE_ADVERTISING:
         {
-        	// 㲥׶öʱʱԺ豸
+        	// 广播阶段设置定时器，超时以后，设备重新启动。
             ke_timer_set(APP_DFU_SUPERVISOR_TIMER, dest_id,
                          KE_TIME_IN_SEC(CFG_MAX_ADVERTISING_TIME));
         }
@@ -747,7 +2394,7 @@ static void StateChangeHandler(ke_msg_id_t msg_id, const void *param_p,
 
         case APP_BLE_CONNECTED:
         {
-        	// Ӻʱ
+        	// 连接后，清楚定时器
             ke_timer_clear(APP_DFU_SUPERVISOR_TIMER, TASK_APP);
         }
         break;
@@ -755,13 +2402,25 @@ static void StateChangeHandler(ke_msg_id_t msg_id, const void *param_p,
         case APP_BLE_LINKUP:
         {
             current_msg.state = MSG_WAIT;
+            current_msg.held  = false;
             image_download.state = PROG_SUCCESS;
+            memset(&transaction, 0, sizeof(transaction));
+#ifdef CFG_DFU_SPARSE
+            sector_hash.nb_sectors = 0;
+            sector_hash.hash_cnt   = 0;
+            sector_hash.tx_len     = 0;
+            sector_hash.resp_len   = 0;
+#endif    /* ifdef CFG_DFU_SPARSE */
+#ifdef CFG_DFU_READ_REGION
+            region_read.tx_len     = 0;
+            region_read.resp_len   = 0;
+#endif    /* ifdef CFG_DFU_READ_REGION */
         }
         break;
 
         case APP_BLE_DISCONNECTED:
         {
-        	// Ͽ豸
+        	// 蓝牙断开，设备重启
             Drv_Targ_Reset();
         }
         break;
@@ -773,6 +2432,85 @@ static void StateChangeHandler(ke_msg_id_t msg_id, const void *param_p,
     }
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : void InstallStagedApp(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Installs an application staged behind this FOTA stack by
+ *                 a transaction. The BootLoader only copies the FOTA stack
+ *                 from the download area, so the application is copied on
+ *                 the first start of the new FOTA stack, followed by a reset
+ *                 to start it.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : Flash sectors are erased before they are programmed
+ * ------------------------------------------------------------------------- */
+static void InstallStagedApp(void)
+{
+    static const uint32_t invalid_mark_a[2] = { 0, 0 };
+    uint_fast32_t app_adr = GetAppStart();
+    uint_fast32_t src_adr = app_adr + APP_MAX_SIZE / 2;
+    const vector_table_t        *vector_p = (const void *)src_adr;
+    const Sys_Boot_descriptor_t *dscr_p;
+    uint_fast32_t size;
+    uint_fast32_t offset;
+
+    /* staged application must be linked behind this FOTA stack */
+    if ((vector_p->reset_handler & ~(IMAGE_SECTOR_SIZE - 1)) != app_adr ||
+        vector_p->image_dscr <  app_adr ||
+        vector_p->image_dscr >= app_adr + IMAGE_SECTOR_SIZE)
+    {
+        return;
+    }
+    dscr_p = (const void *)(src_adr + vector_p->image_dscr - app_adr);
+    size   = dscr_p->image_size + sizeof(App_Conf_key_t);
+    if (!CheckBuildID(dscr_p->build_id_a) || size < APP_MIN_SIZE ||
+        app_adr + size > APP_BASE_ADR + APP_MAX_SIZE / 2)
+    {
+        return;
+    }
+
+    Drv_Flash_Unlock();
+
+    /* an installed application makes the staged one outdated */
+    if (App_Conf_GetVersion(APP_CONF_APP_VERSION) != NULL)
+    {
+        Drv_Flash_Program(src_adr, invalid_mark_a);
+        Drv_Flash_Lock();
+        return;
+    }
+
+    /* copy application, the vector is programmed last to mark it as valid */
+    for (offset = 0; offset < size; offset += FLASH_SECTOR_SIZE)
+    {
+        if (!Drv_Flash_Erase(app_adr + offset))
+        {
+            Drv_Flash_Lock();
+            return;
+        }
+    }
+    for (offset  = sizeof(flash_quantum_t);
+         offset  < size;
+         offset += sizeof(flash_quantum_t))
+    {
+        if (!Drv_Flash_Program(app_adr + offset,
+                               (const uint32_t *)(src_adr + offset)))
+        {
+            Drv_Flash_Lock();
+            return;
+        }
+    }
+    if (!Drv_Flash_Program(app_adr, (const uint32_t *)src_adr))
+    {
+        Drv_Flash_Lock();
+        return;
+    }
+
+    /* invalidate staged application and start the installed one */
+    Drv_Flash_Program(src_adr, invalid_mark_a);
+    Drv_Flash_Lock();
+    Drv_Targ_Reset();
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : bool App_Hdlc_DataInd(const uint8_t *data_p,
  *                                       uint_fast16_t  size)
@@ -788,9 +2526,41 @@ static void StateChangeHandler(ke_msg_id_t msg_id, const void *param_p,
 bool App_Hdlc_DataInd(uint_fast8_t link,
                       const uint8_t *data_p, uint_fast16_t size)
 {
+    App_Stat_Count(APP_STAT_RX_BYTES, size);
     return DataInd(&current_msg, data_p, size);
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Hdlc_RxBufferReq(uint_fast8_t       link,
+ *                                           App_Hdlc_buffer_t *buf_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Offers the free space of the programming ring for the
+ *                 next SDU of a plain image download, which StoreImage()
+ *                 would copy there unchanged anyway.
+ * Inputs        : link             - link ID
+ * Outputs       : buf_p            - ring buffer
+ * Outputs       : return value     - true  SDU is received in place
+ *                                  - false SDU is received in the frame
+ *                                      buffer
+ * Assumptions   : link is up
+ * ------------------------------------------------------------------------- */
+bool App_Hdlc_RxBufferReq(uint_fast8_t link, App_Hdlc_buffer_t *buf_p)
+{
+    message_t   *msg_p = &current_msg;
+    image_dnl_t *dnl_p = &image_download;
+
+    if (msg_p->state != MSG_DATA || msg_p->header.code != IMAGE_DDOWNLOAD)
+    {
+        return false;
+    }
+
+    buf_p->ring_p = (uint8_t *)msg_p->body_a;
+    buf_p->size   = sizeof(msg_p->body_a);
+    buf_p->pos    = dnl_p->rx_len % sizeof(msg_p->body_a);
+    buf_p->free   = sizeof(msg_p->body_a) - GetRingLevel(dnl_p);
+    return true;
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void App_Hdlc_DataCfm(uint_fast8_t   link,
  *                                       const uint8_t *data_p)
@@ -803,6 +2573,54 @@ bool App_Hdlc_DataInd(uint_fast8_t link,
  * ------------------------------------------------------------------------- */
 void App_Hdlc_DataCfm(uint_fast8_t link, const uint8_t *data_p)
 {
+#ifdef CFG_DFU_SPARSE
+    /* continue a pending sector hash response */
+    if (sector_hash.tx_len < sector_hash.resp_len)
+    {
+        SectorHashResp(&sector_hash);
+    }
+#endif    /* ifdef CFG_DFU_SPARSE */
+#ifdef CFG_DFU_READ_REGION
+    /* continue a pending region read response */
+    if (region_read.tx_len < region_read.resp_len)
+    {
+        ReadRegionResp(&region_read);
+    }
+#endif    /* ifdef CFG_DFU_READ_REGION */
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Hdlc_ResetInd(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Fails the current message after the link was
+ *                 re-established without syncing the queues, a message
+ *                 part may have been lost or may be indicated twice. The
+ *                 message is answered with IMAGE_DNL_LINK_RESET and the
+ *                 next SDU is taken as the begin of a new message.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   : link is up
+ * ------------------------------------------------------------------------- */
+void App_Hdlc_ResetInd(uint_fast8_t link)
+{
+    message_t *msg_p = &current_msg;
+
+    if (msg_p->state != MSG_WAIT)
+    {
+        if (image_download.state == PROG_ONGOING)
+        {
+            Drv_Flash_Lock();
+            image_download.state   = PROG_FAILURE;
+            image_download.failure = IMAGE_DNL_LINK_RESET;
+        }
+        ImageDownloadResp(msg_p, IMAGE_DNL_LINK_RESET);
+        msg_p->state    = MSG_WAIT;
+        msg_p->held     = false;
+        msg_p->held_len = 0;
+
+        /* a busy receiver is released by App_Dfu_Poll() */
+        Drv_Targ_SetBackgroundFlag();
+    }
 }
 
 /* ----------------------------------------------------------------------------
@@ -818,8 +2636,11 @@ void App_Dfu_Init(void)
     image_download.state = PROG_SUCCESS;
 
     MsgHandler_Add(SYS_MAN_STATE_CHANGE_IND, StateChangeHandler);
-    // ʱ㲥ʱԺ󣬽
+    // 超时函数，广播超时以后，进行重新启动
     MsgHandler_Add(APP_DFU_SUPERVISOR_TIMER, TimeoutHandler);
+    MsgHandler_Add(APP_DFU_RESET_TIMER, ResetHandler);
+
+    InstallStagedApp();
 }
 
 /* ----------------------------------------------------------------------------
@@ -832,8 +2653,46 @@ void App_Dfu_Init(void)
  * ------------------------------------------------------------------------- */
 void App_Dfu_Poll(void)
 {
-    if (ProgramImage(&current_msg, &image_download))
+    message_t   *msg_p = &current_msg;
+    image_dnl_t *dnl_p = &image_download;
+
+    if (ProgramImage(msg_p, dnl_p))
+    {
+        Drv_Targ_SetBackgroundFlag();
+    }
+#ifdef CFG_DFU_SPARSE
+    else if (HashSector(&sector_hash))
     {
         Drv_Targ_SetBackgroundFlag();
     }
+#endif    /* ifdef CFG_DFU_SPARSE */
+
+    /* go on with a message part or end which waited for flash memory */
+    if (msg_p->held)
+    {
+        uint_fast16_t size = msg_p->held_len;
+
+        msg_p->held     = false;
+        msg_p->held_len = 0;
+        if (size > 0 && msg_p->state == MSG_DATA)
+        {
+            HandleMsg(msg_p, msg_p->held_a, size);
+        }
+        EndMsg(msg_p);
+        if (msg_p->held)
+        {
+            Drv_Targ_SetBackgroundFlag();
+        }
+    }
+
+    /* let the peer go on once the ring has room for its SDU, a residue
+     * below a flash quantum or a failed download cannot drain further */
+    if (msg_p->busy_size != 0 && !msg_p->held &&
+        (msg_p->state != MSG_DATA || dnl_p->state != PROG_ONGOING ||
+         GetRingLevel(dnl_p) < sizeof(flash_quantum_t) ||
+         GetRingLevel(dnl_p) + msg_p->busy_size <= sizeof(msg_p->body_a)))
+    {
+        msg_p->busy_size = 0;
+        App_Hdlc_ReadyReq(0);
+    }
 }
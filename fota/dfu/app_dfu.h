@@ -27,6 +27,7 @@
 
 #define APP_DFU_MSGS            \
     APP_DFU_SUPERVISOR_TIMER,   \
+    APP_DFU_RESET_TIMER,        \
 
 /* ----------------------------------------------------------------------------
  * Function prototypes
@@ -17,13 +17,16 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <string.h>
 #include <rsl10.h>
 #include <rsl10_ke.h>
 
 #include "app_hdlc.h"
 #include "app_ble.h"
+#include "app_stat.h"
 #include "sys_man.h"
 #include "msg_handler.h"
+#include "drv_targ.h"
 
 /* ----------------------------------------------------------------------------
  * Defines
@@ -37,21 +40,79 @@
 #define CRC_CCITT_GOOD          0x0F47
 #define CRC_CCITT_SIZE          sizeof(crc_ccitt_t)
 
-#define FRAME_OVERHEAD          (MIN_FRAME_LEN + 3)
+#define COBS_MAX_CODE           0xFF    /* block of 254 octets, no zero follows */
 #define FRAME_FLAG              0x00
 #define FRAME_HDR_SIZE          1
-#define MIN_FRAME_LEN           (FRAME_HDR_SIZE + CRC_CCITT_SIZE)
-#define MAX_FRAME_LEN           (MIN_FRAME_LEN + CFG_HDLC_SDU_MAX_SIZE)
+#define FRAME_HDR_EXT_SIZE      2       /* I and S frames in modulo 128 mode */
+#define MAX_FRAME_LEN           (FRAME_HDR_EXT_SIZE + CRC_CCITT_SIZE + \
+                                 CFG_HDLC_SDU_MAX_SIZE)
 
-#define INC_SEQNUM(v)           (v = ((v) + 1) & SEQNUM_MASK)
+#define INC_SEQNUM(s, v)        (v = ((v) + 1) & (s)->seq_mask)
 #define SEQNUM_INVALID          -1
 #define SEQNUM_MASK             0x07
+#define SEQNUM_EXT_MASK         0x7F
+#define SYNC_TOGGLE             0x80    /* flips with every own SABM or SABME */
+#define SYNC_NONE               0x100   /* no SABM or SABME info to repeat */
 #define NR_POS                  5
 #define NS_POS                  1
 
+/* control field in modulo 128 mode, first octet in the low byte */
+#define NR_EXT_POS              9
+#define PF_EXT                  0x100
+
+/* ZeroFreeLength scans for the flag a word at a time */
+#if (FRAME_FLAG != 0)
+    #error FRAME_FLAG must be zero
+#endif
+
+/* T200 expiries in a row, with the backoff about 8 s from CFG_HDLC_T200_MIN */
+#define HDLC_N200_RC            8
+
+/* T200 in kernel timer ticks, round-trip times in cycle counter ticks */
+#define CYCLES_PER_TICK         (10000 * DRV_TARG_CYCLES_PER_US)    /* 10 ms */
+#define T200_INIT               ((uint16_t)KE_TIME_IN_SEC(CFG_HDLC_T200))
+#define T200_MIN                ((uint16_t)KE_TIME_IN_SEC(CFG_HDLC_T200_MIN))
+#define T200_MAX                ((uint16_t)KE_TIME_IN_SEC(CFG_HDLC_T200_MAX))
+
+/* may be overridden on the command line (tools/dfusim) */
+#ifndef HDLC_WINDOW_SIZE
+#define HDLC_WINDOW_SIZE        4
+#endif
+#if !defined(HDLC_EXT_WINDOW_SIZE) && defined(CFG_HDLC_EXT_WINDOW_SIZE)
+#define HDLC_EXT_WINDOW_SIZE    CFG_HDLC_EXT_WINDOW_SIZE
+#endif
+
+#if (HDLC_WINDOW_SIZE < 1 || HDLC_WINDOW_SIZE > SEQNUM_MASK)
+    #error HDLC_WINDOW_SIZE must be smaller than the modulus 8
+#endif
+
+/* the I frame queue is indexed by the sequence number modulo its size,
+ * a power of two which divides both moduli */
+#if !defined(HDLC_EXT_WINDOW_SIZE)
 #define I_QUEUE_SIZE            (SEQNUM_MASK + 1)
-#define HDLC_WINDOW_SIZE        4    /* must be smaller than I_QUEUE_SIZE */
-#define HDLC_N200_RC            2
+#elif (HDLC_EXT_WINDOW_SIZE < 1 || HDLC_EXT_WINDOW_SIZE > 64)
+    #error HDLC_EXT_WINDOW_SIZE must be in the range 1 to 64
+#elif (HDLC_EXT_WINDOW_SIZE > 32)
+#define I_QUEUE_SIZE            64
+#elif (HDLC_EXT_WINDOW_SIZE > 16)
+#define I_QUEUE_SIZE            32
+#elif (HDLC_EXT_WINDOW_SIZE > 8)
+#define I_QUEUE_SIZE            16
+#else
+#define I_QUEUE_SIZE            (SEQNUM_MASK + 1)
+#endif
+
+#define I_QUEUE_ENTRY(s, v)     ((s)->i_queue_a[(v) & (I_QUEUE_SIZE - 1)])
+
+/* out-of-sequence I frames within the window, indexed like the I queue */
+#define SREJ_QUEUE_ENTRY(s, v)  ((s)->srej_queue_a[(v) & (I_QUEUE_SIZE - 1)])
+
+/* largest fragment handed to App_Ble_DataReq */
+#if defined(CFG_BLE_LECB) && (CFG_BLE_LECB_MAX_DATA_SIZE > CFG_BLE_MAX_DATA_SIZE)
+#define MAX_FRAGMENT_SIZE       CFG_BLE_LECB_MAX_DATA_SIZE
+#else
+#define MAX_FRAGMENT_SIZE       CFG_BLE_MAX_DATA_SIZE
+#endif
 
 /* ----------------------------------------------------------------------------
  * Local variables and types
@@ -137,12 +198,43 @@ typedef struct
     hdlc_seqnum_t vs;
     hdlc_seqnum_t vq;
     hdlc_seqnum_t vr;
+    hdlc_seqnum_t vm;       /* N(S) following the highest I frame sent */
+    hdlc_seqnum_t seq_mask; /* modulus - 1 */
+    uint8_t hdr_size;       /* control field size of I and S frames */
+    uint8_t window;
+    bool mode_pending;      /* SABM or SABME sent, UA not yet received */
     bool peer_reveiver_busy;
     bool own_receiver_busy;
+    bool rx_discarded;      /* I frame discarded while own receiver busy */
+    bool rx_delivered;      /* SDU indicated since the last reset */
+    hdlc_seqnum_t va_reset; /* N(S) before the reset of the first queued SDU */
+    uint8_t sync_tx;        /* info field of SABM, SABME and UA: V(R) before
+                             * the reset and SYNC_TOGGLE */
+    uint16_t sync_rx;       /* info field of the last SABM, SABME or UA
+                             * taken, SYNC_NONE once an I or S frame
+                             * followed */
+    bool reject_sent;       /* REJ sent, expected I frame not yet received */
     bool ack_pending;
-    uint8_t s_frame_pending;
+    bool poll_pending;      /* RR or RNR with P sent, F not yet received */
+    uint32_t final_time;    /* cycle counter when a poll was last answered */
+    uint16_t s_frame_pending;
     uint8_t rc;
+    bool rtt_timing;        /* I frame rtt_ns sent once, not yet acknowledged */
+    hdlc_seqnum_t rtt_ns;
+    uint32_t rtt_start;     /* cycle counter when rtt_ns was sent */
+    uint32_t srtt;          /* 8 x smoothed round-trip time [cycles], 0 if
+                             * not measured yet */
+    uint32_t rttvar;        /* 4 x round-trip time variation [cycles] */
+    uint16_t t200;          /* [10 ms] */
+    uint8_t backoff;        /* T200 doublings since the last RTT sample */
     hdls_queue_entry_t i_queue_a[I_QUEUE_SIZE];
+#ifdef CFG_HDLC_SREJ_BUFFER_SIZE
+    hdlc_seqnum_t vh;       /* N(S) following the received or SREJ frames */
+    uint8_t srej_count;     /* out-of-sequence I frames held */
+    uint16_t srej_used;     /* used octets of srej_buf_a */
+    hdls_queue_entry_t srej_queue_a[I_QUEUE_SIZE];
+    uint8_t srej_buf_a[CFG_HDLC_SREJ_BUFFER_SIZE];
+#endif    /* ifdef CFG_HDLC_SREJ_BUFFER_SIZE */
 } hdlc_state_t;
 
 typedef uint16_t crc_ccitt_t;
@@ -163,16 +255,31 @@ typedef struct
 {
     coder_state_t state;
     uint16_t max_size;
+    uint16_t frag_size;
     uint16_t seq_nb;
-    uint8_t fragment_a[CFG_BLE_MAX_DATA_SIZE];
+    uint8_t credits;        /* App_Ble_DataReq calls left until confirmed */
+
+    /* frame being encoded */
+    uint8_t hdr_size;
+    uint16_t header;
+    const uint8_t *data_p;
+    uint16_t size;
+    uint8_t crc_a[CRC_CCITT_SIZE];
+    uint16_t pos;           /* next frame octet to encode */
+    uint16_t end;           /* end of the current COBS block */
+    uint16_t next;          /* start of the next COBS block */
 } encoder_state_t;
 
 typedef struct
 {
     coder_state_t state;
     int16_t cobs_cnt;
+    uint8_t cobs_code;
     crc_ccitt_t frame_crc;
     uint16_t frame_len;
+    uint16_t tail;
+    bool in_place;
+    App_Hdlc_buffer_t rx_buf;
     uint8_t frame_a[MAX_FRAME_LEN];
 } decoder_state_t;
 
@@ -181,82 +288,239 @@ static encoder_state_t encoder_state_a[CFG_HDLC_NB_LINKS];
 static decoder_state_t decoder_state_a[CFG_HDLC_NB_LINKS];
 
 /* ----------------------------------------------------------------------------
- * Function      : bool EncodeFrame(uint_fast8_t link, uint_fast8_t header,
+ * Function      : uint_fast16_t GetFragmentSize(uint_fast16_t max_size)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the fragment size used by the encoder.
+ * Inputs        : max_size         - max. data size for App_Ble_DataReq
+ * Outputs       : return value     - fragment size
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint_fast16_t GetFragmentSize(uint_fast16_t max_size)
+{
+    return (max_size < MAX_FRAGMENT_SIZE) ? max_size : MAX_FRAGMENT_SIZE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast8_t GetHeaderSize(const hdlc_state_t *state_p,
+ *                                            uint_fast8_t        octet)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the control field size of a frame. U frames have
+ *                 a single octet in both modes.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : octet            - first octet of the control field
+ * Outputs       : return value     - control field size
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint_fast8_t GetHeaderSize(const hdlc_state_t *state_p,
+                                  uint_fast8_t octet)
+{
+    return ((octet & FRAME_MASK) == U_FRAME) ? FRAME_HDR_SIZE :
+                                               state_p->hdr_size;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t EncodeFragment(encoder_state_t *state_p,
+ *                                              uint8_t         *buf_p,
+ *                                              uint_fast16_t    max_len)
+ * ----------------------------------------------------------------------------
+ * Description   : COBS encodes the next part of the frame of the encoder
+ *                 into the buffer of a BLE fragment, header, SDU and FCS
+ *                 are read in place. The length of each COBS block is
+ *                 determined before its code octet is written, so that the
+ *                 encoding can stop at any fragment boundary.
+ * Inputs        : state_p          - pointer to encoder state
+ * Inputs        : buf_p            - pointer to fragment
+ * Inputs        : max_len          - fragment size
+ * Outputs       : return value     - fragment length
+ * Assumptions   : a frame is being encoded
+ * ------------------------------------------------------------------------- */
+static uint_fast16_t EncodeFragment(encoder_state_t *state_p, uint8_t *buf_p,
+                                    uint_fast16_t max_len)
+{
+    /* octet i of header, SDU and FCS */
+    #define FRAME_OCTET(i)                                              \
+        ((i) < hdr_size        ? (uint8_t)(header >> 8 * (i))       :   \
+         (i) < hdr_size + size ? data_p[(i) - hdr_size]            :   \
+                                 crc_a[(i) - size - hdr_size])
+
+    uint_fast16_t  header    = state_p->header;
+    uint_fast8_t   hdr_size  = state_p->hdr_size;
+    const uint8_t *data_p    = state_p->data_p;
+    uint_fast16_t  size      = state_p->size;
+    const uint8_t *crc_a     = state_p->crc_a;
+    uint_fast16_t  frame_len = hdr_size + size + CRC_CCITT_SIZE;
+    uint_fast16_t  pos       = state_p->pos;
+    uint_fast16_t  end       = state_p->end;
+    uint_fast16_t  run;
+    uint_fast16_t  len       = 0;
+
+    while (len < max_len && state_p->state != ENCODE_IDLE)
+    {
+        if (pos < end)
+        {
+            /* rest of the current block */
+            run = (end - pos < max_len - len) ? end - pos : max_len - len;
+            for (end = pos + run; pos < end; pos++)
+            {
+                buf_p[len++] = FRAME_OCTET(pos);
+            }
+            end = state_p->end;
+        }
+        else if (state_p->state == ENCODE_HDR)
+        {
+            buf_p[len++]   = FRAME_FLAG;
+            state_p->state = ENCODE_DATA;
+        }
+        else if (state_p->next <= frame_len)
+        {
+            /* length of the next block up to a zero or the frame end */
+            pos = state_p->next;
+            run = 0;
+            while (run < COBS_MAX_CODE - 1 && pos + run < frame_len &&
+                   FRAME_OCTET(pos + run) != FRAME_FLAG)
+            {
+                run++;
+            }
+            buf_p[len++]  = run + 1;
+            end           = pos + run;
+            state_p->end  = end;
+
+            /* skip the zero replaced by the next code octet */
+            state_p->next = (run < COBS_MAX_CODE - 1) ? end + 1 : end;
+        }
+        else
+        {
+            buf_p[len++]   = FRAME_FLAG;
+            state_p->state = ENCODE_IDLE;
+        }
+    }
+    state_p->pos = pos;
+    return len;
+
+    #undef FRAME_OCTET
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void SendFragments(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends fragments of the frame being encoded over BLE while
+ *                 there are credits. Each fragment is encoded directly into
+ *                 the message of the BLE stack. App_Ble_DataCfm returns the
+ *                 credits.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void SendFragments(uint_fast8_t link)
+{
+    encoder_state_t *state_p = &encoder_state_a[link];
+    uint8_t         *buf_p;
+    uint_fast16_t    len;
+
+    while (state_p->state != ENCODE_IDLE && state_p->credits > 0)
+    {
+        buf_p = App_Ble_DataAlloc(link, state_p->frag_size);
+        if (buf_p == NULL)
+        {
+            /* link down, the frame is lost */
+            state_p->state = ENCODE_IDLE;
+            break;
+        }
+        len = EncodeFragment(state_p, buf_p, state_p->frag_size);
+        state_p->credits--;
+        App_Ble_DataReq(link, state_p->seq_nb++, buf_p, len);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool EncodeFrame(uint_fast8_t link, uint_fast16_t header,
  *                                  const uint8_t *data_p, uint_fast16_t size)
  * ----------------------------------------------------------------------------
- * Description   : Builds a frame from header, SDU and FCS, COBS encodes it
- *                 and sends it over BLE.
+ * Description   : Builds a frame from header, SDU and FCS and starts sending
+ *                 it over BLE. Frames larger than a BLE fragment are sent as
+ *                 several fragments, the receiver reassembles them from the
+ *                 byte stream. A frame is only accepted while there are
+ *                 credits and no other frame waits for them, so that frames
+ *                 not yet sent stay in the queues of the link. SABM, SABME
+ *                 and UA get sync_tx as info field, see SyncIQueue().
  * Inputs        : link             - link ID
- * Inputs        : header           - frame header
- * Inputs        : data_p           - pointer to SDU
+ * Inputs        : header           - frame header (control field)
+ * Inputs        : data_p           - pointer to SDU, valid until sent
  * Inputs        : size             - SDU size
  * Outputs       : return value     - true  if BLE transmitter is ready
  * Outputs       : return value     - false if BLE transmitter is busy
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static bool EncodeFrame(uint_fast8_t link, uint_fast8_t header,
+static bool EncodeFrame(uint_fast8_t link, uint_fast16_t header,
                         const uint8_t *data_p, uint_fast16_t size)
 {
-    #define COBS_ENCODE(o)          \
-        octet = (o) & 0xFF;         \
-        if (octet == FRAME_FLAG)    \
-        {                           \
-            *code_p = code;         \
-            code_p  = dst_p++;      \
-            code    = 0x01;         \
-        }                           \
-        else                        \
-        {                           \
-            *dst_p++ = octet;       \
-            code++;                 \
-        }
-
-    uint_fast8_t octet;
-    crc_ccitt_t crc;
-    encoder_state_t    *state_p   = &encoder_state_a[link];
-    uint_fast8_t code      = FRAME_FLAG;
-    uint8_t            *dst_p     = state_p->fragment_a;
-    uint8_t            *code_p    = dst_p++;
+    encoder_state_t *state_p  = &encoder_state_a[link];
+    uint_fast8_t     hdr_size = GetHeaderSize(&hdlc_state_a[link], header);
+    crc_ccitt_t      crc;
+    uint_fast16_t    pos;
 
-    if (size > state_p->max_size)
+    if (size > state_p->max_size || state_p->state != ENCODE_IDLE ||
+        state_p->credits == 0)
     {
         return false;
     }
+    if (header == SABM || header == SABME || header == UA)
+    {
+        /* V(R) before the reset, also when sent from s_frame_pending */
+        data_p = &hdlc_state_a[link].sync_tx;
+        size   = sizeof(hdlc_state_a[link].sync_tx);
+    }
 
     /* Select correct CRC algorithm for FCS */
     CRC->CTRL  = CRC_CCITT_CONF;
     CRC->VALUE = CRC_CCITT_INIT_VALUE;
-    COBS_ENCODE(FRAME_FLAG);
-    COBS_ENCODE(CRC->ADD_8 = header);
-    for (; size > 0; size--)
+    for (pos = 0; pos < hdr_size; pos++)
+    {
+        CRC->ADD_8 = header >> 8 * pos;
+    }
+    for (pos = 0; pos < size; pos++)
     {
-        COBS_ENCODE(CRC->ADD_8 = *data_p++);
+        CRC->ADD_8 = data_p[pos];
     }
     crc = CRC->FINAL;
-    COBS_ENCODE(crc >> 0);
-    COBS_ENCODE(crc >> 8);
-    *code_p  = code;
-    *dst_p++ = FRAME_FLAG;
-
-    size = dst_p - state_p->fragment_a;
-    App_Ble_DataReq(link, state_p->seq_nb++, state_p->fragment_a, size);
+    state_p->crc_a[0] = crc >> 0;
+    state_p->crc_a[1] = crc >> 8;
+
+    state_p->state    = ENCODE_HDR;
+    state_p->hdr_size = hdr_size;
+    state_p->header   = header;
+    state_p->data_p   = data_p;
+    state_p->size     = size;
+    state_p->pos      = 0;
+    state_p->end      = 0;
+    state_p->next     = 0;
+    SendFragments(link);
 
     return true;
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : uint_fast16_t DecodeFrameType(const uint8_t *frame_p)
+ * Function      : uint_fast16_t DecodeFrameType(const hdlc_state_t *state_p,
+ *                                               const uint8_t      *frame_p)
  * ----------------------------------------------------------------------------
  * Description   : Decodes a frame header.
+ * Inputs        : state_p          - pointer to HDLC state vector
  * Inputs        : frame_p          - pointer to frame
  * Outputs       : return value     - frame type code
  *                                    (NO_FRAME for unknown frames)
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static uint_fast16_t DecodeFrameType(const uint8_t *frame_p)
+static uint_fast16_t DecodeFrameType(const hdlc_state_t *state_p,
+                                     const uint8_t *frame_p)
 {
     uint_fast16_t header = *frame_p;
 
+    if (GetHeaderSize(state_p, header) == FRAME_HDR_EXT_SIZE)
+    {
+        /* move the P/F bit of the second octet to its basic position */
+        header = (header & 0x0F) | ((frame_p[1] & PF_EXT >> 8) ? P_1 : 0);
+    }
+
     switch (header & FRAME_MASK)
     {
         case U_FRAME:
@@ -294,20 +558,6 @@ static uint_fast16_t DecodeFrameType(const uint8_t *frame_p)
     return NO_FRAME;
 }
 
-/* ----------------------------------------------------------------------------
- * Function      : void LinkError(hdlc_state_t *state_p, link_errors_t error)
- * ----------------------------------------------------------------------------
- * Description   : Handles an uncorrectable link error.
- * Inputs        : state_p          - pointer to HDLC state vector
- * Inputs        : error            - lenk error ID
- * Outputs       : None
- * Assumptions   :
- * ------------------------------------------------------------------------- */
-static void LinkError(hdlc_state_t *state_p, link_errors_t error)
-{
-    /* not implemented */
-}
-
 /* ----------------------------------------------------------------------------
  * Function      : void SendMsg(hdlc_state_t *state_p, ke_msg_id_t msg)
  * ----------------------------------------------------------------------------
@@ -325,7 +575,7 @@ static void SendMsg(hdlc_state_t *state_p, ke_msg_id_t msg)
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : bool SendFrame(hdlc_state_t *state_p, uint_fast8_t header,
+ * Function      : bool SendFrame(hdlc_state_t *state_p, uint_fast16_t header,
  *                                const uint8_t *data_p, uint_fast16_t size)
  * ----------------------------------------------------------------------------
  * Description   : Sends a frame.
@@ -337,7 +587,7 @@ static void SendMsg(hdlc_state_t *state_p, ke_msg_id_t msg)
  * Outputs       : return value     - false if BLE transmitter is busy
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static bool SendFrame(hdlc_state_t *state_p, uint_fast8_t header,
+static bool SendFrame(hdlc_state_t *state_p, uint_fast16_t header,
                       const uint8_t *data_p, uint_fast16_t size)
 {
     /* a pending S frame has priority over a I frame */
@@ -366,18 +616,22 @@ static bool SendFrame(hdlc_state_t *state_p, uint_fast8_t header,
 /* ----------------------------------------------------------------------------
  * Function      : void StartT200(hdlc_state_t *state_p)
  * ----------------------------------------------------------------------------
- * Description   : Starts timer T200 if it is not already running.
+ * Description   : Starts timer T200 if it is not already running, with the
+ *                 value derived from the round-trip time, doubled for each
+ *                 expiry since the last RTT sample.
  * Inputs        : state_p          - pointer to HDLC state vector
  * Outputs       : None
  * Assumptions   :
  * ------------------------------------------------------------------------- */
 static void StartT200(hdlc_state_t *state_p)
 {
-    ke_task_id_t task_id = KE_BUILD_ID(TASK_APP, state_p - hdlc_state_a);
+    ke_task_id_t  task_id = KE_BUILD_ID(TASK_APP, state_p - hdlc_state_a);
+    uint_fast32_t t200    = (uint_fast32_t)state_p->t200 << state_p->backoff;
 
     if (!ke_timer_active(APP_HDLC_T200, task_id))
     {
-        ke_timer_set(APP_HDLC_T200, task_id, KE_TIME_IN_SEC(CFG_HDLC_T200));
+        ke_timer_set(APP_HDLC_T200, task_id,
+                     (t200 < T200_MAX) ? t200 : T200_MAX);
     }
 }
 
@@ -396,12 +650,128 @@ static void StopT200(hdlc_state_t *state_p)
     ke_timer_clear(APP_HDLC_T200, task_id);
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : void BackOffT200(hdlc_state_t *state_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Doubles T200 after an expiry, up to CFG_HDLC_T200_MAX.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void BackOffT200(hdlc_state_t *state_p)
+{
+    if (((uint_fast32_t)state_p->t200 << state_p->backoff) < T200_MAX)
+    {
+        state_p->backoff++;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void TimeIFrame(hdlc_state_t *state_p, hdlc_seqnum_t ns,
+ *                                 bool first)
+ * ----------------------------------------------------------------------------
+ * Description   : Times the round trip of one sent I frame at a time. A
+ *                 frame sent again is not timed, as its acknowledgement
+ *                 may belong to either transmission (Karn's algorithm).
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : ns               - N(S) of the sent I frame
+ * Inputs        : first            - true  sent for the first time
+ * Inputs        : first            - false sent again
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void TimeIFrame(hdlc_state_t *state_p, hdlc_seqnum_t ns, bool first)
+{
+    if (first && !state_p->rtt_timing)
+    {
+        state_p->rtt_timing = true;
+        state_p->rtt_ns     = ns;
+        state_p->rtt_start  = DWT->CYCCNT;
+    }
+    else if (!first && state_p->rtt_ns == ns)
+    {
+        state_p->rtt_timing = false;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void UpdateT200(hdlc_state_t *state_p, uint32_t rtt)
+ * ----------------------------------------------------------------------------
+ * Description   : Updates the smoothed round-trip time and its variation
+ *                 with a new sample and derives T200 from them as the TCP
+ *                 retransmission timeout (RFC 6298): SRTT + 4 x RTTVAR,
+ *                 at least one timer tick more than SRTT.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : rtt              - round-trip time [cycles]
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void UpdateT200(hdlc_state_t *state_p, uint32_t rtt)
+{
+    int32_t  delta;
+    uint32_t t200;
+
+    if (rtt > T200_MAX * CYCLES_PER_TICK)
+    {
+        rtt = T200_MAX * CYCLES_PER_TICK;
+    }
+    if (state_p->srtt == 0)
+    {
+        /* first sample */
+        state_p->srtt   = 8 * rtt;
+        state_p->rttvar = 2 * rtt;
+    }
+    else
+    {
+        /* gains 1/8 and 1/4 */
+        delta = (int32_t)(rtt - state_p->srtt / 8);
+        state_p->srtt += delta;
+        state_p->rttvar += ((delta < 0) ? -delta : delta) -
+                           state_p->rttvar / 4;
+    }
+
+    t200 = state_p->srtt / 8 + ((state_p->rttvar > CYCLES_PER_TICK) ?
+                                state_p->rttvar : CYCLES_PER_TICK);
+    t200 = (t200 + CYCLES_PER_TICK - 1) / CYCLES_PER_TICK;
+    if (t200 < T200_MIN)
+    {
+        t200 = T200_MIN;
+    }
+    else if (t200 > T200_MAX)
+    {
+        t200 = T200_MAX;
+    }
+    state_p->t200    = t200;
+    state_p->backoff = 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : hdlc_seqnum_t GetNR(const hdlc_state_t *state_p,
+ *                                     const uint8_t      *frame_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the value of the N(R) frame header field.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : frame_p          - pointer to frame
+ * Outputs       : return value     - N(R) value
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static hdlc_seqnum_t GetNR(const hdlc_state_t *state_p,
+                           const uint8_t *frame_p)
+{
+    if (state_p->hdr_size == FRAME_HDR_EXT_SIZE)
+    {
+        return frame_p[1] >> (NR_EXT_POS - 8);
+    }
+    return (*frame_p >> NR_POS) & SEQNUM_MASK;
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : hdlc_seqnum_t CheckNR(hdlc_state_t  *state_p,
  *                                       const uint8_t *frame_p)
  * ----------------------------------------------------------------------------
  * Description   : Checks if the value of the N(R) frame header field is
- *                 in the range V(A) <= N(R) <= V(S).
+ *                 in the range V(A) <= N(R) <= V(M). V(M) is V(S) unless
+ *                 the frames from V(S) on are being sent again.
  * Inputs        : state_p          - pointer to HDLC state vector
  * Inputs        : frame_p          - pointer to frame
  * Outputs       : return value     - N(R) value or
@@ -410,10 +780,10 @@ static void StopT200(hdlc_state_t *state_p)
  * ------------------------------------------------------------------------- */
 static hdlc_seqnum_t CheckNR(hdlc_state_t *state_p, const uint8_t *frame_p)
 {
-    hdlc_seqnum_t nr = (*frame_p >> NR_POS) & SEQNUM_MASK;
+    hdlc_seqnum_t nr = GetNR(state_p, frame_p);
 
-    if (((nr - state_p->va) & SEQNUM_MASK) <=
-        ((state_p->vs - state_p->va) & SEQNUM_MASK))
+    if (((nr - state_p->va) & state_p->seq_mask) <=
+        ((state_p->vm - state_p->va) & state_p->seq_mask))
     {
         return nr;
     }
@@ -421,8 +791,8 @@ static hdlc_seqnum_t CheckNR(hdlc_state_t *state_p, const uint8_t *frame_p)
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : hdlc_seqnum_t CheckNS(hdlc_state_t  *state_p,
- *                                       const uint8_t *frame_p)
+ * Function      : hdlc_seqnum_t CheckNS(const hdlc_state_t *state_p,
+ *                                       const uint8_t      *frame_p)
  * ----------------------------------------------------------------------------
  * Description   : Checks if the value of the N(S) frame header field
  *                 equals V(R).
@@ -432,9 +802,10 @@ static hdlc_seqnum_t CheckNR(hdlc_state_t *state_p, const uint8_t *frame_p)
  *                                    SEQNUM_INVALID if unequal
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static hdlc_seqnum_t CheckNS(hdlc_state_t *state_p, const uint8_t *frame_p)
+static hdlc_seqnum_t CheckNS(const hdlc_state_t *state_p,
+                             const uint8_t *frame_p)
 {
-    hdlc_seqnum_t ns = (*frame_p >> NS_POS) & SEQNUM_MASK;
+    hdlc_seqnum_t ns = (*frame_p >> NS_POS) & state_p->seq_mask;
 
     if (ns == state_p->vr)
     {
@@ -460,16 +831,42 @@ static bool InsertInIQueue(hdlc_state_t *state_p,
 {
     hdlc_seqnum_t vq = state_p->vq;
 
-    if (((vq - state_p->va) & SEQNUM_MASK) < HDLC_WINDOW_SIZE)
+    if (((vq - state_p->va) & state_p->seq_mask) < state_p->window)
     {
-        state_p->i_queue_a[vq].data_p = data_p;
-        state_p->i_queue_a[vq].size   = size;
-        INC_SEQNUM(state_p->vq);
+        I_QUEUE_ENTRY(state_p, vq).data_p = data_p;
+        I_QUEUE_ENTRY(state_p, vq).size   = size;
+        INC_SEQNUM(state_p, state_p->vq);
         return true;
     }
     return false;
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t Control(const hdlc_state_t *state_p,
+ *                                       uint_fast16_t       type,
+ *                                       hdlc_seqnum_t       ns,
+ *                                       hdlc_seqnum_t       nr)
+ * ----------------------------------------------------------------------------
+ * Description   : Builds the control field of an I or S frame in the mode
+ *                 of the link.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : type             - frame type code
+ * Inputs        : ns               - N(S) value (0 for S frames)
+ * Inputs        : nr               - N(R) value
+ * Outputs       : return value     - control field
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint_fast16_t Control(const hdlc_state_t *state_p, uint_fast16_t type,
+                             hdlc_seqnum_t ns, hdlc_seqnum_t nr)
+{
+    if (state_p->hdr_size == FRAME_HDR_EXT_SIZE)
+    {
+        return (type & 0x0F) | (ns << NS_POS) |
+               ((type & P_1) ? PF_EXT : 0) | (nr << NR_EXT_POS);
+    }
+    return (type & 0xFF) | (ns << NS_POS) | (nr << NR_POS);
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void TransmitSFrame(hdlc_state_t      *state_p,
  *                                     hdlc_frame_types_t type)
@@ -483,16 +880,15 @@ static bool InsertInIQueue(hdlc_state_t *state_p,
 static void TransmitSFrame(hdlc_state_t *state_p, uint_fast16_t type)
 {
     /* only response frames are supported */
-    uint_fast8_t header = type | (state_p->vr << NR_POS);
-
-    SendFrame(state_p, header, NULL, 0);
+    SendFrame(state_p, Control(state_p, type, 0, state_p->vr), NULL, 0);
     state_p->ack_pending = false;
 }
 
 /* ----------------------------------------------------------------------------
  * Function      : void TransmitIFrames(hdlc_state_t *state_p)
  * ----------------------------------------------------------------------------
- * Description   : Transmits all pending I frames.
+ * Description   : Transmits all pending I frames, unless the peer is busy
+ *                 or a poll is pending.
  * Inputs        : state_p          - pointer to HDLC state vector
  * Outputs       : None
  * Assumptions   :
@@ -501,19 +897,22 @@ static void TransmitIFrames(hdlc_state_t *state_p)
 {
     hdlc_seqnum_t vs;
 
-    if (!state_p->peer_reveiver_busy)
+    if (!state_p->peer_reveiver_busy && !state_p->poll_pending)
     {
-        for (vs = state_p->vs; vs != state_p->vq; INC_SEQNUM(vs))
+        for (vs = state_p->vs; vs != state_p->vq; INC_SEQNUM(state_p, vs))
         {
-            uint_fast8_t header = I_FRAME | P_0 |
-                                  (state_p->vr << NR_POS) |
-                                  (state_p->vs << NS_POS);
-            if (!SendFrame(state_p, header,
-                           state_p->i_queue_a[vs].data_p,
-                           state_p->i_queue_a[vs].size))
+            if (!SendFrame(state_p,
+                           Control(state_p, I_FRAME | P_0, vs, state_p->vr),
+                           I_QUEUE_ENTRY(state_p, vs).data_p,
+                           I_QUEUE_ENTRY(state_p, vs).size))
             {
                 break;
             }
+            TimeIFrame(state_p, vs, vs == state_p->vm);
+            if (vs == state_p->vm)
+            {
+                INC_SEQNUM(state_p, state_p->vm);
+            }
             state_p->ack_pending = false;
             StartT200(state_p);
         }
@@ -521,10 +920,29 @@ static void TransmitIFrames(hdlc_state_t *state_p)
     }
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : void TransmitPending(hdlc_state_t *state_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Transmits the frames held back while the BLE transmitter
+ *                 was busy, the pending S frame first.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void TransmitPending(hdlc_state_t *state_p)
+{
+    if (state_p->s_frame_pending != NO_FRAME)
+    {
+        SendFrame(state_p, state_p->s_frame_pending, NULL, 0);
+    }
+    TransmitIFrames(state_p);
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void DiscardIFrames(hdlc_state_t *state_p, hdlc_seqnum_t nr)
  * ----------------------------------------------------------------------------
  * Description   : Discards I frames up to N(R) from the I frame queue.
+ *                 T200 restarts for the frames still outstanding.
  * Inputs        : state_p          - pointer to HDLC state vector
  * Inputs        : nr               - N(R) value
  * Outputs       : None
@@ -532,136 +950,664 @@ static void TransmitIFrames(hdlc_state_t *state_p)
  * ------------------------------------------------------------------------- */
 static void DiscardIFrames(hdlc_state_t *state_p, hdlc_seqnum_t nr)
 {
-    hdlc_seqnum_t va;
+    bool acked = (state_p->va != nr);
 
-    for (va = state_p->va; va != nr; INC_SEQNUM(va))
+    /* V(A) is updated before the confirmation, so that the upper layer
+     * can immediately reuse the freed queue entry */
+    while (state_p->va != nr)
     {
+        const uint8_t *data_p = I_QUEUE_ENTRY(state_p, state_p->va).data_p;
+
         state_p->rc = 0;
-        App_Hdlc_DataCfm(state_p - hdlc_state_a,
-                         state_p->i_queue_a[va].data_p);
+        if (state_p->rtt_timing && state_p->va == state_p->rtt_ns)
+        {
+            state_p->rtt_timing = false;
+            UpdateT200(state_p, DWT->CYCCNT - state_p->rtt_start);
+        }
+        if (state_p->vs == state_p->va)
+        {
+            /* acknowledged before it was sent again */
+            INC_SEQNUM(state_p, state_p->vs);
+        }
+        INC_SEQNUM(state_p, state_p->va);
+        App_Hdlc_DataCfm(state_p - hdlc_state_a, data_p);
     }
-    if (va == state_p->vs)
+    if (state_p->poll_pending)
+    {
+        /* T200 runs until the poll is answered */
+    }
+    else if (state_p->va == state_p->vs)
+    {
+        StopT200(state_p);
+    }
+    else if (acked)
     {
         StopT200(state_p);
+        StartT200(state_p);
     }
-    state_p->va = va;
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : void EnquiryResponse(hdlc_state_t *state_p)
+ * Function      : void ReverseIQueue(hdlc_state_t *state_p,
+ *                                    uint_fast8_t  first,
+ *                                    uint_fast8_t  last)
  * ----------------------------------------------------------------------------
- * Description   : Sends back the enquiry response.
+ * Description   : Reverses the order of I frame queue entries.
  * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : first            - index of the first entry
+ * Inputs        : last             - index behind the last entry
  * Outputs       : None
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static void EnquiryResponse(hdlc_state_t *state_p)
+static void ReverseIQueue(hdlc_state_t *state_p,
+                          uint_fast8_t first, uint_fast8_t last)
 {
-    /* not implemented */
+    hdls_queue_entry_t entry;
+
+    while (first + 1 < last)
+    {
+        last--;
+        entry = state_p->i_queue_a[first];
+        state_p->i_queue_a[first] = state_p->i_queue_a[last];
+        state_p->i_queue_a[last]  = entry;
+        first++;
+    }
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : void SFrameInd(hdlc_state_t *state_p, const uint8_t *frame_p)
+ * Function      : void RenumberIQueue(hdlc_state_t *state_p)
  * ----------------------------------------------------------------------------
- * Description   : Handles a received S frame.
+ * Description   : Moves the unacknowledged SDUs from V(A) on to the queue
+ *                 entries from 0 on, by rotating the queue in place, and
+ *                 sets V(Q) to their number. In modulo 8 mode only the
+ *                 first 8 entries are used and rotated.
  * Inputs        : state_p          - pointer to HDLC state vector
- * Inputs        : frame_p          - pointer to frame
  * Outputs       : None
- * Assumptions   :
+ * Assumptions   : V(A) to V(Q) fit the window of the next mode
  * ------------------------------------------------------------------------- */
-static void SFrameInd(hdlc_state_t *state_p, const uint8_t *frame_p)
+static void RenumberIQueue(hdlc_state_t *state_p)
 {
-    hdlc_seqnum_t nr = CheckNR(state_p, frame_p);
+    uint_fast8_t size  = (state_p->seq_mask < I_QUEUE_SIZE) ?
+                         state_p->seq_mask + 1 : I_QUEUE_SIZE;
+    uint_fast8_t first = state_p->va & (size - 1);
+
+    ReverseIQueue(state_p, 0, first);
+    ReverseIQueue(state_p, first, size);
+    ReverseIQueue(state_p, 0, size);
+    state_p->vq = (state_p->vq - state_p->va) & state_p->seq_mask;
+}
 
-    if (nr >= 0)
+/* ----------------------------------------------------------------------------
+ * Function      : bool SyncIQueue(hdlc_state_t *state_p, uint_fast8_t info)
+ * ----------------------------------------------------------------------------
+ * Description   : Drops the SDUs the peer received before the reset from
+ *                 the renumbered I frame queue. The info field of the SABM,
+ *                 SABME or UA of the peer holds its V(R) before the reset,
+ *                 V(A) before the reset is kept in va_reset.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : info             - info field of SABM, SABME or UA
+ * Outputs       : return value     - true  if the queue is in sync
+ * Outputs       : return value     - false if the peer received SDUs that
+ *                                      were never sent
+ * Assumptions   : the link was reset, the peer is busy, so that no I frames
+ *                 are sent on App_Hdlc_DataCfm, the mode only changes while
+ *                 no SDUs are queued
+ * ------------------------------------------------------------------------- */
+static bool SyncIQueue(hdlc_state_t *state_p, uint_fast8_t info)
+{
+    hdlc_seqnum_t count = ((info & SEQNUM_EXT_MASK) - state_p->va_reset) &
+                          state_p->seq_mask;
+
+    if (count > state_p->vq)
     {
-        DiscardIFrames(state_p, nr);
-        TransmitIFrames(state_p);
+        return false;
+    }
+    DiscardIFrames(state_p, count);
+    RenumberIQueue(state_p);
+    state_p->va = 0;
+    state_p->vs = 0;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void ResetLink(hdlc_state_t *state_p, bool extended)
+ * ----------------------------------------------------------------------------
+ * Description   : Resets the state variables and selects the mode of the
+ *                 link, on link activation and on a sent or received SABM
+ *                 or SABME. The unacknowledged SDUs stay queued and are
+ *                 sent again from N(S) 0, a pending acknowledge is dropped.
+ *                 A busy own receiver stays busy until App_Hdlc_ReadyReq.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : extended         - true  modulo 128 mode (SABME)
+ * Inputs        : extended         - false modulo 8 mode (SABM)
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void ResetLink(hdlc_state_t *state_p, bool extended)
+{
+    StopT200(state_p);
+    RenumberIQueue(state_p);
+    state_p->va = 0;
+    state_p->vs = 0;
+    state_p->vr = 0;
+    state_p->vm = 0;
+    state_p->rc = 0;
+    state_p->rtt_timing = false;
+#ifdef HDLC_EXT_WINDOW_SIZE
+    if (extended)
+    {
+        state_p->seq_mask = SEQNUM_EXT_MASK;
+        state_p->hdr_size = FRAME_HDR_EXT_SIZE;
+        state_p->window   = HDLC_EXT_WINDOW_SIZE;
     }
     else
+#endif
     {
-        LinkError(state_p, LINK_ERROR_NR);
+        state_p->seq_mask = SEQNUM_MASK;
+        state_p->hdr_size = FRAME_HDR_SIZE;
+        state_p->window   = HDLC_WINDOW_SIZE;
     }
+    state_p->mode_pending       = false;
+    state_p->poll_pending       = false;
+    state_p->peer_reveiver_busy = false;
+    state_p->rx_discarded       = false;
+    state_p->reject_sent        = false;
+    state_p->ack_pending        = false;
+    state_p->s_frame_pending    = NO_FRAME;
+#ifdef CFG_HDLC_SREJ_BUFFER_SIZE
+    memset(state_p->srej_queue_a, 0, sizeof(state_p->srej_queue_a));
+    state_p->vh         = 0;
+    state_p->srej_count = 0;
+    state_p->srej_used  = 0;
+#endif    /* ifdef CFG_HDLC_SREJ_BUFFER_SIZE */
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : void IFrameInd(hdlc_state_t  *state_p,
- *                                const uint8_t *frame_p, uint_fast16_t len)
+ * Function      : void LinkEstablished(hdlc_state_t *state_p, bool synced)
  * ----------------------------------------------------------------------------
- * Description   : Handles a received I frame.
+ * Description   : Goes on after a SABM or SABME was answered by UA. A busy
+ *                 own receiver is announced by RNR, as the peer assumes a
+ *                 ready one. If SDUs were indicated since the last reset
+ *                 and the peer could not drop them from its queue, the
+ *                 upper layer is told that SDUs may be lost or repeated.
  * Inputs        : state_p          - pointer to HDLC state vector
- * Inputs        : frame_p          - pointer to frame
- * Inputs        : len              - frame length (excluding FCS)
+ * Inputs        : synced           - true  the queues were synced
+ * Inputs        : synced           - false the peer sent no V(R) or the
+ *                                      own queue could not be synced
  * Outputs       : None
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static void IFrameInd(hdlc_state_t *state_p,
-                      const uint8_t *frame_p, uint_fast16_t len)
+static void LinkEstablished(hdlc_state_t *state_p, bool synced)
 {
-    hdlc_seqnum_t ns = CheckNS(state_p, frame_p);
-    // æͨnotifyظ
     if (state_p->own_receiver_busy)
     {
         TransmitSFrame(state_p, RNR | F_0);
     }
-    else if (ns < 0)
-    {
-        TransmitSFrame(state_p, REJ | F_0);
-    }
-    // 
-    else
+    if (state_p->rx_delivered && !synced)
     {
-        if (!state_p->ack_pending)
-        {
-            SendMsg(state_p, APP_HDLC_ACKPEND);
-            state_p->ack_pending = true;
-        }
-        INC_SEQNUM(state_p->vr);
-        // 洢
-        state_p->own_receiver_busy =
-            !App_Hdlc_DataInd(state_p - hdlc_state_a,
-                              frame_p + FRAME_HDR_SIZE,
-                              len - FRAME_HDR_SIZE);
+        App_Hdlc_ResetInd(state_p - hdlc_state_a);
     }
-    SFrameInd(state_p, frame_p);
+    state_p->rx_delivered = false;
+    TransmitIFrames(state_p);
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : void AckPending(ke_msg_id_t msg_id, const void *param_p,
- *                                 ke_task_id_t dest_id, ke_task_id_t src_id)
+ * Function      : void EstablishLink(hdlc_state_t *state_p, bool extended)
  * ----------------------------------------------------------------------------
- * Description   : Handles the pending acknowledge of a received I frame.
- * Inputs        : msg_id           - always APP_HDLC_ACKPEND
- * Inputs        : frame_p          - always NULL
- * Inputs        : dest_id          - the task responsible for the link
- * Inputs        : src_id           - the task responsible for the link
+ * Description   : Resets the link and sends a SABM or SABME with V(R)
+ *                 before the reset. The I frames are sent after the UA of
+ *                 the peer. A reset started again while the UA is pending
+ *                 keeps the info field, so that the peer takes it once.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : extended         - true  modulo 128 mode (SABME)
+ * Inputs        : extended         - false modulo 8 mode (SABM)
  * Outputs       : None
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static void AckPending(ke_msg_id_t msg_id, const void *param_p,
-                       ke_task_id_t dest_id, ke_task_id_t src_id)
+static void EstablishLink(hdlc_state_t *state_p, bool extended)
 {
-    hdlc_state_t *state_p = &hdlc_state_a[KE_IDX_GET(dest_id)];
-
-    if (state_p->ack_pending)
+    if (!state_p->mode_pending)
     {
-        state_p->ack_pending = false;
-        if (state_p->own_receiver_busy)
-        {
-            TransmitSFrame(state_p, RNR | F_0);
-        }
-        else
-        {
-            TransmitSFrame(state_p, RR | F_0);
-        }
+        state_p->va_reset = state_p->va;
+        state_p->sync_tx  = (~state_p->sync_tx & SYNC_TOGGLE) | state_p->vr;
     }
+    ResetLink(state_p, extended);
+    state_p->mode_pending       = true;
+    state_p->peer_reveiver_busy = true;
+    SendFrame(state_p, (state_p->hdr_size == FRAME_HDR_EXT_SIZE) ?
+                       SABME : SABM, NULL, 0);
+    StartT200(state_p);
 }
 
 /* ----------------------------------------------------------------------------
- * Function      : void T200Expired(ke_msg_id_t msg_id, const void *param_p,
+ * Function      : void LinkError(hdlc_state_t *state_p, link_errors_t error)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles an uncorrectable link error by re-establishing
+ *                 the link in its mode. Both sides restart from sequence
+ *                 number 0, SABM or SABME and UA carry V(R) before the
+ *                 reset, so that each side drops the SDUs already received
+ *                 by the other and sends the rest again, see SyncIQueue().
+ *                 After a reset, the link is only reset again once the
+ *                 peer sent an I or S frame, so that both sides count V(R)
+ *                 from the same reset.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : error            - link error ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void LinkError(hdlc_state_t *state_p, link_errors_t error)
+{
+    if (state_p->sync_rx != SYNC_NONE)
+    {
+        /* nothing received since the last UA, the peer may still wait
+         * for it and needs the same V(R) again, see ModeInd() */
+        state_p->rc = 0;
+        StartT200(state_p);
+        return;
+    }
+    EstablishLink(state_p, state_p->hdr_size == FRAME_HDR_EXT_SIZE);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void ModeInd(hdlc_state_t  *state_p,
+ *                              const uint8_t *sdu_p, uint_fast16_t len,
+ *                              bool           extended)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles a SABM or SABME of the peer. The link is reset,
+ *                 the SDUs the peer received before are dropped and the
+ *                 UA carries V(R) before the reset. A SABM or SABME with
+ *                 the info field taken last, sent again as the UA was
+ *                 lost or crossed by the own one, is only answered again.
+ *                 While an own SABM or SABME is pending, the info field
+ *                 of the peer equals that of its UA and establishes the
+ *                 link as well.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : sdu_p            - pointer to info field
+ * Inputs        : len              - frame length (without FCS)
+ * Inputs        : extended         - true  modulo 128 mode (SABME)
+ * Inputs        : extended         - false modulo 8 mode (SABM)
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void ModeInd(hdlc_state_t *state_p, const uint8_t *sdu_p,
+                    uint_fast16_t len, bool extended)
+{
+    uint_fast16_t info   = (len > FRAME_HDR_SIZE) ? *sdu_p : SYNC_NONE;
+    bool          synced = false;
+
+    if (info != SYNC_NONE && info == state_p->sync_rx)
+    {
+        SendFrame(state_p, UA, NULL, 0);
+        return;
+    }
+    if (!state_p->mode_pending)
+    {
+        state_p->va_reset = state_p->va;
+        state_p->sync_tx  = (state_p->sync_tx & SYNC_TOGGLE) | state_p->vr;
+    }
+    ResetLink(state_p, extended);
+
+    /* no I frames before the UA */
+    state_p->peer_reveiver_busy = true;
+    if (info != SYNC_NONE)
+    {
+        synced = SyncIQueue(state_p, info);
+    }
+    state_p->peer_reveiver_busy = false;
+    state_p->sync_rx = info;
+    SendFrame(state_p, UA, NULL, 0);
+    LinkEstablished(state_p, synced);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void EnquiryResponse(hdlc_state_t *state_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Answers a poll with V(R) in a RR or RNR with the F bit
+ *                 set, at most once per T200. Without an address field a
+ *                 late answer to an own poll looks like a poll, answering
+ *                 such frames only once keeps the peers from answering
+ *                 each other endlessly.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void EnquiryResponse(hdlc_state_t *state_p)
+{
+    uint32_t now = DWT->CYCCNT;
+
+    if (now - state_p->final_time >= state_p->t200 * CYCLES_PER_TICK)
+    {
+        state_p->final_time = now;
+        TransmitSFrame(state_p,
+                       (state_p->own_receiver_busy ? RNR : RR) | F_1);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void SFrameInd(hdlc_state_t *state_p, const uint8_t *frame_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles a received S frame.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : frame_p          - pointer to frame
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void SFrameInd(hdlc_state_t *state_p, const uint8_t *frame_p)
+{
+    hdlc_seqnum_t nr = CheckNR(state_p, frame_p);
+
+    if (nr >= 0)
+    {
+        DiscardIFrames(state_p, nr);
+        TransmitIFrames(state_p);
+        if (state_p->peer_reveiver_busy && state_p->va != state_p->vq)
+        {
+            /* poll the busy peer, the RR ending its busy condition may
+             * be lost */
+            StartT200(state_p);
+        }
+    }
+    else
+    {
+        LinkError(state_p, LINK_ERROR_NR);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Checkpoint(hdlc_state_t  *state_p,
+ *                                 const uint8_t *frame_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles the answer to a poll. The I frames are sent
+ *                 again from its N(R), the first one the peer has not
+ *                 received. A poll of the peer crossing the own one is
+ *                 taken as the answer, it carries the same N(R).
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : frame_p          - pointer to frame
+ * Outputs       : None
+ * Assumptions   : a poll is pending
+ * ------------------------------------------------------------------------- */
+static void Checkpoint(hdlc_state_t *state_p, const uint8_t *frame_p)
+{
+    hdlc_seqnum_t nr = CheckNR(state_p, frame_p);
+
+    if (nr >= 0)
+    {
+        StopT200(state_p);
+        state_p->poll_pending = false;
+        state_p->rc           = 0;
+        if (nr != state_p->vm)
+        {
+            App_Stat_Count(APP_STAT_RETRANSMISSIONS, 1);
+        }
+        state_p->vs = nr;
+    }
+    SFrameInd(state_p, frame_p);
+}
+
+#ifdef CFG_HDLC_SREJ_BUFFER_SIZE
+/* ----------------------------------------------------------------------------
+ * Function      : bool SelectiveReject(hdlc_state_t  *state_p,
+ *                                      const uint8_t *frame_p,
+ *                                      const uint8_t *sdu_p,
+ *                                      uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Holds an out-of-sequence I frame back and requests each
+ *                 missing I frame before it once with a SREJ. Frames behind
+ *                 V(R) are duplicates and ignored.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : frame_p          - pointer to frame
+ * Inputs        : sdu_p            - pointer to SDU
+ * Inputs        : size             - SDU size
+ * Outputs       : return value     - true  frame held back or ignored
+ * Outputs       : return value     - false buffer full or window larger
+ *                                    than half the modulus, REJ is needed
+ * Assumptions   : N(S) is not V(R), no REJ sent
+ * ------------------------------------------------------------------------- */
+static bool SelectiveReject(hdlc_state_t *state_p, const uint8_t *frame_p,
+                            const uint8_t *sdu_p, uint_fast16_t size)
+{
+    hdls_queue_entry_t *entry_p;
+    hdlc_seqnum_t       ns = (*frame_p >> NS_POS) & state_p->seq_mask;
+    hdlc_seqnum_t       vh = state_p->vh;
+
+    if (2 * state_p->window > state_p->seq_mask + 1)
+    {
+        /* resent frames behind V(R) would look like frames ahead of it */
+        return false;
+    }
+    if (((ns - state_p->vr) & state_p->seq_mask) >= state_p->window)
+    {
+        /* acknowledge again, the last RR may have been lost */
+        if (!state_p->ack_pending)
+        {
+            SendMsg(state_p, APP_HDLC_ACKPEND);
+            state_p->ack_pending = true;
+        }
+        return true;
+    }
+    if (state_p->srej_count == 0)
+    {
+        /* first gap since all frames were in sequence */
+        vh = state_p->vr;
+    }
+
+    entry_p = &SREJ_QUEUE_ENTRY(state_p, ns);
+    if (entry_p->data_p == NULL)
+    {
+        if (size + state_p->srej_used > CFG_HDLC_SREJ_BUFFER_SIZE)
+        {
+            return false;
+        }
+        memcpy(&state_p->srej_buf_a[state_p->srej_used], sdu_p, size);
+        entry_p->data_p = &state_p->srej_buf_a[state_p->srej_used];
+        entry_p->size   = size;
+        state_p->srej_used += size;
+        state_p->srej_count++;
+    }
+
+    /* SREJ the gap between the frames received or requested so far and
+     * this one, while the BLE transmitter takes S frames. The rest of the
+     * gap is requested with the next out-of-sequence frame. */
+    if (((ns - state_p->vr) & state_p->seq_mask) >=
+        ((vh - state_p->vr) & state_p->seq_mask))
+    {
+        for (; vh != ns && state_p->s_frame_pending == NO_FRAME;
+             INC_SEQNUM(state_p, vh))
+        {
+            if (SREJ_QUEUE_ENTRY(state_p, vh).data_p == NULL)
+            {
+                App_Stat_Count(APP_STAT_RETRANSMISSIONS, 1);
+                SendFrame(state_p, Control(state_p, SREJ | F_0, 0, vh),
+                          NULL, 0);
+            }
+        }
+        state_p->vh = (vh == ns) ? (ns + 1) & state_p->seq_mask : vh;
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void DeliverIFrames(hdlc_state_t *state_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Delivers the held back I frames following V(R) in
+ *                 sequence, until the own receiver gets busy.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void DeliverIFrames(hdlc_state_t *state_p)
+{
+    hdls_queue_entry_t *entry_p = &SREJ_QUEUE_ENTRY(state_p, state_p->vr);
+
+    while (!state_p->own_receiver_busy && entry_p->data_p != NULL)
+    {
+        const uint8_t *data_p = entry_p->data_p;
+
+        entry_p->data_p = NULL;
+        state_p->srej_count--;
+        INC_SEQNUM(state_p, state_p->vr);
+        state_p->rx_delivered      = true;
+        state_p->own_receiver_busy =
+            !App_Hdlc_DataInd(state_p - hdlc_state_a, data_p, entry_p->size);
+        App_Stat_Count(APP_STAT_RNR_STALLS, state_p->own_receiver_busy);
+        entry_p = &SREJ_QUEUE_ENTRY(state_p, state_p->vr);
+    }
+    if (state_p->srej_count == 0)
+    {
+        state_p->srej_used = 0;
+    }
+}
+#endif    /* ifdef CFG_HDLC_SREJ_BUFFER_SIZE */
+
+/* ----------------------------------------------------------------------------
+ * Function      : void SRejectInd(hdlc_state_t  *state_p,
+ *                                 const uint8_t *frame_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles a received SREJ. Its N(R) is the one I frame
+ *                 requested again, it acknowledges no I frames.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : frame_p          - pointer to frame
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void SRejectInd(hdlc_state_t *state_p, const uint8_t *frame_p)
+{
+    hdlc_seqnum_t nr = GetNR(state_p, frame_p);
+    hdlc_seqnum_t n  = (nr - state_p->va) & state_p->seq_mask;
+
+    if (n < ((state_p->vs - state_p->va) & state_p->seq_mask))
+    {
+        state_p->peer_reveiver_busy = false;
+        if (SendFrame(state_p,
+                      Control(state_p, I_FRAME | P_0, nr, state_p->vr),
+                      I_QUEUE_ENTRY(state_p, nr).data_p,
+                      I_QUEUE_ENTRY(state_p, nr).size))
+        {
+            TimeIFrame(state_p, nr, false);
+            state_p->ack_pending = false;
+        }
+        else
+        {
+            /* transmitter busy, go back to the requested frame */
+            state_p->vs = nr;
+        }
+    }
+    else if (n >= ((state_p->vq - state_p->va) & state_p->seq_mask))
+    {
+        LinkError(state_p, LINK_ERROR_NR);
+    }
+    /* else the frame is sent again after a T200 expiry anyway */
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void IFrameInd(hdlc_state_t  *state_p,
+ *                                const uint8_t *frame_p,
+ *                                const uint8_t *sdu_p, uint_fast16_t len)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles a received I frame.
+ * Inputs        : state_p          - pointer to HDLC state vector
+ * Inputs        : frame_p          - pointer to frame
+ * Inputs        : sdu_p            - pointer to SDU
+ * Inputs        : len              - frame length (excluding FCS)
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void IFrameInd(hdlc_state_t *state_p, const uint8_t *frame_p,
+                      const uint8_t *sdu_p, uint_fast16_t len)
+{
+    hdlc_seqnum_t ns = CheckNS(state_p, frame_p);
+    // 正在忙，通过notify把这个结果返回给主机
+    if (state_p->own_receiver_busy)
+    {
+        state_p->rx_discarded = true;
+        TransmitSFrame(state_p, RNR | F_0);
+    }
+    else if (ns < 0)
+    {
+#ifdef CFG_HDLC_SREJ_BUFFER_SIZE
+        if (!state_p->reject_sent &&
+            SelectiveReject(state_p, frame_p, sdu_p, len - state_p->hdr_size))
+        {
+            /* frame held back or duplicate */
+        }
+        else
+#endif    /* ifdef CFG_HDLC_SREJ_BUFFER_SIZE */
+        /* one REJ per gap, the following frames are out of sequence too */
+        if (!state_p->reject_sent)
+        {
+#ifdef CFG_HDLC_SREJ_BUFFER_SIZE
+            /* the REJ makes the peer resend all frames from V(R), the
+             * held ones must not be acknowledged before they are resent */
+            memset(state_p->srej_queue_a, 0, sizeof(state_p->srej_queue_a));
+            state_p->srej_count = 0;
+            state_p->srej_used  = 0;
+#endif    /* ifdef CFG_HDLC_SREJ_BUFFER_SIZE */
+            state_p->reject_sent = true;
+            App_Stat_Count(APP_STAT_RETRANSMISSIONS, 1);
+            TransmitSFrame(state_p, REJ | F_0);
+        }
+    }
+    // 正常处理数据
+    else
+    {
+        if (!state_p->ack_pending)
+        {
+            SendMsg(state_p, APP_HDLC_ACKPEND);
+            state_p->ack_pending = true;
+        }
+        state_p->reject_sent = false;
+        INC_SEQNUM(state_p, state_p->vr);
+        // 存储数据
+        state_p->rx_delivered      = true;
+        state_p->own_receiver_busy =
+            !App_Hdlc_DataInd(state_p - hdlc_state_a,
+                              sdu_p, len - state_p->hdr_size);
+        App_Stat_Count(APP_STAT_RNR_STALLS, state_p->own_receiver_busy);
+#ifdef CFG_HDLC_SREJ_BUFFER_SIZE
+        DeliverIFrames(state_p);
+#endif    /* ifdef CFG_HDLC_SREJ_BUFFER_SIZE */
+    }
+    SFrameInd(state_p, frame_p);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void AckPending(ke_msg_id_t msg_id, const void *param_p,
+ *                                 ke_task_id_t dest_id, ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles the pending acknowledge of a received I frame.
+ * Inputs        : msg_id           - always APP_HDLC_ACKPEND
+ * Inputs        : frame_p          - always NULL
+ * Inputs        : dest_id          - the task responsible for the link
+ * Inputs        : src_id           - the task responsible for the link
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void AckPending(ke_msg_id_t msg_id, const void *param_p,
+                       ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    hdlc_state_t *state_p = &hdlc_state_a[KE_IDX_GET(dest_id)];
+
+    if (state_p->ack_pending)
+    {
+        state_p->ack_pending = false;
+        if (state_p->own_receiver_busy)
+        {
+            TransmitSFrame(state_p, RNR | F_0);
+        }
+        else
+        {
+            TransmitSFrame(state_p, RR | F_0);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void T200Expired(ke_msg_id_t msg_id, const void *param_p,
  *                                  ke_task_id_t dest_id, ke_task_id_t src_id)
  * ----------------------------------------------------------------------------
- * Description   : Handles the T200 expiry of a sent I frame.
+ * Description   : Handles the T200 expiry of a sent I frame, of a poll or
+ *                 of a sent SABM or SABME. The link is re-established
+ *                 after HDLC_N200_RC expiries without an answer.
  * Inputs        : msg_id           - always APP_HDLC_T200
  * Inputs        : frame_p          - always NULL
  * Inputs        : dest_id          - the task responsible for the link
@@ -674,33 +1620,56 @@ static void T200Expired(ke_msg_id_t msg_id, const void *param_p,
 {
     hdlc_state_t *state_p = &hdlc_state_a[KE_IDX_GET(dest_id)];
 
-    if (++state_p->rc <= HDLC_N200_RC)
+    if (encoder_state_a[KE_IDX_GET(dest_id)].state != ENCODE_IDLE)
     {
-        state_p->vs = state_p->va;
-        TransmitIFrames(state_p);
+        /* a frame is still waiting for BLE credits, the peer cannot
+         * respond before it is sent */
+        StartT200(state_p);
     }
-    else
+    else if (++state_p->rc > HDLC_N200_RC)
     {
         LinkError(state_p, LINK_ERROR_RC);
     }
+    else if (state_p->mode_pending)
+    {
+        /* the SABM or SABME or its UA was lost */
+        BackOffT200(state_p);
+        SendFrame(state_p, (state_p->hdr_size == FRAME_HDR_EXT_SIZE) ?
+                           SABME : SABM, NULL, 0);
+        StartT200(state_p);
+    }
+    else
+    {
+        /* ask the peer for its V(R) instead of sending all outstanding
+         * I frames again, Checkpoint handles the answer */
+        BackOffT200(state_p);
+        state_p->poll_pending = true;
+        TransmitSFrame(state_p,
+                       (state_p->own_receiver_busy ? RNR : RR) | P_1);
+        StartT200(state_p);
+    }
 }
 
 /* ----------------------------------------------------------------------------
  * Function      : void FrameInd(uint_fast8_t   link,
- *                               const uint8_t *frame_p, uint_fast16_t len)
+ *                               const uint8_t *frame_p,
+ *                               const uint8_t *sdu_p, uint_fast16_t len)
  * ----------------------------------------------------------------------------
  * Description   : Handles a received frame.
  * Inputs        : link             - link ID
  * Inputs        : frame_p          - pointer to frame
+ * Inputs        : sdu_p            - pointer to SDU (behind the header or
+ *                                    in the ring buffer)
  * Inputs        : len              - frame length (including FCS)
  * Outputs       : None
  * Assumptions   :
  * ------------------------------------------------------------------------- */
-static void FrameInd(uint_fast8_t link,
-                     const uint8_t *frame_p, uint_fast16_t len)
+static void FrameInd(uint_fast8_t link, const uint8_t *frame_p,
+                     const uint8_t *sdu_p, uint_fast16_t len)
 {
     hdlc_seqnum_t nr;
     hdlc_state_t *state_p =  &hdlc_state_a[link];
+    uint_fast16_t type;
 
     if (len > MAX_FRAME_LEN)
     {
@@ -712,31 +1681,53 @@ static void FrameInd(uint_fast8_t link,
         /* ignore frames with bad FCS */
         return;
     }
-    else if (len < MIN_FRAME_LEN)
+    else if (len < GetHeaderSize(state_p, *frame_p) + CRC_CCITT_SIZE)
     {
         /* ignore too short frames */
         return;
     }
 
     len -= CRC_CCITT_SIZE;
-    // ݣ֡ͷȻж
-    switch (DecodeFrameType(frame_p))
+    type = DecodeFrameType(state_p, frame_p);
+    if ((type & FRAME_MASK) != U_FRAME)
+    {
+        if (state_p->mode_pending)
+        {
+            /* numbered before the peer reset its sequence numbers */
+            return;
+        }
+
+        /* the peer got the UA, a further SABM or SABME is a new one */
+        state_p->sync_rx = SYNC_NONE;
+    }
+
+    // 解析数据，或者数据帧头，然后进行判断
+    switch (type)
     {
         case I_FRAME | P_0:
         {
-            IFrameInd(state_p, frame_p, len);
+            IFrameInd(state_p, frame_p, sdu_p, len);
         }
         break;
 
-        case RR | P_1:
+        case RR | F_1:
+        case RNR | F_1:
         {
-            EnquiryResponse(state_p);
-
-            /* FALL THROUGH */
+            /* all S frames are responses, the P/F bit is the F bit of an
+             * answer while an own poll is pending and a poll otherwise */
+            state_p->peer_reveiver_busy = (type == (RNR | F_1));
+            if (state_p->poll_pending)
+            {
+                Checkpoint(state_p, frame_p);
+            }
+            else
+            {
+                EnquiryResponse(state_p);
+                SFrameInd(state_p, frame_p);
+            }
         }
+        break;
 
-        case RR | P_0:
-        case RR | F_1:
         case RR | F_0:
         {
             state_p->peer_reveiver_busy = false;
@@ -744,15 +1735,6 @@ static void FrameInd(uint_fast8_t link,
         }
         break;
 
-        case RNR | P_1:
-        {
-            EnquiryResponse(state_p);
-
-            /* FALL THROUGH */
-        }
-
-        case RNR | P_0:
-        case RNR | F_1:
         case RNR | F_0:
         {
             state_p->peer_reveiver_busy = true;
@@ -776,6 +1758,60 @@ static void FrameInd(uint_fast8_t link,
         }
         break;
 
+        case SREJ | F_0:
+        {
+            SRejectInd(state_p, frame_p);
+        }
+        break;
+
+        case SABM | CMD_FRAME:
+        {
+            ModeInd(state_p, sdu_p, len, false);
+        }
+        break;
+
+        case SABME | CMD_FRAME:
+        {
+#ifdef HDLC_EXT_WINDOW_SIZE
+            ModeInd(state_p, sdu_p, len, true);
+#else
+            /* modulo 128 mode not supported, the link stays as it is */
+            SendFrame(state_p, DM, NULL, 0);
+#endif
+        }
+        break;
+
+        case DM | RESP_FRAME:
+        {
+            if (state_p->mode_pending)
+            {
+                /* the peer refused the mode, fall back to modulo 8 */
+                ResetLink(state_p, false);
+                LinkEstablished(state_p, false);
+            }
+        }
+        break;
+
+        case UA | RESP_FRAME:
+        {
+            if (state_p->mode_pending)
+            {
+                bool synced = (len > FRAME_HDR_SIZE) &&
+                              SyncIQueue(state_p, *sdu_p);
+
+                /* a crossed SABM or SABME of the peer has the same info
+                 * field, see ModeInd() */
+                state_p->sync_rx = (len > FRAME_HDR_SIZE) ? *sdu_p :
+                                                            SYNC_NONE;
+                StopT200(state_p);
+                state_p->mode_pending       = false;
+                state_p->peer_reveiver_busy = false;
+                state_p->rc                 = 0;
+                LinkEstablished(state_p, synced);
+            }
+        }
+        break;
+
         default:
         {
             /* ignore unknown frames */
@@ -809,11 +1845,236 @@ static bool DataReq(uint_fast8_t link,
     return false;
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : bool StartInPlace(uint_fast8_t link, uint_fast8_t header)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks whether the SDU of a frame can be received in
+ *                 place. Only the expected I frame is a candidate, as any
+ *                 other frame would be rejected anyway.
+ * Inputs        : link             - link ID
+ * Inputs        : header           - frame header
+ * Outputs       : return value     - true  SDU is received in place
+ * Outputs       : return value     - false SDU is received in frame_a
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool StartInPlace(uint_fast8_t link, uint_fast8_t header)
+{
+    const hdlc_state_t *state_p = &hdlc_state_a[link];
+
+    if ((header & I_MASK) != I_FRAME ||
+        ((header >> NS_POS) & state_p->seq_mask) != state_p->vr ||
+        state_p->own_receiver_busy)
+    {
+        return false;
+    }
+    return App_Hdlc_RxBufferReq(link, &decoder_state_a[link].rx_buf);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void StopInPlace(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Moves the part of an SDU received in place to frame_a,
+ *                 as the SDU does not fit into the free space of the ring.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   : the last two octets are still in tail
+ * ------------------------------------------------------------------------- */
+static void StopInPlace(uint_fast8_t link)
+{
+    decoder_state_t   *state_p = &decoder_state_a[link];
+    App_Hdlc_buffer_t *buf_p   = &state_p->rx_buf;
+    uint_fast16_t      len     = state_p->frame_len - CRC_CCITT_SIZE;
+    uint_fast16_t      pos     = buf_p->pos;
+    uint_fast16_t      i;
+
+    for (i = hdlc_state_a[link].hdr_size; i < len; i++)
+    {
+        state_p->frame_a[i] = buf_p->ring_p[pos];
+        if (++pos == buf_p->size)
+        {
+            pos = 0;
+        }
+    }
+    state_p->frame_a[len + 0] = state_p->tail;
+    state_p->frame_a[len + 1] = state_p->tail >> 8;
+    state_p->in_place = false;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t ZeroFreeLength(const uint8_t *data_p,
+ *                                              uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the number of octets before the first frame flag,
+ *                 scanning a word at a time. A word contains a zero octet
+ *                 if subtracting one from each octet borrows into its top
+ *                 bit.
+ * Inputs        : data_p           - pointer to data
+ * Inputs        : size             - size of data
+ * Outputs       : return value     - octets before the first flag or size
+ * Assumptions   : FRAME_FLAG is zero
+ * ------------------------------------------------------------------------- */
+static uint_fast16_t ZeroFreeLength(const uint8_t *data_p, uint_fast16_t size)
+{
+    uint_fast16_t len = 0;
+    uint32_t      word;
+
+    for (; len + sizeof(word) <= size; len += sizeof(word))
+    {
+        memcpy(&word, &data_p[len], sizeof(word));
+        if (((word - 0x01010101) & ~word & 0x80808080) != 0)
+        {
+            break;
+        }
+    }
+    while (len < size && data_p[len] != FRAME_FLAG)
+    {
+        len++;
+    }
+    return len;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void AddCrc(const uint8_t *data_p, uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds data to the CRC unit, a word at a time. The CRC unit
+ *                 takes the octets of a little-endian word in memory order.
+ * Inputs        : data_p           - pointer to data
+ * Inputs        : size             - size of data
+ * Outputs       : None
+ * Assumptions   : CRC unit is set up for the FCS
+ * ------------------------------------------------------------------------- */
+static void AddCrc(const uint8_t *data_p, uint_fast16_t size)
+{
+    uint32_t word;
+
+    for (; size >= sizeof(word); size -= sizeof(word))
+    {
+        memcpy(&word, data_p, sizeof(word));
+        CRC->ADD_32 = word;
+        data_p += sizeof(word);
+    }
+    for (; size > 0; size--)
+    {
+        CRC->ADD_8 = *data_p++;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void PutRing(const App_Hdlc_buffer_t *buf_p,
+ *                              uint_fast16_t            offset,
+ *                              const uint8_t           *data_p,
+ *                              uint_fast16_t            size)
+ * ----------------------------------------------------------------------------
+ * Description   : Copies data into the ring buffer behind its position,
+ *                 wrapping around the ring end.
+ * Inputs        : buf_p            - pointer to ring buffer
+ * Inputs        : offset           - offset from the ring position
+ * Inputs        : data_p           - pointer to data
+ * Inputs        : size             - size of data
+ * Outputs       : None
+ * Assumptions   : offset + size is within the free space
+ * ------------------------------------------------------------------------- */
+static void PutRing(const App_Hdlc_buffer_t *buf_p, uint_fast16_t offset,
+                    const uint8_t *data_p, uint_fast16_t size)
+{
+    uint_fast16_t pos = buf_p->pos + offset;
+    uint_fast16_t len;
+
+    if (pos >= buf_p->size)
+    {
+        pos -= buf_p->size;
+    }
+    len = buf_p->size - pos;
+    if (len > size)
+    {
+        len = size;
+    }
+    memcpy(&buf_p->ring_p[pos], data_p, len);
+    memcpy(buf_p->ring_p, &data_p[len], size - len);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t DecodeRun(decoder_state_t *dec_p,
+ *                                         uint_fast8_t     hdr_size,
+ *                                         const uint8_t   *data_p,
+ *                                         uint_fast16_t    size)
+ * ----------------------------------------------------------------------------
+ * Description   : Decodes zero-free octets of a COBS block behind the frame
+ *                 header at once, to frame_a or in place to the ring buffer
+ *                 with the last two octets held back. Stops where the
+ *                 octet-wise decoding must take over, at the max. frame
+ *                 length and at the end of the free space of the ring.
+ * Inputs        : dec_p            - pointer to decoder state
+ * Inputs        : hdr_size         - frame header size
+ * Inputs        : data_p           - pointer to data
+ * Inputs        : size             - size of data
+ * Outputs       : return value     - octets decoded
+ * Assumptions   : frame_len is at least hdr_size
+ * ------------------------------------------------------------------------- */
+static uint_fast16_t DecodeRun(decoder_state_t *dec_p, uint_fast8_t hdr_size,
+                               const uint8_t *data_p, uint_fast16_t size)
+{
+    uint_fast16_t frame_len = dec_p->frame_len;
+    uint8_t       held_a[CRC_CCITT_SIZE];
+    uint_fast16_t i;
+
+    if (size > MAX_FRAME_LEN - frame_len)
+    {
+        size = MAX_FRAME_LEN - frame_len;
+    }
+    if (!dec_p->in_place)
+    {
+        memcpy(&dec_p->frame_a[frame_len], data_p, size);
+    }
+    else
+    {
+        /* the octet at frame_len stores the one held back at frame_len - 2
+         * in the ring, which must be in the free space */
+        if (size > dec_p->rx_buf.free + hdr_size + CRC_CCITT_SIZE - frame_len)
+        {
+            size = dec_p->rx_buf.free + hdr_size + CRC_CCITT_SIZE - frame_len;
+        }
+        held_a[0] = dec_p->tail;
+        held_a[1] = dec_p->tail >> 8;
+        for (i = 0; i < CRC_CCITT_SIZE && i < size; i++)
+        {
+            if (frame_len + i >= hdr_size + CRC_CCITT_SIZE)
+            {
+                PutRing(&dec_p->rx_buf,
+                        frame_len + i - hdr_size - CRC_CCITT_SIZE,
+                        &held_a[i], 1);
+            }
+        }
+        if (size > CRC_CCITT_SIZE)
+        {
+            PutRing(&dec_p->rx_buf, frame_len - hdr_size, data_p,
+                    size - CRC_CCITT_SIZE);
+            dec_p->tail = data_p[size - 2] | data_p[size - 1] << 8;
+        }
+        else
+        {
+            for (i = 0; i < size; i++)
+            {
+                dec_p->tail = dec_p->tail >> 8 | data_p[i] << 8;
+            }
+        }
+    }
+    AddCrc(data_p, size);
+    dec_p->frame_len = frame_len + size;
+    return size;
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void DecodeFrame(uint_fast8_t   link,
  *                                  const uint8_t *data_p, uint_fast16_t size)
  * ----------------------------------------------------------------------------
  * Description   : Decodes a frame fragment received from the lower layer.
+ *                 The SDU of the expected I frame is decoded directly to
+ *                 the ring buffer of the upper layer if it offers one. The
+ *                 last two octets are held back in that case, as they are
+ *                 the FCS once the frame ends. The data octets of a COBS
+ *                 block are copied at once up to the next flag, code
+ *                 octets, flags and the frame header octet by octet.
  * Inputs        : link             - link ID
  * Inputs        : data_p           - pointer to fragment
  * Inputs        : size             - fragment size
@@ -823,24 +2084,60 @@ static bool DataReq(uint_fast8_t link,
 static void DecodeFrame(uint_fast8_t link,
                         const uint8_t *data_p, uint_fast16_t size)
 {
-    coder_state_t state     = decoder_state_a[link].state;
-    int_fast16_t cobs_cnt  = decoder_state_a[link].cobs_cnt;
-    uint_fast16_t frame_len = decoder_state_a[link].frame_len;
-    uint8_t      *frame_a   = decoder_state_a[link].frame_a;
-
-    CRC->VALUE = decoder_state_a[link].frame_crc;
+    decoder_state_t *dec_p    = &decoder_state_a[link];
+    coder_state_t state     = dec_p->state;
+    int_fast16_t cobs_cnt  = dec_p->cobs_cnt;
+    uint_fast8_t cobs_code = dec_p->cobs_code;
+    uint_fast16_t frame_len = dec_p->frame_len;
+    uint8_t      *frame_a   = dec_p->frame_a;
+    uint_fast8_t  hdr_size  = hdlc_state_a[link].hdr_size;
+    uint_fast16_t run;
+    uint8_t       octet;
+
+    CRC->VALUE = dec_p->frame_crc;
 
     /* Reassemble COBS frame */
-    for (; size > 0; size--)
+    while (size > 0)
     {
-        uint8_t octet = *data_p++;
+        /* rest of the current block up to the next flag */
+        run = 0;
+        if (state == DECODE_FRAME && cobs_cnt > 1 && frame_len >= hdr_size)
+        {
+            run = (uint_fast16_t)(cobs_cnt - 1);
+            run = ZeroFreeLength(data_p, (size < run) ? size : run);
+        }
+        if (run > 0)
+        {
+            dec_p->frame_len = frame_len;
+            run = DecodeRun(dec_p, hdr_size, data_p, run);
+            frame_len = dec_p->frame_len;
+            data_p   += run;
+            size     -= run;
+            cobs_cnt -= run;
+            if (run > 0)
+            {
+                continue;
+            }
+        }
 
+        octet = *data_p++;
+        size--;
         if (octet == FRAME_FLAG)
         {
             if (frame_len > 0)
             {
                 /* complete frame reception */
-                FrameInd(link, frame_a, frame_len);
+                if (dec_p->in_place)
+                {
+                    FrameInd(link, frame_a, dec_p->rx_buf.ring_p +
+                                            dec_p->rx_buf.pos, frame_len);
+                }
+                else
+                {
+                    FrameInd(link, frame_a, frame_a +
+                             GetHeaderSize(&hdlc_state_a[link], frame_a[0]),
+                             frame_len);
+                }
             }
 
             /* Select correct CRC algorithm for FCS */
@@ -849,39 +2146,83 @@ static void DecodeFrame(uint_fast8_t link,
             cobs_cnt   = 0;
             frame_len  = 0;
             state      = DECODE_FRAME;
+            dec_p->in_place = false;
         }
         else if (state == DECODE_FRAME)
         {
             if (--cobs_cnt < 0)
             {
-                cobs_cnt = octet;
+                cobs_cnt  = octet;
+                cobs_code = octet;
             }
             else
             {
                 if (cobs_cnt == 0)
                 {
                     cobs_cnt = octet;
+                    if (cobs_code == COBS_MAX_CODE)
+                    {
+                        /* a full block is not followed by a zero */
+                        cobs_code = octet;
+                        continue;
+                    }
+                    cobs_code = octet;
                     octet = 0;
                 }
                 if (frame_len >= MAX_FRAME_LEN)
                 {
                     /* frame too long -> abort reception */
-                    FrameInd(link, frame_a, frame_len + 1);
+                    FrameInd(link, frame_a, NULL, frame_len + 1);
                     frame_len = 0;
                     state     = DECODE_SYNC;
                 }
+                else if (dec_p->in_place)
+                {
+                    CRC->ADD_8 = octet;
+                    if (frame_len >= hdr_size + CRC_CCITT_SIZE)
+                    {
+                        /* store the octet held back longest */
+                        App_Hdlc_buffer_t *buf_p = &dec_p->rx_buf;
+                        uint_fast16_t      pos   = frame_len - hdr_size -
+                                                   CRC_CCITT_SIZE;
+
+                        if (pos < buf_p->free)
+                        {
+                            pos += buf_p->pos;
+                            if (pos >= buf_p->size)
+                            {
+                                pos -= buf_p->size;
+                            }
+                            buf_p->ring_p[pos] = dec_p->tail;
+                        }
+                        else
+                        {
+                            dec_p->frame_len = frame_len;
+                            StopInPlace(link);
+                            frame_a[frame_len++] = octet;
+                            continue;
+                        }
+                    }
+                    dec_p->tail = dec_p->tail >> 8 | octet << 8;
+                    frame_len++;
+                }
                 else
                 {
                     CRC->ADD_8 = frame_a[frame_len++] = octet;
+                    if (frame_len == hdr_size)
+                    {
+                        dec_p->in_place = StartInPlace(link, frame_a[0]);
+                    }
                 }
             }
         }
     }
 
-    decoder_state_a[link].state     = state;
-    decoder_state_a[link].cobs_cnt  = cobs_cnt;
-    decoder_state_a[link].frame_len = frame_len;
-    decoder_state_a[link].frame_crc = CRC->VALUE;
+    dec_p->state     = state;
+    dec_p->cobs_cnt  = cobs_cnt;
+    dec_p->cobs_code = cobs_code;
+    dec_p->frame_len = frame_len;
+    dec_p->frame_crc = CRC->VALUE;
 }
 
 /* ----------------------------------------------------------------------------
@@ -902,6 +2243,7 @@ void App_Hdlc_Init(void)
 
     for (link = 0; link < CFG_HDLC_NB_LINKS; link++)
     {
+        ResetLink(&hdlc_state_a[link], false);
         hdlc_state_a[link].peer_reveiver_busy = true;
         hdlc_state_a[link].own_receiver_busy  = true;
     }
@@ -931,6 +2273,84 @@ bool App_Hdlc_DataReq(uint_fast8_t link,
     return false;
 }
 
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Hdlc_ReadyReq(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Requests more data after App_Hdlc_DataInd reported a
+ *                 busy receiver
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   : link is up
+ * ------------------------------------------------------------------------- */
+void App_Hdlc_ReadyReq(uint_fast8_t link)
+{
+    hdlc_state_t *state_p = &hdlc_state_a[link];
+
+    if (link < CFG_HDLC_NB_LINKS && state_p->own_receiver_busy)
+    {
+        state_p->own_receiver_busy = false;
+#ifdef CFG_HDLC_SREJ_BUFFER_SIZE
+        DeliverIFrames(state_p);
+#endif    /* ifdef CFG_HDLC_SREJ_BUFFER_SIZE */
+        if (state_p->mode_pending)
+        {
+            /* only SABM or SABME until the UA, see LinkEstablished() */
+        }
+        else if (state_p->own_receiver_busy)
+        {
+            TransmitSFrame(state_p, RNR | F_0);
+        }
+        else
+        {
+            /* the peer resends the I frames discarded meanwhile on REJ */
+            state_p->reject_sent  = state_p->rx_discarded;
+            state_p->rx_discarded = false;
+            TransmitSFrame(state_p,
+                           state_p->reject_sent ? REJ | F_0 : RR | F_0);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Hdlc_ModeReq(uint_fast8_t link, bool extended)
+ * ----------------------------------------------------------------------------
+ * Description   : Sets the link up in modulo 8 mode (SABM) or in modulo 128
+ *                 mode (SABME). App_Hdlc_DataReq is accepted at once, the
+ *                 I frames are sent after the UA of the peer. A DM of the
+ *                 peer selects modulo 8 mode.
+ * Inputs        : link             - link ID
+ * Inputs        : extended         - true  modulo 128 mode
+ * Inputs        : extended         - false modulo 8 mode
+ * Outputs       : None
+ * Assumptions   : link is up, no I frames are queued
+ * ------------------------------------------------------------------------- */
+void App_Hdlc_ModeReq(uint_fast8_t link, bool extended)
+{
+    hdlc_state_t *state_p = &hdlc_state_a[link];
+
+    if (link < CFG_HDLC_NB_LINKS)
+    {
+        EstablishLink(state_p, extended);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t App_Hdlc_GetMaxSduSize(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the max. SDU size for App_Hdlc_DataReq
+ * Inputs        : link             - link ID
+ * Outputs       : return value     - max. SDU size
+ * Assumptions   : link is up
+ * ------------------------------------------------------------------------- */
+uint_fast16_t App_Hdlc_GetMaxSduSize(uint_fast8_t link)
+{
+    if (link < CFG_HDLC_NB_LINKS)
+    {
+        return encoder_state_a[link].max_size;
+    }
+    return 0;
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void App_Ble_ActivationInd(uint_fast8_t  link,
  *                                            uint_fast16_t max_size)
@@ -945,22 +2365,49 @@ void App_Ble_ActivationInd(uint_fast8_t link, uint_fast16_t max_size)
 {
     if (link < CFG_HDLC_NB_LINKS)
     {
-        hdlc_state_a[link].va = 0;
-        hdlc_state_a[link].vs = 0;
-        hdlc_state_a[link].vq = 0;
-        hdlc_state_a[link].vr = 0;
-        hdlc_state_a[link].rc = 0;
-        hdlc_state_a[link].peer_reveiver_busy = false;
-        hdlc_state_a[link].own_receiver_busy  = false;
-        hdlc_state_a[link].ack_pending        = false;
-        hdlc_state_a[link].s_frame_pending    = NO_FRAME;
-
-        encoder_state_a[link].state    = ENCODE_IDLE;
-        encoder_state_a[link].max_size = max_size - FRAME_OVERHEAD;
-        encoder_state_a[link].seq_nb   = 0;
+        /* modulo 8 mode until the peer sends a SABME, the SDUs of a
+         * previous connection are dropped */
+        hdlc_state_a[link].vq = hdlc_state_a[link].va;
+        ResetLink(&hdlc_state_a[link], false);
+        hdlc_state_a[link].own_receiver_busy = false;
+        hdlc_state_a[link].rx_delivered      = false;
+        hdlc_state_a[link].sync_rx           = SYNC_NONE;
+        hdlc_state_a[link].ack_pending = false;
+        hdlc_state_a[link].srtt        = 0;
+        hdlc_state_a[link].rttvar      = 0;
+        hdlc_state_a[link].t200        = T200_INIT;
+        hdlc_state_a[link].backoff     = 0;
+        hdlc_state_a[link].final_time  = DWT->CYCCNT -
+                                         T200_MAX * CYCLES_PER_TICK;
+
+        encoder_state_a[link].state     = ENCODE_IDLE;
+        encoder_state_a[link].max_size  = CFG_HDLC_SDU_MAX_SIZE;
+        encoder_state_a[link].frag_size = GetFragmentSize(max_size);
+        encoder_state_a[link].seq_nb    = 0;
+        encoder_state_a[link].credits   = CFG_HDLC_TX_CREDITS;
 
         decoder_state_a[link].state     = DECODE_SYNC;
         decoder_state_a[link].frame_len = 0;
+        decoder_state_a[link].in_place  = false;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Ble_MaxSizeInd(uint_fast8_t  link,
+ *                                         uint_fast16_t max_size)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates a larger max. data size after the link
+ *                 parameters have been negotiated
+ * Inputs        : link             - link ID
+ * Inputs        : max_size         - max. data size for App_Ble_DataReq
+ * Outputs       : None
+ * Assumptions   : link is active
+ * ------------------------------------------------------------------------- */
+void App_Ble_MaxSizeInd(uint_fast8_t link, uint_fast16_t max_size)
+{
+    if (link < CFG_HDLC_NB_LINKS)
+    {
+        encoder_state_a[link].frag_size = GetFragmentSize(max_size);
     }
 }
 
@@ -986,7 +2433,8 @@ void App_Ble_DeactivationInd(uint_fast8_t link)
  *                                      uint_fast16_t     seq_nb,
  *                                      App_Hdlc_status_t status)
  * ----------------------------------------------------------------------------
- * Description   : Confirms processing App_Hdlc_DataReq
+ * Description   : Confirms processing App_Ble_DataReq, which returns its
+ *                 credit and continues sending
  * Inputs        : link             - link ID
  * Inputs        : seq_nb           - sequence number
  * Inputs        : status           - request status
@@ -998,7 +2446,17 @@ void App_Ble_DataCfm(uint_fast8_t link, uint_fast16_t seq_nb,
 {
     if (link < CFG_HDLC_NB_LINKS)
     {
-        /* not implemented yet */
+        if (encoder_state_a[link].credits < CFG_HDLC_TX_CREDITS)
+        {
+            encoder_state_a[link].credits++;
+        }
+
+        /* nothing more is sent after the link went down */
+        if (status != APP_BLE_LINK_DOWN)
+        {
+            SendFragments(link);
+            TransmitPending(&hdlc_state_a[link]);
+        }
     }
 }
 
@@ -1019,7 +2477,7 @@ void App_Ble_DataInd(uint_fast8_t link,
 {
     if (link < CFG_HDLC_NB_LINKS)
     {
-    	// ݽн
+    	// 对数据进行解析
         DecodeFrame(link, data_p, size);
     }
 }
@@ -30,6 +30,18 @@
     APP_HDLC_ACKPEND,   \
     APP_HDLC_T200,      \
 
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint8_t *ring_p;    /* ring buffer */
+    uint16_t size;      /* ring buffer size */
+    uint16_t pos;       /* position of the next SDU */
+    uint16_t free;      /* free space behind pos */
+} App_Hdlc_buffer_t;
+
 /* ----------------------------------------------------------------------------
  * Function prototypes
  * ------------------------------------------------------------------------- */
@@ -61,6 +73,40 @@ void App_Hdlc_Init(void);
 bool App_Hdlc_DataReq(uint_fast8_t link,
                       const uint8_t *data_p, uint_fast16_t size);
 
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t App_Hdlc_GetMaxSduSize(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the max. SDU size for App_Hdlc_DataReq
+ * Inputs        : link             - link ID
+ * Outputs       : return value     - max. SDU size
+ * Assumptions   : link is up
+ * ------------------------------------------------------------------------- */
+uint_fast16_t App_Hdlc_GetMaxSduSize(uint_fast8_t link);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Hdlc_ReadyReq(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Requests more data after App_Hdlc_DataInd reported a
+ *                 busy receiver
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   : link is up
+ * ------------------------------------------------------------------------- */
+void App_Hdlc_ReadyReq(uint_fast8_t link);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Hdlc_ModeReq(uint_fast8_t link, bool extended)
+ * ----------------------------------------------------------------------------
+ * Description   : Sets the link up in modulo 8 mode (SABM) or in modulo 128
+ *                 mode (SABME), the peer follows
+ * Inputs        : link             - link ID
+ * Inputs        : extended         - true  modulo 128 mode
+ * Inputs        : extended         - false modulo 8 mode
+ * Outputs       : None
+ * Assumptions   : link is up, no I frames are queued
+ * ------------------------------------------------------------------------- */
+void App_Hdlc_ModeReq(uint_fast8_t link, bool extended);
+
 /* ----------------------------------------------------------------------------
  * Function      : void App_Hdlc_DataCfm(uint_fast8_t   link,
  *                                       const uint8_t *data_p)
@@ -88,4 +134,38 @@ void App_Hdlc_DataCfm(uint_fast8_t link, const uint8_t *data_p);
 bool App_Hdlc_DataInd(uint_fast8_t link,
                       const uint8_t *data_p, uint_fast16_t size);
 
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Hdlc_RxBufferReq(uint_fast8_t       link,
+ *                                           App_Hdlc_buffer_t *buf_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Requests a ring buffer to receive the next SDU in place.
+ *                 The SDU is decoded directly to the ring at buf_p->pos and
+ *                 indicated by App_Hdlc_DataInd with a pointer to it once
+ *                 the frame is verified, it may wrap around the ring end.
+ *                 A rejected frame leaves its data in the free space only.
+ * Inputs        : link             - link ID
+ * Outputs       : buf_p            - ring buffer
+ * Outputs       : return value     - true  SDU is received in place
+ * Outputs       : return value     - false SDU is received in the frame
+ *                                      buffer
+ * Assumptions   : link is up, the ring is not changed until the SDU is
+ *                 indicated or the next SDU is requested
+ * ------------------------------------------------------------------------- */
+bool App_Hdlc_RxBufferReq(uint_fast8_t link, App_Hdlc_buffer_t *buf_p);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Hdlc_ResetInd(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates that the link was re-established after SDUs
+ *                 were indicated, and the peer did not tell its V(R) or it
+ *                 did not fit the own queue. The SDUs of the peer and of
+ *                 the own queue may have been lost or may be indicated
+ *                 twice. A re-established link normally syncs the queues
+ *                 without this indication.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   : link is up
+ * ------------------------------------------------------------------------- */
+void App_Hdlc_ResetInd(uint_fast8_t link);
+
 #endif    /* _APP_HDLC_H */
@@ -0,0 +1,189 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_lz.c
+ * - Streaming LZSS decompressor for compressed image downloads. The output
+ *   ring of the caller doubles as history window, so no extra RAM is
+ *   needed beyond the small state structure.
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_lz.h"
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define TOKEN_DISTANCE_MASK     0x07FF
+#define TOKEN_LENGTH_POS        11
+#define TOKEN_LENGTH_EXT        0x1F
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Lz_Init(App_Lz_state_t *lz_p,
+ *                                  void *window_p, uint_fast32_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes a decompressor instance.
+ * Inputs        : lz_p             - pointer to decompressor state
+ *                 window_p         - output ring which is also used as
+ *                                    history window
+ *                 size             - size of the output ring
+ * Outputs       : None
+ * Assumptions   : size is a power of 2 and >= APP_LZ_MAX_DISTANCE
+ * ------------------------------------------------------------------------- */
+void App_Lz_Init(App_Lz_state_t *lz_p, void *window_p, uint_fast32_t size)
+{
+    lz_p->step        = APP_LZ_FLAGS;
+    lz_p->flag_cnt    = 0;
+    lz_p->length      = 0;
+    lz_p->window_p    = window_p;
+    lz_p->window_mask = size - 1;
+    lz_p->out_len     = 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t App_Lz_Decode(App_Lz_state_t *lz_p,
+ *                                             const uint8_t  *data_p,
+ *                                             uint_fast16_t   size,
+ *                                             uint_fast32_t   out_limit)
+ * ----------------------------------------------------------------------------
+ * Description   : Decompresses a part of the stream to the output ring.
+ *                 Decoding stops when either the input is exhausted or
+ *                 lz_p->out_len has reached out_limit.
+ * Inputs        : lz_p             - pointer to decompressor state
+ *                 data_p           - pointer to compressed data
+ *                 size             - size of compressed data
+ *                 out_limit        - output position to stop at
+ * Outputs       : return value     - number of consumed input bytes
+ * Assumptions   : out_limit does not overwrite unconsumed output
+ * ------------------------------------------------------------------------- */
+uint_fast16_t App_Lz_Decode(App_Lz_state_t *lz_p,
+                            const uint8_t *data_p, uint_fast16_t size,
+                            uint_fast32_t out_limit)
+{
+    uint8_t      *window_p = lz_p->window_p;
+    uint_fast32_t mask     = lz_p->window_mask;
+    uint_fast32_t out_len  = lz_p->out_len;
+    uint_fast16_t used     = 0;
+
+    while (out_len < out_limit)
+    {
+        if (lz_p->step == APP_LZ_COPY)
+        {
+            /* copy match from history window */
+            uint_fast32_t src = out_len - lz_p->distance;
+
+            window_p[out_len & mask] = window_p[src & mask];
+            out_len++;
+            if (--lz_p->length == 0)
+            {
+                lz_p->step = APP_LZ_ITEM;
+            }
+            continue;
+        }
+
+        if (used >= size || lz_p->step == APP_LZ_ERROR)
+        {
+            break;
+        }
+
+        switch (lz_p->step)
+        {
+            case APP_LZ_FLAGS:
+            {
+                lz_p->flags    = data_p[used++];
+                lz_p->flag_cnt = 8;
+                lz_p->step     = APP_LZ_ITEM;
+            }
+            break;
+
+            case APP_LZ_ITEM:
+            {
+                if (lz_p->flag_cnt == 0)
+                {
+                    lz_p->step = APP_LZ_FLAGS;
+                    break;
+                }
+                lz_p->flag_cnt--;
+                if ((lz_p->flags & 1) == 0)
+                {
+                    /* literal */
+                    window_p[out_len & mask] = data_p[used++];
+                    out_len++;
+                }
+                else
+                {
+                    /* 1st byte of match token */
+                    lz_p->token = data_p[used++];
+                    lz_p->step  = APP_LZ_TOKEN_HI;
+                }
+                lz_p->flags >>= 1;
+            }
+            break;
+
+            case APP_LZ_TOKEN_HI:
+            {
+                lz_p->token   |= data_p[used++] << 8;
+                lz_p->distance = (lz_p->token & TOKEN_DISTANCE_MASK) + 1;
+                lz_p->length   = (lz_p->token >> TOKEN_LENGTH_POS);
+                if (lz_p->distance > out_len)
+                {
+                    /* reference before stream start */
+                    lz_p->step = APP_LZ_ERROR;
+                }
+                else if (lz_p->length == TOKEN_LENGTH_EXT)
+                {
+                    lz_p->step = APP_LZ_TOKEN_EXT;
+                }
+                else
+                {
+                    lz_p->length += APP_LZ_MIN_LENGTH;
+                    lz_p->step    = APP_LZ_COPY;
+                }
+            }
+            break;
+
+            case APP_LZ_TOKEN_EXT:
+            {
+                lz_p->length = APP_LZ_EXT_LENGTH + data_p[used++];
+                lz_p->step   = APP_LZ_COPY;
+            }
+            break;
+
+            default:
+            {
+            }
+            break;
+        }
+    }
+
+    lz_p->out_len = out_len;
+    return used;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Lz_IsValid(const App_Lz_state_t *lz_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks that no token referenced data before the stream
+ *                 start.
+ * Inputs        : lz_p             - pointer to decompressor state
+ * Outputs       : return value     - true  stream is consistent so far
+ *                                  - false stream is corrupt
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Lz_IsValid(const App_Lz_state_t *lz_p)
+{
+    return (lz_p->step != APP_LZ_ERROR);
+}
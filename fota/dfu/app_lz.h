@@ -0,0 +1,116 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_lz.h
+ * - Interface to the streaming LZSS decompressor.
+ * ------------------------------------------------------------------------- */
+
+#ifndef _APP_LZ_H    /* avoids multiple inclusion */
+#define _APP_LZ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+/* Stream format (must match mkfotaimg.py):
+ *  - a flag byte precedes every group of 8 items, bit 0 first
+ *  - flag bit 0: item is a literal byte
+ *  - flag bit 1: item is a 16-bit little-endian match token
+ *      bits  0..10: distance - 1           (1..2048)
+ *      bits 11..15: length - 3             (3..33)
+ *                   31 -> extension byte follows, length = 34 + ext
+ */
+#define APP_LZ_MAX_DISTANCE     2048
+#define APP_LZ_MIN_LENGTH       3
+#define APP_LZ_EXT_LENGTH       (APP_LZ_MIN_LENGTH + 31)
+
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef enum
+{
+    APP_LZ_FLAGS,
+    APP_LZ_ITEM,
+    APP_LZ_TOKEN_HI,
+    APP_LZ_TOKEN_EXT,
+    APP_LZ_COPY,
+    APP_LZ_ERROR
+} App_Lz_step_t;
+
+typedef struct
+{
+    App_Lz_step_t step;
+    uint8_t       flags;
+    uint8_t       flag_cnt;
+    uint16_t      token;
+    uint16_t      distance;
+    uint16_t      length;
+    uint8_t      *window_p;
+    uint32_t      window_mask;
+    uint32_t      out_len;
+} App_Lz_state_t;
+
+/* ----------------------------------------------------------------------------
+ * Function prototypes
+ * ------------------------------------------------------------------------- */
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Lz_Init(App_Lz_state_t *lz_p,
+ *                                  void *window_p, uint_fast32_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes a decompressor instance.
+ * Inputs        : lz_p             - pointer to decompressor state
+ *                 window_p         - output ring which is also used as
+ *                                    history window
+ *                 size             - size of the output ring
+ * Outputs       : None
+ * Assumptions   : size is a power of 2 and >= APP_LZ_MAX_DISTANCE
+ * ------------------------------------------------------------------------- */
+void App_Lz_Init(App_Lz_state_t *lz_p, void *window_p, uint_fast32_t size);
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t App_Lz_Decode(App_Lz_state_t *lz_p,
+ *                                             const uint8_t  *data_p,
+ *                                             uint_fast16_t   size,
+ *                                             uint_fast32_t   out_limit)
+ * ----------------------------------------------------------------------------
+ * Description   : Decompresses a part of the stream to the output ring.
+ *                 Decoding stops when either the input is exhausted or
+ *                 lz_p->out_len has reached out_limit.
+ * Inputs        : lz_p             - pointer to decompressor state
+ *                 data_p           - pointer to compressed data
+ *                 size             - size of compressed data
+ *                 out_limit        - output position to stop at
+ * Outputs       : return value     - number of consumed input bytes
+ * Assumptions   : out_limit does not overwrite unconsumed output
+ * ------------------------------------------------------------------------- */
+uint_fast16_t App_Lz_Decode(App_Lz_state_t *lz_p,
+                            const uint8_t *data_p, uint_fast16_t size,
+                            uint_fast32_t out_limit);
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Lz_IsValid(const App_Lz_state_t *lz_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks that no token referenced data before the stream
+ *                 start.
+ * Inputs        : lz_p             - pointer to decompressor state
+ * Outputs       : return value     - true  stream is consistent so far
+ *                                  - false stream is corrupt
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Lz_IsValid(const App_Lz_state_t *lz_p);
+
+#endif    /* _APP_LZ_H */
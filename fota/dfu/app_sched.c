@@ -0,0 +1,231 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_sched.c
+ * - Flash operation scheduler. A sector erase stalls the CPU for
+ *   milliseconds, so erase and program operations are only started in the
+ *   gap between two connection events. The connection events are tracked
+ *   from the radio activity seen by the application and the connection
+ *   interval. Operations which never fit into a gap are started right
+ *   after an event. Connection events overlapped by a flash operation are
+ *   counted in the telemetry.
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <rsl10.h>
+
+#include "app_sched.h"
+#include "app_stat.h"
+#include "drv_targ.h"
+
+#ifdef CFG_DFU_FLASH_SCHED
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define CYCLES_PER_CON_UNIT     (1250 * DRV_TARG_CYCLES_PER_US)     /* 1.25 ms */
+#define GUARD_CYCLES            (CFG_DFU_FLASH_GUARD_US * DRV_TARG_CYCLES_PER_US)
+
+/* initial estimates of the flash operation times, refined at run time */
+#define INIT_PROGRAM_CYCLES     (100 * DRV_TARG_CYCLES_PER_US)
+#define INIT_ERASE_CYCLES       (20000 * DRV_TARG_CYCLES_PER_US)
+
+/* phase is unknown after this many intervals without radio activity */
+#define STALE_INTERVALS         32
+
+/* max. deferral of an operation */
+#define MAX_DEFER_INTERVALS     4
+
+/* ----------------------------------------------------------------------------
+ * Local variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint32_t interval;        /* [cycles], 0 = no connection */
+    uint32_t event_start;     /* first activity of the last connection event */
+    uint32_t last_activity;
+    uint32_t event_len;       /* longest activity seen within an event */
+    bool     deferred;
+    uint32_t defer_start;
+    uint32_t duration_a[APP_SCHED_NB_OPS];
+} sched_t;
+
+static sched_t sched;
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool IsTracking(uint32_t now)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks if the connection events can be predicted.
+ * Inputs        : now              - cycle counter
+ * Outputs       : return value     - true  phase of the events is known
+ *                                  - false no connection or no recent
+ *                                          radio activity
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool IsTracking(uint32_t now)
+{
+    return (sched.interval != 0 &&
+            now - sched.last_activity < STALE_INTERVALS * sched.interval);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_Init(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes the module
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : the cycle counter is enabled by Drv_Targ_Init()
+ * ------------------------------------------------------------------------- */
+void App_Sched_Init(void)
+{
+    sched.interval = 0;
+    sched.deferred = false;
+    sched.duration_a[APP_SCHED_PROGRAM] = INIT_PROGRAM_CYCLES;
+    sched.duration_a[APP_SCHED_ERASE]   = INIT_ERASE_CYCLES;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_IntervalInd(uint_fast16_t con_interval)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the connection interval.
+ * Inputs        : con_interval     - connection interval [1.25 ms],
+ *                                    0 if not connected
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Sched_IntervalInd(uint_fast16_t con_interval)
+{
+    sched.interval  = con_interval * CYCLES_PER_CON_UNIT;
+    sched.event_len = 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_EventInd(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates radio activity of the connection, e.g. a
+ *                 received packet or a completed notification.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Sched_EventInd(void)
+{
+    uint32_t now = DWT->CYCCNT;
+
+    if (now - sched.last_activity > sched.interval / 2 ||
+        now - sched.event_start >= sched.interval)
+    {
+        /* first activity of a new connection event, an event never spans
+         * the interval and the length follows shorter events slowly */
+        sched.event_start = now;
+        sched.event_len  -= sched.event_len / 8;
+    }
+    else if (now - sched.event_start > sched.event_len)
+    {
+        sched.event_len = now - sched.event_start;
+    }
+    sched.last_activity = now;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Sched_Allow(App_Sched_op_t op)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks if a flash operation can be started now.
+ * Inputs        : op               - flash operation
+ * Outputs       : return value     - true  start the operation
+ *                                  - false defer it until the next poll
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Sched_Allow(App_Sched_op_t op)
+{
+    uint32_t now = DWT->CYCCNT;
+    uint32_t phase;
+    uint32_t need;
+
+    if (!IsTracking(now))
+    {
+        return true;
+    }
+
+    phase = (now - sched.event_start) % sched.interval;
+    need  = sched.duration_a[op] + GUARD_CYCLES;
+
+    /* between the end of the last event and the guard before the next one,
+     * or right after the event if the operation never fits into a gap */
+    if (phase >= sched.event_len &&
+        (phase + need <= sched.interval ||
+         sched.event_len + need > sched.interval))
+    {
+        return true;
+    }
+
+    if (!sched.deferred)
+    {
+        sched.deferred    = true;
+        sched.defer_start = now;
+    }
+    return (now - sched.defer_start >= MAX_DEFER_INTERVALS * sched.interval);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint32_t App_Sched_Begin(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the start time stamp of a flash operation.
+ * Inputs        : None
+ * Outputs       : return value     - cycle counter
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+uint32_t App_Sched_Begin(void)
+{
+    return DWT->CYCCNT;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_End(App_Sched_op_t op, uint32_t start)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the end of a flash operation. Refines the
+ *                 duration estimate and counts the connection events the
+ *                 operation overlapped.
+ * Inputs        : op               - flash operation
+ *                 start            - time stamp from App_Sched_Begin
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Sched_End(App_Sched_op_t op, uint32_t start)
+{
+    uint32_t duration = DWT->CYCCNT - start;
+
+    /* follow a longer duration at once and a shorter one slowly */
+    if (duration > sched.duration_a[op])
+    {
+        sched.duration_a[op] = duration;
+    }
+    else
+    {
+        sched.duration_a[op] -= (sched.duration_a[op] - duration) / 8;
+    }
+
+    if (IsTracking(start))
+    {
+        App_Stat_Count(APP_STAT_MISSED_EVENTS,
+                       ((start - sched.event_start) % sched.interval +
+                        duration) / sched.interval);
+    }
+    sched.deferred = false;
+}
+
+#endif    /* ifdef CFG_DFU_FLASH_SCHED */
@@ -0,0 +1,115 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_sched.h
+ * - Interface to the flash operation scheduler.
+ * ------------------------------------------------------------------------- */
+
+#ifndef _APP_SCHED_H    /* avoids multiple inclusion */
+#define _APP_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef enum
+{
+    APP_SCHED_PROGRAM,
+    APP_SCHED_ERASE,
+    APP_SCHED_NB_OPS
+} App_Sched_op_t;
+
+/* ----------------------------------------------------------------------------
+ * Function prototypes
+ * ------------------------------------------------------------------------- */
+
+#ifdef CFG_DFU_FLASH_SCHED
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_Init(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes the module
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Sched_Init(void);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_IntervalInd(uint_fast16_t con_interval)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the connection interval.
+ * Inputs        : con_interval     - connection interval [1.25 ms],
+ *                                    0 if not connected
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Sched_IntervalInd(uint_fast16_t con_interval);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_EventInd(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates radio activity of the connection, e.g. a
+ *                 received packet or a completed notification.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Sched_EventInd(void);
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Sched_Allow(App_Sched_op_t op)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks if a flash operation can be started now.
+ * Inputs        : op               - flash operation
+ * Outputs       : return value     - true  start the operation
+ *                                  - false defer it until the next poll
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Sched_Allow(App_Sched_op_t op);
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint32_t App_Sched_Begin(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the start time stamp of a flash operation.
+ * Inputs        : None
+ * Outputs       : return value     - cycle counter
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+uint32_t App_Sched_Begin(void);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Sched_End(App_Sched_op_t op, uint32_t start)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the end of a flash operation.
+ * Inputs        : op               - flash operation
+ *                 start            - time stamp from App_Sched_Begin
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Sched_End(App_Sched_op_t op, uint32_t start);
+
+#else    /* ifdef CFG_DFU_FLASH_SCHED */
+
+#define App_Sched_Init()
+#define App_Sched_IntervalInd(con_interval)
+#define App_Sched_EventInd()
+#define App_Sched_Allow(op)             true
+#define App_Sched_Begin()               0
+#define App_Sched_End(op, start)        ((void)(start))
+
+#endif    /* ifdef CFG_DFU_FLASH_SCHED */
+
+#endif    /* _APP_SCHED_H */
@@ -0,0 +1,136 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_sig.c
+ * - Image signature verifiers. The scheme is selected per build by
+ *   CFG_DFU_SIG_ECDSA and CFG_DFU_SIG_ED25519 (flash size) and per image by
+ *   the configuration block.
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "app_sig.h"
+#include "app_conf.h"
+#include "sha256.h"
+
+#ifdef CFG_DFU_SIG_ECDSA
+#include "uECC.h"
+#endif    /* ifdef CFG_DFU_SIG_ECDSA */
+
+#ifdef CFG_DFU_SIG_ED25519
+#include "ed25519.h"
+#endif    /* ifdef CFG_DFU_SIG_ED25519 */
+
+#if !defined(CFG_DFU_SIG_ECDSA) && !defined(CFG_DFU_SIG_ED25519)
+#error "No signature scheme configured"
+#endif
+
+/* ----------------------------------------------------------------------------
+ * Local variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef bool (*verify_t)(const uint8_t *key_p, const uint8_t hash_a[],
+                         const uint8_t *sig_p);
+
+#ifdef CFG_DFU_SIG_ECDSA
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool VerifyEcdsa(const uint8_t *key_p,
+ *                                  const uint8_t  hash_a[],
+ *                                  const uint8_t *sig_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Verifies an ECDSA secp256r1 signature.
+ * Inputs        : key_p            - pointer to public key
+ *                 hash_a           - SHA-256 hash (little-endian)
+ *                 sig_p            - pointer to signature
+ * Outputs       : return value     - true if the signature is ok
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool VerifyEcdsa(const uint8_t *key_p, const uint8_t hash_a[],
+                        const uint8_t *sig_p)
+{
+#ifdef CFG_DFU_KEY_TABLE
+    return (uECC_verify_table(key_p, *App_Conf_GetPublicKeyTable(),
+                              hash_a, SHA256_BLOCK_SIZE,
+                              sig_p,
+                              uECC_secp256r1()) != 0);
+#else    /* ifdef CFG_DFU_KEY_TABLE */
+    return (uECC_verify(key_p, hash_a, SHA256_BLOCK_SIZE,
+                        sig_p,
+                        uECC_secp256r1()) != 0);
+#endif    /* ifdef CFG_DFU_KEY_TABLE */
+}
+
+#endif    /* ifdef CFG_DFU_SIG_ECDSA */
+
+#ifdef CFG_DFU_SIG_ED25519
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool VerifyEd25519(const uint8_t *key_p,
+ *                                    const uint8_t  hash_a[],
+ *                                    const uint8_t *sig_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Verifies an Ed25519 signature. The signed message is the
+ *                 hash itself.
+ * Inputs        : key_p            - pointer to public key
+ *                 hash_a           - SHA-256 hash (little-endian)
+ *                 sig_p            - pointer to signature
+ * Outputs       : return value     - true if the signature is ok
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool VerifyEd25519(const uint8_t *key_p, const uint8_t hash_a[],
+                          const uint8_t *sig_p)
+{
+    return (ed25519_verify(key_p, hash_a, SHA256_BLOCK_SIZE, sig_p) != 0);
+}
+
+#endif    /* ifdef CFG_DFU_SIG_ED25519 */
+
+static const verify_t verifier_a[APP_SIG_NB_SCHEMES] =
+{
+#ifdef CFG_DFU_SIG_ECDSA
+    [APP_SIG_ECDSA_P256] = VerifyEcdsa,
+#endif    /* ifdef CFG_DFU_SIG_ECDSA */
+#ifdef CFG_DFU_SIG_ED25519
+    [APP_SIG_ED25519]    = VerifyEd25519,
+#endif    /* ifdef CFG_DFU_SIG_ED25519 */
+};
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Sig_Verify(uint_fast8_t   scheme,
+ *                                     const uint8_t *key_p,
+ *                                     const uint8_t  hash_a[],
+ *                                     const uint8_t *sig_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Verifies a signature with the verifier of a scheme.
+ * Inputs        : scheme           - signature scheme (App_Sig_scheme_t)
+ *                 key_p            - pointer to public key
+ *                 hash_a           - SHA-256 hash (little-endian)
+ *                 sig_p            - pointer to signature
+ * Outputs       : return value     - true  signature is ok
+ *                                  - false signature is wrong or the
+ *                                          scheme is not supported
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Sig_Verify(uint_fast8_t scheme, const uint8_t *key_p,
+                    const uint8_t hash_a[], const uint8_t *sig_p)
+{
+    if (scheme < APP_SIG_NB_SCHEMES && verifier_a[scheme] != NULL)
+    {
+        return verifier_a[scheme](key_p, hash_a, sig_p);
+    }
+    return false;
+}
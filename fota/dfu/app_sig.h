@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_sig.h
+ * - Interface to the image signature verifiers.
+ * ------------------------------------------------------------------------- */
+
+#ifndef _APP_SIG_H    /* avoids multiple inclusion */
+#define _APP_SIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+/* Signature scheme in the configuration block, set by mkfotaimg.py according
+ * to the signing key (must match SIG_SCHEMES there). Both schemes use 64 octet
+ * signatures over the little-endian SHA-256 hash of the image:
+ *  - APP_SIG_ECDSA_P256: key X || Y, signature r || s (little-endian)
+ *  - APP_SIG_ED25519:    key as in RFC 8032 (first 32 octets of the key
+ *                        field), signature R || S
+ */
+typedef enum
+{
+    APP_SIG_ECDSA_P256,
+    APP_SIG_ED25519,
+    APP_SIG_NB_SCHEMES
+} App_Sig_scheme_t;
+
+/* ----------------------------------------------------------------------------
+ * Function prototypes
+ * ------------------------------------------------------------------------- */
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool App_Sig_Verify(uint_fast8_t   scheme,
+ *                                     const uint8_t *key_p,
+ *                                     const uint8_t  hash_a[],
+ *                                     const uint8_t *sig_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Verifies a signature with the verifier of a scheme.
+ * Inputs        : scheme           - signature scheme (App_Sig_scheme_t)
+ *                 key_p            - pointer to public key
+ *                 hash_a           - SHA-256 hash (little-endian)
+ *                 sig_p            - pointer to signature
+ * Outputs       : return value     - true  signature is ok
+ *                                  - false signature is wrong or the
+ *                                          scheme is not supported
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool App_Sig_Verify(uint_fast8_t scheme, const uint8_t *key_p,
+                    const uint8_t hash_a[], const uint8_t *sig_p);
+
+#endif    /* _APP_SIG_H */
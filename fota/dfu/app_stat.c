@@ -0,0 +1,327 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_stat.c
+ * - DFU telemetry. Collects progress counters and the time spent in the
+ *   SHA-256, ECDSA and flash phases of an image download and notifies them
+ *   to the peer. Phases are timed with the DWT cycle counter, so the
+ *   overhead is a few instructions per measurement.
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <rsl10.h>
+#include <rsl10_ke.h>
+
+#include "sys_man.h"
+#include "app_stat.h"
+#include "app_ble.h"
+#include "msg_handler.h"
+#include "drv_targ.h"
+
+#ifdef CFG_DFU_STAT
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define CYCLES_PER_MS           (DRV_TARG_CYCLES_PER_US * 1000)
+
+/* ----------------------------------------------------------------------------
+ * Local variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef struct
+{
+    bool     active;
+    bool     ongoing;
+    uint8_t  link;
+    uint32_t last_cnt;
+    uint64_t elapsed;
+    uint32_t counter_a[APP_STAT_NB_COUNTERS];
+    uint32_t phase_a[APP_STAT_NB_PHASES];
+} stat_t;
+
+static stat_t stat;
+
+/* ----------------------------------------------------------------------------
+ * Function      : void PutU16(uint8_t *p, uint_fast16_t value)
+ * ----------------------------------------------------------------------------
+ * Description   : Stores a 16-bit value little-endian.
+ * Inputs        : p                - destination
+ *                 value            - value
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void PutU16(uint8_t *p, uint_fast16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void PutU32(uint8_t *p, uint_fast32_t value)
+ * ----------------------------------------------------------------------------
+ * Description   : Stores a 32-bit value little-endian.
+ * Inputs        : p                - destination
+ *                 value            - value
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void PutU32(uint8_t *p, uint_fast32_t value)
+{
+    PutU16(p, value);
+    PutU16(p + 2, value >> 16);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void UpdateElapsed(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Extends the 32-bit cycle counter to the download time.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : called at least once per counter wrap (536 s)
+ * ------------------------------------------------------------------------- */
+static void UpdateElapsed(void)
+{
+    uint32_t cnt = DWT->CYCCNT;
+
+    stat.elapsed += (uint32_t)(cnt - stat.last_cnt);
+    stat.last_cnt = cnt;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void SendProgress(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends a progress record.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void SendProgress(void)
+{
+    uint8_t record_a[18];
+
+    record_a[0] = APP_STAT_PROGRESS;
+    record_a[1] = 0;
+    PutU16(&record_a[2],  stat.counter_a[APP_STAT_ERASED_SECTORS]);
+    PutU32(&record_a[4],  stat.counter_a[APP_STAT_RX_BYTES]);
+    PutU32(&record_a[8],  stat.counter_a[APP_STAT_PROG_BYTES]);
+    PutU16(&record_a[12], stat.counter_a[APP_STAT_RNR_STALLS]);
+    PutU16(&record_a[14], stat.counter_a[APP_STAT_RETRANSMISSIONS]);
+    PutU16(&record_a[16], stat.counter_a[APP_STAT_MISSED_EVENTS]);
+    App_Ble_StatReq(stat.link, record_a, sizeof(record_a));
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void SendSummary(uint_fast8_t status)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends the phase timing summary.
+ * Inputs        : status           - download status
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void SendSummary(uint_fast8_t status)
+{
+    uint8_t record_a[APP_STAT_RECORD_SIZE];
+
+    record_a[0] = APP_STAT_SUMMARY;
+    record_a[1] = status;
+    PutU16(&record_a[2],  stat.counter_a[APP_STAT_ERASED_SECTORS]);
+    PutU32(&record_a[4],  stat.elapsed / CYCLES_PER_MS);
+    PutU32(&record_a[8],  stat.phase_a[APP_STAT_SHA]   / DRV_TARG_CYCLES_PER_US);
+    PutU32(&record_a[12], stat.phase_a[APP_STAT_ECDSA] / DRV_TARG_CYCLES_PER_US);
+    PutU32(&record_a[16], stat.phase_a[APP_STAT_FLASH] / DRV_TARG_CYCLES_PER_US);
+    App_Ble_StatReq(stat.link, record_a, sizeof(record_a));
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void TimerHandler(ke_msg_id_t msg_id, const void *param_p,
+ *                                   ke_task_id_t dest_id, ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends the periodic progress record.
+ * Inputs        : msg_id           - always APP_STAT_TIMER
+ *                 param_p          - always NULL
+ *                 dest_id          - Destination task ID number
+ *                 src_id           - Source task ID number
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void TimerHandler(ke_msg_id_t msg_id, const void *param_p,
+                         ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    if (stat.active && stat.ongoing)
+    {
+        UpdateElapsed();
+        SendProgress();
+        ke_timer_set(APP_STAT_TIMER, dest_id,
+                     KE_TIME_IN_SEC(CFG_DFU_STAT_PERIOD));
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void StartTimer(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Starts the progress timer if a download is ongoing and
+ *                 the peer enabled the notifications.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void StartTimer(void)
+{
+    ke_task_id_t task_id = KE_BUILD_ID(TASK_APP, stat.link);
+
+    if (stat.active && stat.ongoing && !ke_timer_active(APP_STAT_TIMER, task_id))
+    {
+        ke_timer_set(APP_STAT_TIMER, task_id,
+                     KE_TIME_IN_SEC(CFG_DFU_STAT_PERIOD));
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Init(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes the module.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : the cycle counter is enabled by Drv_Targ_Init()
+ * ------------------------------------------------------------------------- */
+void App_Stat_Init(void)
+{
+    MsgHandler_Add(APP_STAT_TIMER, TimerHandler);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Count(App_Stat_counter_t counter,
+ *                                     uint_fast32_t      value)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds a value to a counter.
+ * Inputs        : counter          - counter ID
+ *                 value            - value to add
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_Count(App_Stat_counter_t counter, uint_fast32_t value)
+{
+    stat.counter_a[counter] += value;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint32_t App_Stat_Start(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the start time stamp of a timed phase.
+ * Inputs        : None
+ * Outputs       : return value     - cycle counter
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+uint32_t App_Stat_Start(void)
+{
+    return DWT->CYCCNT;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Stop(App_Stat_phase_t phase, uint32_t start)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds the time since start to a phase.
+ * Inputs        : phase            - phase ID
+ *                 start            - time stamp from App_Stat_Start
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_Stop(App_Stat_phase_t phase, uint32_t start)
+{
+    stat.phase_a[phase] += DWT->CYCCNT - start;
+    UpdateElapsed();
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Begin(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the begin of an image download. Clears the
+ *                 counters and starts the progress notifications.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_Begin(void)
+{
+    memset(stat.counter_a, 0, sizeof(stat.counter_a));
+    memset(stat.phase_a, 0, sizeof(stat.phase_a));
+    stat.elapsed  = 0;
+    stat.last_cnt = DWT->CYCCNT;
+    stat.ongoing  = true;
+    StartTimer();
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_End(uint_fast8_t status)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the end of an image download. Stops the
+ *                 progress notifications and sends the summary.
+ * Inputs        : status           - download status
+ * Outputs       : None
+ * Assumptions   : ignored if no download is ongoing
+ * ------------------------------------------------------------------------- */
+void App_Stat_End(uint_fast8_t status)
+{
+    if (stat.ongoing)
+    {
+        stat.ongoing = false;
+        UpdateElapsed();
+        ke_timer_clear(APP_STAT_TIMER, KE_BUILD_ID(TASK_APP, stat.link));
+        if (stat.active)
+        {
+            SendProgress();
+            SendSummary(status);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_ActivationInd(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates that the peer enabled the telemetry
+ *                 notifications.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_ActivationInd(uint_fast8_t link)
+{
+    stat.link   = link;
+    stat.active = true;
+    StartTimer();
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_DeactivationInd(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates that the peer disabled the telemetry
+ *                 notifications or disconnected.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_DeactivationInd(uint_fast8_t link)
+{
+    if (link == stat.link)
+    {
+        stat.active = false;
+        ke_timer_clear(APP_STAT_TIMER, KE_BUILD_ID(TASK_APP, link));
+    }
+}
+
+#endif    /* ifdef CFG_DFU_STAT */
@@ -0,0 +1,180 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * app_stat.h
+ * - Interface to the DFU telemetry (progress counters and phase timing).
+ * ------------------------------------------------------------------------- */
+
+#ifndef _APP_STAT_H    /* avoids multiple inclusion */
+#define _APP_STAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define APP_STAT_MSGS           \
+    APP_STAT_TIMER,             \
+
+/* Record format (little-endian, must match the central):
+ *  - progress (sent every CFG_DFU_STAT_PERIOD during a download)
+ *      uint8_t  type = APP_STAT_PROGRESS
+ *      uint8_t  reserved
+ *      uint16_t sectors erased
+ *      uint32_t bytes received
+ *      uint32_t bytes programmed
+ *      uint16_t RNR stalls
+ *      uint16_t retransmissions
+ *      uint16_t connection events overlapped by flash operations
+ *  - summary (sent once at the end of a download)
+ *      uint8_t  type = APP_STAT_SUMMARY
+ *      uint8_t  download status
+ *      uint16_t sectors erased
+ *      uint32_t download time [ms]
+ *      uint32_t SHA-256 time [us]
+ *      uint32_t ECDSA time [us]
+ *      uint32_t flash time [us]
+ */
+#define APP_STAT_PROGRESS       0
+#define APP_STAT_SUMMARY        1
+#define APP_STAT_RECORD_SIZE    20
+
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef enum
+{
+    APP_STAT_RX_BYTES,
+    APP_STAT_PROG_BYTES,
+    APP_STAT_ERASED_SECTORS,
+    APP_STAT_RNR_STALLS,
+    APP_STAT_RETRANSMISSIONS,
+    APP_STAT_MISSED_EVENTS,
+    APP_STAT_NB_COUNTERS
+} App_Stat_counter_t;
+
+typedef enum
+{
+    APP_STAT_SHA,
+    APP_STAT_ECDSA,
+    APP_STAT_FLASH,
+    APP_STAT_NB_PHASES
+} App_Stat_phase_t;
+
+/* ----------------------------------------------------------------------------
+ * Function prototypes
+ * ------------------------------------------------------------------------- */
+
+#ifdef CFG_DFU_STAT
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Init(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes the module
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_Init(void);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Count(App_Stat_counter_t counter,
+ *                                     uint_fast32_t      value)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds a value to a counter.
+ * Inputs        : counter          - counter ID
+ *                 value            - value to add
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_Count(App_Stat_counter_t counter, uint_fast32_t value);
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint32_t App_Stat_Start(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the start time stamp of a timed phase.
+ * Inputs        : None
+ * Outputs       : return value     - cycle counter
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+uint32_t App_Stat_Start(void);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Stop(App_Stat_phase_t phase, uint32_t start)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds the time since start to a phase.
+ * Inputs        : phase            - phase ID
+ *                 start            - time stamp from App_Stat_Start
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_Stop(App_Stat_phase_t phase, uint32_t start);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_Begin(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the begin of an image download. Clears the
+ *                 counters and starts the progress notifications.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_Begin(void);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_End(uint_fast8_t status)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates the end of an image download. Stops the
+ *                 progress notifications and sends the summary.
+ * Inputs        : status           - download status
+ * Outputs       : None
+ * Assumptions   : ignored if no download is ongoing
+ * ------------------------------------------------------------------------- */
+void App_Stat_End(uint_fast8_t status);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_ActivationInd(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates that the peer enabled the telemetry
+ *                 notifications.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_ActivationInd(uint_fast8_t link);
+
+/* ----------------------------------------------------------------------------
+ * Function      : void App_Stat_DeactivationInd(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : Indicates that the peer disabled the telemetry
+ *                 notifications or disconnected.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void App_Stat_DeactivationInd(uint_fast8_t link);
+
+#else    /* ifdef CFG_DFU_STAT */
+
+#define App_Stat_Init()
+#define App_Stat_Count(counter, value)
+#define App_Stat_Start()                0
+#define App_Stat_Stop(phase, start)     ((void)(start))
+#define App_Stat_Begin()
+#define App_Stat_End(status)
+
+#endif    /* ifdef CFG_DFU_STAT */
+
+#endif    /* _APP_STAT_H */
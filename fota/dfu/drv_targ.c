@@ -94,6 +94,11 @@ void Drv_Targ_Init(void)
     /* Enable CM3 loop cache. */
     SYSCTRL->CSS_LOOP_CACHE_CFG = CSS_LOOP_CACHE_ENABLE;
 
+    /* Enable the cycle counter, used for timing measurements. */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+
     background_active = false;
 }
 
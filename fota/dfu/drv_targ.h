@@ -19,6 +19,14 @@
 
 #include <stdbool.h>
 
+/* ----------------------------------------------------------------------------
+ * Defines
+ * ------------------------------------------------------------------------- */
+
+/* SYSCLK = 48 MHz / 6 (CK_DIV_1_6_PRESCALE_6 in Drv_Targ_Init()), the rate
+ * of the cycle counter DWT->CYCCNT */
+#define DRV_TARG_CYCLES_PER_US  8
+
 /* ----------------------------------------------------------------------------
  * Function prototypes
  * ------------------------------------------------------------------------- */
@@ -25,6 +25,8 @@
 #include "app_dfu.h"
 #include "app_hdlc.h"
 #include "app_ble.h"
+#include "app_stat.h"
+#include "app_sched.h"
 #include "app_trace.h"
 #include "drv_targ.h"
 #include "msg_handler.h"
@@ -88,6 +90,8 @@ static void Init(void)
     App_Dfu_Init();
     App_Hdlc_Init();
     App_Ble_Init();
+    App_Stat_Init();
+    App_Sched_Init();
 }
 
 /* ----------------------------------------------------------------------------
@@ -110,6 +114,7 @@ int main(void)
 
         /* Polling the modules */
         App_Dfu_Poll();
+        App_Ble_Poll();
         Drv_Targ_Poll();
     }
 
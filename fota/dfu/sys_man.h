@@ -25,6 +25,8 @@
 #include "app_hdlc.h"
 #include "app_ble.h"
 #include "app_conf.h"
+#include "app_stat.h"
+#include "app_sched.h"
 
 /* ----------------------------------------------------------------------------
  * Global variables and types
@@ -50,6 +52,7 @@ typedef enum
     APP_BLE_MSGS
     APP_HDLC_MSGS
     APP_DFU_MSGS
+    APP_STAT_MSGS
 
     SYS_MAN_LAST_MSG
 } Sys_Man_app_msg_t;
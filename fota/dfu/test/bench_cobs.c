@@ -0,0 +1,721 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * bench_cobs.c
+ * - Check and benchmark of the HDLC frame decoder on the host. DecodeFrame
+ *   of app_hdlc.c is compared with RefDecodeFrame, the octet-wise decoder
+ *   it replaces, on the same fragments: the indicated SDUs, the frames sent
+ *   in response and the final decoder state must be identical, for
+ *   corrupted streams, both header sizes and SDUs received in place and
+ *   in the frame buffer. Then both are timed per received octet for SDUs
+ *   without zeros, random SDUs and SDUs of zeros only (worst case, one COBS
+ *   block per octet). Prints one JSON object and exits non-zero if a check
+ *   fails. Build and run from this directory with e.g.
+ *     cc -O2 -I../../tools/dfusim/include -I../.. -I.. -I../../ble \
+ *        -I../../../bootloader -o bench_cobs bench_cobs.c
+ *     ./bench_cobs
+ *   The counter is the x86 time stamp counter when available and
+ *   nanoseconds otherwise. The CRC unit is emulated by a table, its
+ *   register writes per octet are reported separately as they are bus
+ *   accesses on the target.
+ * ------------------------------------------------------------------------- */
+
+#include "../app_hdlc.c"
+
+#include <stdio.h>
+#include <time.h>
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define COUNTER_NAME            "tsc"
+static uint64_t Counter(void)
+{
+    return __rdtsc();
+}
+#else
+#define COUNTER_NAME            "ns"
+static uint64_t Counter(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+#define FRAGMENT_SIZE           244     /* ATT MTU 247 */
+#define SDU_SIZE                1024
+#define NB_FRAMES               64
+#define STREAM_SIZE             (NB_FRAMES * (MAX_FRAME_LEN + 16))
+#define RING_SIZE               3001    /* SDUs wrap at any position */
+#define MAX_SAMPLES             255
+#define MIN_SAMPLES             5
+#define MIN_TIME                (CLOCKS_PER_SEC / 4)
+
+#define CRC_IDLE                0x100
+#define CRC_IDLE_WORD           0x100000000ULL
+
+#define FNV_OFFSET              0xCBF29CE484222325ULL
+#define FNV_PRIME               0x100000001B3ULL
+
+typedef enum
+{
+    CONTENT_ZERO_FREE,
+    CONTENT_RANDOM,
+    CONTENT_ZEROS,
+    CONTENT_CORRUPT,
+    NB_CONTENTS
+} content_t;
+
+static const char *content_names_a[NB_CONTENTS] =
+{
+    "zero_free", "random", "zeros", "corrupt"
+};
+
+typedef enum
+{
+    RX_FRAME_BUFFER,                    /* no ring buffer */
+    RX_RING,                            /* SDUs received in place */
+    RX_RING_SHORT,                      /* ring often too short (StopInPlace) */
+    NB_RX_MODES
+} rx_mode_t;
+
+static const char *rx_mode_names_a[NB_RX_MODES] =
+{
+    "frame_buffer", "ring", "ring_short"
+};
+
+/* ----------------------------------------------------------------------------
+ * Global variables
+ * --------------------------------------------------------------------------*/
+
+static uint8_t  stream_a[STREAM_SIZE];
+static uint32_t stream_len;
+static uint16_t fragment_a[STREAM_SIZE];  /* fragment sizes */
+static uint32_t nb_fragments;
+
+static uint8_t  ring_a[RING_SIZE];
+static uint16_t ring_pos;
+static rx_mode_t rx_mode;
+static uint64_t ring_seed;
+
+static uint8_t  tx_a[MAX_FRAGMENT_SIZE];
+static uint64_t log_hash;
+static uint32_t nb_sdus;
+
+static CRC_Type crc_regs;
+static uint16_t crc_value;
+static uint16_t crc_table_a[256];
+static uint32_t crc_writes;
+
+/* ----------------------------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------------------------*/
+
+static uint32_t Random(uint64_t *seed_p)
+{
+    *seed_p = *seed_p * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *seed_p >> 33;
+}
+
+static void Log(const uint8_t *data_p, uint_fast32_t size)
+{
+    while (size-- > 0)
+    {
+        log_hash = (log_hash ^ *data_p++) * FNV_PRIME;
+    }
+}
+
+static void LogValue(uint_fast32_t value)
+{
+    uint8_t value_a[4] = { value, value >> 8, value >> 16, value >> 24 };
+
+    Log(value_a, sizeof(value_a));
+}
+
+static uint_fast16_t CrcUpdate(uint_fast16_t crc, uint_fast8_t octet)
+{
+    return crc >> 8 ^ crc_table_a[(crc ^ octet) & 0xFF];
+}
+
+/* same register semantics as tools/dfusim, table driven */
+CRC_Type * Sim_Crc(void)
+{
+    uint_fast8_t i;
+
+    if (crc_regs.ADD_8 != CRC_IDLE)
+    {
+        crc_value = CrcUpdate(crc_value, crc_regs.ADD_8);
+        crc_writes++;
+    }
+    else if (crc_regs.ADD_32 != CRC_IDLE_WORD)
+    {
+        for (i = 0; i < 32; i += 8)
+        {
+            crc_value = CrcUpdate(crc_value, crc_regs.ADD_32 >> i);
+        }
+        crc_writes++;
+    }
+    else if (crc_regs.VALUE != crc_value)
+    {
+        crc_value = crc_regs.VALUE;
+    }
+
+    crc_regs.VALUE  = crc_value;
+    crc_regs.FINAL  = crc_value ^ 0xFFFF;
+    crc_regs.ADD_8  = CRC_IDLE;
+    crc_regs.ADD_32 = CRC_IDLE_WORD;
+    return &crc_regs;
+}
+
+/* ----------------------------------------------------------------------------
+ * Environment of app_hdlc.c
+ * --------------------------------------------------------------------------*/
+
+DWT_Type * Sim_Dwt(void)
+{
+    static DWT_Type dwt_regs;
+
+    return &dwt_regs;
+}
+
+bool MsgHandler_Add(ke_msg_id_t const msg_id,
+                    void (*callback)(ke_msg_id_t const msg_id, void const *param,
+                                     ke_task_id_t const dest_id, ke_task_id_t const src_id))
+{
+    return true;
+}
+
+void ke_msg_send_basic(ke_msg_id_t id, ke_task_id_t dest_id,
+                       ke_task_id_t src_id)
+{
+}
+
+void ke_timer_set(ke_msg_id_t timer_id, ke_task_id_t task_id,
+                  uint32_t delay)
+{
+}
+
+void ke_timer_clear(ke_msg_id_t timer_id, ke_task_id_t task_id)
+{
+}
+
+bool ke_timer_active(ke_msg_id_t timer_id, ke_task_id_t task_id)
+{
+    return false;
+}
+
+#ifdef CFG_DFU_STAT
+void App_Stat_Count(App_Stat_counter_t counter, uint_fast32_t value)
+{
+}
+#endif    /* ifdef CFG_DFU_STAT */
+
+uint8_t * App_Ble_DataAlloc(uint_fast8_t link, uint_fast16_t size)
+{
+    return tx_a;
+}
+
+void App_Ble_DataReq(uint_fast8_t link, uint_fast16_t seq_nb,
+                     uint8_t *data_p, uint_fast16_t size)
+{
+    /* responses (RR, REJ, SREJ) become part of the result */
+    LogValue(0x80000000 | size);
+    Log(data_p, size);
+}
+
+void App_Hdlc_DataCfm(uint_fast8_t link, const uint8_t *data_p)
+{
+}
+
+bool App_Hdlc_DataInd(uint_fast8_t link,
+                      const uint8_t *data_p, uint_fast16_t size)
+{
+    uint_fast16_t len;
+
+    LogValue(size);
+    if (data_p >= ring_a && data_p < ring_a + RING_SIZE &&
+        data_p + size > ring_a + RING_SIZE)
+    {
+        /* the SDU wraps at the end of the ring */
+        len = ring_a + RING_SIZE - data_p;
+        Log(data_p, len);
+        Log(ring_a, size - len);
+    }
+    else
+    {
+        Log(data_p, size);
+    }
+
+    ring_pos = (ring_pos + size) % RING_SIZE;
+    nb_sdus++;
+    return true;
+}
+
+bool App_Hdlc_RxBufferReq(uint_fast8_t link, App_Hdlc_buffer_t *buf_p)
+{
+    if (rx_mode == RX_FRAME_BUFFER)
+    {
+        return false;
+    }
+    buf_p->ring_p = ring_a;
+    buf_p->size   = RING_SIZE;
+    buf_p->pos    = ring_pos;
+    buf_p->free   = RING_SIZE - 1;
+    if (rx_mode == RX_RING_SHORT && (Random(&ring_seed) & 1) != 0)
+    {
+        buf_p->free = Random(&ring_seed) % (SDU_SIZE + 8);
+    }
+    return true;
+}
+
+void App_Hdlc_ResetInd(uint_fast8_t link)
+{
+}
+
+/* ----------------------------------------------------------------------------
+ * Reference, the octet-wise decoder
+ * --------------------------------------------------------------------------*/
+
+static void RefDecodeFrame(uint_fast8_t link,
+                           const uint8_t *data_p, uint_fast16_t size)
+{
+    decoder_state_t *dec_p    = &decoder_state_a[link];
+    coder_state_t state     = dec_p->state;
+    int_fast16_t cobs_cnt  = dec_p->cobs_cnt;
+    uint_fast8_t cobs_code = dec_p->cobs_code;
+    uint_fast16_t frame_len = dec_p->frame_len;
+    uint8_t      *frame_a   = dec_p->frame_a;
+    uint_fast8_t  hdr_size  = hdlc_state_a[link].hdr_size;
+
+    CRC->VALUE = dec_p->frame_crc;
+
+    /* Reassemble COBS frame */
+    for (; size > 0; size--)
+    {
+        uint8_t octet = *data_p++;
+
+        if (octet == FRAME_FLAG)
+        {
+            if (frame_len > 0)
+            {
+                /* complete frame reception */
+                if (dec_p->in_place)
+                {
+                    FrameInd(link, frame_a, dec_p->rx_buf.ring_p +
+                                            dec_p->rx_buf.pos, frame_len);
+                }
+                else
+                {
+                    FrameInd(link, frame_a, frame_a +
+                             GetHeaderSize(&hdlc_state_a[link], frame_a[0]),
+                             frame_len);
+                }
+            }
+
+            /* Select correct CRC algorithm for FCS */
+            CRC->CTRL  = CRC_CCITT_CONF;
+            CRC->VALUE = CRC_CCITT_INIT_VALUE;
+            cobs_cnt   = 0;
+            frame_len  = 0;
+            state      = DECODE_FRAME;
+            dec_p->in_place = false;
+        }
+        else if (state == DECODE_FRAME)
+        {
+            if (--cobs_cnt < 0)
+            {
+                cobs_cnt  = octet;
+                cobs_code = octet;
+            }
+            else
+            {
+                if (cobs_cnt == 0)
+                {
+                    cobs_cnt = octet;
+                    if (cobs_code == COBS_MAX_CODE)
+                    {
+                        /* a full block is not followed by a zero */
+                        cobs_code = octet;
+                        continue;
+                    }
+                    cobs_code = octet;
+                    octet = 0;
+                }
+                if (frame_len >= MAX_FRAME_LEN)
+                {
+                    /* frame too long -> abort reception */
+                    FrameInd(link, frame_a, NULL, frame_len + 1);
+                    frame_len = 0;
+                    state     = DECODE_SYNC;
+                }
+                else if (dec_p->in_place)
+                {
+                    CRC->ADD_8 = octet;
+                    if (frame_len >= hdr_size + CRC_CCITT_SIZE)
+                    {
+                        /* store the octet held back longest */
+                        App_Hdlc_buffer_t *buf_p = &dec_p->rx_buf;
+                        uint_fast16_t      pos   = frame_len - hdr_size -
+                                                   CRC_CCITT_SIZE;
+
+                        if (pos < buf_p->free)
+                        {
+                            pos += buf_p->pos;
+                            if (pos >= buf_p->size)
+                            {
+                                pos -= buf_p->size;
+                            }
+                            buf_p->ring_p[pos] = dec_p->tail;
+                        }
+                        else
+                        {
+                            dec_p->frame_len = frame_len;
+                            StopInPlace(link);
+                            frame_a[frame_len++] = octet;
+                            continue;
+                        }
+                    }
+                    dec_p->tail = dec_p->tail >> 8 | octet << 8;
+                    frame_len++;
+                }
+                else
+                {
+                    CRC->ADD_8 = frame_a[frame_len++] = octet;
+                    if (frame_len == hdr_size)
+                    {
+                        dec_p->in_place = StartInPlace(link, frame_a[0]);
+                    }
+                }
+            }
+        }
+    }
+
+    dec_p->state     = state;
+    dec_p->cobs_cnt  = cobs_cnt;
+    dec_p->cobs_code = cobs_code;
+    dec_p->frame_len = frame_len;
+    dec_p->frame_crc = CRC->VALUE;
+}
+
+/* ----------------------------------------------------------------------------
+ * Test streams
+ * --------------------------------------------------------------------------*/
+
+static void PutFrame(const uint8_t *frame_p, uint_fast16_t size)
+{
+    uint_fast16_t code_pos;
+    uint_fast8_t  code = 1;
+    uint_fast16_t i;
+
+    code_pos = stream_len++;
+    for (i = 0; i < size; i++)
+    {
+        if (frame_p[i] == 0)
+        {
+            stream_a[code_pos] = code;
+            code_pos = stream_len++;
+            code = 1;
+        }
+        else
+        {
+            stream_a[stream_len++] = frame_p[i];
+            if (++code == COBS_MAX_CODE)
+            {
+                stream_a[code_pos] = code;
+                code_pos = stream_len++;
+                code = 1;
+            }
+        }
+    }
+    stream_a[code_pos] = code;
+    stream_a[stream_len++] = FRAME_FLAG;
+}
+
+static void MakeStream(content_t content, bool extended, uint64_t seed)
+{
+    static uint8_t frame_a[MAX_FRAME_LEN + CFG_HDLC_SDU_MAX_SIZE];
+    uint_fast8_t   hdr_size = extended ? FRAME_HDR_EXT_SIZE : FRAME_HDR_SIZE;
+    uint_fast16_t  size;
+    uint_fast16_t  crc;
+    uint_fast16_t  i;
+    uint_fast16_t  n;
+    uint32_t       pos;
+
+    stream_len = 0;
+    stream_a[stream_len++] = FRAME_FLAG;
+    for (n = 0; n < NB_FRAMES; n++)
+    {
+        size = SDU_SIZE;
+        if (content == CONTENT_CORRUPT)
+        {
+            /* some frames are longer than MAX_FRAME_LEN */
+            size = Random(&seed) % (CFG_HDLC_SDU_MAX_SIZE + 64);
+        }
+
+        /* I frame, N(R) = 0, P/F = 0 */
+        frame_a[0] = (n & (extended ? SEQNUM_EXT_MASK : SEQNUM_MASK)) << NS_POS;
+        frame_a[1] = 0;
+        for (i = hdr_size; i < hdr_size + size; i++)
+        {
+            switch (content)
+            {
+                case CONTENT_ZERO_FREE:
+                    frame_a[i] = 1 + Random(&seed) % 255;
+                    break;
+
+                case CONTENT_ZEROS:
+                    frame_a[i] = 0;
+                    break;
+
+                default:
+                    frame_a[i] = Random(&seed);
+                    break;
+            }
+        }
+        size += hdr_size;
+
+        crc = CRC_CCITT_INIT_VALUE;
+        for (i = 0; i < size; i++)
+        {
+            crc = CrcUpdate(crc, frame_a[i]);
+        }
+        crc ^= 0xFFFF;
+        frame_a[size++] = crc;
+        frame_a[size++] = crc >> 8;
+        PutFrame(frame_a, size);
+    }
+
+    if (content == CONTENT_CORRUPT)
+    {
+        /* changed, zeroed and lost octets */
+        for (n = 0; n < 3 * NB_FRAMES; n++)
+        {
+            pos = Random(&seed) % stream_len;
+            switch (Random(&seed) % 3)
+            {
+                case 0:
+                    stream_a[pos] ^= 1 + Random(&seed) % 255;
+                    break;
+
+                case 1:
+                    stream_a[pos] = 0;
+                    break;
+
+                default:
+                    size = 1 + Random(&seed) % 300;
+                    if (size > stream_len - pos)
+                    {
+                        size = stream_len - pos;
+                    }
+                    memmove(&stream_a[pos], &stream_a[pos + size],
+                            stream_len - pos - size);
+                    stream_len -= size;
+                    break;
+            }
+        }
+    }
+}
+
+static void MakeFragments(bool random_sizes, uint64_t seed)
+{
+    uint32_t pos;
+    uint32_t size;
+
+    nb_fragments = 0;
+    for (pos = 0; pos < stream_len; pos += size)
+    {
+        size = random_sizes ? 1 + Random(&seed) % FRAGMENT_SIZE : FRAGMENT_SIZE;
+        if (size > stream_len - pos)
+        {
+            size = stream_len - pos;
+        }
+        fragment_a[nb_fragments++] = size;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Decoder runs
+ * --------------------------------------------------------------------------*/
+
+static void Reset(bool extended)
+{
+    memset(hdlc_state_a, 0, sizeof(hdlc_state_a));
+    memset(encoder_state_a, 0, sizeof(encoder_state_a));
+    memset(decoder_state_a, 0, sizeof(decoder_state_a));
+    App_Hdlc_Init();
+    App_Ble_ActivationInd(0, FRAGMENT_SIZE);
+    if (extended)
+    {
+        ResetLink(&hdlc_state_a[0], true);
+    }
+    crc_regs.ADD_8  = CRC_IDLE;
+    crc_regs.ADD_32 = CRC_IDLE_WORD;
+    ring_pos  = 0;
+    ring_seed = 1;
+    log_hash  = FNV_OFFSET;
+    nb_sdus   = 0;
+}
+
+static void Decode(bool reference)
+{
+    const uint8_t *data_p = stream_a;
+    uint32_t       i;
+
+    for (i = 0; i < nb_fragments; i++)
+    {
+        if (reference)
+        {
+            RefDecodeFrame(0, data_p, fragment_a[i]);
+        }
+        else
+        {
+            App_Ble_DataInd(0, data_p, fragment_a[i]);
+        }
+        data_p += fragment_a[i];
+    }
+}
+
+static uint64_t Result(bool reference, bool extended)
+{
+    const decoder_state_t *dec_p = &decoder_state_a[0];
+
+    Reset(extended);
+    Decode(reference);
+    LogValue(dec_p->state);
+    LogValue(dec_p->cobs_cnt);
+    LogValue(dec_p->cobs_code);
+    LogValue(dec_p->frame_len);
+    LogValue(dec_p->frame_crc);
+    LogValue(dec_p->tail);
+    LogValue(dec_p->in_place);
+    LogValue(hdlc_state_a[0].vr);
+    return log_hash;
+}
+
+static double Measure(bool reference, double *crc_per_octet_p)
+{
+    uint64_t best = UINT64_MAX;
+    uint64_t t;
+    unsigned samples = 0;
+    clock_t  start = clock();
+
+    do
+    {
+        Reset(false);
+        crc_writes = 0;
+        t = Counter();
+        Decode(reference);
+        t = Counter() - t;
+        if (t < best)
+        {
+            best = t;
+        }
+        samples++;
+    } while (samples < MIN_SAMPLES ||
+             (samples < MAX_SAMPLES && clock() - start < MIN_TIME));
+
+    *crc_per_octet_p = (double)crc_writes / stream_len;
+    return (double)best / stream_len;
+}
+
+int main(void)
+{
+    uint_fast16_t crc;
+    unsigned      content;
+    unsigned      mode;
+    unsigned      extended;
+    unsigned      random_sizes;
+    unsigned      checks = 0;
+    unsigned      failures = 0;
+    uint32_t      sdus = 0;
+    double        ref_crc;
+    double        crc_writes_per_octet;
+    double        ref;
+    double        dut;
+    const char   *sep = "";
+
+    for (crc = 0; crc < 256; crc++)
+    {
+        uint_fast16_t value = crc;
+        unsigned      i;
+
+        for (i = 0; i < 8; i++)
+        {
+            value = (value & 1) ? (value >> 1) ^ 0x8408 : value >> 1;
+        }
+        crc_table_a[crc] = value;
+    }
+
+    /* identical results */
+    for (content = 0; content < NB_CONTENTS; content++)
+    {
+        for (extended = 0; extended < 2; extended++)
+        {
+            MakeStream(content, extended, 100 + content);
+            for (random_sizes = 0; random_sizes < 2; random_sizes++)
+            {
+                MakeFragments(random_sizes, 200 + content);
+                for (mode = 0; mode < NB_RX_MODES; mode++)
+                {
+                    uint64_t ref_hash;
+
+                    rx_mode = mode;
+                    ref_hash = Result(true, extended);
+                    sdus += nb_sdus;
+                    checks++;
+                    if (Result(false, extended) != ref_hash)
+                    {
+                        failures++;
+                        fprintf(stderr, "mismatch: %s, %s, %s, %s fragments\n",
+                                content_names_a[content],
+                                extended ? "modulo 128" : "modulo 8",
+                                rx_mode_names_a[mode],
+                                random_sizes ? "random" : "full");
+                    }
+                }
+            }
+        }
+    }
+
+    printf("{\n  \"counter\": \"%s\",\n  \"fragment_size\": %u,\n"
+           "  \"sdu_size\": %u,\n  \"checks\": %u,\n  \"failures\": %u,\n"
+           "  \"sdus\": %u,\n  \"per_octet\": {",
+           COUNTER_NAME, FRAGMENT_SIZE, SDU_SIZE, checks, failures,
+           (unsigned)sdus);
+
+    /* cost per received octet */
+    for (content = 0; content < CONTENT_CORRUPT; content++)
+    {
+        MakeStream(content, false, 100 + content);
+        MakeFragments(false, 0);
+        for (mode = RX_FRAME_BUFFER; mode <= RX_RING; mode++)
+        {
+            rx_mode = mode;
+            ref = Measure(true, &ref_crc);
+            dut = Measure(false, &crc_writes_per_octet);
+            printf("%s\n    \"%s_%s\": {\"ref\": %.2f, \"new\": %.2f, "
+                   "\"speedup\": %.2f, \"ref_crc_writes\": %.3f, "
+                   "\"new_crc_writes\": %.3f}",
+                   sep, content_names_a[content], rx_mode_names_a[mode],
+                   ref, dut, ref / dut, ref_crc, crc_writes_per_octet);
+            sep = ",";
+        }
+    }
+    printf("\n  }\n}\n");
+
+    return failures != 0;
+}
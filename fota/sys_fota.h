@@ -46,6 +46,14 @@
 #define SYS_FOTA_DFU_APPVER_UUID        SYS_FOTA_UUID(5)
 #define SYS_FOTA_DFU_BUILDID_UUID       SYS_FOTA_UUID(6)
 #define SYS_FOTA_DFU_ENTER_UUID         SYS_FOTA_UUID(7)
+#define SYS_FOTA_DFU_STAT_UUID          SYS_FOTA_UUID(8)
+
+/* Handover from the application to the FOTA stack. It is placed at the end
+ * of DRAM_DSP which is reserved in the linker scripts of both and is not
+ * initialized by any startup code. */
+#define SYS_FOTA_HANDOVER_ADR           0x20011FE0
+#define SYS_FOTA_HANDOVER               ((Sys_Fota_handover_t *)SYS_FOTA_HANDOVER_ADR)
+#define SYS_FOTA_HANDOVER_MAGIC         0x41544F46    /* "FOTA" */
 
 /* ----------------------------------------------------------------------------
  * Global variables and types
@@ -59,6 +67,43 @@ typedef struct
     Sys_Fota_uuid_t dev_id;
 } Sys_Fota_version_t;
 
+typedef struct
+{
+    uint32_t magic;
+    uint8_t  peer_addr_a[6];
+    uint8_t  peer_addr_type;
+    uint8_t  reserved;
+    uint16_t con_interval;
+    uint16_t con_latency;
+    uint16_t sup_to;
+    uint16_t check;
+} Sys_Fota_handover_t;
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint16_t Sys_Fota_HandoverCheck(
+ *                                      const Sys_Fota_handover_t *handover_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Calculates the check value of a handover record
+ * Inputs        : handover_p   pointer to handover record
+ * Outputs       : return value - Fletcher-16 over all fields except check
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static inline uint16_t Sys_Fota_HandoverCheck(
+                                        const Sys_Fota_handover_t *handover_p)
+{
+    const uint8_t *p     = (const uint8_t *)handover_p;
+    const uint8_t *end_p = (const uint8_t *)&handover_p->check;
+    uint_fast16_t  sum1  = 0;
+    uint_fast16_t  sum2  = 0;
+
+    while (p < end_p)
+    {
+        sum1 = (sum1 + *p++) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8 | sum1);
+}
+
 /* ----------------------------------------------------------------------------
  * Function      : void Sys_Fota_StartDfu(uint32_t mode)
  * ----------------------------------------------------------------------------
@@ -0,0 +1,395 @@
+/*********************************************************************
+* Filename:   ed25519.c
+* Details:    Compact Ed25519 signature verification (RFC 8032).
+              Field elements mod p = 2^255 - 19 are held in 8 32-bit
+              words and only partially reduced (< 2^256) between the
+              operations, 2^256 is folded in as 38. Points use extended
+              twisted Edwards coordinates, [S]B - [h]A is computed with
+              Shamir's trick. Only public data is processed, so nothing
+              is constant time.
+              See test/test_ed25519.c for test vectors and a speed
+              comparison with micro-ecc.
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <string.h>
+#include "sha512.h"
+#include "ed25519.h"
+
+/**************************** DATA TYPES ****************************/
+typedef uint32_t fe[8];
+
+typedef struct {
+	fe X, Y, Z, T;
+} ge;
+
+/**************************** VARIABLES *****************************/
+static const fe fe_zero = { 0 };
+static const fe fe_one = { 1 };
+static const fe D = { 0x135978A3, 0x75EB4DCA, 0x4141D8AB, 0x00700A4D,
+                      0x7779E898, 0x8CC74079, 0x2B6FFE73, 0x52036CEE };
+static const fe D2 = { 0x26B2F159, 0xEBD69B94, 0x8283B156, 0x00E0149A,
+                       0xEEF3D130, 0x198E80F2, 0x56DFFCE7, 0x2406D9DC };
+static const fe SQRTM1 = { 0x4A0EA0B0, 0xC4EE1B27, 0xAD2FE478, 0x2F431806,
+                           0x3DFBD7A7, 0x2B4D0099, 0x4FC1DF0B, 0x2B832480 };
+static const ge B = {
+	{ 0x8F25D51A, 0xC9562D60, 0x9525A7B2, 0x692CC760,
+	  0xFDD6DC5C, 0xC0A4E231, 0xCD6E53FE, 0x216936D3 },
+	{ 0x66666658, 0x66666666, 0x66666666, 0x66666666,
+	  0x66666666, 0x66666666, 0x66666666, 0x66666666 },
+	{ 1 },
+	{ 0 }           // set by ed25519_verify()
+};
+// group order
+static const uint32_t L[8] = { 0x5CF5D3ED, 0x5812631A, 0xA2F79CD6, 0x14DEF9DE,
+                               0x00000000, 0x00000000, 0x00000000, 0x10000000 };
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+static void load(uint32_t r[8], const uint8_t s[32])
+{
+	int i;
+
+	for (i = 0; i < 8; ++i)
+		r[i] = s[4 * i] | ((uint32_t)s[4 * i + 1] << 8) |
+		       ((uint32_t)s[4 * i + 2] << 16) | ((uint32_t)s[4 * i + 3] << 24);
+}
+
+// r += c * 2^256 (mod p)
+static void fe_fold(fe r, uint32_t c)
+{
+	uint64_t t;
+	int i;
+
+	while (c) {
+		t = (uint64_t)c * 38;
+		for (i = 0; i < 8; ++i) {
+			t += r[i];
+			r[i] = (uint32_t)t;
+			t >>= 32;
+		}
+		c = (uint32_t)t;
+	}
+}
+
+static void fe_add(fe r, const fe a, const fe b)
+{
+	uint64_t t = 0;
+	int i;
+
+	for (i = 0; i < 8; ++i) {
+		t += (uint64_t)a[i] + b[i];
+		r[i] = (uint32_t)t;
+		t >>= 32;
+	}
+	fe_fold(r, (uint32_t)t);
+}
+
+static void fe_sub(fe r, const fe a, const fe b)
+{
+	uint32_t borrow = 0, x;
+	int i, k;
+
+	for (i = 0; i < 8; ++i) {
+		x = a[i] - b[i] - borrow;
+		borrow = (a[i] < b[i]) || (a[i] == b[i] && borrow);
+		r[i] = x;
+	}
+	// a wrapped difference is 2^256 = 38 too big, at most twice
+	for (k = 0; k < 2 && borrow; ++k) {
+		x = r[0];
+		r[0] = x - 38;
+		borrow = (x < 38);
+		for (i = 1; i < 8 && borrow; ++i)
+			borrow = (r[i]-- == 0);
+	}
+}
+
+static void fe_mul(fe r, const fe a, const fe b)
+{
+	uint32_t p[16];
+	uint64_t t;
+	int i, j;
+
+	memset(p, 0, sizeof(p));
+	for (i = 0; i < 8; ++i) {
+		t = 0;
+		for (j = 0; j < 8; ++j) {
+			t += (uint64_t)a[i] * b[j] + p[i + j];
+			p[i + j] = (uint32_t)t;
+			t >>= 32;
+		}
+		p[i + 8] = (uint32_t)t;
+	}
+	t = 0;
+	for (i = 0; i < 8; ++i) {
+		t += (uint64_t)p[i + 8] * 38 + p[i];
+		r[i] = (uint32_t)t;
+		t >>= 32;
+	}
+	fe_fold(r, (uint32_t)t);
+}
+
+#define fe_sq(r, a) fe_mul(r, a, a)
+
+// fully reduces to [0, p)
+static void fe_freeze(fe r)
+{
+	fe t;
+	int k;
+
+	for (k = 0; k < 2; ++k) {
+		uint32_t c = r[7] >> 31;
+
+		r[7] &= 0x7FFFFFFF;
+		memcpy(t, fe_zero, sizeof(t));
+		t[0] = 19 * c;
+		fe_add(r, r, t);
+	}
+	// r < 2^255, subtract p if r + 19 >= 2^255
+	memcpy(t, fe_zero, sizeof(t));
+	t[0] = 19;
+	fe_add(t, r, t);
+	if (t[7] >> 31) {
+		t[7] &= 0x7FFFFFFF;
+		memcpy(r, t, sizeof(t));
+	}
+}
+
+static int fe_equal(const fe a, const fe b)
+{
+	fe x, y;
+
+	memcpy(x, a, sizeof(x));
+	memcpy(y, b, sizeof(y));
+	fe_freeze(x);
+	fe_freeze(y);
+	return memcmp(x, y, sizeof(x)) == 0;
+}
+
+static int fe_isodd(const fe a)
+{
+	fe x;
+
+	memcpy(x, a, sizeof(x));
+	fe_freeze(x);
+	return x[0] & 1;
+}
+
+// r = a^(p - 2) = 1 / a, p - 2 = 2^255 - 21
+static void fe_inv(fe r, const fe a)
+{
+	fe c;
+	int i;
+
+	memcpy(c, a, sizeof(c));
+	for (i = 253; i >= 0; --i) {
+		fe_sq(c, c);
+		if (i != 2 && i != 4)
+			fe_mul(c, c, a);
+	}
+	memcpy(r, c, sizeof(c));
+}
+
+// r = a^((p - 5) / 8), (p - 5) / 8 = 2^252 - 3
+static void fe_pow2523(fe r, const fe a)
+{
+	fe c;
+	int i;
+
+	memcpy(c, a, sizeof(c));
+	for (i = 250; i >= 0; --i) {
+		fe_sq(c, c);
+		if (i != 1)
+			fe_mul(c, c, a);
+	}
+	memcpy(r, c, sizeof(c));
+}
+
+// r = p + q, complete for all inputs (add-2008-hwcd-3)
+static void ge_add(ge *r, const ge *p, const ge *q)
+{
+	fe a, b, c, d, t;
+
+	fe_sub(a, p->Y, p->X);
+	fe_sub(t, q->Y, q->X);
+	fe_mul(a, a, t);
+	fe_add(b, p->Y, p->X);
+	fe_add(t, q->Y, q->X);
+	fe_mul(b, b, t);
+	fe_mul(c, p->T, q->T);
+	fe_mul(c, c, D2);
+	fe_mul(d, p->Z, q->Z);
+	fe_add(d, d, d);
+
+	fe_sub(t, b, a);                // E
+	fe_add(b, b, a);                // H
+	fe_sub(a, d, c);                // F
+	fe_add(d, d, c);                // G
+	fe_mul(r->X, t, a);
+	fe_mul(r->Y, d, b);
+	fe_mul(r->T, t, b);
+	fe_mul(r->Z, a, d);
+}
+
+// r = 2 * p (dbl-2008-hwcd)
+static void ge_double(ge *r, const ge *p)
+{
+	fe a, b, c, e, t;
+
+	fe_sq(a, p->X);
+	fe_sq(b, p->Y);
+	fe_sq(c, p->Z);
+	fe_add(c, c, c);
+	fe_add(e, p->X, p->Y);
+	fe_sq(e, e);
+	fe_sub(e, e, a);
+	fe_sub(e, e, b);                // E
+
+	fe_add(t, a, b);
+	fe_sub(a, b, a);                // G = B - A
+	fe_sub(b, fe_zero, t);          // H = -A - B
+	fe_sub(c, a, c);                // F = G - C
+	fe_mul(r->X, e, c);
+	fe_mul(r->Y, a, b);
+	fe_mul(r->T, e, b);
+	fe_mul(r->Z, c, a);
+}
+
+// decodes the negated point -A, returns 0 if the encoding is invalid
+static int ge_frombytes_neg(ge *r, const uint8_t s[32])
+{
+	fe u, v, v3, t;
+	int sign = s[31] >> 7;
+
+	load(r->Y, s);
+	r->Y[7] &= 0x7FFFFFFF;
+	memcpy(t, r->Y, sizeof(t));
+	fe_freeze(t);
+	if (memcmp(t, r->Y, sizeof(t)) != 0)
+		return 0;               // y >= p
+	memcpy(r->Z, fe_one, sizeof(fe));
+
+	// x = u v^3 (u v^7)^((p - 5) / 8) with u = y^2 - 1, v = d y^2 + 1
+	fe_sq(u, r->Y);
+	fe_mul(v, u, D);
+	fe_sub(u, u, fe_one);
+	fe_add(v, v, fe_one);
+	fe_sq(v3, v);
+	fe_mul(v3, v3, v);
+	fe_sq(t, v3);
+	fe_mul(t, t, v);
+	fe_mul(t, t, u);
+	fe_pow2523(t, t);
+	fe_mul(t, t, v3);
+	fe_mul(r->X, t, u);
+
+	fe_sq(t, r->X);
+	fe_mul(t, t, v);
+	if (!fe_equal(t, u)) {
+		fe_add(t, t, u);
+		if (!fe_equal(t, fe_zero))
+			return 0;
+		fe_mul(r->X, r->X, SQRTM1);
+	}
+	if (fe_equal(r->X, fe_zero) && sign)
+		return 0;
+	if (fe_isodd(r->X) == sign)
+		fe_sub(r->X, fe_zero, r->X);
+	fe_mul(r->T, r->X, r->Y);
+	return 1;
+}
+
+static void ge_tobytes(uint8_t s[32], const ge *p)
+{
+	fe zi, x, y;
+	int i;
+
+	fe_inv(zi, p->Z);
+	fe_mul(x, p->X, zi);
+	fe_mul(y, p->Y, zi);
+	fe_freeze(x);
+	fe_freeze(y);
+	for (i = 0; i < 32; ++i)
+		s[i] = y[i >> 2] >> (8 * (i & 3));
+	s[31] |= (x[0] & 1) << 7;
+}
+
+// 0 <= a < L ?
+static int sc_is_canonical(const uint32_t a[8])
+{
+	int i;
+
+	for (i = 7; i >= 0; --i) {
+		if (a[i] != L[i])
+			return a[i] < L[i];
+	}
+	return 0;
+}
+
+// r = h mod L for a 512-bit little-endian h, bit by bit
+static void sc_reduce(uint32_t r[8], const uint8_t h[64])
+{
+	uint32_t t[8], borrow, x;
+	int i, j;
+
+	memset(r, 0, 8 * sizeof(uint32_t));
+	for (i = 511; i >= 0; --i) {
+		// r = 2 r + bit < 2 L < 2^254
+		for (j = 7; j > 0; --j)
+			r[j] = (r[j] << 1) | (r[j - 1] >> 31);
+		r[0] = (r[0] << 1) | ((h[i >> 3] >> (i & 7)) & 1);
+
+		borrow = 0;
+		for (j = 0; j < 8; ++j) {
+			x = r[j] - L[j] - borrow;
+			borrow = (r[j] < L[j]) || (r[j] == L[j] && borrow);
+			t[j] = x;
+		}
+		if (!borrow)
+			memcpy(r, t, sizeof(t));
+	}
+}
+
+int ed25519_verify(const uint8_t public_key[ED25519_KEY_SIZE],
+                   const uint8_t *message,
+                   size_t message_len,
+                   const uint8_t signature[ED25519_SIGNATURE_SIZE])
+{
+	SHA512_CTX ctx;
+	uint8_t digest[SHA512_BLOCK_SIZE];
+	uint32_t s[8], h[8];
+	ge table[3], r;
+	int i, index;
+
+	load(s, signature + 32);
+	if (!sc_is_canonical(s))
+		return 0;
+	if (!ge_frombytes_neg(&table[1], public_key))
+		return 0;
+
+	// h = SHA-512(R || A || M) mod L
+	sha512_init(&ctx);
+	sha512_update(&ctx, signature, 32);
+	sha512_update(&ctx, public_key, ED25519_KEY_SIZE);
+	sha512_update(&ctx, message, message_len);
+	sha512_final(&ctx, digest);
+	sc_reduce(h, digest);
+
+	// [S]B + [h](-A) with table = { B, -A, B - A }
+	table[0] = B;
+	fe_mul(table[0].T, B.X, B.Y);
+	ge_add(&table[2], &table[0], &table[1]);
+
+	memset(&r, 0, sizeof(r));
+	r.Y[0] = 1;
+	r.Z[0] = 1;
+	for (i = 252; i >= 0; --i) {
+		ge_double(&r, &r);
+		index = ((s[i >> 5] >> (i & 31)) & 1) | (((h[i >> 5] >> (i & 31)) & 1) << 1);
+		if (index)
+			ge_add(&r, &r, &table[index - 1]);
+	}
+
+	ge_tobytes(digest, &r);
+	return memcmp(digest, signature, 32) == 0;
+}
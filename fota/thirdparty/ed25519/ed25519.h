@@ -0,0 +1,25 @@
+/*********************************************************************
+* Filename:   ed25519.h
+* Details:    Defines the API for the compact Ed25519 signature
+              verifier (RFC 8032, pure Ed25519).
+*********************************************************************/
+
+#ifndef ED25519_H
+#define ED25519_H
+
+/*************************** HEADER FILES ***************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/****************************** MACROS ******************************/
+#define ED25519_KEY_SIZE        32      // encoded public key
+#define ED25519_SIGNATURE_SIZE  64      // R || S
+
+/*********************** FUNCTION DECLARATIONS **********************/
+// Returns 1 if the signature of the message is valid, 0 otherwise.
+int ed25519_verify(const uint8_t public_key[ED25519_KEY_SIZE],
+                   const uint8_t *message,
+                   size_t message_len,
+                   const uint8_t signature[ED25519_SIGNATURE_SIZE]);
+
+#endif   // ED25519_H
@@ -0,0 +1,31 @@
+/*********************************************************************
+* Filename:   sha512.h
+* Details:    Defines the API for the SHA-512 implementation used by
+              the Ed25519 verifier.
+*********************************************************************/
+
+#ifndef SHA512_H
+#define SHA512_H
+
+/*************************** HEADER FILES ***************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/****************************** MACROS ******************************/
+#define SHA512_BLOCK_SIZE 64            // SHA512 outputs a 64 byte digest
+
+/**************************** DATA TYPES ****************************/
+typedef struct {
+	uint8_t data[128];
+	uint32_t datalen;
+	uint64_t bitlen;
+	uint64_t state[8];
+} SHA512_CTX;
+
+/*********************** FUNCTION DECLARATIONS **********************/
+void sha512_init(SHA512_CTX *ctx);
+void sha512_update(SHA512_CTX *ctx, const uint8_t data[], size_t len);
+// big-endian digest as specified, unlike sha256_final()
+void sha512_final(SHA512_CTX *ctx, uint8_t hash[]);
+
+#endif   // SHA512_H
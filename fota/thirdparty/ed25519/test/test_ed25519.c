@@ -0,0 +1,182 @@
+/*********************************************************************
+* Filename:   test_ed25519.c
+* Details:    Host test vectors for ed25519.c and a speed comparison
+              with the micro-ecc secp256r1 verification.
+              Build and run from this directory with e.g.
+                cc -O2 -I.. -I../../micro-ecc -o test_ed25519 test_ed25519.c \
+                   ../ed25519.c ../sha512.c ../../micro-ecc/uECC.c
+                ./test_ed25519
+              Code size, e.g. for the target:
+                arm-none-eabi-gcc -mcpu=cortex-m3 -mthumb -Os -I../../micro-ecc -c \
+                   ../ed25519.c ../sha512.c ../../micro-ecc/uECC.c
+                arm-none-eabi-size *.o
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ed25519.h"
+#include "uECC.h"
+
+/****************************** MACROS ******************************/
+#define NUM_BENCH       200
+
+/**************************** VARIABLES *****************************/
+static const struct {
+	const char *key;
+	const char *msg;
+	const char *sig;
+} vectors[] = {
+	// RFC 8032 section 7.1, tests 1 to 3
+	{ "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+	  "",
+	  "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555"
+	  "fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b" },
+	{ "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+	  "72",
+	  "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+	  "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00" },
+	{ "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+	  "af82",
+	  "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+	  "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a" },
+	// little-endian SHA-256 image hashes signed by mkfotaimg.py
+	{ "9e6f0842b168bbd1690c89ca0033eb89ac819ac27aa2e077524f2d6bceca26b8",
+	  "1da0af1706a31185763837b33f1d90782c0a78bbe644a59c987ab3ff9c0b346e",
+	  "e939219194e13e82aec099aaff1381dbf056b54b067442e2b1adc37493120b9b"
+	  "5ad0d0e2fe111b6cd78ef8da9f74e44ba8dc9173ca177b43aa0e65cb7c7feb01" },
+	{ "2080edad1b0914bd21c54c55f8a2928a095e61b798dfebaba21922adfdbf3a10",
+	  "9a4585773ce2ccd7a585c331d60a60d1e3b7d28cbb2ede3bc55445342f12f54b",
+	  "a8eace05862326ec1fb1dbc048bd04dc75bba15645d28e90d333d4825dc3d26a"
+	  "46506322b8158100c297fce78bb395c221773eac6ffb7fe0d72dfec8537e2005" },
+	{ "85d6ab8abfcdf4954c2998163ada23dff0122274d63852b249242c670e4934f8",
+	  "86d9576498ea764b49243efeb05df625010438c6a55d5b578de4ff00c9b4c1db",
+	  "eb06949e5151d3b19729d1a5b55f2a99a0be1f250a046593e467002a242ab9d7"
+	  "eab056fe9e16ebcbf473a7db7a7fbfadbb92bddb91ac7354b44aa0c5ba556c01" },
+	{ "a9371e70ce77da6d6a6dfca73998b2b47c8b9e6b938b36090254163677bb034e",
+	  "c529ffad9a5ab61162b11d616b639e00586ba846746a197d4daf78b908ed4f08",
+	  "0e820b18ca422d814d886c0d866c3a505410ea16a6ce0c86dfaad90181304259"
+	  "6afb75939de4079be0cda87f30bdd430ce73e8d1d7223646aa333acdb2a99e02" },
+	{ "9865d6d91c8ccc71d86d121768b3a549c635fb3d96f7d3906897216cea014956",
+	  "719ec881a39ca062f09262ff75fc8a06d6cb91ad078c4d344723508c509c2de5",
+	  "2a4ce3fe3eed05b168a96b25a5b9490b237514b7f83f033d2ec8fa2e9faf19c6"
+	  "cb4bce78c8773ee59d7ec72f7c5df2d944e737a8e81cdce5abe8f06037bcb50f" },
+	{ "04d806dd957f68b6721b056bde60dc1bd8d0b3c1b0938c647475c075b0844bc7",
+	  "db43b75a9c05eb89ae926b7b1d5081e79def64a210f5b6bd0d0be3e99a9a7be7",
+	  "5abdf09e94e711c2d5229fdf597416b1b4c038e039177a0b5b9886cd7926f632"
+	  "9b501e007741f66f9932a8bd211364b5641a114d82dc542b29994cd1c8eb8e01" },
+	{ "bcf1c63dd5e61dfab1e39ec274ece3eb7c556fad12575d795d7d079577e80117",
+	  "f6ecc50886479df8bea823e5b8b939c934efa139c08b96b9a07dd2fa986e5867",
+	  "1e3ee5f32dbe821cee401aa11160cb4bd1c7464dcd5065698aca644edb21e135"
+	  "d7d9e1eb6b168ac5286db48948accfeb021a8ffadeb22b2c8c6b88820ece6d01" },
+	{ "700ba69244a6252b863ba61f7b1fb1e472272b7a95a60669717a9c93b1d39cb7",
+	  "79e85e001fbfc77ddace79b61d3988fd48a77779937252f46c7ed2f6588735ca",
+	  "8ee031ab862f68998d7798aabdaff19c8a783417572f3367162a8f72c478eb2f"
+	  "d8194eaa833ad4808c7105afa50c5048267f1636a658b513855484d9442ed80f" },
+};
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+static size_t from_hex(uint8_t *out, const char *hex)
+{
+	size_t n = 0;
+	unsigned int b;
+
+	while (hex[0] && sscanf(hex, "%2x", &b) == 1) {
+		out[n++] = b;
+		hex += 2;
+	}
+	return n;
+}
+
+static int test_vectors(void)
+{
+	uint8_t key[32], msg[64], sig[64], bad[64];
+	size_t i, len;
+	int bit, fail = 0;
+
+	for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+		from_hex(key, vectors[i].key);
+		len = from_hex(msg, vectors[i].msg);
+		from_hex(sig, vectors[i].sig);
+
+		if (!ed25519_verify(key, msg, len, sig)) {
+			printf("vector %d rejected\n", (int)i);
+			fail = 1;
+		}
+		// every single bit error of the signature must be detected
+		for (bit = 0; bit < 8 * 64; ++bit) {
+			memcpy(bad, sig, sizeof(sig));
+			bad[bit / 8] ^= 1 << (bit % 8);
+			if (ed25519_verify(key, msg, len, bad)) {
+				printf("vector %d accepted with bit %d flipped\n", (int)i, bit);
+				fail = 1;
+			}
+		}
+		if (len > 0) {
+			msg[0] ^= 1;
+			if (ed25519_verify(key, msg, len, sig)) {
+				printf("vector %d accepted a wrong message\n", (int)i);
+				fail = 1;
+			}
+			msg[0] ^= 1;
+		}
+		key[0] ^= 1;
+		if (ed25519_verify(key, msg, len, sig)) {
+			printf("vector %d accepted a wrong key\n", (int)i);
+			fail = 1;
+		}
+	}
+	return fail;
+}
+
+static double bench_ed25519(void)
+{
+	uint8_t key[32], msg[32], sig[64];
+	clock_t start;
+	int i;
+
+	from_hex(key, vectors[3].key);
+	from_hex(msg, vectors[3].msg);
+	from_hex(sig, vectors[3].sig);
+	start = clock();
+	for (i = 0; i < NUM_BENCH; ++i)
+		ed25519_verify(key, msg, sizeof(msg), sig);
+	return (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / NUM_BENCH;
+}
+
+static double bench_ecdsa(int use_table)
+{
+	static uint8_t table[uECC_TABLE_SIZE(32)];
+	uint8_t private[32], public[64], hash[32] = { 1 }, sig[64];
+	uECC_Curve curve = uECC_secp256r1();
+	clock_t start;
+	int i;
+
+	uECC_make_key(public, private, curve);
+	uECC_compute_table(public, table, curve);
+	uECC_sign(private, hash, sizeof(hash), sig, curve);
+	start = clock();
+	for (i = 0; i < NUM_BENCH; ++i) {
+		if (use_table)
+			uECC_verify_table(public, table, hash, sizeof(hash), sig, curve);
+		else
+			uECC_verify(public, hash, sizeof(hash), sig, curve);
+	}
+	return (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / NUM_BENCH;
+}
+
+int main()
+{
+	if (test_vectors()) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("test vectors passed\n");
+
+	printf("%-28s %8s\n", "verification", "[us]");
+	printf("%-28s %8.0f\n", "Ed25519", bench_ed25519());
+	printf("%-28s %8.0f\n", "secp256r1 uECC_verify", bench_ecdsa(0));
+	printf("%-28s %8.0f\n", "secp256r1 uECC_verify_table", bench_ecdsa(1));
+	return 0;
+}
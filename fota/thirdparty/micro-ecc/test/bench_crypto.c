@@ -0,0 +1,343 @@
+/* Copyright 2014, Kenneth MacKay. Licensed under the BSD 2-clause license. */
+
+/* Known-answer tests and benchmark of the image verification primitives,
+   SHA-256 and ECDSA on every enabled curve. Prints one JSON object with the
+   configuration, the test results and the lowest cost per operation.
+   ../../../tools/cryptobench.py builds it for each uECC_OPTIMIZATION_LEVEL
+   and uECC_SQUARE_FUNC and compares the results against a baseline. Build
+   and run a single configuration from this directory with e.g.
+     cc -O2 -I.. -I../../sha256 -DuECC_WORD_SIZE=4 -o bench_crypto \
+        bench_crypto.c ../uECC.c ../../sha256/sha256.c
+     ./bench_crypto
+   The counter is the x86 time stamp counter when available and nanoseconds
+   otherwise. */
+
+#include "uECC.h"
+#include "sha256.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define COUNTER_NAME "tsc"
+static uint64_t counter(void) {
+    return __rdtsc();
+}
+#else
+#define COUNTER_NAME "ns"
+static uint64_t counter(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+#define SECTOR_SIZE     2048
+#define QUANTUM_SIZE    8
+#define NUM_SECTORS     255
+#define MAX_SAMPLES     255
+#define MIN_SAMPLES     5
+#define MIN_TIME        (CLOCKS_PER_SEC / 4)
+
+/* FIPS 180-2 appendix B, the digest is big-endian */
+static const struct {
+    const char *msg;
+    unsigned repeat;
+    const char *digest;
+} sha_kat[] = {
+    { "abc", 1,
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "a", 1000000,
+      "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+/* Deterministic ECDSA with SHA-256 over "sample". The NIST curves are the
+   RFC 6979 appendix A.2 vectors, the others were generated the same way.
+   All values are big-endian as printed in the RFC. */
+typedef struct {
+    const char *name;
+    uECC_Curve (*curve)(void);
+    const char *private;
+    const char *x;
+    const char *y;
+    const char *r;
+    const char *s;
+} ecc_kat_t;
+
+static const ecc_kat_t ecc_kat[] = {
+#if uECC_SUPPORTS_secp160r1
+    { "secp160r1", uECC_secp160r1,
+      "AA802842F341A396081DD09D4DAF74A0F75A6F03",
+      "188A2148D8E8F4ED4871F491801EE304FEDCCF9E",
+      "6CDE38D0761C689A0FCFC976096C1B7E9604AC97",
+      "940660142B3C8F5431016F310D0A5FC5813201DF",
+      "767F35D30ECC642132C32AF48F0ED043629B6327" },
+#endif
+#if uECC_SUPPORTS_secp192r1
+    { "secp192r1", uECC_secp192r1,
+      "6FAB034934E4C0FC9AE67F5B5659A9D7D1FEFD187EE09FD4",
+      "AC2C77F529F91689FEA0EA5EFEC7F210D8EEA0B9E047ED56",
+      "3BC723E57670BD4887EBC732C523063D0A7C957BC97C1C43",
+      "4B0B8CE98A92866A2820E20AA6B75B56382E0F9BFD5ECB55",
+      "CCDB006926EA9565CBADC840829D8C384E06DE1F1E381B85" },
+#endif
+#if uECC_SUPPORTS_secp224r1
+    { "secp224r1", uECC_secp224r1,
+      "F220266E1105BFE3083E03EC7A3A654651F45E37167E88600BF257C1",
+      "00CF08DA5AD719E42707FA431292DEA11244D64FC51610D94B130D6C",
+      "EEAB6F3DEBE455E3DBF85416F7030CBD94F34F2D6F232C69F3C1385A",
+      "61AA3DA010E8E8406C656BC477A7A7189895E7E840CDFE8FF42307BA",
+      "BC814050DAB5D23770879494F9E0A680DC1AF7161991BDE692B10101" },
+#endif
+#if uECC_SUPPORTS_secp256r1
+    { "secp256r1", uECC_secp256r1,
+      "C9AFA9D845BA75166B5C215767B1D6934E50C3DB36E89B127B8A622B120F6721",
+      "60FED4BA255A9D31C961EB74C6356D68C049B8923B61FA6CE669622E60F29FB6",
+      "7903FE1008B8BC99A41AE9E95628BC64F2F1B20C2D7E9F5177A3C294D4462299",
+      "EFD48B2AACB6A8FD1140DD9CD45E81D69D2C877B56AAF991C34D0EA84EAF3716",
+      "F7CB1C942D657C41D436C7A1B6E29F65F3E900DBB9AFF4064DC4AB2F843ACDA8" },
+#endif
+#if uECC_SUPPORTS_secp256k1
+    { "secp256k1", uECC_secp256k1,
+      "A5710A63AA78394E65457D79073778B655308F9B824B22E0E0C512B23A421027",
+      "2BD3229CBD229F461EA8CCB3108B9D865B5CAB9A625877B13E8204A8020C480A",
+      "074AEA132848F1B1E2BED49DBBFF04CB40C92B793656FFFC15B80BD94D7B83EB",
+      "9B76905DFE67446B7E5132F733650A0A6ABD562040E76B32AFB37193FE764FC8",
+      "5E55E3599225CB24901F635450AAC8A493E28ED4A44DC4CDAF300AC6CEA0B263" },
+#endif
+};
+
+#define NUM_ECC_KAT (sizeof(ecc_kat) / sizeof(ecc_kat[0]))
+
+/* The fastest sample is the least disturbed by the rest of the host. */
+static uint64_t minimum(const uint64_t *sample, unsigned count) {
+    uint64_t min = sample[0];
+    unsigned i;
+
+    for (i = 1; i < count; ++i) {
+        if (sample[i] < min) {
+            min = sample[i];
+        }
+    }
+    return min;
+}
+
+/* Converts big-endian hex to a little-endian number of size bytes, as used by
+   uECC with uECC_VLI_NATIVE_LITTLE_ENDIAN. */
+static void hex_to_le(const char *hex, uint8_t *out, unsigned size) {
+    unsigned len = strlen(hex) / 2;
+    unsigned i;
+
+    memset(out, 0, size);
+    for (i = 0; i < len && i < size; ++i) {
+        unsigned byte;
+
+        sscanf(hex + 2 * (len - 1 - i), "%2x", &byte);
+        out[i] = byte;
+    }
+}
+
+static int test_sha256(void) {
+    SHA256_CTX ctx;
+    uint8_t hash[SHA256_BLOCK_SIZE];
+    uint8_t expect[SHA256_BLOCK_SIZE];
+    unsigned i, j;
+    int fail = 0;
+
+    for (i = 0; i < sizeof(sha_kat) / sizeof(sha_kat[0]); ++i) {
+        sha256_init(&ctx);
+        for (j = 0; j < sha_kat[i].repeat; ++j) {
+            sha256_update(&ctx, (const BYTE *)sha_kat[i].msg, strlen(sha_kat[i].msg));
+        }
+        /* the output is little-endian (SHA256_FINAL_LE) */
+        sha256_final(&ctx, hash);
+        hex_to_le(sha_kat[i].digest, expect, sizeof(expect));
+        fail |= memcmp(hash, expect, sizeof(hash)) != 0;
+    }
+    return fail;
+}
+
+/* Hash of the message in the form uECC expects it: the leftmost bytes of the
+   digest up to the size of the curve order, little-endian. */
+static unsigned message_hash(uint8_t *hash, uECC_Curve curve) {
+    uint8_t digest[SHA256_BLOCK_SIZE];
+    unsigned size = (uECC_curve_private_key_size(curve) < SHA256_BLOCK_SIZE) ?
+        uECC_curve_private_key_size(curve) : SHA256_BLOCK_SIZE;
+
+    sha256((const BYTE *)"sample", 6, digest);
+    memcpy(hash, digest + SHA256_BLOCK_SIZE - size, size);
+    return size;
+}
+
+static int test_ecc(const ecc_kat_t *kat) {
+    uECC_Curve curve = kat->curve();
+    unsigned size = uECC_curve_public_key_size(curve) / 2;
+    /* native little-endian numbers are accessed in whole words */
+    uint8_t private[36];
+    uint8_t public[64], expect[64];
+    uint8_t hash[36];
+    uint8_t sig[64], bad[64];
+    unsigned hash_size = message_hash(hash, curve);
+
+    hex_to_le(kat->private, private, sizeof(private));
+    hex_to_le(kat->r, sig, size);
+    hex_to_le(kat->s, sig + size, size);
+    if (!uECC_compute_public_key(private, public, curve)) {
+        return 1;
+    }
+    hex_to_le(kat->x, expect, size);
+    hex_to_le(kat->y, expect + size, size);
+    if (memcmp(public, expect, 2 * size) != 0 ||
+            !uECC_valid_public_key(public, curve) ||
+            !uECC_verify(public, hash, hash_size, sig, curve)) {
+        return 1;
+    }
+
+    /* a wrong hash or signature must be rejected, the low bits of the hash
+       are dropped for secp160r1 */
+    hash[hash_size - 1] ^= 0x80;
+    if (uECC_verify(public, hash, hash_size, sig, curve)) {
+        return 1;
+    }
+    hash[hash_size - 1] ^= 0x80;
+    memcpy(bad, sig, sizeof(sig));
+    bad[size] ^= 0x01;
+    if (uECC_verify(public, hash, hash_size, bad, curve)) {
+        return 1;
+    }
+
+    /* signatures with a random nonce must verify */
+    if (!uECC_sign(private, hash, hash_size, bad, curve) ||
+            !uECC_verify(public, hash, hash_size, bad, curve)) {
+        return 1;
+    }
+#if uECC_SUPPORTS_VERIFY_TABLE
+    if (curve == uECC_secp256r1()) {
+        static uint8_t table[uECC_TABLE_SIZE(32)];
+
+        if (!uECC_compute_table(public, table, curve) ||
+                !uECC_verify_table(public, table, hash, hash_size, sig, curve)) {
+            return 1;
+        }
+        hash[hash_size - 1] ^= 0x80;
+        if (uECC_verify_table(public, table, hash, hash_size, sig, curve)) {
+            return 1;
+        }
+        hash[hash_size - 1] ^= 0x80;
+    }
+#endif
+    return 0;
+}
+
+/* Cost per byte of hashing a flash sector in one update and in flash
+   quantum sized updates. */
+static double bench_sha256(size_t part) {
+    static uint8_t sector[SECTOR_SIZE];
+    static uint64_t sample[NUM_SECTORS];
+    SHA256_CTX ctx;
+    uint8_t hash[SHA256_BLOCK_SIZE];
+    unsigned i;
+    size_t j;
+
+    for (i = 0; i < NUM_SECTORS; ++i) {
+        uint64_t start;
+
+        sector[0] = i;
+        start = counter();
+        sha256_init(&ctx);
+        for (j = 0; j < SECTOR_SIZE; j += part) {
+            sha256_update(&ctx, sector + j, part);
+        }
+        sha256_final(&ctx, hash);
+        sample[i] = counter() - start;
+    }
+    return (double)minimum(sample, NUM_SECTORS) / SECTOR_SIZE;
+}
+
+enum { OP_SIGN, OP_VERIFY, OP_VERIFY_TABLE };
+
+/* Cost of an operation, sampled for at least MIN_TIME. */
+static uint64_t bench_ecc(int op, const ecc_kat_t *kat) {
+#if uECC_SUPPORTS_VERIFY_TABLE
+    static uint8_t table[uECC_TABLE_SIZE(32)];
+#endif
+    static uint64_t sample[MAX_SAMPLES];
+    uECC_Curve curve = kat->curve();
+    uint8_t private[36];
+    uint8_t public[64];
+    uint8_t hash[36];
+    uint8_t sig[64];
+    unsigned hash_size = message_hash(hash, curve);
+    unsigned count = 0;
+    clock_t start = clock();
+
+    hex_to_le(kat->private, private, sizeof(private));
+    uECC_compute_public_key(private, public, curve);
+    uECC_sign(private, hash, hash_size, sig, curve);
+#if uECC_SUPPORTS_VERIFY_TABLE
+    if (op == OP_VERIFY_TABLE) {
+        uECC_compute_table(public, table, curve);
+    }
+#endif
+
+    while (count < MAX_SAMPLES && (count < MIN_SAMPLES || clock() - start < MIN_TIME)) {
+        uint64_t begin = counter();
+
+        switch (op) {
+        case OP_SIGN:
+            uECC_sign(private, hash, hash_size, sig, curve);
+            break;
+        case OP_VERIFY:
+            uECC_verify(public, hash, hash_size, sig, curve);
+            break;
+        default:
+#if uECC_SUPPORTS_VERIFY_TABLE
+            uECC_verify_table(public, table, hash, hash_size, sig, curve);
+#endif
+            break;
+        }
+        sample[count++] = counter() - begin;
+    }
+    return minimum(sample, count);
+}
+
+int main() {
+    int fail = 0;
+    int kat_fail;
+    unsigned i;
+
+    printf("{\n");
+    printf("  \"config\": {\"uECC_OPTIMIZATION_LEVEL\": %d, \"uECC_SQUARE_FUNC\": %d, "
+           "\"uECC_WORD_SIZE\": %d, \"uECC_SUPPORTS_VERIFY_TABLE\": %d, \"counter\": \"%s\"},\n",
+           uECC_OPTIMIZATION_LEVEL, uECC_SQUARE_FUNC, uECC_WORD_SIZE,
+           uECC_SUPPORTS_VERIFY_TABLE, COUNTER_NAME);
+
+    kat_fail = test_sha256();
+    fail |= kat_fail;
+    printf("  \"sha256\": {\"kat\": \"%s\", \"sector_per_byte\": %.2f, \"quantum_per_byte\": %.2f},\n",
+           kat_fail ? "fail" : "pass", bench_sha256(SECTOR_SIZE), bench_sha256(QUANTUM_SIZE));
+
+    printf("  \"ecc\": {");
+    for (i = 0; i < NUM_ECC_KAT; ++i) {
+        kat_fail = test_ecc(&ecc_kat[i]);
+        fail |= kat_fail;
+        printf("%s\n    \"%s\": {\"kat\": \"%s\", \"sign\": %llu, \"verify\": %llu",
+               i ? "," : "", ecc_kat[i].name, kat_fail ? "fail" : "pass",
+               (unsigned long long)bench_ecc(OP_SIGN, &ecc_kat[i]),
+               (unsigned long long)bench_ecc(OP_VERIFY, &ecc_kat[i]));
+#if uECC_SUPPORTS_VERIFY_TABLE
+        if (ecc_kat[i].curve() == uECC_secp256r1()) {
+            printf(", \"verify_table\": %llu",
+                   (unsigned long long)bench_ecc(OP_VERIFY_TABLE, &ecc_kat[i]));
+        }
+#endif
+        printf("}");
+    }
+    printf("\n  }\n}\n");
+    return fail;
+}
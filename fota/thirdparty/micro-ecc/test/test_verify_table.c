@@ -0,0 +1,104 @@
+/* Copyright 2014, Kenneth MacKay. Licensed under the BSD 2-clause license. */
+
+/* Checks uECC_verify_table() against uECC_verify() and compares their speed.
+   Build and run from this directory with e.g.
+     cc -O2 -I.. -o test_verify_table test_verify_table.c ../uECC.c
+     ./test_verify_table
+   On the target the ECDSA time per image is reported by the DFU telemetry. */
+
+#include "uECC.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_KEYS    64
+#define NUM_BENCH   200
+
+static uint8_t public[64];
+static uint8_t table[uECC_TABLE_SIZE(32)];
+
+static double bench(int use_table, const uint8_t *hash, const uint8_t *sig, uECC_Curve curve) {
+    clock_t start = clock();
+    int i;
+
+    for (i = 0; i < NUM_BENCH; ++i) {
+        if (use_table) {
+            uECC_verify_table(public, table, hash, 32, sig, curve);
+        } else {
+            uECC_verify(public, hash, 32, sig, curve);
+        }
+    }
+    return (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / NUM_BENCH;
+}
+
+int main() {
+    int i, b;
+    uint8_t private[32] = {0};
+    uint8_t hash[32] = {0};
+    uint8_t sig[64] = {0};
+    uint8_t bad[64];
+    double plain, fast;
+    uECC_Curve curve = uECC_secp256r1();
+
+    printf("Testing %d keys\n", NUM_KEYS);
+    for (i = 0; i < NUM_KEYS; ++i) {
+        if (!uECC_make_key(public, private, curve) ||
+                !uECC_compute_table(public, table, curve)) {
+            printf("key generation failed\n");
+            return 1;
+        }
+        if (memcmp(table, public, sizeof(public)) != 0) {
+            printf("first table entry is not the public key\n");
+            return 1;
+        }
+        memcpy(hash, table + sizeof(table) - sizeof(hash), sizeof(hash));
+
+        if (!uECC_sign(private, hash, sizeof(hash), sig, curve)) {
+            printf("uECC_sign() failed\n");
+            return 1;
+        }
+        if (!uECC_verify_table(public, table, hash, sizeof(hash), sig, curve)) {
+            printf("uECC_verify_table() rejected a valid signature\n");
+            return 1;
+        }
+
+        /* corrupted signature, hash and table must be rejected */
+        for (b = 0; b < 8; ++b) {
+            int bit = (i * 8 + b) % (8 * sizeof(sig));
+
+            memcpy(bad, sig, sizeof(sig));
+            bad[bit / 8] ^= 1 << (bit % 8);
+            if (uECC_verify_table(public, table, hash, sizeof(hash), bad, curve) !=
+                    uECC_verify(public, hash, sizeof(hash), bad, curve)) {
+                printf("uECC_verify_table() differs for a corrupted signature\n");
+                return 1;
+            }
+        }
+        hash[i % sizeof(hash)] ^= 0x80;
+        if (uECC_verify_table(public, table, hash, sizeof(hash), sig, curve)) {
+            printf("uECC_verify_table() accepted a wrong hash\n");
+            return 1;
+        }
+        hash[i % sizeof(hash)] ^= 0x80;
+        for (b = sizeof(public); b < (int)sizeof(table); b += sizeof(public)) {
+            table[b + i] ^= 0x01;
+        }
+        if (uECC_verify_table(public, table, hash, sizeof(hash), sig, curve)) {
+            printf("uECC_verify_table() accepted a corrupted table\n");
+            return 1;
+        }
+        for (b = sizeof(public); b < (int)sizeof(table); b += sizeof(public)) {
+            table[b + i] ^= 0x01;
+        }
+        printf(".");
+        fflush(stdout);
+    }
+    printf("\n");
+
+    plain = bench(0, hash, sig, curve);
+    fast = bench(1, hash, sig, curve);
+    printf("uECC_verify()       %8.0f us\n", plain);
+    printf("uECC_verify_table() %8.0f us (%.2fx)\n", fast, plain / fast);
+    return 0;
+}
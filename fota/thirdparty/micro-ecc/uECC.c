@@ -1451,6 +1451,72 @@ static bitcount_t smax(bitcount_t a, bitcount_t b) {
     return (a > b ? a : b);
 }
 
+/* Computes u1 = e/s and u2 = r/s of a signature (r, s), and returns r.
+   Returns 0 if r or s is out of range. */
+static int verify_scalars(uECC_word_t *u1,
+                          uECC_word_t *u2,
+                          uECC_word_t *r,
+                          const uint8_t *message_hash,
+                          unsigned hash_size,
+                          const uint8_t *signature,
+                          uECC_Curve curve) {
+    uECC_word_t z[uECC_MAX_WORDS];
+    uECC_word_t s[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+
+    r[num_n_words - 1] = 0;
+    s[num_n_words - 1] = 0;
+
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    bcopy((uint8_t *) r, signature, curve->num_bytes);
+    bcopy((uint8_t *) s, signature + curve->num_bytes, curve->num_bytes);
+#else
+    uECC_vli_bytesToNative(r, signature, curve->num_bytes);
+    uECC_vli_bytesToNative(s, signature + curve->num_bytes, curve->num_bytes);
+#endif
+
+    /* r, s must not be 0. */
+    if (uECC_vli_isZero(r, num_words) || uECC_vli_isZero(s, num_words)) {
+        return 0;
+    }
+
+    /* r, s must be < n. */
+    if (uECC_vli_cmp_unsafe(curve->n, r, num_n_words) != 1 ||
+            uECC_vli_cmp_unsafe(curve->n, s, num_n_words) != 1) {
+        return 0;
+    }
+
+    /* Calculate u1 and u2. */
+    uECC_vli_modInv(z, s, curve->n, num_n_words); /* z = 1/s */
+    u1[num_n_words - 1] = 0;
+    bits2int(u1, message_hash, hash_size, curve);
+    uECC_vli_modMult(u1, u1, z, curve->n, num_n_words); /* u1 = e/s */
+    uECC_vli_modMult(u2, r, z, curve->n, num_n_words); /* u2 = r/s */
+    return 1;
+}
+
+/* Converts (rx, ry, z) = u1*G + u2*Q to affine and accepts only if x mod n == r. */
+static int verify_result(uECC_word_t *rx,
+                         uECC_word_t *ry,
+                         uECC_word_t *z,
+                         const uECC_word_t *r,
+                         uECC_Curve curve) {
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+
+    uECC_vli_modInv(z, z, curve->p, num_words); /* Z = 1/Z */
+    apply_z(rx, ry, z, curve);
+
+    /* v = x1 (mod n) */
+    if (uECC_vli_cmp_unsafe(curve->n, rx, num_n_words) != 1) {
+        uECC_vli_sub(rx, rx, curve->n, num_n_words);
+    }
+
+    /* Accept only if v == r. */
+    return (int)(uECC_vli_equal(rx, r, num_words));
+}
+
 int uECC_verify(const uint8_t *public_key,
                 const uint8_t *message_hash,
                 unsigned hash_size,
@@ -1473,43 +1539,22 @@ int uECC_verify(const uint8_t *public_key,
 #else
     uECC_word_t _public[uECC_MAX_WORDS * 2];
 #endif    
-    uECC_word_t r[uECC_MAX_WORDS], s[uECC_MAX_WORDS];
+    uECC_word_t r[uECC_MAX_WORDS];
     wordcount_t num_words = curve->num_words;
     wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
 
     rx[num_n_words - 1] = 0;
-    r[num_n_words - 1] = 0;
-    s[num_n_words - 1] = 0;
 
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    bcopy((uint8_t *) r, signature, curve->num_bytes);
-    bcopy((uint8_t *) s, signature + curve->num_bytes, curve->num_bytes);
-#else
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
     uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
     uECC_vli_bytesToNative(
         _public + num_words, public_key + curve->num_bytes, curve->num_bytes);
-    uECC_vli_bytesToNative(r, signature, curve->num_bytes);
-    uECC_vli_bytesToNative(s, signature + curve->num_bytes, curve->num_bytes);
 #endif
 
-    /* r, s must not be 0. */
-    if (uECC_vli_isZero(r, num_words) || uECC_vli_isZero(s, num_words)) {
-        return 0;
-    }
-
-    /* r, s must be < n. */
-    if (uECC_vli_cmp_unsafe(curve->n, r, num_n_words) != 1 ||
-            uECC_vli_cmp_unsafe(curve->n, s, num_n_words) != 1) {
+    if (!verify_scalars(u1, u2, r, message_hash, hash_size, signature, curve)) {
         return 0;
     }
 
-    /* Calculate u1 and u2. */
-    uECC_vli_modInv(z, s, curve->n, num_n_words); /* z = 1/s */
-    u1[num_n_words - 1] = 0;
-    bits2int(u1, message_hash, hash_size, curve);
-    uECC_vli_modMult(u1, u1, z, curve->n, num_n_words); /* u1 = e/s */
-    uECC_vli_modMult(u2, r, z, curve->n, num_n_words); /* u2 = r/s */
-
     /* Calculate sum = G + Q. */
     uECC_vli_set(sum, _public, num_words);
     uECC_vli_set(sum + num_words, _public + num_words, num_words);
@@ -1551,18 +1596,176 @@ int uECC_verify(const uint8_t *public_key,
         }
     }
 
-    uECC_vli_modInv(z, z, curve->p, num_words); /* Z = 1/Z */
-    apply_z(rx, ry, z, curve);
+    return verify_result(rx, ry, z, r, curve);
+}
 
-    /* v = x1 (mod n) */
-    if (uECC_vli_cmp_unsafe(curve->n, rx, num_n_words) != 1) {
-        uECC_vli_sub(rx, rx, curve->n, num_n_words);
+#if uECC_SUPPORTS_VERIFY_TABLE
+
+#define uECC_TABLE_TEETH 4
+
+/* Distance of the comb teeth in bits. */
+static bitcount_t comb_spacing(uECC_Curve curve) {
+    return (curve->num_n_bits + uECC_TABLE_TEETH - 1) / uECC_TABLE_TEETH;
+}
+
+/* Returns the table index of the comb column i of scalar k. */
+static uECC_word_t comb_index(const uECC_word_t *k, bitcount_t i, bitcount_t spacing) {
+    uECC_word_t index = 0;
+    wordcount_t j;
+
+    for (j = uECC_TABLE_TEETH - 1; j >= 0; --j) {
+        index = (index << 1) | !!uECC_vli_testBit(k, i + j * spacing);
     }
+    return index;
+}
 
-    /* Accept only if v == r. */
-    return (int)(uECC_vli_equal(rx, r, num_words));
+/* (rx, ry, z) += (tx, ty), where the sum is empty while *empty is set.
+   tx and ty are destroyed. */
+static void comb_add(uECC_word_t *rx,
+                     uECC_word_t *ry,
+                     uECC_word_t *z,
+                     uECC_word_t *tx,
+                     uECC_word_t *ty,
+                     uECC_word_t *empty,
+                     uECC_Curve curve) {
+    uECC_word_t tz[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+
+    if (*empty) {
+        uECC_vli_set(rx, tx, num_words);
+        uECC_vli_set(ry, ty, num_words);
+        uECC_vli_clear(z, num_words);
+        z[0] = 1;
+        *empty = 0;
+        return;
+    }
+    apply_z(tx, ty, z, curve);
+    uECC_vli_modSub(tz, rx, tx, curve->p, num_words); /* Z = x2 - x1 */
+    XYcZ_add(tx, ty, rx, ry, curve);
+    uECC_vli_modMult_fast(z, z, tz, curve);
 }
 
+int uECC_compute_table(const uint8_t *public_key, uint8_t *public_key_table, uECC_Curve curve) {
+    uECC_word_t _public[uECC_MAX_WORDS * 2];
+    uECC_word_t point[uECC_MAX_WORDS * 2];
+    uECC_word_t k[uECC_MAX_WORDS];
+    bitcount_t spacing = comb_spacing(curve);
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    unsigned num_bytes = curve->num_bytes;
+    uECC_word_t index;
+    wordcount_t j;
+
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    bcopy((uint8_t *) _public, public_key, num_bytes * 2);
+#else
+    uECC_vli_bytesToNative(_public, public_key, num_bytes);
+    uECC_vli_bytesToNative(_public + num_words, public_key + num_bytes, num_bytes);
+#endif
+
+    if (!uECC_valid_point(_public, curve)) {
+        return 0;
+    }
+
+    for (index = 1; index < (1 << uECC_TABLE_TEETH); ++index) {
+        uint8_t *entry = public_key_table + (index - 1) * num_bytes * 2;
+
+        uECC_vli_clear(k, num_n_words);
+        for (j = 0; j < uECC_TABLE_TEETH; ++j) {
+            if (index & (1 << j)) {
+                bitcount_t bit = j * spacing;
+                k[bit >> uECC_WORD_BITS_SHIFT] |= (uECC_word_t)1 << (bit & uECC_WORD_BITS_MASK);
+            }
+        }
+
+        /* The ladder needs at least two bits. */
+        if (index == 1) {
+            uECC_vli_set(point, _public, num_words * 2);
+        } else {
+            EccPoint_mult(point, _public, k, 0, uECC_vli_numBits(k, num_n_words), curve);
+        }
+
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+        bcopy(entry, (uint8_t *) point, num_bytes * 2);
+#else
+        uECC_vli_nativeToBytes(entry, num_bytes, point);
+        uECC_vli_nativeToBytes(entry + num_bytes, num_bytes, point + num_words);
+#endif
+    }
+    return 1;
+}
+
+int uECC_verify_table(const uint8_t *public_key,
+                      const uint8_t *public_key_table,
+                      const uint8_t *message_hash,
+                      unsigned hash_size,
+                      const uint8_t *signature,
+                      uECC_Curve curve) {
+    uECC_word_t u1[uECC_MAX_WORDS], u2[uECC_MAX_WORDS];
+    uECC_word_t z[uECC_MAX_WORDS];
+    uECC_word_t rx[uECC_MAX_WORDS];
+    uECC_word_t ry[uECC_MAX_WORDS];
+    uECC_word_t tx[uECC_MAX_WORDS];
+    uECC_word_t ty[uECC_MAX_WORDS];
+    uECC_word_t r[uECC_MAX_WORDS];
+    uECC_word_t empty = 1;
+    const uECC_word_t *G_table = curve_G_table(curve);
+    const uint8_t *entry;
+    bitcount_t spacing = comb_spacing(curve);
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    unsigned num_bytes = curve->num_bytes;
+    uECC_word_t index;
+    bitcount_t i;
+
+    /* The first entry of the table is the public key itself. */
+    for (i = 0; i < (bitcount_t)num_bytes * 2; ++i) {
+        if (public_key_table[i] != public_key[i]) {
+            G_table = 0;
+        }
+    }
+    if (!G_table) {
+        return uECC_verify(public_key, message_hash, hash_size, signature, curve);
+    }
+
+    rx[num_n_words - 1] = 0;
+
+    if (!verify_scalars(u1, u2, r, message_hash, hash_size, signature, curve)) {
+        return 0;
+    }
+
+    /* Calculate u1*G + u2*Q with one comb column of each scalar per doubling. */
+    for (i = spacing - 1; i >= 0; --i) {
+        if (!empty) {
+            curve->double_jacobian(rx, ry, z, curve);
+        }
+
+        index = comb_index(u1, i, spacing);
+        if (index) {
+            uECC_vli_set(tx, G_table + (index - 1) * num_words * 2, num_words);
+            uECC_vli_set(ty, G_table + (index - 1) * num_words * 2 + num_words, num_words);
+            comb_add(rx, ry, z, tx, ty, &empty, curve);
+        }
+
+        index = comb_index(u2, i, spacing);
+        if (index) {
+            entry = public_key_table + (index - 1) * num_bytes * 2;
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+            bcopy((uint8_t *) tx, entry, num_bytes);
+            bcopy((uint8_t *) ty, entry + num_bytes, num_bytes);
+#else
+            uECC_vli_bytesToNative(tx, entry, num_bytes);
+            uECC_vli_bytesToNative(ty, entry + num_bytes, num_bytes);
+#endif
+            comb_add(rx, ry, z, tx, ty, &empty, curve);
+        }
+    }
+
+    return verify_result(rx, ry, z, r, curve);
+}
+
+#endif /* uECC_SUPPORTS_VERIFY_TABLE */
+
 #if uECC_ENABLE_VLI_API
 
 unsigned uECC_curve_num_words(uECC_Curve curve) {
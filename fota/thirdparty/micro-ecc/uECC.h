@@ -18,13 +18,28 @@ Possible values for uECC_PLATFORM are defined below: */
 #define uECC_avr        7
 
 
-/* Project specific settings */
+/* Project specific settings, may be overridden on the command line (test/bench_crypto.c) */
+#ifndef uECC_ENABLE_VLI_API
 #define uECC_ENABLE_VLI_API 1
+#endif
+#ifndef uECC_VLI_NATIVE_LITTLE_ENDIAN
 #define uECC_VLI_NATIVE_LITTLE_ENDIAN 1
+#endif
+#ifndef uECC_SUPPORTS_secp256r1
 #define uECC_SUPPORTS_secp256r1 1
+#endif
+#ifndef uECC_SQUARE_FUNC
 #define uECC_SQUARE_FUNC 1
+#endif
+#ifndef uECC_SUPPORT_COMPRESSED_POINT
 #define uECC_SUPPORT_COMPRESSED_POINT 0
+#endif
+#ifndef uECC_OPTIMIZATION_LEVEL
 #define uECC_OPTIMIZATION_LEVEL 3
+#endif
+#ifndef uECC_SUPPORTS_VERIFY_TABLE
+#define uECC_SUPPORTS_VERIFY_TABLE 1
+#endif
 
 
 /* If desired, you can define uECC_WORD_SIZE as appropriate for your platform (1, 4, or 8 bytes).
@@ -82,6 +97,14 @@ to be word aligned on architectures that do not support unaligned accesses. */
     #define uECC_SUPPORT_COMPRESSED_POINT 1
 #endif
 
+/* uECC_SUPPORTS_VERIFY_TABLE - If enabled (defined as nonzero), uECC_verify_table() and
+uECC_compute_table() are available. Verification with a precomputed table of the public key
+takes less than half the time of uECC_verify(), at the cost of a table of 15 points per key and
+one for the curve generator (secp256r1 only). */
+#ifndef uECC_SUPPORTS_VERIFY_TABLE
+    #define uECC_SUPPORTS_VERIFY_TABLE 0
+#endif
+
 struct uECC_Curve_t;
 typedef const struct uECC_Curve_t * uECC_Curve;
 
@@ -365,6 +388,55 @@ int uECC_verify(const uint8_t *public_key,
                 const uint8_t *signature,
                 uECC_Curve curve);
 
+#if uECC_SUPPORTS_VERIFY_TABLE
+
+/* uECC_TABLE_SIZE() macro.
+Size in bytes of the precomputed table of a public key for the given curve size in bytes. */
+#define uECC_TABLE_SIZE(num_bytes) (15 * 2 * (num_bytes))
+
+/* uECC_compute_table() function.
+Compute the precomputed table of a public key for uECC_verify_table().
+
+The table is a comb with 4 teeth: entry i (1 <= i <= 15) holds the sum of 2^(d * j) * Q
+over the bits j set in i, where Q is the public key and d = ceil(num_n_bits / 4). The points
+are stored in the same format as the public key, so the first entry is the public key itself.
+The table can as well be computed offline, e.g. when the key is embedded into a firmware image.
+
+Inputs:
+    public_key - The public key.
+
+Outputs:
+    public_key_table - Will be filled in with the table, uECC_TABLE_SIZE() bytes.
+
+Returns 1 if the table was computed successfully, 0 if the public key is invalid.
+*/
+int uECC_compute_table(const uint8_t *public_key, uint8_t *public_key_table, uECC_Curve curve);
+
+/* uECC_verify_table() function.
+Verify an ECDSA signature with a precomputed table of the public key.
+
+Same as uECC_verify(), but u1 * G + u2 * Q is computed with fixed comb tables of G and Q, which
+needs a quarter of the point doublings. If the curve has no table of G (only secp256r1 has) or
+the table does not match the public key, it falls back to uECC_verify().
+
+Inputs:
+    public_key       - The signer's public key.
+    public_key_table - The table computed by uECC_compute_table().
+    message_hash     - The hash of the signed data.
+    hash_size        - The size of message_hash in bytes.
+    signature        - The signature value.
+
+Returns 1 if the signature is valid, 0 if it is invalid.
+*/
+int uECC_verify_table(const uint8_t *public_key,
+                      const uint8_t *public_key_table,
+                      const uint8_t *message_hash,
+                      unsigned hash_size,
+                      const uint8_t *signature,
+                      uECC_Curve curve);
+
+#endif /* uECC_SUPPORTS_VERIFY_TABLE */
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
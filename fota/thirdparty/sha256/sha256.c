@@ -10,6 +10,11 @@
               Algorithm specification can be found here:
                * http://csrc.nist.gov/publications/fips/fips180-2/fips180-2withchangenotice.pdf
               This implementation uses little endian byte order.
+              Word-oriented variant: whole blocks are hashed directly
+              from the input with big-endian word loads, the rounds are
+              unrolled by 8 and use a rolling 16-word message schedule.
+              See test/test_sha256.c for known-answer tests and a
+              comparison with the byte-wise original (test/sha256_ref.c).
 *********************************************************************/
 
 /*************************** HEADER FILES ***************************/
@@ -21,8 +26,8 @@
 #define ROTLEFT(a,b) (((a) << (b)) | ((a) >> (32-(b))))
 #define ROTRIGHT(a,b) (((a) >> (b)) | ((a) << (32-(b))))
 
-#define CH(x,y,z) (((x) & (y)) ^ (~(x) & (z)))
-#define MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define CH(x,y,z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x,y,z) (((x) & (y)) | ((z) & ((x) | (y))))
 #define EP0(x) (ROTRIGHT(x,2) ^ ROTRIGHT(x,13) ^ ROTRIGHT(x,22))
 #define EP1(x) (ROTRIGHT(x,6) ^ ROTRIGHT(x,11) ^ ROTRIGHT(x,25))
 #define SIG0(x) (ROTRIGHT(x,7) ^ ROTRIGHT(x,18) ^ ((x) >> 3))
@@ -32,6 +37,34 @@
 	#define SHA256_FINAL_LE		1
 #endif
 
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	#define BE32(x)		(x)
+#elif defined(__GNUC__)
+	#define BE32(x)		__builtin_bswap32(x)	// REV on Cortex-M3
+#else
+	#define BE32(x)		((ROTRIGHT(x,24) & 0x00ff00ff) | (ROTRIGHT(x,8) & 0xff00ff00))
+#endif
+
+// rolling message schedule, m[] holds the last 16 words
+#define M(i) m[(i) & 15]
+#define SCHED(i) (M(i) += SIG1(M((i) - 2)) + M((i) - 7) + SIG0(M((i) - 15)))
+
+// one round, the working variables rotate by renaming instead of moving
+#define ROUND(a,b,c,d,e,f,g,h,i,w) \
+	t1 = (h) + EP1(e) + CH(e,f,g) + k[i] + (w); \
+	(d) += t1; \
+	(h) = t1 + EP0(a) + MAJ(a,b,c)
+
+#define ROUNDS8(i,W) \
+	ROUND(a,b,c,d,e,f,g,h,(i) + 0,W((i) + 0)); \
+	ROUND(h,a,b,c,d,e,f,g,(i) + 1,W((i) + 1)); \
+	ROUND(g,h,a,b,c,d,e,f,(i) + 2,W((i) + 2)); \
+	ROUND(f,g,h,a,b,c,d,e,(i) + 3,W((i) + 3)); \
+	ROUND(e,f,g,h,a,b,c,d,(i) + 4,W((i) + 4)); \
+	ROUND(d,e,f,g,h,a,b,c,(i) + 5,W((i) + 5)); \
+	ROUND(c,d,e,f,g,h,a,b,(i) + 6,W((i) + 6)); \
+	ROUND(b,c,d,e,f,g,h,a,(i) + 7,W((i) + 7))
+
 /**************************** VARIABLES *****************************/
 static const WORD k[64] = {
 	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
@@ -45,45 +78,43 @@ static const WORD k[64] = {
 };
 
 /*********************** FUNCTION DEFINITIONS ***********************/
-static void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
+static void sha256_transform(WORD state[], const BYTE data[], size_t blocks)
 {
-	WORD a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
-
-	for (i = 0, j = 0; i < 16; ++i, j += 4)
-		m[i] = (data[j] << 24) | (data[j + 1] << 16) | (data[j + 2] << 8) | (data[j + 3]);
-	for ( ; i < 64; ++i)
-		m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
-
-	a = ctx->state[0];
-	b = ctx->state[1];
-	c = ctx->state[2];
-	d = ctx->state[3];
-	e = ctx->state[4];
-	f = ctx->state[5];
-	g = ctx->state[6];
-	h = ctx->state[7];
-
-	for (i = 0; i < 64; ++i) {
-		t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
-		t2 = EP0(a) + MAJ(a,b,c);
-		h = g;
-		g = f;
-		f = e;
-		e = d + t1;
-		d = c;
-		c = b;
-		b = a;
-		a = t1 + t2;
-	}
+	WORD a, b, c, d, e, f, g, h, i, t1, m[16];
+
+	for (; blocks > 0; --blocks, data += 64) {
+		// big-endian word loads, compiled to LDR and REV on Cortex-M3,
+		// which also handles unaligned input
+		for (i = 0; i < 16; ++i) {
+			memcpy(&t1, data + i * 4, sizeof(t1));
+			m[i] = BE32(t1);
+		}
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		f = state[5];
+		g = state[6];
+		h = state[7];
+
+		for (i = 0; i < 16; i += 8) {
+			ROUNDS8(i, M);
+		}
+		for (; i < 64; i += 8) {
+			ROUNDS8(i, SCHED);
+		}
 
-	ctx->state[0] += a;
-	ctx->state[1] += b;
-	ctx->state[2] += c;
-	ctx->state[3] += d;
-	ctx->state[4] += e;
-	ctx->state[5] += f;
-	ctx->state[6] += g;
-	ctx->state[7] += h;
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
 }
 
 void sha256_init(SHA256_CTX *ctx)
@@ -102,17 +133,35 @@ void sha256_init(SHA256_CTX *ctx)
 
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
 {
-	WORD i;
+	size_t n;
+
+	// complete a buffered block first
+	if (ctx->datalen > 0) {
+		n = 64 - ctx->datalen;
+		if (n > len)
+			n = len;
+		memcpy(ctx->data + ctx->datalen, data, n);
+		ctx->datalen += n;
+		data += n;
+		len -= n;
+		if (ctx->datalen < 64)
+			return;
+		sha256_transform(ctx->state, ctx->data, 1);
+		ctx->bitlen += 512;
+		ctx->datalen = 0;
+	}
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			sha256_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
-		}
+	// whole blocks directly from the input
+	n = len / 64;
+	if (n > 0) {
+		sha256_transform(ctx->state, data, n);
+		ctx->bitlen += (unsigned long long)n * 512;
+		data += n * 64;
+		len -= n * 64;
 	}
+
+	memcpy(ctx->data, data, len);
+	ctx->datalen = len;
 }
 
 void sha256_final(SHA256_CTX *ctx, BYTE hash[])
@@ -131,7 +180,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 		ctx->data[i++] = 0x80;
 		while (i < 64)
 			ctx->data[i++] = 0x00;
-		sha256_transform(ctx, ctx->data);
+		sha256_transform(ctx->state, ctx->data, 1);
 		memset(ctx->data, 0, 56);
 	}
 
@@ -145,7 +194,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 	ctx->data[58] = ctx->bitlen >> 40;
 	ctx->data[57] = ctx->bitlen >> 48;
 	ctx->data[56] = ctx->bitlen >> 56;
-	sha256_transform(ctx, ctx->data);
+	sha256_transform(ctx->state, ctx->data, 1);
 
 #if (SHA256_FINAL_LE)
 	// Since this implementation uses little endian byte ordering and micro-ecc also,
@@ -175,3 +224,12 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 	}
 #endif
 }
+
+void sha256(const BYTE data[], size_t len, BYTE hash[])
+{
+	SHA256_CTX ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, hash);
+}
@@ -30,5 +30,7 @@ typedef struct {
 void sha256_init(SHA256_CTX *ctx);
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len);
 void sha256_final(SHA256_CTX *ctx, BYTE hash[]);
+// one-shot hash, e.g. of a whole flash sector straight from flash
+void sha256(const BYTE data[], size_t len, BYTE hash[]);
 
 #endif   // SHA256_H
@@ -0,0 +1,174 @@
+/*********************************************************************
+* Filename:   test_sha256.c
+* Details:    Host known-answer tests and benchmark of sha256.c against
+              the byte-wise original in sha256_ref.c.
+              Build and run from this directory with e.g.
+                cc -O2 -I.. -o test_sha256 test_sha256.c sha256_ref.c ../sha256.c
+                ./test_sha256
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sha256.h"
+
+/****************************** MACROS ******************************/
+#define SECTOR_SIZE     2048
+#define QUANTUM_SIZE    8
+#define BENCH_BYTES     (4 * 1024 * 1024)
+
+/*********************** FUNCTION DECLARATIONS **********************/
+void ref_sha256_init(SHA256_CTX *ctx);
+void ref_sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len);
+void ref_sha256_final(SHA256_CTX *ctx, BYTE hash[]);
+
+/**************************** VARIABLES *****************************/
+static const struct {
+	const char *msg;
+	size_t repeat;
+	const char *digest;
+} kat[] = {
+	// FIPS 180-2 appendix B
+	{ "abc", 1,
+	  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+	  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	{ "a", 1000000,
+	  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+	{ "", 1,
+	  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	// padding fits into the last block or needs an extra block
+	{ "0123456701234567012345670123456701234567012345670123456", 1,
+	  "6c8b1d86d0460e5cf48cacad0b844dc52b91967791d15fc7a90bb1cc3bc20879" },
+	{ "01234567012345670123456701234567012345670123456701234567", 1,
+	  "0cb5334657776890d96b6b53e706e77df142e3b23357273d96f91f61c8b89636" },
+	{ "0123456701234567012345670123456701234567012345670123456701234567", 1,
+	  "8182cadb21af0e37c06414ece08e19c65bdb22c396d48ba7341012eea9ffdfdd" },
+};
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+static void to_hex(const BYTE hash[], char hex[])
+{
+	int i;
+
+	// the output is little-endian (SHA256_FINAL_LE)
+	for (i = 0; i < SHA256_BLOCK_SIZE; ++i)
+		sprintf(hex + i * 2, "%02x", hash[SHA256_BLOCK_SIZE - 1 - i]);
+}
+
+static int test_kat(void)
+{
+	SHA256_CTX ctx;
+	BYTE hash[SHA256_BLOCK_SIZE];
+	char hex[2 * SHA256_BLOCK_SIZE + 1];
+	size_t i, j;
+	int fail = 0;
+
+	for (i = 0; i < sizeof(kat) / sizeof(kat[0]); ++i) {
+		sha256_init(&ctx);
+		for (j = 0; j < kat[i].repeat; ++j)
+			sha256_update(&ctx, (const BYTE *)kat[i].msg, strlen(kat[i].msg));
+		sha256_final(&ctx, hash);
+		to_hex(hash, hex);
+
+		if (strcmp(hex, kat[i].digest) != 0) {
+			printf("KAT %d failed: %s\n", (int)i, hex);
+			fail = 1;
+		}
+	}
+	return fail;
+}
+
+static int test_random(void)
+{
+	static BYTE buf[3 * SECTOR_SIZE + 3];
+	SHA256_CTX ctx, ref_ctx;
+	BYTE hash[SHA256_BLOCK_SIZE], ref[SHA256_BLOCK_SIZE];
+	int n, fail = 0;
+
+	srand(1);
+	for (n = 0; n < (int)sizeof(buf); ++n)
+		buf[n] = rand();
+
+	// random lengths, offsets and update splits
+	for (n = 0; n < 2000; ++n) {
+		size_t off = rand() % 4;
+		size_t len = rand() % (sizeof(buf) - off);
+		size_t pos = 0;
+
+		sha256_init(&ctx);
+		ref_sha256_init(&ref_ctx);
+		while (pos < len) {
+			size_t part = (n & 1) ? QUANTUM_SIZE : (size_t)rand() % 200 + 1;
+
+			if (part > len - pos)
+				part = len - pos;
+			sha256_update(&ctx, buf + off + pos, part);
+			pos += part;
+		}
+		ref_sha256_update(&ref_ctx, buf + off, len);
+		sha256_final(&ctx, hash);
+		ref_sha256_final(&ref_ctx, ref);
+		if (memcmp(hash, ref, sizeof(hash)) != 0) {
+			printf("random test %d failed (len %d)\n", n, (int)len);
+			fail = 1;
+		}
+
+		sha256(buf + off, len, hash);
+		if (memcmp(hash, ref, sizeof(hash)) != 0) {
+			printf("one-shot test %d failed (len %d)\n", n, (int)len);
+			fail = 1;
+		}
+	}
+	return fail;
+}
+
+static double bench(int ref, size_t part)
+{
+	static BYTE sector[SECTOR_SIZE];
+	SHA256_CTX ctx;
+	BYTE hash[SHA256_BLOCK_SIZE];
+	clock_t start = clock();
+	size_t i, j;
+
+	for (i = 0; i < BENCH_BYTES / SECTOR_SIZE; ++i) {
+		sector[0] = i;
+		if (ref)
+			ref_sha256_init(&ctx);
+		else
+			sha256_init(&ctx);
+		for (j = 0; j < SECTOR_SIZE; j += part) {
+			if (ref)
+				ref_sha256_update(&ctx, sector + j, part);
+			else
+				sha256_update(&ctx, sector + j, part);
+		}
+		if (ref)
+			ref_sha256_final(&ctx, hash);
+		else
+			sha256_final(&ctx, hash);
+	}
+	return (double)BENCH_BYTES / 1e6 / ((double)(clock() - start) / CLOCKS_PER_SEC);
+}
+
+int main()
+{
+	double ref, new;
+
+	if (test_kat() || test_random()) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("known-answer and random tests passed\n");
+
+	printf("%-28s %10s %10s %7s\n", "pattern", "ref [MB/s]", "new [MB/s]", "speedup");
+	ref = bench(1, SECTOR_SIZE);
+	new = bench(0, SECTOR_SIZE);
+	printf("%-28s %10.1f %10.1f %6.1fx\n", "whole sector per update", ref, new, new / ref);
+	ref = bench(1, QUANTUM_SIZE);
+	new = bench(0, QUANTUM_SIZE);
+	printf("%-28s %10.1f %10.1f %6.1fx\n", "flash quantum per update", ref, new, new / ref);
+	return 0;
+}
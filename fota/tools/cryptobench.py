@@ -0,0 +1,164 @@
+#!/usr/bin/env python
+""" Host benchmark and known-answer tests of the image verification crypto.
+
+    Builds thirdparty/micro-ecc/test/bench_crypto.c with the host compiler
+    for every uECC_OPTIMIZATION_LEVEL and uECC_SQUARE_FUNC combination,
+    runs the known-answer tests (FIPS 180-2 for SHA-256, RFC 6979 for the
+    NIST curves) and collects the cost of hashing a flash sector and of an
+    ECDSA sign/verify on every enabled curve into one JSON report. Given a
+    previous report as baseline, it lists the changes and fails if one of
+    them is a regression beyond the tolerance, so that slower OTA finalize
+    times show up in review.
+
+    The words are 32-bit by default as on the target. The host numbers
+    scale roughly, but not exactly, with the Cortex-M3 ones; the ECDSA time
+    of a real download is reported by the DFU telemetry (CFG_DFU_STAT).
+    uECC_OPTIMIZATION_LEVEL 4 only differs from 3 where there is inline
+    assembly for the host.
+
+    Prerequisites:
+    - installed Python, version >=2.7 or >=3.4
+    - a C compiler for the host (cc, gcc or clang)
+"""
+from __future__ import print_function, division
+
+
+__version__ = '1.0.0'
+
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+
+FOTA_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+UECC_DIR = os.path.join(FOTA_DIR, 'thirdparty', 'micro-ecc')
+SHA256_DIR = os.path.join(FOTA_DIR, 'thirdparty', 'sha256')
+SOURCES = [os.path.join(UECC_DIR, 'test', 'bench_crypto.c'),
+           os.path.join(UECC_DIR, 'uECC.c'),
+           os.path.join(SHA256_DIR, 'sha256.c')]
+
+# micro-ecc declares its own bcopy(), which clashes with the built-in one
+UECC_CFLAGS = ['-fno-builtin-bcopy']
+
+
+def build_and_run(args, tmp, level, square):
+    """ Builds and runs one configuration, returns its report. """
+    exe = os.path.join(tmp, 'bench_crypto_o{}_s{}'.format(level, square))
+    cmd = [args.cc] + args.cflags.split() + UECC_CFLAGS + [
+        '-I' + UECC_DIR, '-I' + SHA256_DIR,
+        '-DuECC_WORD_SIZE={}'.format(args.word_size),
+        '-DuECC_OPTIMIZATION_LEVEL={}'.format(level),
+        '-DuECC_SQUARE_FUNC={}'.format(square),
+        '-o', exe] + SOURCES
+    subprocess.check_call(cmd)
+    proc = subprocess.Popen([exe], stdout=subprocess.PIPE)
+    out = proc.communicate()[0]
+    run = json.loads(out.decode('ascii'))
+    run['kat_passed'] = proc.returncode == 0
+    return run
+
+
+def compiler_version(cc):
+    try:
+        out = subprocess.check_output([cc, '--version'], stderr=subprocess.STDOUT)
+        return out.decode('ascii', 'replace').splitlines()[0]
+    except (OSError, subprocess.CalledProcessError):
+        return cc
+
+
+def metrics(report):
+    """ Flattens a report to {(level, square, primitive, operation): cost}. """
+    result = {}
+    for run in report['runs']:
+        cfg = run['config']
+        key = (cfg['uECC_OPTIMIZATION_LEVEL'], cfg['uECC_SQUARE_FUNC'])
+        for op in ('sector_per_byte', 'quantum_per_byte'):
+            result[key + ('sha256', op)] = run['sha256'][op]
+        for curve, values in run['ecc'].items():
+            for op, value in values.items():
+                if op != 'kat':
+                    result[key + (curve, op)] = value
+    return result
+
+
+def compare(report, baseline, tolerance):
+    """ Prints the changes against a baseline, returns the number of
+        regressions. """
+    if baseline['runs'] and report['runs'] and \
+            baseline['runs'][0]['config']['counter'] != report['runs'][0]['config']['counter']:
+        print("baseline uses a different counter, not compared", file=sys.stderr)
+        return 0
+
+    new = metrics(report)
+    old = metrics(baseline)
+    regressions = 0
+    print("{:>3} {:>3} {:<10} {:<16} {:>12} {:>12} {:>8}".format(
+          "OPT", "SQR", "primitive", "operation", "baseline", "new", "change"), file=sys.stderr)
+    for key in sorted(set(new) & set(old)):
+        change = (new[key] / old[key] - 1) * 100 if old[key] else 0.0
+        mark = ''
+        if change > tolerance:
+            mark = ' regression'
+            regressions += 1
+        print("{:>3} {:>3} {:<10} {:<16} {:>12} {:>12} {:>+7.1f}%{}".format(
+              key[0], key[1], key[2], key[3], old[key], new[key], change, mark), file=sys.stderr)
+    return regressions
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Host benchmark and known-answer tests of the image verification crypto.')
+    parser.add_argument('--version', action='version', version='%(prog)s ' + __version__)
+    parser.add_argument('--cc', default=os.environ.get('CC', 'cc'), help='host C compiler')
+    parser.add_argument('--cflags', default='-O2', help='compiler flags')
+    parser.add_argument('--word-size', type=int, default=4, choices=[4, 8], help='uECC_WORD_SIZE [byte]')
+    parser.add_argument('--level', type=int, nargs='+', default=[0, 1, 2, 3, 4], choices=range(5),
+                        help='uECC_OPTIMIZATION_LEVEL values')
+    parser.add_argument('--square', type=int, nargs='+', default=[0, 1], choices=[0, 1],
+                        help='uECC_SQUARE_FUNC values')
+    parser.add_argument('-o', '--output', help='JSON report file, default stdout')
+    parser.add_argument('--baseline', help='JSON report to compare with')
+    parser.add_argument('--tolerance', type=float, default=10.0,
+                        help='allowed slowdown against the baseline [%%]')
+    args = parser.parse_args()
+
+    report = {'version': __version__, 'compiler': compiler_version(args.cc),
+              'cflags': args.cflags, 'runs': []}
+    tmp = tempfile.mkdtemp()
+    try:
+        for level in args.level:
+            for square in args.square:
+                print("uECC_OPTIMIZATION_LEVEL {} uECC_SQUARE_FUNC {}".format(level, square),
+                      file=sys.stderr)
+                report['runs'].append(build_and_run(args, tmp, level, square))
+    finally:
+        shutil.rmtree(tmp)
+
+    text = json.dumps(report, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+
+    failed = [run['config'] for run in report['runs'] if not run['kat_passed']]
+    for cfg in failed:
+        print("known-answer tests failed with uECC_OPTIMIZATION_LEVEL {} uECC_SQUARE_FUNC {}".format(
+              cfg['uECC_OPTIMIZATION_LEVEL'], cfg['uECC_SQUARE_FUNC']), file=sys.stderr)
+
+    regressions = 0
+    if args.baseline:
+        with open(args.baseline) as f:
+            regressions = compare(report, json.load(f), args.tolerance)
+        if regressions:
+            print("{} regressions beyond {}%".format(regressions, args.tolerance), file=sys.stderr)
+
+    sys.exit(1 if failed or regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
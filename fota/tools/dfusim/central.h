@@ -0,0 +1,61 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * central.h
+ * - Renames the external symbols of dfu/app_hdlc.c, so that it can be
+ *   linked a second time as the data link of the simulated central
+ *   (compiled with -include central.h)
+ * ------------------------------------------------------------------------- */
+
+#ifndef _CENTRAL_H    /* avoids multiple inclusion */
+#define _CENTRAL_H
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+/* interface to the upper layer */
+#define App_Hdlc_Init               Central_Hdlc_Init
+#define App_Hdlc_DataReq            Central_Hdlc_DataReq
+#define App_Hdlc_GetMaxSduSize      Central_Hdlc_GetMaxSduSize
+#define App_Hdlc_ReadyReq           Central_Hdlc_ReadyReq
+#define App_Hdlc_ModeReq            Central_Hdlc_ModeReq
+#define App_Hdlc_DataCfm            Central_Hdlc_DataCfm
+#define App_Hdlc_DataInd            Central_Hdlc_DataInd
+#define App_Hdlc_RxBufferReq        Central_Hdlc_RxBufferReq
+#define App_Hdlc_ResetInd           Central_Hdlc_ResetInd
+
+/* interface to the lower layer */
+#define App_Ble_ActivationInd       Central_Ble_ActivationInd
+#define App_Ble_MaxSizeInd          Central_Ble_MaxSizeInd
+#define App_Ble_DeactivationInd     Central_Ble_DeactivationInd
+#define App_Ble_DataAlloc           Central_Ble_DataAlloc
+#define App_Ble_DataReq             Central_Ble_DataReq
+#define App_Ble_DataCfm             Central_Ble_DataCfm
+#define App_Ble_DataInd             Central_Ble_DataInd
+
+/* telemetry */
+#define App_Stat_Count              Central_Stat_Count
+
+/* kernel */
+#define MsgHandler_Add              Central_MsgHandler_Add
+#define ke_msg_send_basic           Central_ke_msg_send_basic
+#define ke_timer_set                Central_ke_timer_set
+#define ke_timer_clear              Central_ke_timer_clear
+#define ke_timer_active             Central_ke_timer_active
+#define ke_state_get                Central_ke_state_get
+#define ke_state_set                Central_ke_state_set
+
+/* cycle counter (DWT->CYCCNT) on the central time */
+#define Sim_Dwt                     Central_Sim_Dwt
+
+#endif    /* _CENTRAL_H */
@@ -0,0 +1,22 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * ke_msg.h
+ * - Host stand-in of the kernel message header for the DFU simulator
+ * ------------------------------------------------------------------------- */
+
+#ifndef _KE_MSG_H    /* avoids multiple inclusion */
+#define _KE_MSG_H
+
+#include <rsl10_ke.h>
+
+#endif    /* _KE_MSG_H */
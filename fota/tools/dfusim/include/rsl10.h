@@ -0,0 +1,85 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * rsl10.h
+ * - Host stand-in of the RSL10 device header for the DFU simulator. The
+ *   flash is mapped at its target addresses (sim_flash.c), the CRC unit and
+ *   the cycle counter are emulated (sim_kernel.c).
+ * ------------------------------------------------------------------------- */
+
+#ifndef _RSL10_H    /* avoids multiple inclusion */
+#define _RSL10_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* ----------------------------------------------------------------------------
+ * Memory map
+ * --------------------------------------------------------------------------*/
+
+#define FLASH_MAIN_BASE                 0x00100000
+#define FLASH_MAIN_SIZE                 (380 * 1024)
+#define FLASH_MAIN_TOP                  (FLASH_MAIN_BASE + FLASH_MAIN_SIZE - 1)
+#define FLASH_SECTOR_SIZE               0x800
+
+#define FLASH_NVR1_BASE                 0x00080000
+#define FLASH_NVR2_BASE                 0x00080800
+#define FLASH_NVR3_BASE                 0x00081000
+#define FLASH_NVR_SIZE                  (4 * FLASH_SECTOR_SIZE)
+
+/* ----------------------------------------------------------------------------
+ * CRC unit
+ * --------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint32_t CTRL;
+    uint32_t VALUE;
+    uint32_t FINAL;
+    uint32_t ADD_1;
+    uint32_t ADD_8;
+    uint32_t ADD_16;
+    uint32_t ADD_24;
+    uint64_t ADD_32;                    /* wider to detect a write */
+} CRC_Type;
+
+#define CRC_CCITT                       0x0
+#define CRC_BIT_ORDER_NON_STANDARD      0x4
+#define CRC_FINAL_REVERSE_NON_STANDARD  0x10
+#define CRC_FINAL_XOR_NON_STANDARD      0x20
+#define CRC_CCITT_INIT_VALUE            0xFFFF
+
+/* every access goes through Sim_Crc(), which applies the previous one */
+#define CRC                             (Sim_Crc())
+
+CRC_Type * Sim_Crc(void);
+
+/* ----------------------------------------------------------------------------
+ * Cycle counter, SYSCLK = 8 MHz
+ * --------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint32_t CTRL;
+    uint32_t CYCCNT;
+} DWT_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk          0x1
+
+/* every access reads the virtual time of the simulated device */
+#define DWT                             (Sim_Dwt())
+
+DWT_Type * Sim_Dwt(void);
+
+#endif    /* _RSL10_H */
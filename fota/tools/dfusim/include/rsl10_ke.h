@@ -0,0 +1,67 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * rsl10_ke.h
+ * - Host stand-in of the kernel API for the DFU simulator, implemented
+ *   by sim_kernel.c on virtual time
+ * ------------------------------------------------------------------------- */
+
+#ifndef _RSL10_KE_H    /* avoids multiple inclusion */
+#define _RSL10_KE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define TASK_ID_GATTC                   12
+#define TASK_ID_APP                     15
+#define TASK_APP                        TASK_ID_APP
+
+#define TASK_FIRST_MSG(task)            ((ke_msg_id_t)((task) << 8))
+#define KE_BUILD_ID(type, index)        ((ke_task_id_t)(((index) << 8) | (type)))
+#define KE_IDX_GET(id)                  (((id) >> 8) & 0xFF)
+
+/* timer ticks are 10 ms */
+#define KE_TIME_IN_SEC(s)               ((uint32_t)((s) * 100))
+
+#define KE_MSG_CONSUMED                 0
+
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef uint16_t ke_msg_id_t;
+typedef uint16_t ke_task_id_t;
+typedef uint8_t ke_state_t;
+
+/* ----------------------------------------------------------------------------
+ * Function prototypes
+ * ------------------------------------------------------------------------- */
+
+void ke_msg_send_basic(ke_msg_id_t id, ke_task_id_t dest_id,
+                       ke_task_id_t src_id);
+
+void ke_timer_set(ke_msg_id_t timer_id, ke_task_id_t task_id,
+                  uint32_t delay);
+
+void ke_timer_clear(ke_msg_id_t timer_id, ke_task_id_t task_id);
+
+bool ke_timer_active(ke_msg_id_t timer_id, ke_task_id_t task_id);
+
+ke_state_t ke_state_get(ke_task_id_t id);
+
+void ke_state_set(ke_task_id_t id, ke_state_t state_id);
+
+#endif    /* _RSL10_KE_H */
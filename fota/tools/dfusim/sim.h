@@ -0,0 +1,188 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * sim.h
+ * - Internal interfaces of the host DFU pipeline simulator
+ * ------------------------------------------------------------------------- */
+
+#ifndef _SIM_H    /* avoids multiple inclusion */
+#define _SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <rsl10.h>
+#include <rsl10_ke.h>
+
+#include "app_ble.h"
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define SIM_TIME_NEVER          UINT64_MAX
+#define SIM_US(us)              ((sim_time_t)((us) * 1000.0))
+#define SIM_MS(ms)              ((sim_time_t)((ms) * 1000000.0))
+#define SIM_TO_MS(t)            ((t) / 1e6)
+
+/* messages of the simulated BLE stack to the application task */
+#define SIM_BLE_DATA_IND        (TASK_FIRST_MSG(TASK_ID_GATTC) + 0)
+#define SIM_BLE_DATA_CFM        (TASK_FIRST_MSG(TASK_ID_GATTC) + 1)
+#define SIM_BLE_EVENT_END       (TASK_FIRST_MSG(TASK_ID_GATTC) + 2)
+
+/* ----------------------------------------------------------------------------
+ * Global variables and types
+ * --------------------------------------------------------------------------*/
+
+/* virtual time [ns] */
+typedef uint64_t sim_time_t;
+
+typedef void (*sim_handler_t)(ke_msg_id_t msg_id, const void *param_p,
+                              ke_task_id_t dest_id, ke_task_id_t src_id);
+
+typedef enum
+{
+    SIM_DEVICE,
+    SIM_CENTRAL,
+    SIM_NB_DOMAINS
+} sim_domain_t;
+
+typedef struct
+{
+    /* link */
+    double   interval_ms;
+    uint8_t  phy;
+    uint16_t tx_octets;
+    uint16_t mtu;
+    double   event_time;
+    double   per;
+    double   drop;
+    uint8_t  rx_buffers;
+    uint32_t seed;
+
+    /* data link */
+    bool     extended;
+
+    /* device */
+    double   cpu_scale;
+    double   stack_us;
+    double   program_us;
+    double   erase_ms;
+} sim_config_t;
+
+typedef struct
+{
+    uint32_t events;
+    uint32_t missed_events;
+    uint32_t pdus;
+    uint32_t ll_retransmissions;
+    uint32_t dropped;
+    uint64_t air_bytes;
+    sim_time_t flash_busy;
+} sim_link_stat_t;
+
+/* ----------------------------------------------------------------------------
+ * Function prototypes
+ * ------------------------------------------------------------------------- */
+
+/* sim_kernel.c */
+void Sim_Kernel_Init(const sim_config_t *cfg_p);
+
+sim_time_t Sim_Now(sim_domain_t domain);
+
+void Sim_SetNow(sim_domain_t domain, sim_time_t now);
+
+void Sim_CpuBegin(void);
+
+void Sim_CpuEnd(void);
+
+void Sim_CpuPause(void);
+
+void Sim_CpuResume(void);
+
+void Sim_Delay(sim_time_t delay);
+
+void Sim_Send(sim_domain_t domain, ke_msg_id_t id, void *param_p,
+              sim_time_t time);
+
+sim_time_t Sim_NextEvent(sim_domain_t domain);
+
+bool Sim_Schedule(sim_domain_t domain);
+
+void Sim_Wake(void);
+
+bool Sim_ResetRequested(void);
+
+void Sim_AddHandler(sim_domain_t domain, ke_msg_id_t id,
+                    sim_handler_t handler);
+
+/* sim_flash.c */
+void Sim_Flash_Init(const sim_config_t *cfg_p);
+
+bool Sim_Flash_Install(uint32_t adr, const uint8_t *data_p, uint32_t size);
+
+bool Sim_Flash_Busy(sim_time_t t);
+
+sim_time_t Sim_Flash_GetBusyTime(void);
+
+/* sim_link.c */
+void Sim_Link_Init(const sim_config_t *cfg_p);
+
+sim_time_t Sim_Link_NextEvent(void);
+
+void Sim_Link_Event(void);
+
+const sim_link_stat_t * Sim_Link_GetStat(void);
+
+uint_fast8_t Sim_Link_GetSummaries(const uint8_t **record_pp);
+
+/* kernel API of the central, see central.h */
+void Central_ke_msg_send_basic(ke_msg_id_t id, ke_task_id_t dest_id,
+                               ke_task_id_t src_id);
+
+void Central_ke_timer_set(ke_msg_id_t timer_id, ke_task_id_t task_id,
+                          uint32_t delay);
+
+void Central_ke_timer_clear(ke_msg_id_t timer_id, ke_task_id_t task_id);
+
+bool Central_ke_timer_active(ke_msg_id_t timer_id, ke_task_id_t task_id);
+
+ke_state_t Central_ke_state_get(ke_task_id_t id);
+
+void Central_ke_state_set(ke_task_id_t id, ke_state_t state_id);
+
+bool Central_MsgHandler_Add(ke_msg_id_t const msg_id,
+                            sim_handler_t callback);
+
+DWT_Type * Central_Sim_Dwt(void);
+
+/* central data link, dfu/app_hdlc.c compiled with central.h */
+void Central_Hdlc_Init(void);
+
+bool Central_Hdlc_DataReq(uint_fast8_t link,
+                          const uint8_t *data_p, uint_fast16_t size);
+
+void Central_Hdlc_ModeReq(uint_fast8_t link, bool extended);
+
+void Central_Ble_ActivationInd(uint_fast8_t link, uint_fast16_t max_size);
+
+void Central_Ble_DataInd(uint_fast8_t link,
+                         const uint8_t *data_p, uint_fast16_t size);
+
+uint8_t * Central_Ble_DataAlloc(uint_fast8_t link, uint_fast16_t size);
+
+void Central_Ble_DataReq(uint_fast8_t link, uint_fast16_t seq_nb,
+                         uint8_t *data_p, uint_fast16_t size);
+
+void Central_Ble_DataCfm(uint_fast8_t link, uint_fast16_t seq_nb,
+                         App_Ble_status_t status);
+
+#endif    /* _SIM_H */
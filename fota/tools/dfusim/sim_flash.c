@@ -0,0 +1,336 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * sim_flash.c
+ * - Flash memory of the simulated device, mapped at its target
+ *   addresses, and the configuration of the installed FOTA stack
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <rsl10.h>
+
+#include "sim.h"
+#include "sys_boot.h"
+#include "app_conf.h"
+#include "drv_flash.h"
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE     MAP_FIXED
+#endif
+
+#define MAX_BUSY_INTERVALS      4096
+
+/* ----------------------------------------------------------------------------
+ * Local variables and types
+ * --------------------------------------------------------------------------*/
+
+/* configuration behind the version info, see app_conf.c */
+typedef struct
+{
+    uint32_t length;
+    uint8_t public_key_a[64];
+    uint8_t uuid_a[16];
+    uint16_t dev_name_length;
+    uint8_t dev_name_a[29];
+    uint32_t sig_scheme;
+    uint8_t public_key_table_a[15 * 64];
+} config_t;
+
+typedef struct
+{
+    Sys_Fota_version_t version;
+    config_t config;
+} version_t;
+
+typedef struct
+{
+    sim_time_t start;
+    sim_time_t end;
+} interval_t;
+
+static bool unlocked;
+static sim_time_t program_delay;
+static sim_time_t erase_delay;
+static sim_time_t busy_time;
+static interval_t busy_a[MAX_BUSY_INTERVALS];
+static uint32_t busy_head;
+static uint32_t busy_tail;
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool MapRegion(uint32_t adr, uint32_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Maps an erased flash region at its target address.
+ * Inputs        : adr              - region start address
+ *                 size             - region size
+ * Outputs       : return value     - true  region is mapped
+ *                                  - false address is not available
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool MapRegion(uint32_t adr, uint32_t size)
+{
+    void *p = mmap((void *)(uintptr_t)adr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (p != (void *)(uintptr_t)adr)
+    {
+        fprintf(stderr, "cannot map flash at 0x%08X\n", (unsigned)adr);
+        return false;
+    }
+    memset(p, 0xFF, size);
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Busy(sim_time_t delay)
+ * ----------------------------------------------------------------------------
+ * Description   : Records a flash operation starting now and advances the
+ *                 device time by its duration, as the CPU is stalled.
+ * Inputs        : delay            - duration [ns]
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void Busy(sim_time_t delay)
+{
+    sim_time_t now = Sim_Now(SIM_DEVICE);
+
+    if (busy_head - busy_tail == MAX_BUSY_INTERVALS)
+    {
+        busy_tail++;
+    }
+    busy_a[busy_head % MAX_BUSY_INTERVALS].start = now;
+    busy_a[busy_head % MAX_BUSY_INTERVALS].end   = now + delay;
+    busy_head++;
+    busy_time += delay;
+    Sim_Delay(delay);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : const version_t *GetConfig(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the version info and configuration of the
+ *                 installed FOTA stack (Sys_Boot_app_version).
+ * Inputs        : None
+ * Outputs       : return value     - pointer to version info or NULL
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static const version_t * GetConfig(void)
+{
+    return (const version_t *)Sys_Boot_GetVersion(APP_BASE_ADR);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_Flash_Init(const sim_config_t *cfg_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Maps the erased main flash and NVR sectors.
+ * Inputs        : cfg_p            - pointer to simulation parameters
+ * Outputs       : None
+ * Assumptions   : called once
+ * ------------------------------------------------------------------------- */
+void Sim_Flash_Init(const sim_config_t *cfg_p)
+{
+    if (!MapRegion(FLASH_MAIN_BASE, FLASH_MAIN_SIZE) ||
+        !MapRegion(FLASH_NVR1_BASE, FLASH_NVR_SIZE))
+    {
+        exit(2);
+    }
+    unlocked      = false;
+    program_delay = SIM_US(cfg_p->program_us);
+    erase_delay   = SIM_MS(cfg_p->erase_ms);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool Sim_Flash_Install(uint32_t adr, const uint8_t *data_p,
+ *                                        uint32_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Installs an image before the simulation starts.
+ * Inputs        : adr              - image start address
+ *                 data_p           - pointer to image
+ *                 size             - image size
+ * Outputs       : return value     - true  image fits into the main flash
+ *                                  - false image is too large
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool Sim_Flash_Install(uint32_t adr, const uint8_t *data_p, uint32_t size)
+{
+    if (adr < FLASH_MAIN_BASE || adr + size > FLASH_MAIN_BASE + FLASH_MAIN_SIZE)
+    {
+        return false;
+    }
+    memcpy((void *)(uintptr_t)adr, data_p, size);
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool Sim_Flash_Busy(sim_time_t t)
+ * ----------------------------------------------------------------------------
+ * Description   : Checks whether a flash operation stalls the device at a
+ *                 point of time.
+ * Inputs        : t                - virtual time [ns]
+ * Outputs       : return value     - true if a flash operation is ongoing
+ * Assumptions   : t does not decrease between calls
+ * ------------------------------------------------------------------------- */
+bool Sim_Flash_Busy(sim_time_t t)
+{
+    while (busy_tail != busy_head &&
+           busy_a[busy_tail % MAX_BUSY_INTERVALS].end <= t)
+    {
+        busy_tail++;
+    }
+    return (busy_tail != busy_head &&
+            busy_a[busy_tail % MAX_BUSY_INTERVALS].start <= t);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : sim_time_t Sim_Flash_GetBusyTime(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the total time of the flash operations.
+ * Inputs        : None
+ * Outputs       : return value     - time [ns]
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+sim_time_t Sim_Flash_GetBusyTime(void)
+{
+    return busy_time;
+}
+
+/* ----------------------------------------------------------------------------
+ * Flash driver, see drv_flash.c
+ * ------------------------------------------------------------------------- */
+
+void Drv_Flash_Unlock(void)
+{
+    unlocked = true;
+}
+
+void Drv_Flash_Lock(void)
+{
+    unlocked = false;
+}
+
+bool Drv_Flash_Program(uint_fast32_t adr, const uint32_t data_a[])
+{
+    uint32_t *flash_p = (uint32_t *)(uintptr_t)adr;
+    bool      ok;
+
+    Sim_CpuPause();
+    ok = (unlocked && adr % 8 == 0 &&
+          adr >= FLASH_MAIN_BASE + BOOT_MAX_SIZE &&
+          adr + 8 <= FLASH_MAIN_BASE + FLASH_MAIN_SIZE);
+    if (ok)
+    {
+        flash_p[0] &= data_a[0];
+        flash_p[1] &= data_a[1];
+        ok = (memcmp(flash_p, data_a, 2 * sizeof(uint32_t)) == 0);
+        Busy(program_delay);
+    }
+    Sim_CpuResume();
+    return ok;
+}
+
+bool Drv_Flash_Erase(uint_fast32_t adr)
+{
+    bool ok;
+
+    Sim_CpuPause();
+    ok = (unlocked && adr % FLASH_SECTOR_SIZE == 0 &&
+          adr >= FLASH_MAIN_BASE + BOOT_MAX_SIZE &&
+          adr < FLASH_MAIN_BASE + FLASH_MAIN_SIZE);
+    if (ok)
+    {
+        memset((void *)(uintptr_t)adr, 0xFF, FLASH_SECTOR_SIZE);
+        Busy(erase_delay);
+    }
+    Sim_CpuResume();
+    return ok;
+}
+
+/* ----------------------------------------------------------------------------
+ * Configuration of the installed FOTA stack, see app_conf.c
+ * ------------------------------------------------------------------------- */
+
+App_Conf_uuid_t * App_Conf_GetDeviceID(void)
+{
+    return &GetConfig()->version.dev_id;
+}
+
+App_Conf_version_t * App_Conf_GetVersion(App_Conf_version_type_t type)
+{
+    const Sys_Boot_descriptor_t *dscr_p = Sys_Boot_GetDscr(APP_BASE_ADR);
+    uint_fast32_t size;
+
+    switch (type)
+    {
+        case APP_CONF_BOOT_VERSION:
+        {
+            return NULL;
+        }
+
+        case APP_CONF_STACK_VERSION:
+        {
+            return &GetConfig()->version.app_id;
+        }
+
+        case APP_CONF_APP_VERSION:
+        {
+            /* the BootLoader finds the application behind the FOTA stack */
+            size  = Sys_Boot_GetImageSize(dscr_p) + sizeof(App_Conf_key_t);
+            size += -size % FLASH_SECTOR_SIZE;
+            return Sys_Boot_GetVersion(APP_BASE_ADR + size);
+        }
+    }
+    return NULL;
+}
+
+App_Conf_build_id_t * App_Conf_GetBuildID(void)
+{
+    return (App_Conf_build_id_t *)Sys_Boot_GetDscr(APP_BASE_ADR)->build_id_a;
+}
+
+App_Conf_key_t * App_Conf_GetPublicKey(void)
+{
+    return (App_Conf_key_t *)GetConfig()->config.public_key_a;
+}
+
+uint_fast8_t App_Conf_GetSignatureScheme(void)
+{
+    return GetConfig()->config.sig_scheme;
+}
+
+#ifdef CFG_DFU_KEY_TABLE
+
+App_Conf_key_table_t * App_Conf_GetPublicKeyTable(void)
+{
+    return (App_Conf_key_table_t *)GetConfig()->config.public_key_table_a;
+}
+
+#endif    /* ifdef CFG_DFU_KEY_TABLE */
+
+App_Conf_uuid_t * App_Conf_GetServiceId(void)
+{
+    return (App_Conf_uuid_t *)GetConfig()->config.uuid_a;
+}
+
+App_Conf_dev_name_t * App_Conf_GetDeviceName(void)
+{
+    return (App_Conf_dev_name_t *)&GetConfig()->config.dev_name_length;
+}
@@ -0,0 +1,878 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * sim_kernel.c
+ * - Virtual time, CPU accounting and the kernel of the simulated device
+ *   and central. The device time advances by the host CPU time of the
+ *   firmware code scaled to the target, by the flash operation delays and
+ *   while the device sleeps. The CRC unit and the cycle counter are
+ *   emulated here as well.
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <rsl10.h>
+#include <rsl10_ke.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "sim.h"
+#include "drv_targ.h"
+#include "msg_handler.h"
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define MAX_HANDLERS            32
+#define MAX_TIMERS              16
+#define MAX_TASKS               8
+#define KE_TICK_NS              SIM_MS(10)
+
+/* ADD_8 and ADD_32 never hold these values after data was written */
+#define CRC_IDLE                0x100
+#define CRC_IDLE_WORD           0x100000000ULL
+
+/* target cost of a CRC or cycle counter access [ns] */
+#define IO_ACCESS_NS            (1000 / DRV_TARG_CYCLES_PER_US)
+
+#define CALIBRATION_LOOPS       1000000
+
+/* ----------------------------------------------------------------------------
+ * Local variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef struct message
+{
+    struct message *next_p;
+    ke_msg_id_t     id;
+    ke_task_id_t    dest_id;
+    ke_task_id_t    src_id;
+    sim_time_t      time;
+    void           *param_p;
+} message_t;
+
+typedef struct
+{
+    bool         active;
+    ke_msg_id_t  id;
+    ke_task_id_t task_id;
+    sim_time_t   expiry;
+} sim_timer_t;
+
+typedef struct
+{
+    ke_msg_id_t   id;
+    sim_handler_t handler;
+} handler_t;
+
+typedef struct
+{
+    sim_time_t  now;
+    message_t  *head_p;
+    message_t  *tail_p;
+    sim_timer_t     timer_a[MAX_TIMERS];
+    handler_t   handler_a[MAX_HANDLERS];
+    uint8_t     nb_handlers;
+    ke_state_t  state_a[MAX_TASKS];
+} kernel_t;
+
+typedef struct
+{
+    double     ns_per_tick;
+    double     scale;
+    uint64_t   start;
+    uint64_t   paused;
+    uint64_t   pause_start;
+    uint32_t   pause_depth;
+    uint32_t   pause_count;
+    double     pause_ticks;
+    uint32_t   io_count;
+    double     io_ticks;
+    bool       running;
+    bool       background;
+    bool       reset;
+    sim_time_t last;
+} cpu_t;
+
+static kernel_t kernel_a[SIM_NB_DOMAINS];
+static cpu_t cpu;
+static CRC_Type crc_regs;
+static uint16_t crc_value;
+static DWT_Type dwt_regs;
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint64_t HostTicks(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Reads the host time stamp counter.
+ * Inputs        : None
+ * Outputs       : return value     - host ticks
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint64_t HostTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : double HostNs(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Reads the host monotonic clock.
+ * Inputs        : None
+ * Outputs       : return value     - host time [ns]
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static double HostNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Calibrate(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Measures the host tick length, the host cost of an
+ *                 emulated CRC access, which is replaced by the target cost
+ *                 in the CPU accounting, and the host cost of excluding a
+ *                 simulator call from the accounting.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : CPU accounting is not running
+ * ------------------------------------------------------------------------- */
+static void Calibrate(void)
+{
+    double   ns    = HostNs();
+    uint64_t ticks = HostTicks();
+    uint32_t i;
+
+    do
+    {
+    } while (HostNs() - ns < 20e6);
+    cpu.ns_per_tick = (HostNs() - ns) / (double)(HostTicks() - ticks);
+
+    ticks = HostTicks();
+    for (i = 0; i < CALIBRATION_LOOPS; i++)
+    {
+        CRC->ADD_8 = i;
+    }
+    cpu.io_ticks = (double)(HostTicks() - ticks) / CALIBRATION_LOOPS;
+
+    Sim_CpuBegin();
+    for (i = 0; i < CALIBRATION_LOOPS; i++)
+    {
+        Sim_CpuPause();
+        Sim_CpuResume();
+    }
+    cpu.pause_ticks = (double)(HostTicks() - cpu.start - cpu.paused) /
+                      CALIBRATION_LOOPS;
+    cpu.running = false;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Enqueue(kernel_t *kernel_p, message_t *msg_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Inserts a message into the message queue of a kernel
+ *                 behind all messages of the same or an earlier time.
+ * Inputs        : kernel_p         - pointer to kernel
+ *                 msg_p            - pointer to message
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void Enqueue(kernel_t *kernel_p, message_t *msg_p)
+{
+    message_t **next_pp = &kernel_p->head_p;
+
+    if (kernel_p->tail_p != NULL && kernel_p->tail_p->time <= msg_p->time)
+    {
+        next_pp = &kernel_p->tail_p->next_p;
+    }
+    while (*next_pp != NULL && (*next_pp)->time <= msg_p->time)
+    {
+        next_pp = &(*next_pp)->next_p;
+    }
+    msg_p->next_p = *next_pp;
+    *next_pp = msg_p;
+    if (msg_p->next_p == NULL)
+    {
+        kernel_p->tail_p = msg_p;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void SendMsg(sim_domain_t domain, ke_msg_id_t id,
+ *                              ke_task_id_t dest_id, ke_task_id_t src_id,
+ *                              void *param_p, sim_time_t time)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends a message to a task of a domain.
+ * Inputs        : domain           - device or central
+ *                 id               - message ID
+ *                 dest_id          - destination task ID
+ *                 src_id           - source task ID
+ *                 param_p          - message parameter allocated with
+ *                                    malloc() or NULL
+ *                 time             - virtual time of the message [ns]
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void SendMsg(sim_domain_t domain, ke_msg_id_t id,
+                    ke_task_id_t dest_id, ke_task_id_t src_id, void *param_p,
+                    sim_time_t time)
+{
+    message_t *msg_p = malloc(sizeof(message_t));
+
+    msg_p->id      = id;
+    msg_p->dest_id = dest_id;
+    msg_p->src_id  = src_id;
+    msg_p->time    = time;
+    msg_p->param_p = param_p;
+    Enqueue(&kernel_a[domain], msg_p);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : sim_timer_t *FindTimer(kernel_t *kernel_p, ke_msg_id_t id,
+ *                                    ke_task_id_t task_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Looks up an active timer.
+ * Inputs        : kernel_p         - pointer to kernel
+ *                 id               - timer ID
+ *                 task_id          - task ID
+ * Outputs       : return value     - pointer to timer or NULL
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static sim_timer_t *FindTimer(kernel_t *kernel_p, ke_msg_id_t id,
+                          ke_task_id_t task_id)
+{
+    uint_fast8_t i;
+
+    for (i = 0; i < MAX_TIMERS; i++)
+    {
+        sim_timer_t *timer_p = &kernel_p->timer_a[i];
+
+        if (timer_p->active && timer_p->id == id &&
+            timer_p->task_id == task_id)
+        {
+            return timer_p;
+        }
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void SetTimer(sim_domain_t domain, ke_msg_id_t id,
+ *                               ke_task_id_t task_id, uint32_t delay)
+ * ----------------------------------------------------------------------------
+ * Description   : Starts or restarts a timer of a domain.
+ * Inputs        : domain           - device or central
+ *                 id               - timer ID
+ *                 task_id          - task ID
+ *                 delay            - delay [10 ms]
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void SetTimer(sim_domain_t domain, ke_msg_id_t id,
+                     ke_task_id_t task_id, uint32_t delay)
+{
+    kernel_t *kernel_p = &kernel_a[domain];
+    sim_timer_t  *timer_p  = FindTimer(kernel_p, id, task_id);
+    uint_fast8_t i;
+
+    for (i = 0; timer_p == NULL && i < MAX_TIMERS; i++)
+    {
+        if (!kernel_p->timer_a[i].active)
+        {
+            timer_p = &kernel_p->timer_a[i];
+        }
+    }
+    if (timer_p == NULL)
+    {
+        fprintf(stderr, "too many timers\n");
+        abort();
+    }
+    timer_p->active  = true;
+    timer_p->id      = id;
+    timer_p->task_id = task_id;
+    timer_p->expiry  = Sim_Now(domain) + (delay ? delay : 1) * KE_TICK_NS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void ClearTimer(sim_domain_t domain, ke_msg_id_t id,
+ *                                 ke_task_id_t task_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Stops a timer of a domain.
+ * Inputs        : domain           - device or central
+ *                 id               - timer ID
+ *                 task_id          - task ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void ClearTimer(sim_domain_t domain, ke_msg_id_t id,
+                       ke_task_id_t task_id)
+{
+    sim_timer_t *timer_p = FindTimer(&kernel_a[domain], id, task_id);
+
+    if (timer_p != NULL)
+    {
+        timer_p->active = false;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void ExpireTimers(sim_domain_t domain)
+ * ----------------------------------------------------------------------------
+ * Description   : Turns the expired timers of a domain into messages.
+ * Inputs        : domain           - device or central
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void ExpireTimers(sim_domain_t domain)
+{
+    kernel_t  *kernel_p = &kernel_a[domain];
+    sim_time_t now      = Sim_Now(domain);
+    uint_fast8_t i;
+
+    for (i = 0; i < MAX_TIMERS; i++)
+    {
+        sim_timer_t *timer_p = &kernel_p->timer_a[i];
+
+        if (timer_p->active && timer_p->expiry <= now)
+        {
+            timer_p->active = false;
+            SendMsg(domain, timer_p->id, timer_p->task_id, timer_p->task_id,
+                    NULL, timer_p->expiry);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool AddHandler(sim_domain_t domain, ke_msg_id_t id,
+ *                                 sim_handler_t handler)
+ * ----------------------------------------------------------------------------
+ * Description   : Registers a message handler of a domain.
+ * Inputs        : domain           - device or central
+ *                 id               - message ID
+ *                 handler          - message handler
+ * Outputs       : return value     - true
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static bool AddHandler(sim_domain_t domain, ke_msg_id_t id,
+                       sim_handler_t handler)
+{
+    kernel_t *kernel_p = &kernel_a[domain];
+
+    if (kernel_p->nb_handlers == MAX_HANDLERS)
+    {
+        fprintf(stderr, "too many message handlers\n");
+        abort();
+    }
+    kernel_p->handler_a[kernel_p->nb_handlers].id      = id;
+    kernel_p->handler_a[kernel_p->nb_handlers].handler = handler;
+    kernel_p->nb_handlers++;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_Kernel_Init(const sim_config_t *cfg_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes the kernels and the CPU accounting.
+ * Inputs        : cfg_p            - pointer to simulation parameters
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_Kernel_Init(const sim_config_t *cfg_p)
+{
+    memset(kernel_a, 0, sizeof(kernel_a));
+    memset(&cpu, 0, sizeof(cpu));
+    crc_regs.ADD_8  = CRC_IDLE;
+    crc_regs.ADD_32 = CRC_IDLE_WORD;
+    cpu.scale = cfg_p->cpu_scale;
+    Calibrate();
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : sim_time_t Sim_Now(sim_domain_t domain)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the virtual time of a domain. While the firmware
+ *                 runs, the device time includes its scaled CPU time so far.
+ * Inputs        : domain           - device or central
+ * Outputs       : return value     - virtual time [ns]
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+sim_time_t Sim_Now(sim_domain_t domain)
+{
+    kernel_t *kernel_p = &kernel_a[domain];
+    double    ticks;
+    sim_time_t now;
+
+    if (domain != SIM_DEVICE || !cpu.running)
+    {
+        return kernel_p->now;
+    }
+
+    ticks = (double)(HostTicks() - cpu.start - cpu.paused) -
+            cpu.io_count * cpu.io_ticks - cpu.pause_count * cpu.pause_ticks;
+    if (cpu.pause_depth > 0)
+    {
+        ticks -= HostTicks() - cpu.pause_start;
+    }
+    if (ticks < 0)
+    {
+        ticks = 0;
+    }
+    now = kernel_p->now + (sim_time_t)(ticks * cpu.ns_per_tick * cpu.scale) +
+          (sim_time_t)cpu.io_count * IO_ACCESS_NS;
+
+    /* keep the time monotonic despite the calibrated corrections */
+    if (now < cpu.last)
+    {
+        now = cpu.last;
+    }
+    cpu.last = now;
+    return now;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_SetNow(sim_domain_t domain, sim_time_t now)
+ * ----------------------------------------------------------------------------
+ * Description   : Advances the virtual time of an idle domain.
+ * Inputs        : domain           - device or central
+ *                 now              - new virtual time [ns]
+ * Outputs       : None
+ * Assumptions   : the firmware is not running
+ * ------------------------------------------------------------------------- */
+void Sim_SetNow(sim_domain_t domain, sim_time_t now)
+{
+    if (now > kernel_a[domain].now)
+    {
+        kernel_a[domain].now = now;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_CpuBegin(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Starts accounting the CPU time of the device firmware
+ *                 for one main loop iteration. Like Drv_Targ_Poll(), the
+ *                 iteration consumes the background task flag.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_CpuBegin(void)
+{
+    cpu.background  = false;
+    cpu.last        = kernel_a[SIM_DEVICE].now;
+    cpu.paused      = 0;
+    cpu.pause_depth = 0;
+    cpu.pause_count = 0;
+    cpu.io_count    = 0;
+    cpu.running     = true;
+    cpu.start       = HostTicks();
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_CpuEnd(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Stops accounting the CPU time of the device firmware and
+ *                 adds it to the device time.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : Sim_CpuBegin() was called
+ * ------------------------------------------------------------------------- */
+void Sim_CpuEnd(void)
+{
+    kernel_a[SIM_DEVICE].now = Sim_Now(SIM_DEVICE);
+    cpu.running = false;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_CpuPause(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Excludes the host time of simulator code called by the
+ *                 firmware from the CPU accounting until Sim_CpuResume().
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_CpuPause(void)
+{
+    if (cpu.running && cpu.pause_depth++ == 0)
+    {
+        cpu.pause_start = HostTicks();
+        cpu.pause_count++;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_CpuResume(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Resumes the CPU accounting, see Sim_CpuPause().
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_CpuResume(void)
+{
+    if (cpu.running && --cpu.pause_depth == 0)
+    {
+        cpu.paused += HostTicks() - cpu.pause_start;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_Delay(sim_time_t delay)
+ * ----------------------------------------------------------------------------
+ * Description   : Advances the device time, e.g. by a flash operation.
+ * Inputs        : delay            - delay [ns]
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_Delay(sim_time_t delay)
+{
+    kernel_a[SIM_DEVICE].now += delay;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_Send(sim_domain_t domain, ke_msg_id_t id,
+ *                               void *param_p, sim_time_t time)
+ * ----------------------------------------------------------------------------
+ * Description   : Sends a message of the simulated BLE stack to the
+ *                 application task of a domain.
+ * Inputs        : domain           - device or central
+ *                 id               - message ID
+ *                 param_p          - message parameter allocated with
+ *                                    malloc() or NULL
+ *                 time             - reception time [ns]
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_Send(sim_domain_t domain, ke_msg_id_t id, void *param_p,
+              sim_time_t time)
+{
+    SendMsg(domain, id, TASK_APP, TASK_APP, param_p, time);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : sim_time_t Sim_NextEvent(sim_domain_t domain)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns when a domain has something to do next: now for
+ *                 a pending message or background task, else the next
+ *                 timer expiry.
+ * Inputs        : domain           - device or central
+ * Outputs       : return value     - virtual time [ns] or SIM_TIME_NEVER
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+sim_time_t Sim_NextEvent(sim_domain_t domain)
+{
+    kernel_t  *kernel_p = &kernel_a[domain];
+    sim_time_t next     = SIM_TIME_NEVER;
+    uint_fast8_t i;
+
+    if (domain == SIM_DEVICE && cpu.background)
+    {
+        return kernel_p->now;
+    }
+    if (kernel_p->head_p != NULL)
+    {
+        next = kernel_p->head_p->time;
+    }
+    for (i = 0; i < MAX_TIMERS; i++)
+    {
+        if (kernel_p->timer_a[i].active && kernel_p->timer_a[i].expiry < next)
+        {
+            next = kernel_p->timer_a[i].expiry;
+        }
+    }
+    return (next < kernel_p->now) ? kernel_p->now : next;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool Sim_Schedule(sim_domain_t domain)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles the expired timers and the next due message of
+ *                 a domain, like Kernel_Schedule() in the main loop.
+ * Inputs        : domain           - device or central
+ * Outputs       : return value     - true if a message was handled
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool Sim_Schedule(sim_domain_t domain)
+{
+    kernel_t  *kernel_p = &kernel_a[domain];
+    message_t *msg_p;
+    uint_fast8_t i;
+
+    ExpireTimers(domain);
+
+    msg_p = kernel_p->head_p;
+    if (msg_p == NULL || msg_p->time > Sim_Now(domain))
+    {
+        return false;
+    }
+    kernel_p->head_p = msg_p->next_p;
+    if (kernel_p->head_p == NULL)
+    {
+        kernel_p->tail_p = NULL;
+    }
+
+    for (i = 0; i < kernel_p->nb_handlers; i++)
+    {
+        if (kernel_p->handler_a[i].id == msg_p->id)
+        {
+            kernel_p->handler_a[i].handler(msg_p->id, msg_p->param_p,
+                                           msg_p->dest_id, msg_p->src_id);
+        }
+    }
+    free(msg_p->param_p);
+    free(msg_p);
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_Wake(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Wakes the device for one main loop iteration, as the
+ *                 baseband interrupt of a connection event does.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_Wake(void)
+{
+    cpu.background = true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool Sim_ResetRequested(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns whether the device firmware requested a reset.
+ * Inputs        : None
+ * Outputs       : return value     - true after Drv_Targ_Reset()
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool Sim_ResetRequested(void)
+{
+    return cpu.reset;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_AddHandler(sim_domain_t domain, ke_msg_id_t id,
+ *                                     sim_handler_t handler)
+ * ----------------------------------------------------------------------------
+ * Description   : Registers a message handler of the simulator.
+ * Inputs        : domain           - device or central
+ *                 id               - message ID
+ *                 handler          - message handler
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_AddHandler(sim_domain_t domain, ke_msg_id_t id,
+                    sim_handler_t handler)
+{
+    AddHandler(domain, id, handler);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void CrcOctet(uint_fast32_t octet)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds an octet to the emulated CRC, reflected CRC-CCITT
+ *                 with the polynomial 0x8408.
+ * Inputs        : octet            - octet in the low 8 bits
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void CrcOctet(uint_fast32_t octet)
+{
+    octet     = (octet ^ crc_value) & 0xFF;
+    octet    ^= (octet << 4) & 0xFF;
+    crc_value = (crc_value >> 8) ^ (octet >> 4) ^ (octet << 3) ^
+                (octet << 8);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : CRC_Type *Sim_Crc(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Emulates the CRC unit configured for CRC-CCITT with the
+ *                 non-standard bit order, final reverse and final XOR, as
+ *                 used by app_hdlc.c. Every CRC access calls this function
+ *                 first, so it applies the register write of the previous
+ *                 access and returns the registers with the current values.
+ * Inputs        : None
+ * Outputs       : return value     - pointer to CRC registers
+ * Assumptions   : only ADD_8, ADD_32, VALUE and CTRL are written
+ * ------------------------------------------------------------------------- */
+CRC_Type * Sim_Crc(void)
+{
+    uint_fast8_t i;
+
+    cpu.io_count++;
+
+    if (crc_regs.ADD_8 != CRC_IDLE)
+    {
+        CrcOctet(crc_regs.ADD_8);
+    }
+    else if (crc_regs.ADD_32 != CRC_IDLE_WORD)
+    {
+        /* the octets of the word in memory order (little-endian) */
+        for (i = 0; i < 32; i += 8)
+        {
+            CrcOctet(crc_regs.ADD_32 >> i);
+        }
+    }
+    else if (crc_regs.VALUE != crc_value)
+    {
+        crc_value = crc_regs.VALUE;
+    }
+
+    crc_regs.CTRL   = 0;
+    crc_regs.VALUE  = crc_value;
+    crc_regs.FINAL  = crc_value ^ 0xFFFF;
+    crc_regs.ADD_8  = CRC_IDLE;
+    crc_regs.ADD_32 = CRC_IDLE_WORD;
+    return &crc_regs;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : DWT_Type *Sim_Dwt(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Emulates the cycle counter on the device time.
+ * Inputs        : None
+ * Outputs       : return value     - pointer to DWT registers
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+DWT_Type * Sim_Dwt(void)
+{
+    Sim_CpuPause();
+    dwt_regs.CYCCNT = (uint32_t)(Sim_Now(SIM_DEVICE) * DRV_TARG_CYCLES_PER_US /
+                                 1000);
+    Sim_CpuResume();
+    Sim_Delay(IO_ACCESS_NS);
+    return &dwt_regs;
+}
+
+/* ----------------------------------------------------------------------------
+ * Kernel API of the device
+ * ------------------------------------------------------------------------- */
+
+void ke_msg_send_basic(ke_msg_id_t id, ke_task_id_t dest_id,
+                       ke_task_id_t src_id)
+{
+    SendMsg(SIM_DEVICE, id, dest_id, src_id, NULL, Sim_Now(SIM_DEVICE));
+}
+
+void ke_timer_set(ke_msg_id_t timer_id, ke_task_id_t task_id, uint32_t delay)
+{
+    SetTimer(SIM_DEVICE, timer_id, task_id, delay);
+}
+
+void ke_timer_clear(ke_msg_id_t timer_id, ke_task_id_t task_id)
+{
+    ClearTimer(SIM_DEVICE, timer_id, task_id);
+}
+
+bool ke_timer_active(ke_msg_id_t timer_id, ke_task_id_t task_id)
+{
+    return (FindTimer(&kernel_a[SIM_DEVICE], timer_id, task_id) != NULL);
+}
+
+ke_state_t ke_state_get(ke_task_id_t id)
+{
+    return kernel_a[SIM_DEVICE].state_a[KE_IDX_GET(id) % MAX_TASKS];
+}
+
+void ke_state_set(ke_task_id_t id, ke_state_t state_id)
+{
+    kernel_a[SIM_DEVICE].state_a[KE_IDX_GET(id) % MAX_TASKS] = state_id;
+}
+
+bool MsgHandler_Add(ke_msg_id_t const msg_id,
+                    void (*callback)(ke_msg_id_t const msg_id, void const *param,
+                                     ke_task_id_t const dest_id, ke_task_id_t const src_id))
+{
+    return AddHandler(SIM_DEVICE, msg_id, callback);
+}
+
+void Drv_Targ_SetBackgroundFlag(void)
+{
+    cpu.background = true;
+}
+
+void Drv_Targ_Reset(void)
+{
+    cpu.reset = true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Kernel API of the central, see central.h
+ * ------------------------------------------------------------------------- */
+
+void Central_ke_msg_send_basic(ke_msg_id_t id, ke_task_id_t dest_id,
+                               ke_task_id_t src_id)
+{
+    SendMsg(SIM_CENTRAL, id, dest_id, src_id, NULL, Sim_Now(SIM_CENTRAL));
+}
+
+void Central_ke_timer_set(ke_msg_id_t timer_id, ke_task_id_t task_id,
+                          uint32_t delay)
+{
+    SetTimer(SIM_CENTRAL, timer_id, task_id, delay);
+}
+
+void Central_ke_timer_clear(ke_msg_id_t timer_id, ke_task_id_t task_id)
+{
+    ClearTimer(SIM_CENTRAL, timer_id, task_id);
+}
+
+bool Central_ke_timer_active(ke_msg_id_t timer_id, ke_task_id_t task_id)
+{
+    return (FindTimer(&kernel_a[SIM_CENTRAL], timer_id, task_id) != NULL);
+}
+
+ke_state_t Central_ke_state_get(ke_task_id_t id)
+{
+    return kernel_a[SIM_CENTRAL].state_a[KE_IDX_GET(id) % MAX_TASKS];
+}
+
+void Central_ke_state_set(ke_task_id_t id, ke_state_t state_id)
+{
+    kernel_a[SIM_CENTRAL].state_a[KE_IDX_GET(id) % MAX_TASKS] = state_id;
+}
+
+bool Central_MsgHandler_Add(ke_msg_id_t const msg_id,
+                            sim_handler_t callback)
+{
+    return AddHandler(SIM_CENTRAL, msg_id, callback);
+}
+
+DWT_Type * Central_Sim_Dwt(void)
+{
+    static DWT_Type central_dwt_regs;
+
+    central_dwt_regs.CYCCNT = (uint32_t)(Sim_Now(SIM_CENTRAL) *
+                                         DRV_TARG_CYCLES_PER_US / 1000);
+    return &central_dwt_regs;
+}
@@ -0,0 +1,508 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * sim_link.c
+ * - BLE link of the simulator: GATT write commands of the central and
+ *   notifications of the device, exchanged as link layer PDUs in
+ *   connection events. Replaces app_ble.c on the device side.
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rsl10.h>
+#include <rsl10_ke.h>
+
+#include "sim.h"
+#include "app_ble.h"
+#include "app_stat.h"
+#include "app_sched.h"
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define T_IFS                   SIM_US(150)
+#define L2CAP_HDR               4
+#define ATT_HDR                 3       /* write command or notification */
+
+#define MAX_PACKET_SIZE         512     /* max. ATT value */
+#define MAX_PACKETS             256     /* per direction */
+#define MAX_SUMMARIES           8
+
+/* ----------------------------------------------------------------------------
+ * Local variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint16_t   seq_nb;
+    uint16_t   size;
+    uint16_t   sent;                    /* L2CAP octets acknowledged */
+    sim_time_t time;                    /* time the packet was queued */
+    uint8_t    data_a[MAX_PACKET_SIZE];
+} packet_t;
+
+typedef struct
+{
+    packet_t packet_a[MAX_PACKETS];
+    uint32_t head;
+    uint32_t tail;
+} queue_t;
+
+/* parameter of SIM_BLE_DATA_IND and SIM_BLE_DATA_CFM */
+typedef struct
+{
+    uint16_t seq_nb;
+    uint16_t size;
+    uint8_t  data_a[];
+} data_t;
+
+static sim_config_t cfg;
+static sim_time_t interval;
+static sim_time_t budget;
+static uint32_t event_nb;
+static bool in_event;
+static sim_time_t event_start;
+static sim_time_t used;                 /* air time of the event so far */
+static uint64_t rnd_state;
+static uint8_t rx_pending;
+static queue_t central_queue;
+static queue_t device_queue;
+static sim_link_stat_t stat;
+static uint8_t summary_a[MAX_SUMMARIES][APP_STAT_RECORD_SIZE];
+static uint_fast8_t nb_summaries;
+
+/* octets of preamble, access address, header and CRC per PHY */
+static const uint8_t ll_overhead_a[3] = { 0, 1 + 4 + 2 + 3, 2 + 4 + 2 + 3 };
+
+/* ----------------------------------------------------------------------------
+ * Function      : double Random(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns a pseudo random number (xorshift64*), so that a
+ *                 run is reproducible for a seed.
+ * Inputs        : None
+ * Outputs       : return value     - number in [0, 1)
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static double Random(void)
+{
+    rnd_state ^= rnd_state >> 12;
+    rnd_state ^= rnd_state << 25;
+    rnd_state ^= rnd_state >> 27;
+    return (double)((rnd_state * 0x2545F4914F6CDD1DULL) >> 11) /
+           (double)(1ULL << 53);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : sim_time_t PduTime(uint_fast16_t payload)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the air time of a data PDU.
+ * Inputs        : payload          - LL payload size (0 for an empty PDU)
+ * Outputs       : return value     - air time [ns]
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static sim_time_t PduTime(uint_fast16_t payload)
+{
+    return (sim_time_t)(ll_overhead_a[cfg.phy] + payload) * SIM_US(8) /
+           cfg.phy;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint8_t *Alloc(queue_t *queue_p, uint_fast16_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the buffer of the next packet of a queue, which is
+ *                 built in place. A packet not fitting into the queue is
+ *                 lost, like a write the stack refuses.
+ * Inputs        : queue_p          - pointer to queue
+ *                 size             - max. size of data
+ * Outputs       : return value     - pointer to data or NULL
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint8_t * Alloc(queue_t *queue_p, uint_fast16_t size)
+{
+    if (queue_p->head - queue_p->tail == MAX_PACKETS ||
+        size > MAX_PACKET_SIZE)
+    {
+        stat.dropped++;
+        return NULL;
+    }
+    return queue_p->packet_a[queue_p->head % MAX_PACKETS].data_a;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Enqueue(queue_t *queue_p, uint_fast16_t seq_nb,
+ *                              uint_fast16_t size, sim_time_t time)
+ * ----------------------------------------------------------------------------
+ * Description   : Queues the packet built in the buffer of Alloc for
+ *                 transmission.
+ * Inputs        : queue_p          - pointer to queue
+ *                 seq_nb           - sequence number
+ *                 size             - size of data
+ *                 time             - virtual time [ns]
+ * Outputs       : None
+ * Assumptions   : Alloc returned the buffer
+ * ------------------------------------------------------------------------- */
+static void Enqueue(queue_t *queue_p, uint_fast16_t seq_nb,
+                    uint_fast16_t size, sim_time_t time)
+{
+    packet_t *packet_p = &queue_p->packet_a[queue_p->head % MAX_PACKETS];
+
+    packet_p->seq_nb = seq_nb;
+    packet_p->size   = size;
+    packet_p->sent   = 0;
+    packet_p->time   = time;
+    queue_p->head++;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast16_t NextPdu(const queue_t *queue_p,
+ *                                       sim_time_t     time)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the LL payload size of the next PDU of a queue.
+ * Inputs        : queue_p          - pointer to queue
+ *                 time             - only packets queued before are sent
+ * Outputs       : return value     - payload size, 0 for an empty PDU
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint_fast16_t NextPdu(const queue_t *queue_p, sim_time_t time)
+{
+    const packet_t *packet_p = &queue_p->packet_a[queue_p->tail % MAX_PACKETS];
+    uint_fast16_t   rest;
+
+    if (queue_p->head == queue_p->tail || packet_p->time >= time)
+    {
+        return 0;
+    }
+    rest = L2CAP_HDR + ATT_HDR + packet_p->size - packet_p->sent;
+    return (rest < cfg.tx_octets) ? rest : cfg.tx_octets;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : data_t *Advance(queue_t *queue_p, uint_fast16_t payload)
+ * ----------------------------------------------------------------------------
+ * Description   : Accounts an acknowledged PDU of a queue.
+ * Inputs        : queue_p          - pointer to queue
+ *                 payload          - LL payload size
+ * Outputs       : return value     - copy of the completed packet or NULL
+ *                                    (allocated with malloc())
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static data_t * Advance(queue_t *queue_p, uint_fast16_t payload)
+{
+    packet_t *packet_p = &queue_p->packet_a[queue_p->tail % MAX_PACKETS];
+    data_t   *data_p;
+
+    stat.air_bytes += payload;
+    packet_p->sent += payload;
+    if (packet_p->sent < L2CAP_HDR + ATT_HDR + packet_p->size)
+    {
+        return NULL;
+    }
+    data_p = malloc(sizeof(data_t) + packet_p->size);
+    data_p->seq_nb = packet_p->seq_nb;
+    data_p->size   = packet_p->size;
+    memcpy(data_p->data_a, packet_p->data_a, packet_p->size);
+    queue_p->tail++;
+    return data_p;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void DataInd(ke_msg_id_t msg_id, const void *param_p,
+ *                              ke_task_id_t dest_id, ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles a write command of the central on the device,
+ *                 see DfusCallback() in app_ble.c.
+ * Inputs        : msg_id           - always SIM_BLE_DATA_IND
+ *                 param_p          - pointer to data_t
+ *                 dest_id          - always TASK_APP
+ *                 src_id           - always TASK_APP
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void DataInd(ke_msg_id_t msg_id, const void *param_p,
+                    ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    const data_t *data_p = param_p;
+
+    Sim_Delay(SIM_US(cfg.stack_us));
+    rx_pending--;
+    App_Sched_EventInd();
+    App_Ble_DataInd(0, data_p->data_a, data_p->size);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void DataCfm(ke_msg_id_t msg_id, const void *param_p,
+ *                              ke_task_id_t dest_id, ke_task_id_t src_id)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles a sent notification on the device, see the
+ *                 GATTC_CMP_EVT handler in app_ble.c.
+ * Inputs        : msg_id           - always SIM_BLE_DATA_CFM
+ *                 param_p          - pointer to data_t
+ *                 dest_id          - always TASK_APP
+ *                 src_id           - always TASK_APP
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void DataCfm(ke_msg_id_t msg_id, const void *param_p,
+                    ke_task_id_t dest_id, ke_task_id_t src_id)
+{
+    const data_t *data_p = param_p;
+
+    Sim_Delay(SIM_US(cfg.stack_us));
+    App_Sched_EventInd();
+    App_Ble_DataCfm(0, data_p->seq_nb, APP_BLE_SUCCESS);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_Link_Init(const sim_config_t *cfg_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Initializes the link model, the first connection event
+ *                 is at time 0.
+ * Inputs        : cfg_p            - pointer to simulation parameters
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Sim_Link_Init(const sim_config_t *cfg_p)
+{
+    cfg       = *cfg_p;
+    interval  = SIM_MS(cfg.interval_ms);
+    budget    = (sim_time_t)(interval * cfg.event_time);
+    event_nb  = 0;
+    in_event  = false;
+    rnd_state = cfg.seed * 0x9E3779B97F4A7C15ULL + 1;
+    memset(&stat, 0, sizeof(stat));
+
+    Sim_AddHandler(SIM_DEVICE, SIM_BLE_DATA_IND, DataInd);
+    Sim_AddHandler(SIM_DEVICE, SIM_BLE_DATA_CFM, DataCfm);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : sim_time_t Sim_Link_NextEvent(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the start of the next exchange of the current
+ *                 connection event or of the next connection event.
+ * Inputs        : None
+ * Outputs       : return value     - virtual time [ns]
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+sim_time_t Sim_Link_NextEvent(void)
+{
+    return in_event ? event_start + used : event_nb * interval;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void EndEvent(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Closes the current connection event, the baseband
+ *                 interrupt at its end wakes the device.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void EndEvent(void)
+{
+    in_event = false;
+    Sim_Send(SIM_DEVICE, SIM_BLE_EVENT_END, NULL, event_start + used);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Sim_Link_Event(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Runs the next step of the link, which opens a connection
+ *                 event or is an exchange of a PDU of the central, the PDU
+ *                 of the device and two inter frame spaces. The event goes
+ *                 on while one side has data and the next exchange fits
+ *                 into the usable part of the interval. A PDU hit by a
+ *                 packet error is repeated by the link layer. The central
+ *                 only starts a packet while the device has a free receive
+ *                 buffer. An event starting during a flash operation is
+ *                 missed, as the CPU is stalled. Completed packets may be
+ *                 dropped above the link layer, which the data link must
+ *                 recover. The device wakes up at the start and at the end
+ *                 of each event.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   : the central and the device are not behind the step
+ * ------------------------------------------------------------------------- */
+void Sim_Link_Event(void)
+{
+    sim_time_t    now = Sim_Link_NextEvent();
+    uint_fast16_t m   = 0;
+    uint_fast16_t s;
+    uint_fast16_t seq_nb;
+    sim_time_t    duration;
+    data_t       *data_p;
+
+    if (!in_event)
+    {
+        event_start = now;
+        used        = 0;
+        event_nb++;
+        stat.events++;
+        Sim_Wake();
+        if (Sim_Flash_Busy(now))
+        {
+            stat.missed_events++;
+        }
+        else
+        {
+            in_event = true;
+        }
+        return;
+    }
+
+    s = NextPdu(&device_queue, now);
+    if (rx_pending < cfg.rx_buffers ||
+        central_queue.packet_a[central_queue.tail % MAX_PACKETS].sent > 0)
+    {
+        m = NextPdu(&central_queue, now);
+    }
+    duration = PduTime(m) + T_IFS + PduTime(s) + T_IFS;
+    if (used > 0 && ((m == 0 && s == 0) || used + duration > budget))
+    {
+        EndEvent();
+        return;
+    }
+    used += duration;
+    now  += duration;
+
+    if (m > 0)
+    {
+        stat.pdus++;
+        if (Random() < cfg.per)
+        {
+            stat.ll_retransmissions++;
+        }
+        else if ((data_p = Advance(&central_queue, m)) != NULL)
+        {
+            seq_nb = data_p->seq_nb;
+            if (Random() < cfg.drop)
+            {
+                stat.dropped++;
+                free(data_p);
+            }
+            else
+            {
+                rx_pending++;
+                Sim_Send(SIM_DEVICE, SIM_BLE_DATA_IND, data_p, now);
+            }
+            Sim_SetNow(SIM_CENTRAL, now);
+            Central_Ble_DataCfm(0, seq_nb, APP_BLE_SUCCESS);
+        }
+    }
+
+    if (s > 0)
+    {
+        stat.pdus++;
+        if (Random() < cfg.per)
+        {
+            stat.ll_retransmissions++;
+        }
+        else if ((data_p = Advance(&device_queue, s)) != NULL)
+        {
+            if (Random() < cfg.drop)
+            {
+                stat.dropped++;
+            }
+            else
+            {
+                Sim_SetNow(SIM_CENTRAL, now);
+                Central_Ble_DataInd(0, data_p->data_a, data_p->size);
+            }
+            Sim_Send(SIM_DEVICE, SIM_BLE_DATA_CFM, data_p, now);
+        }
+    }
+
+    if (m == 0 && s == 0)
+    {
+        /* empty poll keeping the connection */
+        EndEvent();
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : const sim_link_stat_t *Sim_Link_GetStat(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the link statistics.
+ * Inputs        : None
+ * Outputs       : return value     - pointer to statistics
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+const sim_link_stat_t * Sim_Link_GetStat(void)
+{
+    stat.flash_busy = Sim_Flash_GetBusyTime();
+    return &stat;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint_fast8_t Sim_Link_GetSummaries(
+ *                                          const uint8_t **record_pp)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the telemetry summary records sent by the device.
+ * Inputs        : None
+ * Outputs       : record_pp        - pointer to the first record, the
+ *                                    records are APP_STAT_RECORD_SIZE apart
+ *                 return value     - number of records
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+uint_fast8_t Sim_Link_GetSummaries(const uint8_t **record_pp)
+{
+    *record_pp = summary_a[0];
+    return nb_summaries;
+}
+
+/* ----------------------------------------------------------------------------
+ * BLE interface of the device, see app_ble.c
+ * ------------------------------------------------------------------------- */
+
+uint8_t * App_Ble_DataAlloc(uint_fast8_t link, uint_fast16_t size)
+{
+    return Alloc(&device_queue, size);
+}
+
+void App_Ble_DataReq(uint_fast8_t link, uint_fast16_t seq_nb,
+                     uint8_t *data_p, uint_fast16_t size)
+{
+    Sim_CpuPause();
+    Enqueue(&device_queue, seq_nb, size, Sim_Now(SIM_DEVICE));
+    Sim_CpuResume();
+}
+
+void App_Ble_StatReq(uint_fast8_t link,
+                     const uint8_t *data_p, uint_fast16_t size)
+{
+    /* telemetry is collected directly, its air time is negligible */
+    if (data_p[0] == APP_STAT_SUMMARY && nb_summaries < MAX_SUMMARIES &&
+        size <= APP_STAT_RECORD_SIZE)
+    {
+        memcpy(summary_a[nb_summaries++], data_p, size);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * BLE interface of the central
+ * ------------------------------------------------------------------------- */
+
+uint8_t * Central_Ble_DataAlloc(uint_fast8_t link, uint_fast16_t size)
+{
+    return Alloc(&central_queue, size);
+}
+
+void Central_Ble_DataReq(uint_fast8_t link, uint_fast16_t seq_nb,
+                         uint8_t *data_p, uint_fast16_t size)
+{
+    Enqueue(&central_queue, seq_nb, size, Sim_Now(SIM_CENTRAL));
+}
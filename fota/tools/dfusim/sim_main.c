@@ -0,0 +1,772 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (c) 2019 Semiconductor Components Industries, LLC (d/b/a
+ * ON Semiconductor), All Rights Reserved
+ *
+ * This code is the property of ON Semiconductor and may not be redistributed
+ * in any form without prior written permission from ON Semiconductor.
+ * The terms of use and warranty for this code are covered by contractual
+ * agreements between ON Semiconductor and the licensee.
+ *
+ * This is Reusable Code.
+ *
+ * ----------------------------------------------------------------------------
+ * sim_main.c
+ * - Host DFU pipeline simulator: runs the DFU component of the FOTA
+ *   stack against a simulated central over a simulated BLE link and
+ *   reports where the time of an OTA download goes
+ * ------------------------------------------------------------------------- */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <rsl10.h>
+#include <rsl10_ke.h>
+
+#include "sim.h"
+#include "sys_boot.h"
+#include "sys_man.h"
+#include "app_conf.h"
+#include "app_stat.h"
+#include "app_sched.h"
+
+/* ----------------------------------------------------------------------------
+ * Defines
+ * --------------------------------------------------------------------------*/
+
+#define IMAGE_DDOWNLOAD         1
+#define IMAGE_DDOWNLOAD_Z       2
+#define IMAGE_DDOWNLOAD_D       3
+#define IMAGE_TRANSACTION       7
+
+#define MSG_HDR_SIZE            8
+#define MAX_MESSAGES            3
+#define VECTOR_RESET            0x04
+#define VECTOR_DSCR             0x20
+
+#define STATUS_TIMEOUT          -1
+#define STATUS_RESET            -2
+
+/* ----------------------------------------------------------------------------
+ * Local variables and types
+ * --------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint8_t   *data_p;                  /* header and body */
+    uint32_t   size;
+    uint32_t   tx_len;                  /* passed to the data link */
+    uint32_t   cfm_len;                 /* confirmed by the data link */
+    sim_time_t done;                    /* all data confirmed */
+} message_t;
+
+typedef struct
+{
+    message_t  msg_a[MAX_MESSAGES];
+    uint_fast8_t nb_msgs;
+    uint_fast8_t current;
+    uint16_t   sdu_size;
+    int        status;
+    uint32_t   retransmissions;
+    uint64_t   body_bytes;
+    sim_time_t stall_start;
+    sim_time_t stall;
+    sim_time_t finalize;
+    sim_time_t end;
+} central_t;
+
+static central_t central;
+
+static const struct option option_a[] =
+{
+    { "base",       required_argument, NULL, 'b' },
+    { "app-only",   no_argument,       NULL, 'a' },
+    { "interval",   required_argument, NULL, 'i' },
+    { "phy",        required_argument, NULL, 'p' },
+    { "tx-octets",  required_argument, NULL, 'o' },
+    { "mtu",        required_argument, NULL, 'm' },
+    { "event-time", required_argument, NULL, 'e' },
+    { "per",        required_argument, NULL, 'r' },
+    { "drop",       required_argument, NULL, 'd' },
+    { "rx-buffers", required_argument, NULL, 'x' },
+    { "seed",       required_argument, NULL, 's' },
+    { "extended",   no_argument,       NULL, 'X' },
+    { "sdu",        required_argument, NULL, 'u' },
+    { "cpu-scale",  required_argument, NULL, 'c' },
+    { "stack-us",   required_argument, NULL, 'k' },
+    { "program-us", required_argument, NULL, 'g' },
+    { "erase-ms",   required_argument, NULL, 'E' },
+    { "timeout",    required_argument, NULL, 't' },
+    { "json",       no_argument,       NULL, 'j' },
+    { NULL,         0,                 NULL, 0   }
+};
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint32_t GetU32(const uint8_t *p)
+ * ----------------------------------------------------------------------------
+ * Description   : Reads a little-endian 32-bit value.
+ * Inputs        : p                - pointer to value
+ * Outputs       : return value     - value
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint32_t GetU32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint8_t *ReadFile(const char *name, uint32_t *size_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Reads a whole file.
+ * Inputs        : name             - file name
+ * Outputs       : size_p           - file size
+ *                 return value     - file content (allocated with malloc())
+ * Assumptions   : exits on errors
+ * ------------------------------------------------------------------------- */
+static uint8_t * ReadFile(const char *name, uint32_t *size_p)
+{
+    FILE    *f = fopen(name, "rb");
+    uint8_t *data_p;
+    long     size;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0)
+    {
+        fprintf(stderr, "cannot read %s\n", name);
+        exit(2);
+    }
+    rewind(f);
+    data_p = malloc(size);
+    if (fread(data_p, 1, size, f) != (size_t)size)
+    {
+        fprintf(stderr, "cannot read %s\n", name);
+        exit(2);
+    }
+    fclose(f);
+    *size_p = size;
+    return data_p;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint32_t GetSubImageSize(const uint8_t *image_p,
+ *                                          uint32_t       size)
+ * ----------------------------------------------------------------------------
+ * Description   : Returns the signed size of a plain sub-image from its
+ *                 BootLoader descriptor, see split_img() in mkfotaimg.py.
+ * Inputs        : image_p          - pointer to sub-image
+ *                 size             - bytes available
+ * Outputs       : return value     - sub-image size including signature
+ * Assumptions   : exits on errors
+ * ------------------------------------------------------------------------- */
+static uint32_t GetSubImageSize(const uint8_t *image_p, uint32_t size)
+{
+    uint32_t start;
+    uint32_t dscr;
+    uint32_t len = 0;
+
+    if (size >= FLASH_SECTOR_SIZE)
+    {
+        start = GetU32(image_p + VECTOR_RESET) & ~(FLASH_SECTOR_SIZE - 1);
+        dscr  = GetU32(image_p + VECTOR_DSCR) - start;
+        if (dscr + sizeof(Sys_Boot_descriptor_t) <= FLASH_SECTOR_SIZE)
+        {
+            len = GetU32(image_p + dscr) + sizeof(App_Conf_key_t);
+        }
+    }
+    if (len < APP_MIN_SIZE || len > size)
+    {
+        fprintf(stderr, "no valid sub-image\n");
+        exit(2);
+    }
+    return len;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : uint32_t Align(uint32_t size)
+ * ----------------------------------------------------------------------------
+ * Description   : Aligns a size to the flash sectors.
+ * Inputs        : size             - size
+ * Outputs       : return value     - aligned size
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static uint32_t Align(uint32_t size)
+{
+    return size + (-size % FLASH_SECTOR_SIZE);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Install(const char *name)
+ * ----------------------------------------------------------------------------
+ * Description   : Installs the FOTA stack and the application of a plain
+ *                 FOTA image file as the BootLoader would have done.
+ * Inputs        : name             - plain FOTA image file
+ * Outputs       : None
+ * Assumptions   : exits on errors
+ * ------------------------------------------------------------------------- */
+static void Install(const char *name)
+{
+    uint32_t size;
+    uint8_t *image_p = ReadFile(name, &size);
+    uint32_t stack   = GetSubImageSize(image_p, size);
+    uint32_t app_adr = APP_BASE_ADR + Align(stack);
+
+    if (!Sim_Flash_Install(APP_BASE_ADR, image_p, stack) ||
+        Align(stack) >= size ||
+        !Sim_Flash_Install(app_adr, image_p + Align(stack),
+                           GetSubImageSize(image_p + Align(stack),
+                                           size - Align(stack))))
+    {
+        fprintf(stderr, "cannot install %s\n", name);
+        exit(2);
+    }
+    free(image_p);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void AddMessage(uint_fast8_t code, uint32_t param,
+ *                                 const uint8_t *body_p, uint32_t len)
+ * ----------------------------------------------------------------------------
+ * Description   : Adds a message for the device.
+ * Inputs        : code             - message code
+ *                 param            - 24-bit message parameter
+ *                 body_p           - pointer to message body
+ *                 len              - body length
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void AddMessage(uint_fast8_t code, uint32_t param,
+                       const uint8_t *body_p, uint32_t len)
+{
+    message_t *msg_p = &central.msg_a[central.nb_msgs++];
+
+    msg_p->size   = MSG_HDR_SIZE + len;
+    msg_p->data_p = malloc(msg_p->size);
+    msg_p->data_p[0] = code;
+    msg_p->data_p[1] = param;
+    msg_p->data_p[2] = param >> 8;
+    msg_p->data_p[3] = param >> 16;
+    msg_p->data_p[4] = len;
+    msg_p->data_p[5] = len >> 8;
+    msg_p->data_p[6] = len >> 16;
+    msg_p->data_p[7] = len >> 24;
+    if (len > 0)
+    {
+        memcpy(msg_p->data_p + MSG_HDR_SIZE, body_p, len);
+    }
+    central.body_bytes += len;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void LoadImage(const char *name, bool app_only)
+ * ----------------------------------------------------------------------------
+ * Description   : Builds the download messages of a FOTA image file, the
+ *                 format follows the file extension of mkfotaimg.py. The
+ *                 FOTA stack and the application are sent in a
+ *                 transaction.
+ * Inputs        : name             - .fota, .fotaz or .fotad file
+ *                 app_only         - skip the FOTA stack sub-image
+ * Outputs       : None
+ * Assumptions   : exits on errors
+ * ------------------------------------------------------------------------- */
+static void LoadImage(const char *name, bool app_only)
+{
+    const char *ext_p = strrchr(name, '.');
+    uint32_t    size;
+    uint8_t    *image_p = ReadFile(name, &size);
+    uint32_t    pos     = 0;
+    uint32_t    len;
+    uint_fast8_t i;
+    uint_fast8_t nb_subs = 2;
+    uint8_t      transaction = 0;
+
+    if (ext_p != NULL && strcmp(ext_p, ".fotad") == 0)
+    {
+        nb_subs = 1;
+    }
+    else if (!app_only)
+    {
+        transaction = 2;
+        AddMessage(IMAGE_TRANSACTION, transaction, NULL, 0);
+    }
+
+    for (i = 0; i < nb_subs; i++)
+    {
+        if (ext_p != NULL &&
+            (strcmp(ext_p, ".fotaz") == 0 || strcmp(ext_p, ".fotad") == 0))
+        {
+            /* uncompressed and encoded size, followed by the encoded body */
+            if (size - pos < 8 || size - pos - 8 < GetU32(image_p + pos + 4))
+            {
+                fprintf(stderr, "corrupt image %s\n", name);
+                exit(2);
+            }
+            len = GetU32(image_p + pos + 4);
+            if (i > 0 || !app_only || nb_subs == 1)
+            {
+                AddMessage(nb_subs == 1 ? IMAGE_DDOWNLOAD_D : IMAGE_DDOWNLOAD_Z,
+                           GetU32(image_p + pos), image_p + pos + 8, len);
+            }
+            pos += 8 + len;
+        }
+        else
+        {
+            len = GetSubImageSize(image_p + pos, size - pos);
+            if (i > 0 || !app_only)
+            {
+                AddMessage(IMAGE_DDOWNLOAD, 0, image_p + pos, len);
+            }
+            pos += Align(len);
+        }
+    }
+    free(image_p);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Push(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Passes SDUs of the current message to the data link until
+ *                 its window is closed. Each message starts with an SDU.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void Push(void)
+{
+    message_t *msg_p = &central.msg_a[central.current];
+
+    while (central.current < central.nb_msgs && msg_p->tx_len < msg_p->size)
+    {
+        uint32_t len = msg_p->size - msg_p->tx_len;
+
+        if (len > central.sdu_size)
+        {
+            len = central.sdu_size;
+        }
+        if (!Central_Hdlc_DataReq(0, msg_p->data_p + msg_p->tx_len, len))
+        {
+            if (central.stall_start == SIM_TIME_NEVER)
+            {
+                central.stall_start = Sim_Now(SIM_CENTRAL);
+            }
+            return;
+        }
+        msg_p->tx_len += len;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Central_Stat_Count(App_Stat_counter_t counter,
+ *                                         uint_fast32_t      value)
+ * ----------------------------------------------------------------------------
+ * Description   : Counts the events of the central data link.
+ * Inputs        : counter          - counter ID
+ *                 value            - value to add
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Central_Stat_Count(App_Stat_counter_t counter, uint_fast32_t value)
+{
+    if (counter == APP_STAT_RETRANSMISSIONS)
+    {
+        central.retransmissions += value;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Central_Hdlc_DataCfm(uint_fast8_t   link,
+ *                                           const uint8_t *data_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Confirms an SDU acknowledged by the device and passes
+ *                 more data to the data link.
+ * Inputs        : link             - link ID
+ *                 data_p           - pointer to SDU
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Central_Hdlc_DataCfm(uint_fast8_t link, const uint8_t *data_p)
+{
+    message_t *msg_p = &central.msg_a[central.current];
+    uint32_t   len   = msg_p->size - msg_p->cfm_len;
+
+    if (central.current == central.nb_msgs)
+    {
+        return;
+    }
+    if (len > central.sdu_size)
+    {
+        len = central.sdu_size;
+    }
+    msg_p->cfm_len += len;
+    if (msg_p->cfm_len == msg_p->size)
+    {
+        msg_p->done = Sim_Now(SIM_CENTRAL);
+    }
+    if (central.stall_start != SIM_TIME_NEVER)
+    {
+        central.stall      += Sim_Now(SIM_CENTRAL) - central.stall_start;
+        central.stall_start = SIM_TIME_NEVER;
+    }
+    Push();
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool Central_Hdlc_DataInd(uint_fast8_t   link,
+ *                                           const uint8_t *data_p,
+ *                                           uint_fast16_t  size)
+ * ----------------------------------------------------------------------------
+ * Description   : Handles the response to the current message and starts
+ *                 sending the next one.
+ * Inputs        : link             - link ID
+ *                 data_p           - pointer to SDU
+ *                 size             - SDU size
+ * Outputs       : return value     - always true
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool Central_Hdlc_DataInd(uint_fast8_t link,
+                          const uint8_t *data_p, uint_fast16_t size)
+{
+    message_t *msg_p = &central.msg_a[central.current];
+
+    if (size < MSG_HDR_SIZE || central.current == central.nb_msgs ||
+        data_p[0] != msg_p->data_p[0])
+    {
+        return true;
+    }
+    if (msg_p->done != SIM_TIME_NEVER)
+    {
+        central.finalize += Sim_Now(SIM_CENTRAL) - msg_p->done;
+    }
+    central.status = data_p[1];
+    if (central.status != 0)
+    {
+        central.end = Sim_Now(SIM_CENTRAL);
+        return true;
+    }
+    if (++central.current == central.nb_msgs)
+    {
+        central.end = Sim_Now(SIM_CENTRAL);
+        return true;
+    }
+    Push();
+    return true;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : bool Central_Hdlc_RxBufferReq(uint_fast8_t       link,
+ *                                               App_Hdlc_buffer_t *buf_p)
+ * ----------------------------------------------------------------------------
+ * Description   : The central receives all SDUs in the frame buffer.
+ * Inputs        : link             - link ID
+ * Outputs       : buf_p            - unused
+ *                 return value     - always false
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+bool Central_Hdlc_RxBufferReq(uint_fast8_t link, App_Hdlc_buffer_t *buf_p)
+{
+    return false;
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Central_Hdlc_ResetInd(uint_fast8_t link)
+ * ----------------------------------------------------------------------------
+ * Description   : The central goes on after a link reset without synced
+ *                 queues, the device fails the current message with
+ *                 IMAGE_DNL_LINK_RESET.
+ * Inputs        : link             - link ID
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+void Central_Hdlc_ResetInd(uint_fast8_t link)
+{
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void LinkUp(const sim_config_t *cfg_p)
+ * ----------------------------------------------------------------------------
+ * Description   : Starts the device and the central with an established
+ *                 connection and enabled notifications, see main() and the
+ *                 DFU data CCC handling in app_ble.c. The central selects
+ *                 the modulo 128 mode with --extended.
+ * Inputs        : cfg_p            - pointer to simulation parameters
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void LinkUp(const sim_config_t *cfg_p)
+{
+    Sim_CpuBegin();
+    App_Dfu_Init();
+    App_Hdlc_Init();
+    App_Stat_Init();
+    App_Sched_Init();
+    App_Ble_ActivationInd(0, cfg_p->mtu - 3);
+    Sys_Man_SetAppState(KE_BUILD_ID(TASK_APP, 0), APP_BLE_LINKUP);
+    App_Stat_ActivationInd(0);
+
+    /* the state change is handled before any data of the central, which
+     * the device receives through the kernel queue as well */
+    while (Sim_Schedule(SIM_DEVICE));
+    App_Sched_IntervalInd(cfg_p->interval_ms / 1.25);
+    Sim_CpuEnd();
+
+    Central_Hdlc_Init();
+    Central_Ble_ActivationInd(0, cfg_p->mtu - 3);
+    if (cfg_p->extended)
+    {
+        Central_Hdlc_ModeReq(0, true);
+    }
+    Push();
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Run(sim_time_t timeout)
+ * ----------------------------------------------------------------------------
+ * Description   : Runs the simulation until the central got all responses,
+ *                 a download failed, the device reset or the time is up.
+ *                 The next thing to happen is a connection event, a
+ *                 message or timer of the central or a main loop iteration
+ *                 of the device.
+ * Inputs        : timeout          - max. virtual time [ns]
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void Run(sim_time_t timeout)
+{
+    while (central.end == SIM_TIME_NEVER)
+    {
+        sim_time_t link   = Sim_Link_NextEvent();
+        sim_time_t device = Sim_NextEvent(SIM_DEVICE);
+        sim_time_t peer   = Sim_NextEvent(SIM_CENTRAL);
+
+        if (link <= device && link <= peer)
+        {
+            if (link > timeout)
+            {
+                central.status = STATUS_TIMEOUT;
+                return;
+            }
+            Sim_SetNow(SIM_DEVICE, link);
+            Sim_SetNow(SIM_CENTRAL, link);
+            Sim_Link_Event();
+        }
+        else if (peer <= device)
+        {
+            Sim_SetNow(SIM_CENTRAL, peer);
+            while (Sim_Schedule(SIM_CENTRAL));
+        }
+        else
+        {
+            Sim_SetNow(SIM_DEVICE, device);
+            Sim_CpuBegin();
+            Sim_Schedule(SIM_DEVICE);
+            App_Dfu_Poll();
+            Sim_CpuEnd();
+            if (Sim_ResetRequested())
+            {
+                central.status = STATUS_RESET;
+                return;
+            }
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Report(const sim_config_t *cfg_p, bool json)
+ * ----------------------------------------------------------------------------
+ * Description   : Prints the results.
+ * Inputs        : cfg_p            - pointer to simulation parameters
+ *                 json             - JSON instead of text
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void Report(const sim_config_t *cfg_p, bool json)
+{
+    const sim_link_stat_t *stat_p = Sim_Link_GetStat();
+    const uint8_t *record_p;
+    uint_fast8_t   nb_records = Sim_Link_GetSummaries(&record_p);
+    sim_time_t     end = (central.end != SIM_TIME_NEVER) ?
+                         central.end : Sim_Now(SIM_CENTRAL);
+    double   total_ms = SIM_TO_MS(end);
+    uint32_t erased = 0;
+    uint32_t sha_us = 0;
+    uint32_t ecdsa_us = 0;
+    uint32_t flash_us = 0;
+    uint_fast8_t i;
+
+    for (i = 0; i < nb_records; i++, record_p += APP_STAT_RECORD_SIZE)
+    {
+        erased   += record_p[2] | record_p[3] << 8;
+        sha_us   += GetU32(record_p + 8);
+        ecdsa_us += GetU32(record_p + 12);
+        flash_us += GetU32(record_p + 16);
+    }
+
+    if (json)
+    {
+        printf("{\"status\": %d, \"bytes\": %llu, \"total_ms\": %.1f, "
+               "\"throughput_kBps\": %.2f, \"stall_ms\": %.1f, "
+               "\"finalize_ms\": %.1f, \"events\": %u, "
+               "\"missed_events\": %u, \"pdus\": %u, "
+               "\"ll_retransmissions\": %u, \"dropped\": %u, "
+               "\"hdlc_retransmissions\": %u, \"flash_busy_ms\": %.1f, "
+               "\"device\": {\"downloads\": %u, \"erased_sectors\": %u, "
+               "\"sha_us\": %u, \"ecdsa_us\": %u, \"flash_us\": %u}}\n",
+               central.status, (unsigned long long)central.body_bytes,
+               total_ms, central.body_bytes / total_ms,
+               SIM_TO_MS(central.stall), SIM_TO_MS(central.finalize),
+               stat_p->events, stat_p->missed_events, stat_p->pdus,
+               stat_p->ll_retransmissions, stat_p->dropped,
+               central.retransmissions, SIM_TO_MS(stat_p->flash_busy),
+               (unsigned)nb_records, erased, sha_us, ecdsa_us, flash_us);
+        return;
+    }
+
+    printf("status               %d\n", central.status);
+    printf("image data           %llu B\n",
+           (unsigned long long)central.body_bytes);
+    printf("OTA time             %.1f ms (%.2f kB/s)\n",
+           total_ms, central.body_bytes / total_ms);
+    printf("window stalls        %.1f ms\n", SIM_TO_MS(central.stall));
+    printf("finalize             %.1f ms\n", SIM_TO_MS(central.finalize));
+    printf("connection events    %u (%u missed)\n",
+           stat_p->events, stat_p->missed_events);
+    printf("LL PDUs              %u (%u repeated)\n",
+           stat_p->pdus, stat_p->ll_retransmissions);
+    printf("dropped packets      %u\n", stat_p->dropped);
+    printf("HDLC retransmissions %u\n", central.retransmissions);
+    printf("flash busy           %.1f ms\n", SIM_TO_MS(stat_p->flash_busy));
+    printf("device telemetry     %u downloads, %u sectors erased, "
+           "SHA %u us, ECDSA %u us, flash %u us\n",
+           (unsigned)nb_records, erased, sha_us, ecdsa_us, flash_us);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : void Usage(void)
+ * ----------------------------------------------------------------------------
+ * Description   : Prints the command line usage and exits.
+ * Inputs        : None
+ * Outputs       : None
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+static void Usage(void)
+{
+    fprintf(stderr,
+            "usage: dfusim [options] IMAGE\n"
+            "  IMAGE               .fota, .fotaz or .fotad file of mkfotaimg.py\n"
+            "  --base FILE         installed plain .fota file (default IMAGE,\n"
+            "                      required for .fotaz and .fotad)\n"
+            "  --app-only          download the application sub-image only\n"
+            "  --interval MS       connection interval (15)\n"
+            "  --phy 1|2           PHY [Mbit/s] (2)\n"
+            "  --tx-octets N       LE data length (251)\n"
+            "  --mtu N             ATT MTU (247)\n"
+            "  --event-time F      usable fraction of the interval (0.5)\n"
+            "  --per F             packet error rate (0)\n"
+            "  --drop F            rate of packets lost above the LL (0)\n"
+            "  --rx-buffers N      receive buffers of the device (8)\n"
+            "  --seed N            random seed (1)\n"
+            "  --extended          modulo 128 HDLC mode (SABME)\n"
+            "  --sdu N             SDU size of the central (1024)\n"
+            "  --cpu-scale F       target/host CPU time ratio (1000)\n"
+            "  --stack-us F        stack CPU time per packet (100)\n"
+            "  --program-us F      flash program time per 8 bytes (100)\n"
+            "  --erase-ms F        flash sector erase time (20)\n"
+            "  --timeout S         max. virtual time (600)\n"
+            "  --json              JSON output\n");
+    exit(2);
+}
+
+/* ----------------------------------------------------------------------------
+ * Function      : int main(int argc, char *argv[])
+ * ----------------------------------------------------------------------------
+ * Description   : Main function of the simulator.
+ * Inputs        : argc, argv       - see Usage()
+ * Outputs       : return value     - 0 download succeeded
+ *                                  - 1 download failed
+ *                                  - 2 usage or file error
+ * Assumptions   :
+ * ------------------------------------------------------------------------- */
+int main(int argc, char *argv[])
+{
+    sim_config_t cfg =
+    {
+        .interval_ms = 15.0,
+        .phy         = 2,
+        .tx_octets   = 251,
+        .mtu         = 247,
+        .event_time  = 0.5,
+        .per         = 0.0,
+        .drop        = 0.0,
+        .rx_buffers  = 8,
+        .seed        = 1,
+        .cpu_scale   = 1000.0,
+        .stack_us    = 100.0,
+        .program_us  = 100.0,
+        .erase_ms    = 20.0
+    };
+    const char *base_p   = NULL;
+    bool        app_only = false;
+    bool        json     = false;
+    double      timeout  = 600.0;
+    int         opt;
+
+    central.sdu_size = 1024;
+    while ((opt = getopt_long(argc, argv, "", option_a, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': base_p          = optarg;         break;
+            case 'a': app_only        = true;           break;
+            case 'i': cfg.interval_ms = atof(optarg);   break;
+            case 'p': cfg.phy         = atoi(optarg);   break;
+            case 'o': cfg.tx_octets   = atoi(optarg);   break;
+            case 'm': cfg.mtu         = atoi(optarg);   break;
+            case 'e': cfg.event_time  = atof(optarg);   break;
+            case 'r': cfg.per         = atof(optarg);   break;
+            case 'd': cfg.drop        = atof(optarg);   break;
+            case 'x': cfg.rx_buffers  = atoi(optarg);   break;
+            case 's': cfg.seed        = atoi(optarg);   break;
+            case 'X': cfg.extended    = true;           break;
+            case 'u': central.sdu_size = atoi(optarg);  break;
+            case 'c': cfg.cpu_scale   = atof(optarg);   break;
+            case 'k': cfg.stack_us    = atof(optarg);   break;
+            case 'g': cfg.program_us  = atof(optarg);   break;
+            case 'E': cfg.erase_ms    = atof(optarg);   break;
+            case 't': timeout         = atof(optarg);   break;
+            case 'j': json            = true;           break;
+            default:  Usage();
+        }
+    }
+    if (optind != argc - 1 || (cfg.phy != 1 && cfg.phy != 2) ||
+        cfg.tx_octets < 27 || cfg.tx_octets > 251 ||
+        cfg.mtu < 23 || cfg.mtu > 512 || cfg.rx_buffers == 0 ||
+        central.sdu_size <= MSG_HDR_SIZE ||
+        central.sdu_size > CFG_HDLC_SDU_MAX_SIZE)
+    {
+        Usage();
+    }
+    if (base_p == NULL)
+    {
+        base_p = argv[optind];
+    }
+
+    Sim_Kernel_Init(&cfg);
+    Sim_Flash_Init(&cfg);
+    Sim_Link_Init(&cfg);
+    Install(base_p);
+    LoadImage(argv[optind], app_only);
+
+    central.stall_start = SIM_TIME_NEVER;
+    central.end         = SIM_TIME_NEVER;
+    for (opt = 0; opt < MAX_MESSAGES; opt++)
+    {
+        central.msg_a[opt].done = SIM_TIME_NEVER;
+    }
+
+    LinkUp(&cfg);
+    Run(SIM_MS(timeout * 1000));
+    Report(&cfg, json);
+    return (central.status == 0) ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+#!/usr/bin/env python
+""" Simulated BLE link benchmark for the DFU data transports.
+
+    Compares the download throughput of the HDLC/COBS stream carried over
+    GATT write commands with the one carried over an L2CAP LE credit based
+    channel (CFG_BLE_LECB). The model covers the link layer timing per
+    connection event (PHY, data length, inter frame space, empty acks),
+    the per transport headers, the HDLC window and the LECB credits.
+    It is not a replacement for a measurement, but shows where the time
+    goes and which parameters matter.
+
+    Prerequisites:
+    - installed Python, version >=2.7 or >=3.4
+"""
+from __future__ import print_function, division
+
+
+__version__ = '1.0.0'
+
+import random
+
+
+# link layer
+T_IFS_US            = 150
+LL_OVERHEAD         = {1: 1 + 4 + 2 + 3, 2: 2 + 4 + 2 + 3}    # preamble, AA, header, CRC
+LL_US_PER_OCTET     = {1: 8, 2: 4}
+
+# protocol overhead
+L2CAP_HDR           = 4
+ATT_WRITE_CMD_HDR   = 3
+LECB_SDU_HDR        = 2
+
+# HDLC/COBS framing, see app_hdlc.c
+HDLC_FRAME_OVERHEAD = 6
+HDLC_WINDOW_SIZE    = 4
+COBS_MAX_CODE       = 0xFF
+
+
+class Config(object):
+    def __init__(self, **kwargs):
+        self.image      = 128 * 1024    # image size [byte]
+        self.frame      = 1024          # HDLC SDU size used by the central [byte]
+        self.interval   = 15.0          # connection interval [ms]
+        self.phy        = 2             # 1 or 2 [Mbit/s]
+        self.tx_octets  = 251           # LE data length
+        self.mtu        = 247           # ATT MTU
+        self.sdu        = 490           # LECB SDU size used by the central
+        self.credits    = 16            # LECB credits (CFG_BLE_LECB_CREDITS)
+        self.mps        = 512           # MPS of the device (GAPM_DEFAULT_MPS_MAX)
+        self.per        = 0.0           # packet error rate
+        self.event_time = 1.0           # usable fraction of the connection interval
+        self.seed       = 1
+        self.__dict__.update(kwargs)
+
+
+def pdu_time(cfg, payload):
+    """ Duration of a data PDU with its empty ack [us]. """
+    data = (LL_OVERHEAD[cfg.phy] + payload) * LL_US_PER_OCTET[cfg.phy]
+    ack = LL_OVERHEAD[cfg.phy] * LL_US_PER_OCTET[cfg.phy]
+    return data + T_IFS_US + ack + T_IFS_US
+
+
+def encoded_size(sdu):
+    """ Size of a COBS encoded HDLC frame with delimiters. """
+    return sdu + HDLC_FRAME_OVERHEAD + (sdu + 3) // (COBS_MAX_CODE - 1)
+
+
+def gatt_pdus(cfg, size):
+    """ LL payload sizes of a frame sent as write commands, see
+        lecb_pdus(). """
+    frag = min(cfg.mtu, cfg.tx_octets - L2CAP_HDR) - ATT_WRITE_CMD_HDR
+    pdus = []
+    while size > 0:
+        n = min(size, frag)
+        pdus.append((L2CAP_HDR + ATT_WRITE_CMD_HDR + n, False, 0))
+        size -= n
+    return pdus
+
+
+def lecb_pdus(cfg, size):
+    """ LL payload sizes of a frame sent as SDUs, with a flag for the first
+        PDU of a K-frame and the credits the device returns after the last
+        PDU of an SDU. The central cuts the SDUs to the MPS of the device,
+        a K-frame may span several LL PDUs. """
+    pdus = []
+    while size > 0:
+        sdu = min(size, cfg.sdu)
+        rest = LECB_SDU_HDR + sdu
+        credit = (rest + cfg.mps - 1) // cfg.mps    # as returned by app_ble.c
+        while rest > 0:
+            kframe = L2CAP_HDR + min(rest, cfg.mps)
+            rest -= kframe - L2CAP_HDR
+            first = True
+            while kframe > 0:
+                n = min(kframe, cfg.tx_octets)
+                kframe -= n
+                pdus.append((n, first, credit if rest == 0 and kframe == 0 else 0))
+                first = False
+        size -= sdu
+    return pdus
+
+
+def simulate(cfg, lecb):
+    """ Returns the download time [s] and the number of connection events. """
+    rnd = random.Random(cfg.seed)
+    frames = []
+    left = cfg.image
+    while left > 0:
+        n = min(left, cfg.frame)
+        frames.append(encoded_size(n))
+        left -= n
+
+    budget = cfg.interval * 1000 * cfg.event_time
+    pending = []                # PDUs of the frames inside the window
+    next_frame = 0
+    in_flight = 0               # frames waiting for an acknowledge
+    acks = 0                    # acknowledges sent in the current event
+    credits = cfg.credits
+    returned = 0                # credits returned in the current event
+    events = 0
+
+    while next_frame < len(frames) or pending or in_flight:
+        events += 1
+        # the device answers in the event following the reception
+        in_flight -= acks
+        credits += returned
+        acks = returned = 0
+
+        used = 0.0
+        while True:
+            while not pending and next_frame < len(frames) and \
+                    in_flight < HDLC_WINDOW_SIZE:
+                fn = lecb_pdus if lecb else gatt_pdus
+                for payload, kframe, credit in fn(cfg, frames[next_frame]):
+                    pending.append((payload, False, kframe, credit))
+                pending[-1] = (pending[-1][0], True) + pending[-1][2:]
+                next_frame += 1
+            if not pending:
+                break
+            payload, frame_end, kframe, credit = pending[0]
+            if kframe and credits == 0:
+                break
+            t = pdu_time(cfg, payload)
+            if used + t > budget:
+                break
+            used += t
+            if rnd.random() < cfg.per:
+                # lost PDU, repeated by the link layer
+                continue
+            pending.pop(0)
+            if kframe:
+                # one credit per K-frame, returned once the SDU is consumed
+                credits -= 1
+            returned += credit
+            if frame_end:
+                in_flight += 1
+                acks += 1
+        if events > 10000000:
+            raise RuntimeError("no progress")
+
+    return events * cfg.interval / 1000, events
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Simulated BLE link benchmark of the DFU data transports.')
+    parser.add_argument('--version', action='version', version='%(prog)s ' + __version__)
+    parser.add_argument('--image', type=int, default=128 * 1024, help='image size [byte]')
+    parser.add_argument('--frame', type=int, default=1024, help='HDLC SDU size of the central [byte]')
+    parser.add_argument('--interval', type=float, nargs='+', default=[7.5, 15, 30, 50],
+                        help='connection intervals [ms]')
+    parser.add_argument('--phy', type=int, nargs='+', default=[1, 2], choices=[1, 2], help='PHY [Mbit/s]')
+    parser.add_argument('--tx-octets', type=int, default=251, help='LE data length')
+    parser.add_argument('--mtu', type=int, default=247, help='ATT MTU')
+    parser.add_argument('--sdu', type=int, default=490, help='LECB SDU size of the central')
+    parser.add_argument('--credits', type=int, default=16, help='LECB credits granted by the device')
+    parser.add_argument('--mps', type=int, default=512, help='LECB MPS of the device')
+    parser.add_argument('--per', type=float, default=0.0, help='packet error rate')
+    parser.add_argument('--event-time', type=float, default=1.0,
+                        help='usable fraction of the connection interval')
+    args = parser.parse_args()
+
+    print("image {} B, frame {} B, data length {}, MTU {}, SDU {}, MPS {}, credits {}, PER {}".format(
+          args.image, args.frame, args.tx_octets, args.mtu, args.sdu, args.mps, args.credits,
+          args.per))
+    print("{:>4} {:>8} {:>12} {:>12} {:>7}".format("PHY", "CI [ms]", "GATT [kB/s]", "LECB [kB/s]", "gain"))
+    for phy in args.phy:
+        for interval in args.interval:
+            cfg = Config(image=args.image, frame=args.frame, interval=interval, phy=phy,
+                         tx_octets=args.tx_octets, mtu=args.mtu, sdu=args.sdu,
+                         credits=args.credits, mps=args.mps, per=args.per,
+                         event_time=args.event_time)
+            gatt, _ = simulate(cfg, False)
+            lecb, _ = simulate(cfg, True)
+            print("{:>3}M {:>8} {:>12.1f} {:>12.1f} {:>6.0f}%".format(
+                  phy, interval, args.image / gatt / 1000, args.image / lecb / 1000,
+                  (gatt / lecb - 1) * 100))
+
+
+if __name__ == "__main__":
+    main()
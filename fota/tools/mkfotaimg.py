@@ -3,7 +3,7 @@
 
     Prerequisites:
     - installed Python, version >=2.7 or >=3.4
-    - installed module ecdsa, version >=0.13
+    - installed module ecdsa, version >=0.13 (>=0.18 for Ed25519 keys)
 """
 from __future__ import print_function
 
@@ -54,6 +54,7 @@ else:
 
 
 CURVE = ecdsa.curves.NIST256p
+ED25519 = getattr(ecdsa.curves, 'Ed25519', None)
 HASHFUNC = hashlib.sha256
 
 # The default encoding of ecdsa is big-endian, but the micro-ecc
@@ -79,6 +80,31 @@ def vkeyrecode_string(vkey_str):
     y_str = vkey_str[:l:-1]
     return x_str + y_str
 
+# signature schemes of the configuration block, see App_Sig_scheme_t
+SIG_ECDSA_P256 = 0
+SIG_ED25519    = 1
+
+KEY_TABLE_TEETH = 4
+
+def vkey_table(veri_key):
+    """ Precomputed table of the verifying key for uECC_verify_table().
+        Entry i holds the sum of 2^(d * j) * Q over the bits j set in i,
+        encoded like the key itself. """
+    l = CURVE.baselen
+    x = int_from_bytes(veri_key[:l], 'little')
+    y = int_from_bytes(veri_key[l:], 'little')
+    q = ecdsa.ellipticcurve.Point(CURVE.curve, x, y, CURVE.order)
+    d = (CURVE.order.bit_length() + KEY_TABLE_TEETH - 1) // KEY_TABLE_TEETH
+    table = b''
+    for i in range(1, 1 << KEY_TABLE_TEETH):
+        p = None
+        for j in range(KEY_TABLE_TEETH):
+            if i & (1 << j):
+                t = q * (1 << (d * j))
+                p = t if p is None else p + t
+        table += int_to_bytes(p.x(), l, 'little') + int_to_bytes(p.y(), l, 'little')
+    return table
+
 
 FLASH_START = 0x100000
 FLASH_SIZE  = 380 * 1024
@@ -95,7 +121,29 @@ IMG_HDR_FMT  = struct.Struct("<7L2L")
 IMG_DSCR_FMT = struct.Struct("<L32s")
 IMG_VER_FMT  = struct.Struct("<6sH")
 IMG_DEV_FMT  = struct.Struct("<16s")
-IMG_CFG_FMT  = struct.Struct("<L64s16sH29s")
+IMG_CFG_FMT  = struct.Struct("<L64s16sH29sxL")
+IMG_KEY_TABLE_FMT = struct.Struct("<960s")
+IMG_LZ_FMT   = struct.Struct("<LL")
+IMG_MAN_FMT  = struct.Struct("<L")
+IMG_MSG_FMT  = struct.Struct("<B3sL")
+IMG_REC_FMT  = struct.Struct("<HH")
+
+CHUNK_HASH_SIZE  = 16
+SECTOR_HASH_SIZE = 8
+
+# LZSS parameters (must match dfu/app_lz.h)
+LZ_MAX_DISTANCE = 2048
+LZ_MIN_LENGTH   = 3
+LZ_EXT_LENGTH   = LZ_MIN_LENGTH + 31
+LZ_MAX_LENGTH   = LZ_EXT_LENGTH + 255
+LZ_MAX_CHAIN    = 64
+
+# delta parameters (must match dfu/app_delta.h)
+DELTA_OP_INSERT = 0
+DELTA_OP_COPY   = 1
+DELTA_MIN_COPY  = 8
+DELTA_KEY_LEN   = 4
+DELTA_MAX_CHAIN = 16
 
 
 def check_img(imgfile, start_adr, max_size):
@@ -143,16 +191,23 @@ def embed_devid(img, ver_offset, devid):
 
 def embed_cfg(img, ver_offset, args):
     cfg_offset = ver_offset + IMG_VER_FMT.size + IMG_DEV_FMT.size
-    length, veri_key, srvid, name_len, name = IMG_CFG_FMT.unpack_from(img, cfg_offset)
+    length, veri_key, srvid, name_len, name, scheme = IMG_CFG_FMT.unpack_from(img, cfg_offset)
     assert length >= IMG_CFG_FMT.size, "Wrong configuration length ({0}/{1})".format(length, IMG_CFG_FMT.size)
-    if args.key:
+    if args.key and args.key.curve == ED25519:
+        veri_key = args.key.get_verifying_key().to_string().ljust(64, b'\0')
+        scheme = SIG_ED25519
+    elif args.key:
         veri_key = vkeyrecode_string(args.key.get_verifying_key().to_string())
+        scheme = SIG_ECDSA_P256
     if args.srvid:
         srvid = args.srvid
     if args.name:
         name_len, name = len(args.name), args.name
     img = bytearray(img)
-    IMG_CFG_FMT.pack_into(img, cfg_offset, length, veri_key, srvid, name_len, name)
+    IMG_CFG_FMT.pack_into(img, cfg_offset, length, veri_key, srvid, name_len, name, scheme)
+    if length >= IMG_CFG_FMT.size + IMG_KEY_TABLE_FMT.size and veri_key.strip(b'\0') and \
+            scheme == SIG_ECDSA_P256:
+        IMG_KEY_TABLE_FMT.pack_into(img, cfg_offset + IMG_CFG_FMT.size, vkey_table(veri_key))
     img = bytes(img)
     return img
 
@@ -161,19 +216,266 @@ def pad(img, align=FLASH_SECTOR_SIZE):
     return img
 
 def sign(text, sign_key):
-    if sign_key:
+    if sign_key and sign_key.curve == ED25519:
+        # the device verifies the little-endian SHA-256 hash as message
+        signature = sign_key.sign(HASHFUNC(text).digest()[::-1])
+    elif sign_key:
         signature = sign_key.sign(text, sigencode=sigencode_string)
     else:
         signature = HASHFUNC(text).digest()[::-1]
         signature = pad(signature, CURVE.signature_length)
     return text + signature
 
+def compress(data):
+    data = octets(data)
+    out = bytearray()
+    chains = {}
+    items = []
+    pos = 0
+    
+    def flush(items):
+        flags = 0
+        for i, (is_match, _) in enumerate(items):
+            flags |= is_match << i
+        out.append(flags)
+        for _, item in items:
+            out.extend(item)
+    
+    while pos < len(data):
+        best_len, best_dist = 0, 0
+        key = bytes(data[pos:pos + LZ_MIN_LENGTH])
+        if len(key) == LZ_MIN_LENGTH:
+            max_len = min(LZ_MAX_LENGTH, len(data) - pos)
+            for cand in reversed(chains.get(key, ())):
+                dist = pos - cand
+                if dist > LZ_MAX_DISTANCE:
+                    break
+                l = LZ_MIN_LENGTH
+                while l < max_len and data[cand + l] == data[pos + l]:
+                    l += 1
+                if l > best_len:
+                    best_len, best_dist = l, dist
+                    if l == max_len:
+                        break
+        if best_len >= LZ_MIN_LENGTH:
+            if best_len < LZ_EXT_LENGTH:
+                token = (best_len - LZ_MIN_LENGTH) << 11 | (best_dist - 1)
+                items.append((1, struct.pack("<H", token)))
+            else:
+                token = 31 << 11 | (best_dist - 1)
+                items.append((1, struct.pack("<HB", token, best_len - LZ_EXT_LENGTH)))
+            step = best_len
+        else:
+            items.append((0, data[pos:pos + 1]))
+            step = 1
+        for p in range(pos, pos + step):
+            k = bytes(data[p:p + LZ_MIN_LENGTH])
+            chain = chains.setdefault(k, [])
+            chain.append(p)
+            if len(chain) > LZ_MAX_CHAIN:
+                del chain[0]
+        pos += step
+        if len(items) == 8:
+            flush(items)
+            items = []
+    if items:
+        flush(items)
+    return bytes(out)
+
+def decompress(data, size):
+    data = octets(data)
+    out = bytearray()
+    pos = 0
+    while len(out) < size:
+        flags = data[pos]
+        pos += 1
+        for i in range(8):
+            if len(out) >= size:
+                break
+            if flags >> i & 1:
+                token = data[pos] | data[pos + 1] << 8
+                pos += 2
+                dist = (token & 0x7FF) + 1
+                length = token >> 11
+                if length == 31:
+                    length = LZ_EXT_LENGTH + data[pos]
+                    pos += 1
+                else:
+                    length += LZ_MIN_LENGTH
+                assert dist <= len(out), "Bad match distance"
+                for _ in range(length):
+                    out.append(out[-dist])
+            else:
+                out.append(data[pos])
+                pos += 1
+    assert pos == len(data), "Trailing compressed data"
+    return bytes(out)
+
+def pack_lz(img):
+    stream = compress(img)
+    assert decompress(stream, len(img)) == img, "Compression self-check failed"
+    return IMG_LZ_FMT.pack(len(img), len(stream)) + stream
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return out
+
+def read_varint(data, pos):
+    value, shift = 0, 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+def copy_limit(pos, dist, max_len):
+    # The device patches in place, so a copy source must not lie before the
+    # flash sector which is being written at the same time.
+    if dist >= 0:
+        return max_len
+    offset = pos % FLASH_SECTOR_SIZE
+    if offset < -dist:
+        return 0
+    return min(max_len, FLASH_SECTOR_SIZE - offset)
+
+def delta(old, new):
+    old, new = octets(old), octets(new)
+    index = {}
+    for q in range(len(old) - DELTA_KEY_LEN + 1):
+        chain = index.setdefault(bytes(old[q:q + DELTA_KEY_LEN]), [])
+        if len(chain) < DELTA_MAX_CHAIN:
+            chain.append(q)
+    out = bytearray()
+    literal = bytearray()
+    last_dist = 0
+    pos = 0
+    
+    def match_len(pos, q):
+        limit = copy_limit(pos, q - pos, min(len(new) - pos, len(old) - q))
+        l = 0
+        while l < limit and old[q + l] == new[pos + l]:
+            l += 1
+        return l
+    
+    def flush_literal():
+        if literal:
+            out.extend(varint(len(literal) << 1 | DELTA_OP_INSERT))
+            out.extend(literal)
+            del literal[:]
+    
+    while pos < len(new):
+        best_len, best_q = 0, 0
+        candidates = index.get(bytes(new[pos:pos + DELTA_KEY_LEN]), [])
+        if 0 <= pos + last_dist < len(old):
+            candidates = [pos + last_dist] + candidates
+        for q in candidates:
+            l = match_len(pos, q)
+            if l > best_len:
+                best_len, best_q = l, q
+        if best_len >= DELTA_MIN_COPY:
+            flush_literal()
+            dist = best_q - pos
+            out.extend(varint(best_len << 1 | DELTA_OP_COPY))
+            out.extend(varint(dist << 1 if dist >= 0 else (-dist << 1) - 1))
+            last_dist = dist
+            pos += best_len
+        else:
+            literal.append(new[pos])
+            pos += 1
+    flush_literal()
+    return bytes(out)
+
+def patch(old, ops, size):
+    old, ops = octets(old), octets(ops)
+    out = bytearray()
+    pos = 0
+    while pos < len(ops):
+        header, pos = read_varint(ops, pos)
+        length = header >> 1
+        assert length > 0, "Empty delta operation"
+        if header & 1 == DELTA_OP_COPY:
+            value, pos = read_varint(ops, pos)
+            dist = (value >> 1) ^ -(value & 1)
+            q = len(out) + dist
+            assert copy_limit(len(out), dist, length) == length, "Delta copy not applicable in place"
+            assert 0 <= q and q + length <= len(old), "Delta copy out of base image"
+            out.extend(old[q:q + length])
+        else:
+            out.extend(ops[pos:pos + length])
+            pos += length
+    assert len(out) == size, "Wrong patched image size"
+    return bytes(out)
+
+def pack_delta(old, new):
+    # the delta starts with the signature of the base image to identify it
+    ops = delta(old, new)
+    assert patch(old, ops, len(new)) == new, "Delta self-check failed"
+    body = old[-CURVE.signature_length:] + ops
+    return IMG_LZ_FMT.pack(len(new), len(body)) + body
+
+def split_img(img):
+    # split a FOTA image file into its signed sub-images
+    subs = []
+    start = 0
+    for i in range(2):
+        hdr = IMG_HDR_FMT.unpack_from(img, start)
+        img_start = hdr[1] - hdr[1] % FLASH_SECTOR_SIZE
+        size, _ = IMG_DSCR_FMT.unpack_from(img, start + hdr[8] - img_start)
+        size += CURVE.signature_length
+        subs.append(img[start:start + size])
+        start += size + (-size % FLASH_SECTOR_SIZE)
+    return subs
+
+def manifest(img, sign_key):
+    # truncated little-endian SHA-256 hash of every flash sector sized chunk
+    hashes = b''.join(HASHFUNC(img[i:i + FLASH_SECTOR_SIZE]).digest()[::-1][:CHUNK_HASH_SIZE]
+                      for i in range(0, len(img), FLASH_SECTOR_SIZE))
+    body = sign(IMG_MAN_FMT.pack(len(img)) + hashes, sign_key)
+    return IMG_MAN_FMT.pack(len(body)) + body
+
+def sector_hash(sector):
+    # truncated little-endian SHA-256 hash of an erased-padded flash sector
+    return HASHFUNC(pad(sector)).digest()[::-1][:SECTOR_HASH_SIZE]
+
+def read_sector_hashes(data):
+    # IMAGE_SECTOR_HASH responses for the FOTA stack and application region
+    regions = []
+    pos = 0
+    for i in range(2):
+        _, _, body_len = IMG_MSG_FMT.unpack_from(data, pos)
+        pos += IMG_MSG_FMT.size
+        body = data[pos:pos + body_len]
+        regions.append([body[j:j + SECTOR_HASH_SIZE]
+                        for j in range(0, len(body), SECTOR_HASH_SIZE)])
+        pos += body_len
+    return regions
+
+def pack_sparse(img, hashes):
+    # records of all sectors differing from the installed ones,
+    # the header sector is always needed to check the image
+    body = bytearray()
+    for idx, i in enumerate(range(0, len(img), FLASH_SECTOR_SIZE)):
+        sector = img[i:i + FLASH_SECTOR_SIZE]
+        if idx > 0 and idx < len(hashes) and sector_hash(sector) == hashes[idx]:
+            continue
+        body += IMG_REC_FMT.pack(idx, 0) + sector
+    return IMG_LZ_FMT.pack(len(img), len(body)) + bytes(body)
+
 def make(args):
     fota, ver_offset, fota_id = check_img(args.fota, FOTA_BASE_ADR, FOTA_MAX_SIZE)
     fota = embed_devid(fota, ver_offset, args.devid)
     fota = embed_cfg(fota, ver_offset, args)
-    fota = pad(sign(fota, args.key))
-    fota_size = len(fota)
+    fota = sign(fota, args.key)
+    fota_size = len(pad(fota))
     
     app_start = FOTA_BASE_ADR + fota_size
     app_max_size = FLASH_SIZE - BOOT_MAX_SIZE - fota_size
@@ -182,7 +484,32 @@ def make(args):
     app = embed_devid(app, ver_offset, args.devid)
     app = sign(app, args.key)
     
-    return fota + app
+    if args.base:
+        # only the application can be patched, the FOTA stack must be the same
+        base_fota, base_app = split_img(args.base.read())
+        assert base_fota == fota, "FOTA stack sub-image differs from base image"
+        if args.manifest:
+            args.manifest.write(manifest(app, args.key))
+        return pack_delta(base_app, app)
+    if args.manifest:
+        # each manifest is sent as IMAGE_MANIFEST before its sub-image
+        args.manifest.write(manifest(fota, args.key) + manifest(app, args.key))
+    if args.sectors:
+        # each sub-image is preceded by its size and the size of its sector
+        # records, sent as IMAGE_DDOWNLOAD_S with the size as parameter;
+        # an installed FOTA stack is not sent again (record size 0)
+        fota_hashes, app_hashes = read_sector_hashes(args.sectors.read())
+        fota_sectors = [sector_hash(fota[i:i + FLASH_SECTOR_SIZE])
+                        for i in range(0, len(fota), FLASH_SECTOR_SIZE)]
+        if fota_sectors == fota_hashes:
+            return IMG_LZ_FMT.pack(len(fota), 0) + pack_sparse(app, app_hashes)
+        # a new FOTA stack moves or destroys the installed application
+        return pack_sparse(fota, fota_hashes) + pack_sparse(app, [])
+    if args.compress:
+        # each sub-image is preceded by its uncompressed and compressed size,
+        # sent as IMAGE_DDOWNLOAD_Z with the uncompressed size as parameter
+        return pack_lz(fota) + pack_lz(app)
+    return pad(fota) + app
 
 
 if __name__ == "__main__":
@@ -210,6 +537,14 @@ if __name__ == "__main__":
                         help="advertised UUID to embed in the image (default: DFU service UUID)")
     parser.add_argument('-n', '--name', dest="name", metavar='NAME', type=utf8str,
                         help="advertised name to embed in the image (default: 'ON FOTA RSL10')")
+    parser.add_argument('-z', '--compress', dest="compress", action='store_true',
+                        help="write LZSS compressed sub-images (default: <APP-IMG>.fotaz)")
+    parser.add_argument('-b', '--base', dest="base", metavar='BASE-IMG', type=argparse.FileType('rb'),
+                        help="write a delta of the application against this installed FOTA image file (default: <APP-IMG>.fotad)")
+    parser.add_argument('-x', '--sectors', dest="sectors", metavar='HASH-FILE', type=argparse.FileType('rb'),
+                        help="write only sectors differing from the sector hashes reported by the device (default: <APP-IMG>.fotas)")
+    parser.add_argument('-m', '--manifest', dest="manifest", metavar='MAN-OUT', type=argparse.FileType('wb'),
+                        help="also write signed chunk hash manifests of the sub-images to this file (default: none)")
     parser.add_argument('-o', dest="out", metavar='OUT-IMG', type=argparse.FileType('wb'),
                         help="name of output image file (default: <APP-IMG>.fota)")
     parser.add_argument('fota', metavar='FOTA-IMG', type=argparse.FileType('rb'),
@@ -220,7 +555,8 @@ if __name__ == "__main__":
     
     #print(args)
     if not args.out:
-        args.out = open(args.app.name + ".fota", 'wb')
+        ext = ".fotad" if args.base else ".fotas" if args.sectors else ".fotaz" if args.compress else ".fota"
+        args.out = open(args.app.name + ext, 'wb')
     
     if args.key:
         with args.key:
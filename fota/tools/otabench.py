@@ -0,0 +1,253 @@
+#!/usr/bin/env python
+""" End-to-end OTA benchmark on the host DFU pipeline simulator.
+
+    Builds tools/dfusim with the host compiler for every HDLC window size
+    (HDLC_WINDOW_SIZE, or HDLC_EXT_WINDOW_SIZE with --extended for the
+    modulo 128 mode set up by SABME) and runs it for every ATT MTU on a FOTA image of
+    mkfotaimg.py. The simulator links the DFU firmware (app_dfu.c,
+    app_hdlc.c, SHA-256 and micro-ecc) against a simulated BLE link,
+    kernel and flash, and the central runs the same HDLC code. The report
+    lists the total OTA time, the time the central was stalled by the
+    window and the throughput of each combination as a table on stderr
+    and as JSON.
+
+    The firmware CPU time is the scaled host time (--cpu-scale), so the
+    numbers show trends and where the time goes rather than the exact
+    download time of a board. Flash and link timing are modelled, see
+    dfusim --help.
+
+    With --check no image is needed: the simulator downloads synthetic
+    images built with mkfotaimg.py whose compressed or delta data ends
+    within a long match or copy, which the device has to finish without
+    more input, and the exit
+    status tells whether all of them were installed.
+
+    Prerequisites:
+    - installed Python, version >=2.7 or >=3.4
+    - a C compiler for the host (cc, gcc or clang)
+"""
+from __future__ import print_function, division
+
+
+__version__ = '1.1.0'
+
+import glob
+import json
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+
+FOTA_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+SIM_DIR = os.path.join(FOTA_DIR, 'tools', 'dfusim')
+INCLUDES = [os.path.join(SIM_DIR, 'include'), SIM_DIR, FOTA_DIR,
+            os.path.join(FOTA_DIR, 'dfu'), os.path.join(FOTA_DIR, 'ble'),
+            os.path.join(FOTA_DIR, '..', 'bootloader'),
+            os.path.join(FOTA_DIR, 'thirdparty', 'sha256'),
+            os.path.join(FOTA_DIR, 'thirdparty', 'micro-ecc')]
+SOURCES = sorted(glob.glob(os.path.join(SIM_DIR, '*.c'))) + \
+          [os.path.join(FOTA_DIR, 'dfu', name + '.c')
+           for name in ('app_dfu', 'app_hdlc', 'app_stat', 'app_sched',
+                        'app_sig', 'app_lz', 'app_delta')] + \
+          [os.path.join(FOTA_DIR, 'thirdparty', 'sha256', 'sha256.c'),
+           os.path.join(FOTA_DIR, 'thirdparty', 'micro-ecc', 'uECC.c')]
+
+# micro-ecc declares its own bcopy(), which clashes with the built-in one
+SOURCE_CFLAGS = {'uECC.c': ['-fno-builtin-bcopy']}
+
+# the window of the modulo 8 and of the modulo 128 sequence numbers
+WINDOW_SIZES = range(1, 8)
+EXT_WINDOW_SIZES = range(1, 65)
+
+# synthetic sub-images of --check, see check_img() in mkfotaimg.py
+FOTA_BASE_ADR = 0x00102000
+FLASH_SECTOR_SIZE = 2048
+SIG_SIZE = 64
+SYNTH_VER_OFFSET = 0x100
+SYNTH_DSCR_OFFSET = 0x200
+SYNTH_CFG_SIZE = 120
+SYNTH_TAIL = 16 * 1024
+
+
+def build(args, tmp, window):
+    """ Builds the simulator for a window size, returns its path. """
+    flags = [args.cc] + args.cflags.split() + ['-I' + d for d in INCLUDES] + [
+        '-DuECC_WORD_SIZE=4', '-D{}={}'.format(window_macro(args), window)]
+    objs = []
+    for src in SOURCES:
+        obj = os.path.join(tmp, os.path.basename(src)[:-2] + '.o')
+        subprocess.check_call(flags + SOURCE_CFLAGS.get(os.path.basename(src), []) +
+                              ['-c', src, '-o', obj])
+        objs.append(obj)
+
+    # the central runs the HDLC code of the device under other names
+    obj = os.path.join(tmp, 'central_hdlc.o')
+    subprocess.check_call(flags + ['-include', os.path.join(SIM_DIR, 'central.h'), '-c',
+                                   os.path.join(FOTA_DIR, 'dfu', 'app_hdlc.c'), '-o', obj])
+    objs.append(obj)
+
+    exe = os.path.join(tmp, 'dfusim_w{}'.format(window))
+    subprocess.check_call([args.cc] + args.cflags.split() + objs + ['-o', exe])
+    return exe
+
+
+def window_macro(args):
+    """ Returns the macro of the window size in the selected mode. """
+    return 'HDLC_EXT_WINDOW_SIZE' if args.extended else 'HDLC_WINDOW_SIZE'
+
+
+def run(args, exe, mtu, image, base):
+    """ Runs the simulator for an MTU, returns its JSON result. """
+    cmd = [exe, '--json', '--mtu', str(mtu)] + args.sim_args
+    if args.extended:
+        cmd += ['--extended']
+    if base:
+        cmd += ['--base', base]
+    proc = subprocess.Popen(cmd + [image], stdout=subprocess.PIPE)
+    out = proc.communicate()[0]
+    if proc.returncode == 2:
+        raise SystemExit("dfusim failed: " + ' '.join(cmd))
+    return json.loads(out.decode('ascii'))
+
+
+def synth_image(start, size, seed, stack):
+    """ Returns a synthetic sub-image linked to start: a vector table, the
+        version info, for a FOTA stack followed by a configuration without
+        public key, the descriptor and random code. The last SYNTH_TAIL bytes
+        are zero, so their LZSS stream is a row of long matches. """
+    rnd = random.Random(seed)
+    img = bytearray(rnd.getrandbits(8) for _ in range(size - SYNTH_TAIL))
+    img += bytearray(SYNTH_TAIL)
+    reset = start + 0x41
+    struct.pack_into('<7L2L', img, 0, 0x20004000, reset, reset + 2, reset + 2,
+                     reset + 2, reset + 2, reset + 2,
+                     start + SYNTH_VER_OFFSET, start + SYNTH_DSCR_OFFSET)
+    struct.pack_into('<6sH16s', img, SYNTH_VER_OFFSET, b'SYNTH ', 0x0100, bytes(bytearray(16)))
+    if stack:
+        struct.pack_into('<L{}x'.format(SYNTH_CFG_SIZE - 4), img, SYNTH_VER_OFFSET + 24, SYNTH_CFG_SIZE)
+    struct.pack_into('<L32s', img, SYNTH_DSCR_OFFSET, size, b'B' * 32)
+    return bytes(img)
+
+
+def check(args, tmp, exe, mtu):
+    """ Downloads the synthetic images of --check, returns the results. """
+    mkfotaimg = [sys.executable, os.path.join(FOTA_DIR, 'tools', 'mkfotaimg.py')]
+    stack = os.path.join(tmp, 'stack.bin')
+    app = os.path.join(tmp, 'app.bin')
+    patch = os.path.join(tmp, 'patch.bin')
+    base = os.path.join(tmp, 'base.fota')
+    stack_size = 60000
+    app_start = FOTA_BASE_ADR + stack_size + SIG_SIZE + (-(stack_size + SIG_SIZE) % FLASH_SECTOR_SIZE)
+    with open(stack, 'wb') as f:
+        f.write(synth_image(FOTA_BASE_ADR, stack_size, 1, True))
+    with open(app, 'wb') as f:
+        f.write(synth_image(app_start, 40000, 2, False))
+    with open(app, 'rb') as f:
+        img = bytearray(f.read())
+    img[3000:3016] = bytearray(16)
+    with open(patch, 'wb') as f:
+        f.write(img)
+    subprocess.check_call(mkfotaimg + ['-o', base, stack, app])
+
+    # the LZSS stream ends with the matches of the zeros and of the 0xFF
+    # padding of the plain hash in the signature field, the delta of an
+    # application patched near its start with a copy of the base image tail
+    cases = [('lz-match', ['-z'], '.fotaz', app),
+             ('delta-copy', ['-b', base], '.fotad', patch)]
+    results = []
+    for name, opts, ext, sub_image in cases:
+        image = os.path.join(tmp, name + ext)
+        subprocess.check_call(mkfotaimg + opts + ['-o', image, stack, sub_image])
+        result = run(args, exe, mtu, image, base)
+        result['config'] = {'check': name}
+        results.append(result)
+    return results
+
+
+def compiler_version(cc):
+    try:
+        out = subprocess.check_output([cc, '--version'], stderr=subprocess.STDOUT)
+        return out.decode('ascii', 'replace').splitlines()[0]
+    except (OSError, subprocess.CalledProcessError):
+        return cc
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(description='End-to-end OTA benchmark on the host DFU pipeline simulator.',
+                                     epilog='Arguments after -- are passed to dfusim, e.g. -- --drop 0.01 --interval 30')
+    parser.add_argument('--version', action='version', version='%(prog)s ' + __version__)
+    parser.add_argument('--cc', default=os.environ.get('CC', 'cc'), help='host C compiler')
+    parser.add_argument('--cflags', default='-std=gnu99 -O2 -Wall', help='compiler flags')
+    parser.add_argument('--extended', action='store_true', help='modulo 128 mode (SABME)')
+    parser.add_argument('--window', type=int, nargs='+', choices=EXT_WINDOW_SIZES, metavar='N',
+                        help='HDLC_WINDOW_SIZE values (1..7, default all) or with --extended '
+                             'HDLC_EXT_WINDOW_SIZE values (1..64, default 8 16 32 64)')
+    parser.add_argument('--mtu', type=int, nargs='+', default=[23, 64, 128, 247, 512], help='ATT MTU values')
+    parser.add_argument('--base', help='installed plain .fota file, required for .fotaz and .fotad')
+    parser.add_argument('-o', '--output', help='JSON report file, default stdout')
+    parser.add_argument('--check', action='store_true',
+                        help='download synthetic images ending in long matches or copies with the largest WINDOW and MTU '
+                             'instead of the benchmark')
+    parser.add_argument('image', nargs='?', help='.fota, .fotaz or .fotad file of mkfotaimg.py')
+    parser.add_argument('sim_args', nargs=argparse.REMAINDER, help=argparse.SUPPRESS)
+    args = parser.parse_args()
+    if args.sim_args[:1] == ['--']:
+        args.sim_args = args.sim_args[1:]
+    if args.image is not None and args.image.startswith('-'):
+        # '--' was taken as the end of the options, so the first simulator
+        # argument became the image, e.g. --check -- --drop 0.03
+        args.sim_args = [args.image] + args.sim_args
+        args.image = None
+    if args.window is None:
+        args.window = [8, 16, 32, 64] if args.extended else list(WINDOW_SIZES)
+    elif not args.extended and max(args.window) not in WINDOW_SIZES:
+        parser.error('HDLC_WINDOW_SIZE must be in the range 1 to 7, see --extended')
+    if args.image is None and not args.check:
+        parser.error('an image is required without --check')
+    if args.check:
+        args.image = None
+        args.window = [max(args.window)]
+        args.mtu = [max(args.mtu)]
+
+    report = {'version': __version__, 'compiler': compiler_version(args.cc),
+              'cflags': args.cflags, 'image': args.image and os.path.basename(args.image),
+              'sim_args': args.sim_args, 'extended': args.extended, 'runs': []}
+    print("{:>6} {:>5} {:>7} {:>10} {:>10} {:>8} {:>6}".format(
+          "WINDOW", "MTU", "status", "total ms", "stall ms", "kB/s", "retx"), file=sys.stderr)
+    tmp = tempfile.mkdtemp()
+    try:
+        for window in args.window:
+            exe = build(args, tmp, window)
+            for mtu in args.mtu:
+                if args.check:
+                    results = check(args, tmp, exe, mtu)
+                else:
+                    results = [run(args, exe, mtu, args.image, args.base)]
+                for result in results:
+                    result.setdefault('config', {}).update({window_macro(args): window, 'mtu': mtu})
+                    report['runs'].append(result)
+                    print("{:>6} {:>5} {:>7} {:>10.1f} {:>10.1f} {:>8.2f} {:>6} {}".format(
+                          window, mtu, result['status'], result['total_ms'], result['stall_ms'],
+                          result['throughput_kBps'], result['hdlc_retransmissions'],
+                          result['config'].get('check', '')).rstrip(), file=sys.stderr)
+    finally:
+        shutil.rmtree(tmp)
+
+    text = json.dumps(report, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+
+    sys.exit(1 if any(r['status'] != 0 for r in report['runs']) else 0)
+
+
+if __name__ == "__main__":
+    main()